@@ -0,0 +1,659 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Serial link and dispatch microbenchmarks
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+/* Times the per frame work done between the serial port and the tun device:
+ * encoding a frame (vSL_WriteMessage), decoding one (bSL_ReadMessage), the
+ * two frame checksums and dispatching a received message to its handler
+ * (eJennicModuleProcessMessage). The loopback case sends each frame through
+ * the "loopback" serial transport and back, checking it decodes intact, so
+ * includes the system calls of a real link. Each case runs once per packet size and
+ * once over a mix of sizes resembling border router traffic, for a fixed
+ * time rather than a fixed count.
+ *
+ * Output is one line of key=value pairs per case, giving the time per
+ * frame and per payload byte, the frame rate and the number of heap
+ * allocations made per frame.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+
+#include "Serial.h"
+#include "SerialLink.h"
+#include "JennicModule.h"
+#include "TunDevice.h"
+#include "IPv6.h"
+#include "Latency.h"
+#include "Clock.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define BENCH_DEFAULT_TIME_MS   200
+
+/* Operations between clock reads */
+#define BENCH_BATCH             256
+
+/* Number of sizes drawn for the mixed case, cycled through */
+#define BENCH_MIX_SAMPLES       1024
+
+/* Distinct source addresses of dispatched packets */
+#define BENCH_SOURCES           64
+
+#define BENCH_UDP_PORT          5683
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** A benchmark case. Runs u32Count operations using the given sizes. */
+typedef struct
+{
+    const char *pcName;
+    void (*prSetup)(void);
+    void (*prRun)(uint32_t u32Count, const uint16_t *pu16Sizes);
+    uint16_t    u16MinLength;               /**< Smallest payload the case can handle */
+} tsBenchCase;
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+
+static void vSetupEncode(void);
+static void vRunEncode(uint32_t u32Count, const uint16_t *pu16Sizes);
+static void vSetupDecode(void);
+static void vRunDecode(uint32_t u32Count, const uint16_t *pu16Sizes);
+static void vSetupLoopback(void);
+static void vRunLoopback(uint32_t u32Count, const uint16_t *pu16Sizes);
+static void vRunCRC8(uint32_t u32Count, const uint16_t *pu16Sizes);
+static void vRunCRC16(uint32_t u32Count, const uint16_t *pu16Sizes);
+static void vSetupDispatch(void);
+static void vRunDispatch(uint32_t u32Count, const uint16_t *pu16Sizes);
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+/* Required by the daemon modules */
+int verbosity = 0;
+volatile sig_atomic_t bRunning = 1;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static const tsBenchCase asCases[] =
+{
+    { "encode",     vSetupEncode,   vRunEncode,     0 },
+    { "decode",     vSetupDecode,   vRunDecode,     0 },
+    { "loopback",   vSetupLoopback, vRunLoopback,   0 },
+    { "crc8",       NULL,           vRunCRC8,       0 },
+    { "crc16",      NULL,           vRunCRC16,      0 },
+    { "dispatch",   vSetupDispatch, vRunDispatch,   IPV6_HEADER_LENGTH + sizeof(struct udphdr) },
+};
+
+/** Fixed sizes measured, 0 standing for the mix */
+static const uint16_t au16Lengths[] = { 64, 128, 256, 512, 1280, 0 };
+
+/** Share of border router traffic, by payload size range */
+static const struct
+{
+    uint16_t    u16Min;
+    uint16_t    u16Max;
+    uint32_t    u32Weight;
+} asMix[] =
+{
+    {   48,   80, 40 },     /* CoAP and JIP requests and responses, acks */
+    {   81,  127, 30 },     /* Anything fitting a single radio frame */
+    {  128,  600, 20 },     /* Fragmented, e.g. JIP MIB listings */
+    {  601, 1280, 10 },     /* Bulk transfer, firmware images */
+};
+
+static uint8_t au8Payload[SL_MAX_MESSAGE_LENGTH];
+
+/** Pre-encoded frames for the decoder */
+static int iDecodeFd = -1;
+
+/** Heap allocations made while bCountAllocations is set */
+static uint64_t u64Allocations;
+static volatile int bCountAllocations;
+
+static uint64_t u64RandomState = 1;
+
+/** Changed each time a new set of sizes is made */
+static uint32_t u32SizesGeneration;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static uint64_t u64Random(void)
+{
+    /* xorshift64* - reproducible for a given seed */
+    u64RandomState ^= u64RandomState >> 12;
+    u64RandomState ^= u64RandomState << 25;
+    u64RandomState ^= u64RandomState >> 27;
+    return u64RandomState * 0x2545F4914F6CDD1DULL;
+}
+
+
+static uint64_t u64NowNs(void)
+{
+    struct timespec sTime;
+    
+    clock_gettime(CLOCK_MONOTONIC, &sTime);
+    return ((uint64_t)sTime.tv_sec * 1000000000ULL) + sTime.tv_nsec;
+}
+
+
+/** Sizes for one case: all u16Length, or drawn from the mix if 0 */
+static void vMakeSizes(uint16_t u16Length, uint16_t u16MinLength, uint16_t *pu16Sizes)
+{
+    uint32_t u32TotalWeight = 0;
+    uint32_t i, j;
+    
+    for (j = 0; j < sizeof(asMix) / sizeof(asMix[0]); j++)
+    {
+        u32TotalWeight += asMix[j].u32Weight;
+    }
+    
+    u32SizesGeneration++;
+    u64RandomState = 1;
+    for (i = 0; i < BENCH_MIX_SAMPLES; i++)
+    {
+        if (u16Length == 0)
+        {
+            uint32_t u32Pick = u64Random() % u32TotalWeight;
+            
+            for (j = 0; u32Pick >= asMix[j].u32Weight; j++)
+            {
+                u32Pick -= asMix[j].u32Weight;
+            }
+            pu16Sizes[i] = asMix[j].u16Min + u64Random() % (asMix[j].u16Max - asMix[j].u16Min + 1);
+        }
+        else
+        {
+            pu16Sizes[i] = u16Length;
+        }
+        
+        if (pu16Sizes[i] < u16MinLength)
+        {
+            pu16Sizes[i] = u16MinLength;
+        }
+    }
+}
+
+
+static void vSetupEncode(void)
+{
+    serial_fd = open("/dev/null", O_WRONLY);
+    if (serial_fd < 0)
+    {
+        perror("open /dev/null");
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+static void vRunEncode(uint32_t u32Count, const uint16_t *pu16Sizes)
+{
+    uint32_t i;
+    
+    for (i = 0; i < u32Count; i++)
+    {
+        vSL_WriteMessage(E_SL_MSG_IPV6, pu16Sizes[i % BENCH_MIX_SAMPLES], au8Payload);
+    }
+}
+
+
+static void vSetupDecode(void)
+{
+    iDecodeFd = memfd_create("microbench", 0);
+    if (iDecodeFd < 0)
+    {
+        perror("memfd_create");
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+static void vRunDecode(uint32_t u32Count, const uint16_t *pu16Sizes)
+{
+    uint8_t au8Message[SL_MAX_MESSAGE_LENGTH];
+    uint8_t u8Type;
+    uint16_t u16Length;
+    uint32_t i;
+    
+    if (lseek(iDecodeFd, 0, SEEK_SET) < 0)
+    {
+        perror("lseek");
+        exit(EXIT_FAILURE);
+    }
+    
+    /* Encode the frames when the sizes change, which happens in the
+     * untimed warm up call of each case */
+    {
+        static uint32_t u32EncodedGeneration;
+        static uint32_t u32Encoded;
+        
+        if ((u32EncodedGeneration != u32SizesGeneration) || (u32Encoded != u32Count))
+        {
+            int iSavedFd = serial_fd;
+            
+            if (ftruncate(iDecodeFd, 0) < 0)
+            {
+                perror("ftruncate");
+                exit(EXIT_FAILURE);
+            }
+            serial_fd = iDecodeFd;
+            vRunEncode(u32Count, pu16Sizes);
+            serial_fd = iSavedFd;
+            lseek(iDecodeFd, 0, SEEK_SET);
+            u32EncodedGeneration = u32SizesGeneration;
+            u32Encoded           = u32Count;
+        }
+    }
+    
+    serial_fd = iDecodeFd;
+    for (i = 0; i < u32Count; )
+    {
+        /* A false return without a frame only means the read budget ran out */
+        if (bSL_ReadMessage(&u8Type, &u16Length, sizeof(au8Message), au8Message))
+        {
+            if ((u8Type != E_SL_MSG_IPV6) || (u16Length != pu16Sizes[i % BENCH_MIX_SAMPLES]))
+            {
+                fprintf(stderr, "Decoded the wrong frame\n");
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        }
+    }
+}
+
+
+static void vSetupLoopback(void)
+{
+    char acName[] = "loopback";
+    
+    if (serial_open(acName, 0) < 0)
+    {
+        fprintf(stderr, "Could not open loopback transport\n");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(serial_loopback_fd, F_SETFL, O_NONBLOCK);
+}
+
+
+/** Send each frame into the transport, pass it back from the module end and decode it */
+static void vRunLoopback(uint32_t u32Count, const uint16_t *pu16Sizes)
+{
+    uint8_t au8Message[SL_MAX_MESSAGE_LENGTH];
+    uint8_t au8Wire[4096];
+    uint8_t u8Type;
+    uint16_t u16Length;
+    uint32_t i;
+    ssize_t iBytes;
+    
+    for (i = 0; i < u32Count; i++)
+    {
+        vSL_WriteMessage(E_SL_MSG_IPV6, pu16Sizes[i % BENCH_MIX_SAMPLES], au8Payload);
+        
+        do
+        {
+            iBytes = read(serial_loopback_fd, au8Wire, sizeof(au8Wire));
+            if ((iBytes > 0) && (write(serial_loopback_fd, au8Wire, iBytes) != iBytes))
+            {
+                perror("write loopback");
+                exit(EXIT_FAILURE);
+            }
+        } while (!bSL_ReadMessage(&u8Type, &u16Length, sizeof(au8Message), au8Message));
+        
+        if ((u8Type != E_SL_MSG_IPV6) || (u16Length != pu16Sizes[i % BENCH_MIX_SAMPLES]) ||
+            (memcmp(au8Message, au8Payload, u16Length) != 0))
+        {
+            fprintf(stderr, "Frame corrupted through loopback transport\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
+static void vRunCRC8(uint32_t u32Count, const uint16_t *pu16Sizes)
+{
+    static volatile uint8_t u8Sink;
+    uint32_t i;
+    
+    for (i = 0; i < u32Count; i++)
+    {
+        u8Sink = u8SL_CalculateCRC(E_SL_MSG_IPV6, pu16Sizes[i % BENCH_MIX_SAMPLES], au8Payload);
+    }
+    (void)u8Sink;
+}
+
+
+static void vRunCRC16(uint32_t u32Count, const uint16_t *pu16Sizes)
+{
+    static volatile uint16_t u16Sink;
+    uint32_t i;
+    
+    for (i = 0; i < u32Count; i++)
+    {
+        u16Sink = u16SL_CalculateCRC16(E_SL_MSG_IPV6, pu16Sizes[i % BENCH_MIX_SAMPLES], i & 0xFF, 0, au8Payload);
+    }
+    (void)u16Sink;
+}
+
+
+/** Bring the module state machine up to running, as if a 1.0 border router had been attached */
+static void vSetupDispatch(void)
+{
+    uint8_t au8Version[] = { 1, 0, 5 };
+    struct in6_addr sAddress;
+    char acFileName[64];
+    int i;
+    
+    vSetupEncode();
+    
+    cpTunDevice = "microbench";
+    pcTunEndpoint = "sink";
+    if (eTunDeviceOpen(cpTunDevice) != E_TUN_OK)
+    {
+        fprintf(stderr, "Could not open packet sink\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    eJennicModuleStart();
+    eJennicModuleProcessMessage(E_SL_MSG_VERSION, sizeof(au8Version), au8Version);
+    for (i = 0; i < 8; i++)
+    {
+        eJennicModuleStateMachine(0);
+    }
+    
+    inet_pton(AF_INET6, "fd00::fffe", &sAddress);
+    eJennicModuleProcessMessage(E_SL_MSG_ADDR, sizeof(sAddress), (uint8_t *)&sAddress);
+    
+    /* Don't leave the address file of a device that doesn't exist behind */
+    snprintf(acFileName, sizeof(acFileName), "/tmp/6LoWPANd.%s", cpTunDevice);
+    unlink(acFileName);
+}
+
+
+static void vRunDispatch(uint32_t u32Count, const uint16_t *pu16Sizes)
+{
+    struct ip6_hdr *psHeader = (struct ip6_hdr *)au8Payload;
+    struct udphdr *psUDP = (struct udphdr *)&au8Payload[IPV6_HEADER_LENGTH];
+    uint32_t i;
+    
+    memset(au8Payload, 0, IPV6_HEADER_LENGTH + sizeof(struct udphdr));
+    psHeader->ip6_flow  = htonl(0x60000000);
+    psHeader->ip6_nxt   = IPPROTO_UDP;
+    psHeader->ip6_hlim  = 64;
+    inet_pton(AF_INET6, "fd00::1:0", &psHeader->ip6_src);
+    inet_pton(AF_INET6, "fd00::fffe", &psHeader->ip6_dst);
+    psUDP->uh_sport = htons(BENCH_UDP_PORT);
+    psUDP->uh_dport = htons(BENCH_UDP_PORT);
+    
+    for (i = 0; i < u32Count; i++)
+    {
+        uint16_t u16Length = pu16Sizes[i % BENCH_MIX_SAMPLES];
+        
+        psHeader->ip6_plen = htons(u16Length - IPV6_HEADER_LENGTH);
+        psHeader->ip6_src.s6_addr[15] = i % BENCH_SOURCES;
+        psUDP->uh_ulen = htons(u16Length - IPV6_HEADER_LENGTH);
+        
+        /* Stamped as the main loop does */
+        u64LatencyDecoded = u64ClockNowNs();
+        if (eJennicModuleProcessMessage(E_SL_MSG_IPV6, u16Length, au8Payload) != E_MODULE_OK)
+        {
+            fprintf(stderr, "Dispatch failed\n");
+            exit(EXIT_FAILURE);
+        }
+        u64LatencyDecoded = 0;
+    }
+}
+
+
+/** Time one case at one size and print the result */
+static void vRunCase(const tsBenchCase *psCase, uint16_t u16Length, uint32_t u32TimeMs)
+{
+    static uint16_t au16Sizes[BENCH_MIX_SAMPLES];
+    uint64_t u64Start, u64Elapsed, u64Operations = 0, u64Bytes = 0;
+    uint64_t u64Deadline;
+    char acSize[8];
+    uint32_t i;
+    
+    vMakeSizes(u16Length, psCase->u16MinLength, au16Sizes);
+    
+    /* Warm up caches and any lazily created state */
+    psCase->prRun(BENCH_BATCH, au16Sizes);
+    
+    u64Allocations = 0;
+    bCountAllocations = 1;
+    u64Start = u64NowNs();
+    u64Deadline = u64Start + (uint64_t)u32TimeMs * 1000000ULL;
+    do
+    {
+        psCase->prRun(BENCH_BATCH, au16Sizes);
+        u64Operations += BENCH_BATCH;
+        u64Elapsed = u64NowNs() - u64Start;
+    } while (u64Start + u64Elapsed < u64Deadline);
+    bCountAllocations = 0;
+    
+    /* Every batch starts at the beginning of the sizes */
+    for (i = 0; i < BENCH_BATCH; i++)
+    {
+        u64Bytes += au16Sizes[i % BENCH_MIX_SAMPLES];
+    }
+    u64Bytes *= u64Operations / BENCH_BATCH;
+    
+    if (u16Length)
+    {
+        snprintf(acSize, sizeof(acSize), "%u", u16Length);
+    }
+    else
+    {
+        strcpy(acSize, "mix");
+    }
+    
+    printf("bench=%s size=%s frames=%llu bytes=%llu ns_per_frame=%.1f ns_per_byte=%.3f frames_per_s=%.0f allocs_per_frame=%.3f\n",
+           psCase->pcName, acSize,
+           (unsigned long long)u64Operations, (unsigned long long)u64Bytes,
+           (double)u64Elapsed / u64Operations,
+           (double)u64Elapsed / u64Bytes,
+           (double)u64Operations * 1e9 / u64Elapsed,
+           (double)u64Allocations / u64Operations);
+    fflush(stdout);
+}
+
+
+static void print_usage_exit(char *argv[])
+{
+    unsigned int i;
+    
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "  Options:\n");
+    fprintf(stderr, "    -h --help                  Print this help.\n");
+    fprintf(stderr, "    -b --bench <list>          Comma separated cases to run. Default all of:");
+    for (i = 0; i < sizeof(asCases) / sizeof(asCases[0]); i++)
+    {
+        fprintf(stderr, " %s", asCases[i].pcName);
+    }
+    fprintf(stderr, ".\n");
+    fprintf(stderr, "    -t --time <ms>             Time spent on each case and size. Default %d.\n", BENCH_DEFAULT_TIME_MS);
+    exit(EXIT_FAILURE);
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+/* Count heap allocations by wrapping the C library allocator */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    if (bCountAllocations)
+    {
+        u64Allocations++;
+    }
+    return __libc_malloc(size);
+}
+
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (bCountAllocations)
+    {
+        u64Allocations++;
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+
+void *realloc(void *ptr, size_t size)
+{
+    if (bCountAllocations)
+    {
+        u64Allocations++;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *pcBench = NULL;
+    uint32_t u32TimeMs = BENCH_DEFAULT_TIME_MS;
+    unsigned int i, j;
+    
+    {
+        static struct option long_options[] =
+        {
+            /* Program options */
+            {"help",                    no_argument,        NULL, 'h'},
+            {"bench",                   required_argument,  NULL, 'b'},
+            {"time",                    required_argument,  NULL, 't'},
+            { NULL, 0, NULL, 0}
+        };
+        signed char opt;
+        int option_index;
+        
+        while ((opt = getopt_long(argc, argv, "hb:t:", long_options, &option_index)) != -1) 
+        {
+            switch (opt) 
+            {
+                case 'b':
+                    pcBench = optarg;
+                    break;
+                case 't':
+                    u32TimeMs = strtoul(optarg, NULL, 10);
+                    break;
+                case 'h':
+                default: /* '?' */
+                    print_usage_exit(argv);
+            }
+        }
+    }
+    
+    for (i = 0; i < sizeof(au8Payload); i++)
+    {
+        au8Payload[i] = i * 7 + 3;
+    }
+    
+    for (i = 0; i < sizeof(asCases) / sizeof(asCases[0]); i++)
+    {
+        if (pcBench)
+        {
+            /* Match whole names in the comma separated list */
+            const char *pcMatch = pcBench;
+            size_t iNameLength = strlen(asCases[i].pcName);
+            
+            while ((pcMatch = strstr(pcMatch, asCases[i].pcName)) != NULL)
+            {
+                if (((pcMatch == pcBench) || (pcMatch[-1] == ',')) &&
+                    ((pcMatch[iNameLength] == '\0') || (pcMatch[iNameLength] == ',')))
+                {
+                    break;
+                }
+                pcMatch++;
+            }
+            if (!pcMatch)
+            {
+                continue;
+            }
+        }
+        
+        if (asCases[i].prSetup)
+        {
+            asCases[i].prSetup();
+        }
+        for (j = 0; j < sizeof(au16Lengths) / sizeof(au16Lengths[0]); j++)
+        {
+            if (au16Lengths[j] && (au16Lengths[j] < asCases[i].u16MinLength))
+            {
+                continue;
+            }
+            vRunCase(&asCases[i], au16Lengths[j], u32TimeMs);
+        }
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -0,0 +1,876 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Border router module emulator
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+/* Stands in for the border router firmware on the far side of a pseudo
+ * terminal, so that the daemon can be run and measured without hardware.
+ * Start it, then point the daemon's -s option at the pty link it creates.
+ *
+ * The emulator answers the start up handshake the way each firmware series
+ * does, so that every JENNIC_VERSION branch in the daemon can be exercised:
+ *   1.0.x  ignores version requests, answers the configuration with its version
+ *   1.1.x  version handshake with capabilities, profiles, ping, config request
+ *   1.3.x  activity LED
+ *   1.4.x  radio front end and antenna diversity
+ *
+ * IPv6 packets from the daemon go into a fixed number of radio buffers and
+ * are sent over an emulated radio at a limited rate, with random loss and a
+ * fixed one way latency. In echo mode each packet comes back from its
+ * destination as if that node had answered it: addresses and ports are
+ * swapped and ICMPv6 echo requests become replies. In sink mode packets
+ * are just counted.
+ *
+ * On exit one line of key=value pairs is printed, including the time the
+ * daemon took from its first message to learning the module's address.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <poll.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/icmp6.h>
+
+#include "Serial.h"
+#include "SerialLink.h"
+#include "IPv6.h"
+#include "Clock.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define EMU_VERSION(a,b,c)          (((a) << 16) | ((b) << 8) | (c))
+
+#define EMU_DEFAULT_LINK            "/tmp/6LoWPANd-emulator"
+#define EMU_DEFAULT_VERSION         EMU_VERSION(1,4,0)
+#define EMU_DEFAULT_WINDOW          8
+
+/* Bytes of 802.15.4 and 6LoWPAN framing charged to each packet on the radio */
+#define EMU_RADIO_OVERHEAD          25
+
+/* Lateness in servicing the radio that is made up by sending the next packet sooner */
+#define EMU_RADIO_SLACK_US          1000
+
+/* Packets that can be on their way back to the daemon */
+#define EMU_MAX_RETURNING           256
+
+/* Longest time to sleep, so that the run time is checked */
+#define EMU_MAX_SLEEP_US            100000
+
+/* Length of the network configuration message */
+#define EMU_CONFIG_LENGTH           16
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** Packet held by the emulated radio */
+typedef struct
+{
+    uint64_t    u64Due;                 /**< Time it reaches the daemon, for returning packets */
+    uint16_t    u16Length;
+    uint8_t     au8Data[SL_MAX_MESSAGE_LENGTH];
+} tsEmuPacket;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+/* Required by Serial.c */
+int verbosity = 0;
+volatile sig_atomic_t bRunning = 1;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+/** What is being emulated */
+static struct
+{
+    uint32_t        u32Version;         /**< Firmware version, as EMU_VERSION */
+    uint8_t         u8Capabilities;     /**< teSL_Capability the firmware offers */
+    uint8_t         u8Window;           /**< IPv6 buffers */
+    uint32_t        u32RateBps;         /**< Radio bit rate, 0 for unlimited */
+    double          dLoss;              /**< Probability of losing a packet on each radio hop */
+    uint32_t        u32LatencyUs;       /**< One way latency to the nodes */
+    int             iEcho;              /**< Echo packets rather than sinking them */
+    int             iAddressSet;
+    struct in6_addr sAddress;           /**< Module address, default prefix::1 */
+} sEmu;
+
+/** Firmware state */
+static struct
+{
+    int             iRunning;           /**< Network has been started */
+    uint8_t         u8Capabilities;     /**< Capabilities enabled in the handshake */
+    uint8_t         au8Config[EMU_CONFIG_LENGTH];
+    int             iConfigured;
+    uint8_t         au8Security[256];
+    uint16_t        u16SecurityLength;
+    uint8_t         u8Profile;
+    uint16_t        u16Consumed;        /**< IPv6 frames taken from the buffers */
+    uint64_t        u64RadioFree;       /**< Time the radio finishes its current packet */
+    uint64_t        u64FirstContact;    /**< Time of the first message from the daemon */
+    uint64_t        u64AddressSent;     /**< Time the address was first sent */
+} sState;
+
+/** Radio buffers for packets from the daemon */
+static tsEmuPacket *asBuffers;
+static uint32_t u32BufferHead, u32BufferCount;
+
+/** Packets on their way back to the daemon */
+static tsEmuPacket asReturning[EMU_MAX_RETURNING];
+static uint32_t u32ReturningHead, u32ReturningCount;
+
+static uint64_t u64RandomState;
+
+/** Results */
+static struct
+{
+    uint64_t    u64RxPackets;           /**< IPv6 packets from the daemon */
+    uint64_t    u64RxBytes;
+    uint64_t    u64TxPackets;           /**< IPv6 packets to the daemon */
+    uint64_t    u64TxBytes;
+    uint64_t    u64Overflows;           /**< Packets that arrived with every buffer in use */
+    uint64_t    u64NotRunning;          /**< Packets that arrived before the network was started */
+    uint64_t    u64Lost;                /**< Packets lost on the radio */
+    uint64_t    u64NotEchoed;           /**< Packets that cannot be answered */
+    uint64_t    u64Pings;
+    uint64_t    u64CreditUpdates;
+} sResult;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static uint64_t u64Random(void)
+{
+    /* xorshift64* - reproducible for a given seed */
+    u64RandomState ^= u64RandomState >> 12;
+    u64RandomState ^= u64RandomState << 25;
+    u64RandomState ^= u64RandomState >> 27;
+    return u64RandomState * 0x2545F4914F6CDD1DULL;
+}
+
+
+/** Decide whether a packet is lost on one radio hop */
+static int iRadioLoss(void)
+{
+    if (sEmu.dLoss <= 0.0)
+    {
+        return 0;
+    }
+    return ((double)(u64Random() >> 11) / 9007199254740992.0) < sEmu.dLoss;
+}
+
+
+/** Time a packet occupies the radio */
+static uint32_t u32RadioAirtime(uint16_t u16Length)
+{
+    if (sEmu.u32RateBps == 0)
+    {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)(u16Length + EMU_RADIO_OVERHEAD) * 8 * 1000000) / sEmu.u32RateBps);
+}
+
+
+static void vSendLog(const char *pcMessage)
+{
+    uint8_t au8Message[128];
+    size_t iLength = strlen(pcMessage);
+    
+    if (iLength > sizeof(au8Message) - 1)
+    {
+        iLength = sizeof(au8Message) - 1;
+    }
+    au8Message[0] = LOG_INFO;
+    memcpy(&au8Message[1], pcMessage, iLength);
+    vSL_WriteMessage(E_SL_MSG_LOG, iLength + 1, au8Message);
+}
+
+
+/** Tell the daemon how many buffers there are and how many frames have been taken from them */
+static void vSendCredit(void)
+{
+    uint8_t au8Credit[3];
+    
+    if (!(sState.u8Capabilities & E_SL_CAPABILITY_CREDIT))
+    {
+        return;
+    }
+    au8Credit[0] = sEmu.u8Window;
+    au8Credit[1] = sState.u16Consumed >> 8;
+    au8Credit[2] = sState.u16Consumed & 0xFF;
+    vSL_WriteMessage(E_SL_MSG_CREDIT, sizeof(au8Credit), au8Credit);
+    sResult.u64CreditUpdates++;
+}
+
+
+/** Answer the host's capabilities with the version, in a message of the given type */
+static void vSendVersion(uint8_t u8Type, uint16_t u16Length, const uint8_t *pu8Message)
+{
+    uint8_t au8Version[4];
+    uint16_t u16VersionLength = 3;
+    
+    au8Version[0] = (sEmu.u32Version >> 16) & 0xFF;
+    au8Version[1] = (sEmu.u32Version >>  8) & 0xFF;
+    au8Version[2] = (sEmu.u32Version >>  0) & 0xFF;
+    
+    /* Enable the capabilities both sides have */
+    sState.u8Capabilities = 0;
+    if (u16Length >= 1)
+    {
+        sState.u8Capabilities = pu8Message[0] & sEmu.u8Capabilities;
+        au8Version[3] = sState.u8Capabilities;
+        u16VersionLength = 4;
+    }
+    
+    vSL_SetReliable(FALSE);
+    vSL_WriteMessage(u8Type, u16VersionLength, au8Version);
+    
+    if (sState.u8Capabilities & E_SL_CAPABILITY_RELIABLE)
+    {
+        vSL_SetReliable(TRUE);
+    }
+    
+    /* The daemon starts counting again */
+    sState.u16Consumed = 0;
+    vSendCredit();
+}
+
+
+/** Turn a packet into the answer its destination would send back.
+ *  \return 0 if the packet cannot be answered
+ */
+static int iEchoPacket(tsEmuPacket *psPacket)
+{
+    uint8_t *pu8Packet = psPacket->au8Data;
+    uint8_t au8Address[sizeof(struct in6_addr)];
+    uint32_t u32Offset;
+    uint8_t u8Protocol;
+    
+    if ((psPacket->u16Length < IPV6_HEADER_LENGTH) || ((pu8Packet[0] >> 4) != 6) || (pu8Packet[24] == 0xFF))
+    {
+        /* Not IPv6, or multicast */
+        return 0;
+    }
+    
+    memcpy(au8Address, &pu8Packet[8], sizeof(au8Address));
+    memcpy(&pu8Packet[8], &pu8Packet[24], sizeof(au8Address));
+    memcpy(&pu8Packet[24], au8Address, sizeof(au8Address));
+    pu8Packet[7] = 64;
+    
+    u8Protocol = u8IPv6UpperLayer(pu8Packet, psPacket->u16Length, &u32Offset);
+    if ((u8Protocol == IPPROTO_UDP) || (u8Protocol == IPPROTO_TCP))
+    {
+        uint8_t au8Port[2];
+        
+        /* The checksum does not change when the ports are swapped */
+        if (psPacket->u16Length < u32Offset + 4)
+        {
+            return 0;
+        }
+        memcpy(au8Port, &pu8Packet[u32Offset], 2);
+        memcpy(&pu8Packet[u32Offset], &pu8Packet[u32Offset + 2], 2);
+        memcpy(&pu8Packet[u32Offset + 2], au8Port, 2);
+    }
+    else if (u8Protocol == IPPROTO_ICMPV6)
+    {
+        struct icmp6_hdr *psICMP = (struct icmp6_hdr *)&pu8Packet[u32Offset];
+        
+        if ((psPacket->u16Length < u32Offset + sizeof(struct icmp6_hdr)) || (psICMP->icmp6_type != ICMP6_ECHO_REQUEST))
+        {
+            return 0;
+        }
+        psICMP->icmp6_type  = ICMP6_ECHO_REPLY;
+        psICMP->icmp6_cksum = 0;
+        psICMP->icmp6_cksum = htons(u16IPv6Checksum((struct in6_addr *)&pu8Packet[8], (struct in6_addr *)&pu8Packet[24], IPPROTO_ICMPV6,
+                                                    &pu8Packet[u32Offset], psPacket->u16Length - u32Offset));
+    }
+    return 1;
+}
+
+
+static void vHandleIPv6(uint16_t u16Length, const uint8_t *pu8Message)
+{
+    tsEmuPacket *psPacket;
+    
+    sResult.u64RxPackets++;
+    sResult.u64RxBytes += u16Length;
+    
+    if (!sState.iRunning)
+    {
+        /* Discarded, freeing the buffer straight away */
+        sResult.u64NotRunning++;
+        sState.u16Consumed++;
+        vSendCredit();
+        return;
+    }
+    if (u32BufferCount == sEmu.u8Window)
+    {
+        /* Firmware without credits has no way to tell the daemon */
+        sResult.u64Overflows++;
+        return;
+    }
+    
+    psPacket = &asBuffers[(u32BufferHead + u32BufferCount) % sEmu.u8Window];
+    psPacket->u16Length = u16Length;
+    memcpy(psPacket->au8Data, pu8Message, u16Length);
+    u32BufferCount++;
+}
+
+
+static void vHandleMessage(uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Message, uint64_t u64Now)
+{
+    int iV11 = sEmu.u32Version >= EMU_VERSION(1,1,0);
+    
+    if (verbosity >= LOG_DEBUG)
+    {
+        fprintf(stderr, "Message type %d, length %d\n", u8Type, u16Length);
+    }
+    if ((sState.u64FirstContact == 0) && (u8Type != E_SL_MSG_LINK))
+    {
+        sState.u64FirstContact = u64Now;
+    }
+    
+    switch (u8Type)
+    {
+        case (E_SL_MSG_VERSION_REQUEST):
+            if (iV11)
+            {
+                vSendVersion(E_SL_MSG_VERSION, u16Length, pu8Message);
+            }
+            break;
+        
+        case (E_SL_MSG_CONFIG):
+            if (u16Length == EMU_CONFIG_LENGTH)
+            {
+                memcpy(sState.au8Config, pu8Message, EMU_CONFIG_LENGTH);
+                sState.iConfigured = 1;
+            }
+            if (!iV11)
+            {
+                /* 1.0 firmware answers the configuration with its version */
+                vSendVersion(E_SL_MSG_CONFIG, 0, NULL);
+            }
+            break;
+        
+        case (E_SL_MSG_SECURITY):
+            if (u16Length <= sizeof(sState.au8Security))
+            {
+                memcpy(sState.au8Security, pu8Message, u16Length);
+                sState.u16SecurityLength = u16Length;
+            }
+            break;
+        
+        case (E_SL_MSG_PROFILE):
+            if (iV11 && (u16Length >= 1))
+            {
+                sState.u8Profile = pu8Message[0];
+            }
+            break;
+        
+        case (E_SL_MSG_RUN_COORDINATOR):
+        case (E_SL_MSG_RUN_ROUTER):
+        case (E_SL_MSG_RUN_COMMISIONING):
+        {
+            char acLog[64];
+            
+            sState.iRunning = 1;
+            snprintf(acLog, sizeof(acLog), "Emulated border router V%d.%d.%d running, profile %d",
+                     (sEmu.u32Version >> 16) & 0xFF, (sEmu.u32Version >> 8) & 0xFF, sEmu.u32Version & 0xFF, sState.u8Profile);
+            vSendLog(acLog);
+            break;
+        }
+        
+        case (E_SL_MSG_RESET):
+            memset(&sState, 0, sizeof(sState));
+            u32BufferCount = 0;
+            u32ReturningCount = 0;
+            vSL_SetReliable(FALSE);
+            break;
+        
+        case (E_SL_MSG_CONFIG_REQUEST):
+            if (iV11 && sState.iRunning && sState.iConfigured)
+            {
+                vSL_WriteMessage(E_SL_MSG_CONFIG, EMU_CONFIG_LENGTH, sState.au8Config);
+                if (sState.u16SecurityLength)
+                {
+                    vSL_WriteMessage(E_SL_MSG_SECURITY, sState.u16SecurityLength, sState.au8Security);
+                }
+            }
+            break;
+        
+        case (E_SL_MSG_ADDR):
+            if (sState.iRunning)
+            {
+                struct in6_addr sAddress = sEmu.sAddress;
+                
+                if (!sEmu.iAddressSet)
+                {
+                    /* Prefix from the configuration, interface identifier 1 */
+                    memset(&sAddress, 0, sizeof(sAddress));
+                    memcpy(&sAddress.s6_addr[0], &sState.au8Config[8], 8);
+                    sAddress.s6_addr[15] = 1;
+                }
+                vSL_WriteMessage(E_SL_MSG_ADDR, sizeof(sAddress), sAddress.s6_addr);
+                if (sState.u64AddressSent == 0)
+                {
+                    sState.u64AddressSent = u64Now;
+                }
+            }
+            break;
+        
+        case (E_SL_MSG_PING):
+            if (iV11)
+            {
+                vSL_WriteMessage(E_SL_MSG_PING, 0, NULL);
+                sResult.u64Pings++;
+            }
+            break;
+        
+        case (E_SL_MSG_CREDIT):
+            vSendCredit();
+            break;
+        
+        case (E_SL_MSG_IPV6):
+            vHandleIPv6(u16Length, pu8Message);
+            break;
+        
+        case (E_SL_MSG_ACTIVITY_LED):
+        case (E_SL_MSG_SET_RADIO_FRONTEND):
+        case (E_SL_MSG_ENABLE_DIVERSITY):
+        default:
+            /* Accepted with no effect */
+            break;
+    }
+}
+
+
+/** Send packets from the buffers over the radio
+ *  \return Microseconds until the radio is free, 0 if there is nothing to send
+ */
+static uint32_t u32ServiceRadio(uint64_t u64Now)
+{
+    int iFreed = 0;
+    
+    while (u32BufferCount && (u64Now >= sState.u64RadioFree))
+    {
+        tsEmuPacket *psPacket = &asBuffers[u32BufferHead];
+        uint32_t u32Airtime = u32RadioAirtime(psPacket->u16Length);
+        
+        /* Back to back with the previous packet unless the radio has been idle */
+        if (sState.u64RadioFree + EMU_RADIO_SLACK_US < u64Now)
+        {
+            sState.u64RadioFree = u64Now;
+        }
+        sState.u64RadioFree += u32Airtime;
+        
+        if (iRadioLoss())
+        {
+            sResult.u64Lost++;
+        }
+        else if (sEmu.iEcho)
+        {
+            if (u32ReturningCount == EMU_MAX_RETURNING)
+            {
+                sResult.u64Overflows++;
+            }
+            else if (!iEchoPacket(psPacket))
+            {
+                sResult.u64NotEchoed++;
+            }
+            else if (iRadioLoss())
+            {
+                sResult.u64Lost++;
+            }
+            else
+            {
+                tsEmuPacket *psReturn = &asReturning[(u32ReturningHead + u32ReturningCount) % EMU_MAX_RETURNING];
+                
+                /* There and back, with the answer taking as long on the radio */
+                psReturn->u64Due    = sState.u64RadioFree + (2 * sEmu.u32LatencyUs) + u32Airtime;
+                psReturn->u16Length = psPacket->u16Length;
+                memcpy(psReturn->au8Data, psPacket->au8Data, psPacket->u16Length);
+                u32ReturningCount++;
+            }
+        }
+        
+        u32BufferHead = (u32BufferHead + 1) % sEmu.u8Window;
+        u32BufferCount--;
+        sState.u16Consumed++;
+        iFreed = 1;
+    }
+    
+    if (iFreed)
+    {
+        vSendCredit();
+    }
+    return u32BufferCount ? (uint32_t)(sState.u64RadioFree - u64Now) : 0;
+}
+
+
+/** Pass answers back to the daemon when they arrive
+ *  \return Microseconds until the next one is due, 0 if there are none
+ */
+static uint32_t u32ServiceReturning(uint64_t u64Now)
+{
+    while (u32ReturningCount)
+    {
+        tsEmuPacket *psReturn = &asReturning[u32ReturningHead];
+        
+        if (psReturn->u64Due > u64Now)
+        {
+            return (uint32_t)(psReturn->u64Due - u64Now);
+        }
+        if (!bSL_TxWindowOpen())
+        {
+            return 1000;
+        }
+        
+        vSL_WriteMessage(E_SL_MSG_IPV6, psReturn->u16Length, psReturn->au8Data);
+        sResult.u64TxPackets++;
+        sResult.u64TxBytes += psReturn->u16Length;
+        u32ReturningHead = (u32ReturningHead + 1) % EMU_MAX_RETURNING;
+        u32ReturningCount--;
+    }
+    return 0;
+}
+
+
+static void vQuitSignalHandler(int sig)
+{
+    bRunning = 0;
+}
+
+
+static int iParseVersion(const char *pcVersion)
+{
+    unsigned int uMajor, uMinor, uRevision;
+    
+    if ((sscanf(pcVersion, "%u.%u.%u", &uMajor, &uMinor, &uRevision) != 3) || (uMajor > 255) || (uMinor > 255) || (uRevision > 255))
+    {
+        return -1;
+    }
+    sEmu.u32Version = EMU_VERSION(uMajor, uMinor, uRevision);
+    return 0;
+}
+
+
+static int iParseCapabilities(char *pcList)
+{
+    char *pcToken, *pcSave = NULL;
+    
+    sEmu.u8Capabilities = 0;
+    for (pcToken = strtok_r(pcList, ",", &pcSave); pcToken; pcToken = strtok_r(NULL, ",", &pcSave))
+    {
+        if (strcmp(pcToken, "credit") == 0)
+        {
+            sEmu.u8Capabilities |= E_SL_CAPABILITY_CREDIT;
+        }
+        else if (strcmp(pcToken, "reliable") == 0)
+        {
+            sEmu.u8Capabilities |= E_SL_CAPABILITY_RELIABLE;
+        }
+        else if (strcmp(pcToken, "none") != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+static void print_usage_exit(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "  Options:\n");
+    fprintf(stderr, "    -h --help                  Print this help.\n");
+    fprintf(stderr, "    -p --pty <path>            Link to create to the pseudo terminal. Default %s.\n", EMU_DEFAULT_LINK);
+    fprintf(stderr, "    -V --firmware <a.b.c>      Firmware version to emulate. Default 1.4.0.\n");
+    fprintf(stderr, "    -C --capabilities <list>   Comma separated link capabilities offered: credit, reliable or none. Default credit,reliable.\n");
+    fprintf(stderr, "    -w --window <buffers>      IPv6 buffers in the module. Default %d.\n", EMU_DEFAULT_WINDOW);
+    fprintf(stderr, "    -R --rate <bit/s>          Radio bit rate, 0 for unlimited. Default 0.\n");
+    fprintf(stderr, "    -l --loss <probability>    Probability of losing a packet on each radio hop. Default 0.\n");
+    fprintf(stderr, "    -d --latency <ms>          One way latency to the nodes. Default 0.\n");
+    fprintf(stderr, "    -m --mode <echo|sink>      Answer packets as their destination would, or discard them. Default echo.\n");
+    fprintf(stderr, "    -a --address <IPv6>        Module address. Default the configured prefix with interface identifier 1.\n");
+    fprintf(stderr, "    -t --time <seconds>        Exit after this long. Default run until interrupted.\n");
+    fprintf(stderr, "    -s --seed <seed>           Random seed. Default 1.\n");
+    fprintf(stderr, "    -v --verbose               Print each message received.\n");
+    exit(EXIT_FAILURE);
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+    char acDefaultLink[] = EMU_DEFAULT_LINK;
+    char *pcLink = acDefaultLink;
+    char acDevice[256];
+    uint8_t au8Message[SL_MAX_MESSAGE_LENGTH];
+    uint64_t u64Start, u64End = 0, u64Elapsed;
+    static const char *apcCapabilities[] = { "none", "credit", "reliable", "credit,reliable" };
+    
+    sEmu.u32Version     = EMU_DEFAULT_VERSION;
+    sEmu.u8Capabilities = E_SL_CAPABILITY_CREDIT | E_SL_CAPABILITY_RELIABLE;
+    sEmu.u8Window       = EMU_DEFAULT_WINDOW;
+    sEmu.iEcho          = 1;
+    u64RandomState      = 1;
+    
+    {
+        static struct option long_options[] =
+        {
+            /* Program options */
+            {"help",                    no_argument,        NULL, 'h'},
+            {"pty",                     required_argument,  NULL, 'p'},
+            {"firmware",                required_argument,  NULL, 'V'},
+            {"capabilities",            required_argument,  NULL, 'C'},
+            {"window",                  required_argument,  NULL, 'w'},
+            {"rate",                    required_argument,  NULL, 'R'},
+            {"loss",                    required_argument,  NULL, 'l'},
+            {"latency",                 required_argument,  NULL, 'd'},
+            {"mode",                    required_argument,  NULL, 'm'},
+            {"address",                 required_argument,  NULL, 'a'},
+            {"time",                    required_argument,  NULL, 't'},
+            {"seed",                    required_argument,  NULL, 's'},
+            {"verbose",                 no_argument,        NULL, 'v'},
+            { NULL, 0, NULL, 0}
+        };
+        signed char opt;
+        int option_index;
+        
+        while ((opt = getopt_long(argc, argv, "hp:V:C:w:R:l:d:m:a:t:s:v", long_options, &option_index)) != -1) 
+        {
+            switch (opt) 
+            {
+                case 'p':
+                    pcLink = optarg;
+                    break;
+                case 'V':
+                    if (iParseVersion(optarg) < 0)
+                    {
+                        fprintf(stderr, "Invalid firmware version '%s'\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    break;
+                case 'C':
+                    if (iParseCapabilities(optarg) < 0)
+                    {
+                        fprintf(stderr, "Invalid capabilities '%s'\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    break;
+                case 'w':
+                {
+                    unsigned long ulWindow = strtoul(optarg, NULL, 10);
+                    if ((ulWindow < 1) || (ulWindow > 255))
+                    {
+                        fprintf(stderr, "Window must be between 1 and 255\n");
+                        print_usage_exit(argv);
+                    }
+                    sEmu.u8Window = ulWindow;
+                    break;
+                }
+                case 'R':
+                    sEmu.u32RateBps = strtoul(optarg, NULL, 10);
+                    break;
+                case 'l':
+                    sEmu.dLoss = strtod(optarg, NULL);
+                    if ((sEmu.dLoss < 0.0) || (sEmu.dLoss > 1.0))
+                    {
+                        fprintf(stderr, "Loss must be between 0 and 1\n");
+                        print_usage_exit(argv);
+                    }
+                    break;
+                case 'd':
+                    sEmu.u32LatencyUs = (uint32_t)(strtod(optarg, NULL) * 1000.0);
+                    break;
+                case 'm':
+                    if (strcmp(optarg, "echo") == 0)
+                    {
+                        sEmu.iEcho = 1;
+                    }
+                    else if (strcmp(optarg, "sink") == 0)
+                    {
+                        sEmu.iEcho = 0;
+                    }
+                    else
+                    {
+                        fprintf(stderr, "Unknown mode '%s'\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    break;
+                case 'a':
+                    if (inet_pton(AF_INET6, optarg, &sEmu.sAddress) != 1)
+                    {
+                        fprintf(stderr, "Invalid address '%s'\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    sEmu.iAddressSet = 1;
+                    break;
+                case 't':
+                    u64End = strtoull(optarg, NULL, 10) * 1000000ULL;
+                    break;
+                case 's':
+                    u64RandomState = strtoull(optarg, NULL, 0);
+                    if (u64RandomState == 0)
+                    {
+                        u64RandomState = 1;
+                    }
+                    break;
+                case 'v':
+                    verbosity = LOG_DEBUG;
+                    break;
+                case 'h':
+                default: /* '?' */
+                    print_usage_exit(argv);
+            }
+        }
+    }
+    
+    asBuffers = calloc(sEmu.u8Window, sizeof(tsEmuPacket));
+    if (!asBuffers)
+    {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    
+    snprintf(acDevice, sizeof(acDevice), "pty:%s", pcLink);
+    if (serial_open(acDevice, 0) < 0)
+    {
+        fprintf(stderr, "Could not create pseudo terminal %s\n", pcLink);
+        return EXIT_FAILURE;
+    }
+    
+    signal(SIGTERM, vQuitSignalHandler);
+    signal(SIGINT, vQuitSignalHandler);
+    
+    fprintf(stderr, "Emulating border router V%d.%d.%d on %s\n",
+            (sEmu.u32Version >> 16) & 0xFF, (sEmu.u32Version >> 8) & 0xFF, sEmu.u32Version & 0xFF, pcLink);
+    
+    u64Start = u64ClockNowUs();
+    if (u64End)
+    {
+        u64End += u64Start;
+    }
+    
+    while (bRunning)
+    {
+        uint64_t u64Now = u64ClockNowUs();
+        uint32_t u32Wait = EMU_MAX_SLEEP_US;
+        uint32_t u32Next;
+        uint8_t u8Type;
+        uint16_t u16Length;
+        struct pollfd sPoll = { serial_fd, POLLIN, 0 };
+        
+        if (u64End && (u64Now >= u64End))
+        {
+            break;
+        }
+        
+        while (bSL_ReadMessage(&u8Type, &u16Length, sizeof(au8Message), au8Message))
+        {
+            vHandleMessage(u8Type, u16Length, au8Message, u64Now);
+        }
+        
+        u32Next = u32ServiceRadio(u64Now);
+        if (u32Next && (u32Next < u32Wait))
+        {
+            u32Wait = u32Next;
+        }
+        u32Next = u32ServiceReturning(u64Now);
+        if (u32Next && (u32Next < u32Wait))
+        {
+            u32Wait = u32Next;
+        }
+        u32Next = u32SL_Service(u64Now);
+        if (u32Next && (u32Next < u32Wait))
+        {
+            u32Wait = u32Next;
+        }
+        
+        poll(&sPoll, 1, (u32Wait + 999) / 1000);
+    }
+    
+    u64Elapsed = u64ClockNowUs() - u64Start;
+    unlink(pcLink);
+    
+    printf("firmware=%d.%d.%d capabilities=%s window=%u rate_bps=%u loss=%g latency_ms=%.3f mode=%s "
+           "handshake_ms=%.3f rx_packets=%llu rx_bytes=%llu tx_packets=%llu tx_bytes=%llu "
+           "overflows=%llu not_running=%llu lost=%llu not_echoed=%llu pings=%llu credit_updates=%llu "
+           "elapsed_s=%.3f rx_pps=%.1f crc_errors=%llu retransmissions=%llu\n",
+           (sEmu.u32Version >> 16) & 0xFF, (sEmu.u32Version >> 8) & 0xFF, sEmu.u32Version & 0xFF,
+           apcCapabilities[sState.u8Capabilities & (E_SL_CAPABILITY_CREDIT | E_SL_CAPABILITY_RELIABLE)],
+           sEmu.u8Window, sEmu.u32RateBps, sEmu.dLoss, sEmu.u32LatencyUs / 1000.0, sEmu.iEcho ? "echo" : "sink",
+           sState.u64AddressSent ? (sState.u64AddressSent - sState.u64FirstContact) / 1000.0 : -1.0,
+           (unsigned long long)sResult.u64RxPackets,
+           (unsigned long long)sResult.u64RxBytes,
+           (unsigned long long)sResult.u64TxPackets,
+           (unsigned long long)sResult.u64TxBytes,
+           (unsigned long long)sResult.u64Overflows,
+           (unsigned long long)sResult.u64NotRunning,
+           (unsigned long long)sResult.u64Lost,
+           (unsigned long long)sResult.u64NotEchoed,
+           (unsigned long long)sResult.u64Pings,
+           (unsigned long long)sResult.u64CreditUpdates,
+           u64Elapsed / 1000000.0,
+           u64Elapsed ? (double)sResult.u64RxPackets * 1000000.0 / u64Elapsed : 0.0,
+           (unsigned long long)sSL_Stats.u64CRCErrors,
+           (unsigned long long)sSL_Stats.u64Retransmissions);
+    fflush(stdout);
+    
+    return EXIT_SUCCESS;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
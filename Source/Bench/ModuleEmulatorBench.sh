@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Runs the daemon against the border router module emulator and reports
+# the time taken by the start up handshake and the round trip times and
+# loss of a ping flood through the tun device to an emulated node.
+#
+# Needs root for the tun device. Run from the build directory, passing any
+# further options to the emulator, e.g.
+#   sudo sh ../Source/Bench/ModuleEmulatorBench.sh -V 1.1.0 -R 250000 -d 5
+#
+# Environment: IFACE, LINK, PREFIX, COUNT, SIZE, RUNTIME
+#
+
+IFACE=${IFACE:-emu0}
+LINK=${LINK:-/tmp/6LoWPANd-emulator}
+PREFIX=${PREFIX:-fd04:bd3:80e8:2}
+COUNT=${COUNT:-1000}
+SIZE=${SIZE:-64}
+RUNTIME=${RUNTIME:-60}
+
+rm -f /tmp/6LoWPANd.$IFACE
+
+./ModuleEmulator -p $LINK -t $RUNTIME "$@" > emulator.out &
+EMULATOR=$!
+
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -e $LINK ] && break
+    sleep 0.1
+done
+
+./6LoWPANd -f -v 4 -s $LINK -I $IFACE -6 $PREFIX:: &
+DAEMON=$!
+
+# The daemon writes the module address once the handshake is complete
+for i in $(seq 1 100); do
+    [ -e /tmp/6LoWPANd.$IFACE ] && break
+    sleep 0.1
+done
+if [ ! -e /tmp/6LoWPANd.$IFACE ]; then
+    echo "Handshake with emulator did not complete" >&2
+    kill $DAEMON $EMULATOR
+    exit 1
+fi
+
+ip link set $IFACE up
+ip -6 addr add $PREFIX::fffe/64 dev $IFACE nodad
+sleep 0.5
+
+ping -6 -q -f -c $COUNT -s $SIZE $PREFIX::2 | tail -n 2
+
+kill $DAEMON
+wait $DAEMON
+kill -INT $EMULATOR
+wait $EMULATOR
+cat emulator.out
@@ -0,0 +1,457 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          SerialLink corruption benchmark
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+/* Feeds frames produced by the serial link encoder back into its own
+ * decoder through the "loopback" serial transport, flipping bits at a chosen bit error rate,
+ * and reports how much data got through intact along with the decoder's
+ * error counters. With -r the reliable (sequenced) framing is used, the
+ * link acting as its own peer so that acknowledgements are corrupted too.
+ * The transport is far faster than a UART; the baud rate given with -B
+ * is what the link assumes when timing retransmissions.
+ *
+ * Output is one line of key=value pairs per bit error rate.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "Serial.h"
+#include "SerialLink.h"
+#include "Clock.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/* Message type used for the test frames */
+#define BENCH_MSG_TYPE          E_SL_MSG_IPV6
+
+/* Time without traffic after which the reliable link is considered drained */
+#define BENCH_IDLE_US           500000
+
+#define BENCH_DEFAULT_MESSAGES  10000
+#define BENCH_DEFAULT_LENGTH    128
+#define BENCH_DEFAULT_BAUD_RATE 1000000
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+/* Required by Serial.c */
+int verbosity = 0;
+volatile sig_atomic_t bRunning = 1;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+/** Far end of the socket pair, standing in for the module */
+static int iWireFd;
+
+/** Bit error rate being applied */
+static double dBER;
+
+/** Bits left before the next error is injected */
+static uint64_t u64BitsToError;
+
+static uint64_t u64RandomState;
+
+/** Results for one run */
+static struct
+{
+    uint64_t    u64Sent;                /**< Messages written */
+    uint64_t    u64Delivered;           /**< Messages received intact */
+    uint64_t    u64Corrupted;           /**< Messages received with bad contents */
+    uint64_t    u64Misordered;          /**< Messages received out of order */
+    uint64_t    u64WireBytes;           /**< Bytes carried, including framing and link control */
+    uint64_t    u64BitErrors;           /**< Bits flipped */
+} sResult;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static uint64_t u64Random(void)
+{
+    /* xorshift64* - reproducible for a given seed */
+    u64RandomState ^= u64RandomState >> 12;
+    u64RandomState ^= u64RandomState << 25;
+    u64RandomState ^= u64RandomState >> 27;
+    return u64RandomState * 0x2545F4914F6CDD1DULL;
+}
+
+
+/** Number of error free bits before the next flipped one (geometric distribution) */
+static uint64_t u64NextError(void)
+{
+    double dU;
+    
+    if (dBER <= 0.0)
+    {
+        return UINT64_MAX;
+    }
+    dU = ((double)(u64Random() >> 11) + 1.0) / 9007199254740993.0;
+    return (uint64_t)(log(dU) / log1p(-dBER));
+}
+
+
+/** Contents of message number u32Index */
+static void vFillMessage(uint32_t u32Index, uint8_t *pu8Data, uint16_t u16Length)
+{
+    uint32_t u32State = u32Index * 2654435761u + 1;
+    uint16_t i;
+    
+    for (i = 0; i < u16Length; i++)
+    {
+        if (i < sizeof(uint32_t))
+        {
+            pu8Data[i] = (u32Index >> (8 * i)) & 0xFF;
+        }
+        else
+        {
+            u32State = u32State * 1103515245u + 12345u;
+            pu8Data[i] = u32State >> 16;
+        }
+    }
+}
+
+
+/** Move everything the encoder has written back to the decoder, corrupting it on the way */
+static int iPumpWire(void)
+{
+    uint8_t au8Buffer[4096];
+    ssize_t iBytes;
+    ssize_t i;
+    int iMoved = 0;
+    
+    while ((iBytes = read(iWireFd, au8Buffer, sizeof(au8Buffer))) > 0)
+    {
+        for (i = 0; i < iBytes; i++)
+        {
+            int iBit;
+            
+            if (u64BitsToError >= 8)
+            {
+                u64BitsToError -= 8;
+                continue;
+            }
+            
+            iBit = u64BitsToError;
+            for (;;)
+            {
+                au8Buffer[i] ^= 1 << iBit;
+                sResult.u64BitErrors++;
+                u64BitsToError = u64NextError();
+                if (u64BitsToError >= (uint64_t)(7 - iBit))
+                {
+                    u64BitsToError -= (7 - iBit);
+                    break;
+                }
+                iBit += u64BitsToError + 1;
+            }
+        }
+        
+        if (write(iWireFd, au8Buffer, iBytes) != iBytes)
+        {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        sResult.u64WireBytes += iBytes;
+        iMoved += iBytes;
+    }
+    return iMoved;
+}
+
+
+/** Read and check everything the decoder has for us */
+static void vDrainDecoder(uint16_t u16Length, uint32_t *pu32NextExpected)
+{
+    uint8_t au8Message[SL_MAX_MESSAGE_LENGTH];
+    uint8_t au8Expected[SL_MAX_MESSAGE_LENGTH];
+    uint8_t u8Type;
+    uint16_t u16RxLength;
+    uint32_t u32Index;
+    
+    while (bSL_ReadMessage(&u8Type, &u16RxLength, sizeof(au8Message), au8Message))
+    {
+        if (u8Type == E_SL_MSG_LINK)
+        {
+            continue;
+        }
+        
+        if ((u8Type != BENCH_MSG_TYPE) || (u16RxLength != u16Length))
+        {
+            sResult.u64Corrupted++;
+            continue;
+        }
+        
+        memcpy(&u32Index, au8Message, sizeof(uint32_t));
+        vFillMessage(u32Index, au8Expected, u16Length);
+        if ((u32Index >= sResult.u64Sent) || memcmp(au8Message, au8Expected, u16Length))
+        {
+            sResult.u64Corrupted++;
+            continue;
+        }
+        
+        if (u32Index < *pu32NextExpected)
+        {
+            sResult.u64Misordered++;
+        }
+        else
+        {
+            *pu32NextExpected = u32Index + 1;
+        }
+        sResult.u64Delivered++;
+    }
+}
+
+
+static void vRun(uint32_t u32Messages, uint16_t u16Length, int iReliable)
+{
+    uint8_t au8Message[SL_MAX_MESSAGE_LENGTH];
+    uint32_t u32NextExpected = 0;
+    uint64_t u64Start, u64LastTraffic, u64Elapsed;
+    char acTransport[] = "loopback";
+    
+    if (serial_open(acTransport, 0) < 0)
+    {
+        fprintf(stderr, "Could not open loopback transport\n");
+        exit(EXIT_FAILURE);
+    }
+    iWireFd = serial_loopback_fd;
+    fcntl(iWireFd, F_SETFL, O_NONBLOCK);
+    
+    memset(&sResult, 0, sizeof(sResult));
+    memset(&sSL_Stats, 0, sizeof(sSL_Stats));
+    u64BitsToError = u64NextError();
+    
+    vSL_SetReliable(iReliable ? TRUE : FALSE);
+    
+    u64Start = u64LastTraffic = u64ClockNowUs();
+    
+    for (;;)
+    {
+        uint64_t u64Now = u64ClockNowUs();
+        uint32_t u32Wait;
+        
+        if ((sResult.u64Sent < u32Messages) && bSL_TxWindowOpen())
+        {
+            vFillMessage(sResult.u64Sent, au8Message, u16Length);
+            sResult.u64Sent++;
+            vSL_WriteMessage(BENCH_MSG_TYPE, u16Length, au8Message);
+        }
+        
+        if (iPumpWire() > 0)
+        {
+            u64LastTraffic = u64Now;
+        }
+        vDrainDecoder(u16Length, &u32NextExpected);
+        u32Wait = u32SL_Service(u64Now);
+        
+        if (sResult.u64Sent == u32Messages)
+        {
+            if (!iReliable || (u64Now - u64LastTraffic > BENCH_IDLE_US))
+            {
+                /* Final pass to collect anything still in flight */
+                iPumpWire();
+                vDrainDecoder(u16Length, &u32NextExpected);
+                break;
+            }
+        }
+        
+        if ((sResult.u64Sent == u32Messages) || !bSL_TxWindowOpen())
+        {
+            /* Nothing to send - sleep until there is input or a timer is due */
+            struct pollfd asPoll[2] = {{ serial_fd, POLLIN, 0 }, { iWireFd, POLLIN, 0 }};
+            int iTimeout = u32Wait ? (u32Wait + 999) / 1000 : 10;
+            
+            poll(asPoll, 2, iTimeout);
+        }
+    }
+    
+    u64Elapsed = u64ClockNowUs() - u64Start;
+    
+    vSL_SetReliable(FALSE);
+    close(serial_fd);
+    close(iWireFd);
+    
+    printf("mode=%s ber=%g messages=%u length=%u delivered=%llu lost=%llu corrupted=%llu misordered=%llu "
+           "bit_errors=%llu wire_bytes=%llu efficiency=%.4f goodput_kbps=%.1f "
+           "crc_errors=%llu overflows=%llu missing_end=%llu truncated=%llu unexpected_start=%llu "
+           "escape_errors=%llu discarded_bytes=%llu retransmissions=%llu abandoned=%llu\n",
+           iReliable ? "reliable" : "plain", dBER, u32Messages, u16Length,
+           (unsigned long long)sResult.u64Delivered,
+           (unsigned long long)(sResult.u64Sent - sResult.u64Delivered),
+           (unsigned long long)sResult.u64Corrupted,
+           (unsigned long long)sResult.u64Misordered,
+           (unsigned long long)sResult.u64BitErrors,
+           (unsigned long long)sResult.u64WireBytes,
+           sResult.u64WireBytes ? (double)(sResult.u64Delivered * u16Length) / sResult.u64WireBytes : 0.0,
+           u64Elapsed ? (double)(sResult.u64Delivered * u16Length * 8) * 1000.0 / u64Elapsed : 0.0,
+           (unsigned long long)sSL_Stats.u64CRCErrors,
+           (unsigned long long)sSL_Stats.u64Overflows,
+           (unsigned long long)sSL_Stats.u64MissingEnd,
+           (unsigned long long)sSL_Stats.u64Truncated,
+           (unsigned long long)sSL_Stats.u64UnexpectedStart,
+           (unsigned long long)sSL_Stats.u64EscapeErrors,
+           (unsigned long long)sSL_Stats.u64DiscardedBytes,
+           (unsigned long long)sSL_Stats.u64Retransmissions,
+           (unsigned long long)sSL_Stats.u64Abandoned);
+    fflush(stdout);
+}
+
+
+static void print_usage_exit(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "  Options:\n");
+    fprintf(stderr, "    -h --help                  Print this help.\n");
+    fprintf(stderr, "    -b --ber <list>            Comma separated bit error rates. Default 0,1e-6,1e-5,1e-4,1e-3.\n");
+    fprintf(stderr, "    -n --messages <count>      Messages per run. Default %d.\n", BENCH_DEFAULT_MESSAGES);
+    fprintf(stderr, "    -l --length <bytes>        Message length. Default %d.\n", BENCH_DEFAULT_LENGTH);
+    fprintf(stderr, "    -r --reliable              Use sequenced frames with retransmission.\n");
+    fprintf(stderr, "    -B --baud <rate>           Baud rate the link assumes. Default %d.\n", BENCH_DEFAULT_BAUD_RATE);
+    fprintf(stderr, "    -s --seed <seed>           Random seed. Default 1.\n");
+    exit(EXIT_FAILURE);
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+    char acDefaultBER[] = "0,1e-6,1e-5,1e-4,1e-3";
+    char *pcBER = acDefaultBER;
+    char *pcToken, *pcSave = NULL;
+    uint32_t u32Messages = BENCH_DEFAULT_MESSAGES;
+    uint16_t u16Length = BENCH_DEFAULT_LENGTH;
+    uint32_t u32BaudRate = BENCH_DEFAULT_BAUD_RATE;
+    int iReliable = 0;
+    
+    u64RandomState = 1;
+    
+    {
+        static struct option long_options[] =
+        {
+            /* Program options */
+            {"help",                    no_argument,        NULL, 'h'},
+            {"ber",                     required_argument,  NULL, 'b'},
+            {"messages",                required_argument,  NULL, 'n'},
+            {"length",                  required_argument,  NULL, 'l'},
+            {"reliable",                no_argument,        NULL, 'r'},
+            {"baud",                    required_argument,  NULL, 'B'},
+            {"seed",                    required_argument,  NULL, 's'},
+            { NULL, 0, NULL, 0}
+        };
+        signed char opt;
+        int option_index;
+        
+        while ((opt = getopt_long(argc, argv, "hb:n:l:rB:s:", long_options, &option_index)) != -1) 
+        {
+            switch (opt) 
+            {
+                case 'b':
+                    pcBER = optarg;
+                    break;
+                case 'n':
+                    u32Messages = strtoul(optarg, NULL, 10);
+                    break;
+                case 'l':
+                    u16Length = strtoul(optarg, NULL, 10);
+                    if ((u16Length < sizeof(uint32_t)) || (u16Length > SL_MAX_MESSAGE_LENGTH))
+                    {
+                        fprintf(stderr, "Length must be between %d and %d\n", (int)sizeof(uint32_t), SL_MAX_MESSAGE_LENGTH);
+                        print_usage_exit(argv);
+                    }
+                    break;
+                case 'r':
+                    iReliable = 1;
+                    break;
+                case 'B':
+                    u32BaudRate = strtoul(optarg, NULL, 10);
+                    if (u32BaudRate == 0)
+                    {
+                        fprintf(stderr, "Invalid baud rate '%s'\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    break;
+                case 's':
+                    u64RandomState = strtoull(optarg, NULL, 0);
+                    if (u64RandomState == 0)
+                    {
+                        u64RandomState = 1;
+                    }
+                    break;
+                case 'h':
+                default: /* '?' */
+                    print_usage_exit(argv);
+            }
+        }
+    }
+    
+    signal(SIGPIPE, SIG_IGN);
+    vSL_SetBaudRate(u32BaudRate);
+    
+    for (pcToken = strtok_r(pcBER, ",", &pcSave); pcToken; pcToken = strtok_r(NULL, ",", &pcSave))
+    {
+        dBER = strtod(pcToken, NULL);
+        if ((dBER < 0.0) || (dBER >= 1.0))
+        {
+            fprintf(stderr, "Invalid bit error rate '%s'\n", pcToken);
+            return EXIT_FAILURE;
+        }
+        vRun(u32Messages, u16Length, iReliable);
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,75 @@
+#!/bin/sh
+#
+# Runs the daemon against the border router module emulator, exchanging
+# packets for local hosts over a UDP endpoint rather than the tun device,
+# and measures the round trip times, throughput and loss of generated
+# traffic through the whole path. Does not need root, the daemon's dumps
+# and statistics page are written to DUMPDIR rather than /run.
+#
+# The daemon's own per stage latency histograms are fetched with SIGUSR1
+# at the end and their summary printed.
+#
+# Run from the build directory, passing any further options to the
+# emulator, e.g.
+#   sh ../Source/Bench/TrafficBench.sh -V 1.1.0 -R 250000 -d 5
+#
+# Environment: IFACE, LINK, PORT, PREFIX, RATE, TIME, LENGTHS, PROTOCOLS,
+# FLOWS, HISTOGRAM (file for the HdrHistogram round trip time distribution),
+# DUMPDIR (directory for the daemon's dumps)
+#
+
+IFACE=${IFACE:-emu0}
+LINK=${LINK:-/tmp/6LoWPANd-emulator}
+PORT=${PORT:-6464}
+PREFIX=${PREFIX:-fd04:bd3:80e8:2}
+RATE=${RATE:-200}
+TIME=${TIME:-10}
+LENGTHS=${LENGTHS:-48-80:40,81-127:30,128-600:20,601-1280:10}
+PROTOCOLS=${PROTOCOLS:-udp:8,icmp:1,tcp:1}
+FLOWS=${FLOWS:-16}
+HISTOGRAM=${HISTOGRAM:-traffic.hgrm}
+DUMPDIR=${DUMPDIR:-/tmp}
+
+rm -f /tmp/6LoWPANd.$IFACE
+
+./ModuleEmulator -p $LINK -t $((TIME + 30)) "$@" > emulator.out &
+EMULATOR=$!
+
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -e $LINK ] && break
+    sleep 0.1
+done
+
+./6LoWPANd -f -v 4 -s $LINK -I $IFACE -6 $PREFIX:: -E udp:[::1]:$PORT -d $DUMPDIR \
+    -O $DUMPDIR/6LoWPANd.$IFACE.stats &
+DAEMON=$!
+
+# The daemon writes the module address once the handshake is complete
+for i in $(seq 1 100); do
+    [ -e /tmp/6LoWPANd.$IFACE ] && break
+    sleep 0.1
+done
+if [ ! -e /tmp/6LoWPANd.$IFACE ]; then
+    echo "Handshake with emulator did not complete" >&2
+    kill $DAEMON $EMULATOR
+    exit 1
+fi
+
+./TrafficGenerator -e udp:[::1]:$PORT -a $PREFIX::fffe -d $PREFIX::2 -r $RATE -t $TIME \
+    -l $LENGTHS -p $PROTOCOLS -f $FLOWS -o $HISTOGRAM
+
+rm -f $DUMPDIR/6LoWPANd.$IFACE.latency
+kill -USR1 $DAEMON
+for i in $(seq 1 20); do
+    [ -e $DUMPDIR/6LoWPANd.$IFACE.latency ] && break
+    sleep 0.1
+done
+grep "^# stage\|^# [a-z_]* [0-9]" $DUMPDIR/6LoWPANd.$IFACE.latency
+
+kill $DAEMON
+wait $DAEMON
+kill -INT $EMULATOR
+wait $EMULATOR
+cat emulator.out
+rm -f /tmp/6LoWPANd.$IFACE $DUMPDIR/6LoWPANd.$IFACE.nodes $DUMPDIR/6LoWPANd.$IFACE.latency \
+    $DUMPDIR/6LoWPANd.$IFACE.stats
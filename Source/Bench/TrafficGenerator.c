@@ -0,0 +1,781 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Traffic generator
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+/* Sends IPv6 traffic into the daemon through a datagram endpoint (see the
+ * -E option of 6LoWPANd), as a host on the tun device would, and measures
+ * what comes back. Run against the border router module emulator in echo
+ * mode, every packet makes the whole trip through the daemon and the
+ * serial link to an emulated node and back, so the round trip times,
+ * throughput and loss reported are those of the complete path.
+ *
+ * Traffic is a mix of UDP datagrams, ICMPv6 echo requests and TCP
+ * segments spread over a number of flows, with lengths drawn from a
+ * weighted distribution, sent at a fixed rate. Each packet carries a
+ * sequence number and its send time, which are used to match answers.
+ *
+ * A line of key=value pairs is printed at the end. The round trip time
+ * distribution can also be written in HdrHistogram's text format.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/ip6.h>
+#include <netinet/icmp6.h>
+#include <netinet/udp.h>
+#include <netinet/tcp.h>
+
+#include "IPv6.h"
+#include "Histogram.h"
+#include "Clock.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define TRAFFIC_DEFAULT_ENDPOINT    "udp:[::1]:6464"
+#define TRAFFIC_DEFAULT_SOURCE      "fd04:bd3:80e8:2::fffe"
+#define TRAFFIC_DEFAULT_DESTINATION "fd04:bd3:80e8:2::2"
+#define TRAFFIC_DEFAULT_RATE        100
+#define TRAFFIC_DEFAULT_TIME        10
+#define TRAFFIC_DEFAULT_WAIT_MS     2000
+
+/** Identifies packets sent by this tool */
+#define TRAFFIC_MAGIC               0x54524146
+
+/** First source port, one per flow */
+#define TRAFFIC_BASE_PORT           49152
+
+/** Echo service port that UDP and TCP traffic is sent to */
+#define TRAFFIC_DEST_PORT           7
+
+#define TRAFFIC_MAX_DESTINATIONS    16
+#define TRAFFIC_MAX_LENGTHS         16
+#define TRAFFIC_MAX_FLOWS           16384
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** Protocols generated */
+typedef enum
+{
+    E_TRAFFIC_UDP,
+    E_TRAFFIC_ICMP,
+    E_TRAFFIC_TCP,
+    E_TRAFFIC_PROTOCOLS,
+} teTrafficProtocol;
+
+/** Carried at the start of the payload of every packet */
+typedef struct
+{
+    uint32_t    u32Magic;
+    uint32_t    u32Sequence;
+    uint64_t    u64SentUs;
+} __attribute__((__packed__)) tsTrafficStamp;
+
+/** A weighted range of packet lengths */
+typedef struct
+{
+    uint16_t    u16Min;
+    uint16_t    u16Max;
+    uint32_t    u32Weight;
+} tsTrafficLength;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+volatile sig_atomic_t bRunning = 1;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static const char *apcProtocols[E_TRAFFIC_PROTOCOLS] = { "udp", "icmp", "tcp" };
+
+/** Length of the protocol headers of each type of packet */
+static const uint16_t au16HeaderLength[E_TRAFFIC_PROTOCOLS] =
+{
+    IPV6_HEADER_LENGTH + sizeof(struct udphdr),
+    IPV6_HEADER_LENGTH + sizeof(struct icmp6_hdr),
+    IPV6_HEADER_LENGTH + sizeof(struct tcphdr),
+};
+
+static struct
+{
+    int             iFd;
+    char            acLocalPath[108];       /**< Our socket, for UNIX endpoints */
+    struct in6_addr sSource;
+    struct in6_addr asDestinations[TRAFFIC_MAX_DESTINATIONS];
+    uint32_t        u32NumDestinations;
+    tsTrafficLength asLengths[TRAFFIC_MAX_LENGTHS];
+    uint32_t        u32NumLengths;
+    uint32_t        u32LengthWeight;        /**< Sum of the length weights */
+    uint32_t        au32ProtocolWeight[E_TRAFFIC_PROTOCOLS];
+    uint32_t        u32ProtocolWeight;      /**< Sum of the protocol weights */
+    uint32_t        u32Flows;
+    uint32_t        u32Rate;                /**< Packets per second */
+} sTraffic;
+
+/** Results */
+static struct
+{
+    uint64_t    au64Sent[E_TRAFFIC_PROTOCOLS];
+    uint64_t    au64Received[E_TRAFFIC_PROTOCOLS];
+    uint64_t    u64SentBytes;
+    uint64_t    u64ReceivedBytes;
+    uint64_t    u64SendErrors;          /**< Packets the endpoint would not take */
+    uint64_t    u64Duplicates;          /**< Answers to packets already answered */
+    uint64_t    u64Other;               /**< Packets received that were not answers */
+    uint64_t    u64FirstSentUs;
+    uint64_t    u64LastReceivedUs;
+} sResult;
+
+/** Round trip times, microseconds */
+static tsHistogram sRTT;
+
+/** One bit per sequence number, set when it has been answered */
+static uint8_t *pu8Answered;
+static uint32_t u32MaxPackets;
+
+static uint64_t u64RandomState = 1;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static uint64_t u64Random(void)
+{
+    /* xorshift64* - reproducible for a given seed */
+    u64RandomState ^= u64RandomState >> 12;
+    u64RandomState ^= u64RandomState << 25;
+    u64RandomState ^= u64RandomState >> 27;
+    return u64RandomState * 0x2545F4914F6CDD1DULL;
+}
+
+
+/** Parse "<length>[-<length>][:<weight>],..." */
+static int iParseLengths(char *pcList)
+{
+    char *pcToken, *pcSave = NULL;
+    
+    sTraffic.u32NumLengths = 0;
+    sTraffic.u32LengthWeight = 0;
+    for (pcToken = strtok_r(pcList, ",", &pcSave); pcToken; pcToken = strtok_r(NULL, ",", &pcSave))
+    {
+        tsTrafficLength *psLength = &sTraffic.asLengths[sTraffic.u32NumLengths];
+        unsigned int uMin, uMax, uWeight = 1;
+        char *pcEnd;
+        
+        if (sTraffic.u32NumLengths == TRAFFIC_MAX_LENGTHS)
+        {
+            return -1;
+        }
+        
+        uMin = uMax = strtoul(pcToken, &pcEnd, 10);
+        if (*pcEnd == '-')
+        {
+            uMax = strtoul(pcEnd + 1, &pcEnd, 10);
+        }
+        if (*pcEnd == ':')
+        {
+            uWeight = strtoul(pcEnd + 1, &pcEnd, 10);
+        }
+        if ((*pcEnd != '\0') || (uMin > uMax) || (uMax > IPV6_MIN_MTU) || (uWeight == 0))
+        {
+            return -1;
+        }
+        
+        psLength->u16Min    = uMin;
+        psLength->u16Max    = uMax;
+        psLength->u32Weight = uWeight;
+        sTraffic.u32LengthWeight += uWeight;
+        sTraffic.u32NumLengths++;
+    }
+    return sTraffic.u32NumLengths ? 0 : -1;
+}
+
+
+/** Parse "<protocol>[:<weight>],..." */
+static int iParseProtocols(char *pcList)
+{
+    char *pcToken, *pcSave = NULL;
+    
+    memset(sTraffic.au32ProtocolWeight, 0, sizeof(sTraffic.au32ProtocolWeight));
+    sTraffic.u32ProtocolWeight = 0;
+    for (pcToken = strtok_r(pcList, ",", &pcSave); pcToken; pcToken = strtok_r(NULL, ",", &pcSave))
+    {
+        char *pcWeight = strchr(pcToken, ':');
+        unsigned int uWeight = 1;
+        int i;
+        
+        if (pcWeight)
+        {
+            *pcWeight++ = '\0';
+            uWeight = strtoul(pcWeight, NULL, 10);
+        }
+        for (i = 0; i < E_TRAFFIC_PROTOCOLS; i++)
+        {
+            if (strcmp(pcToken, apcProtocols[i]) == 0)
+            {
+                break;
+            }
+        }
+        if (i == E_TRAFFIC_PROTOCOLS)
+        {
+            return -1;
+        }
+        sTraffic.au32ProtocolWeight[i] += uWeight;
+        sTraffic.u32ProtocolWeight += uWeight;
+    }
+    return sTraffic.u32ProtocolWeight ? 0 : -1;
+}
+
+
+static int iParseDestinations(char *pcList)
+{
+    char *pcToken, *pcSave = NULL;
+    
+    sTraffic.u32NumDestinations = 0;
+    for (pcToken = strtok_r(pcList, ",", &pcSave); pcToken; pcToken = strtok_r(NULL, ",", &pcSave))
+    {
+        if ((sTraffic.u32NumDestinations == TRAFFIC_MAX_DESTINATIONS) ||
+            (inet_pton(AF_INET6, pcToken, &sTraffic.asDestinations[sTraffic.u32NumDestinations]) != 1))
+        {
+            return -1;
+        }
+        sTraffic.u32NumDestinations++;
+    }
+    return sTraffic.u32NumDestinations ? 0 : -1;
+}
+
+
+/** Connect to the daemon's endpoint, "udp:[<address>:]<port>" or "unix:<path>" */
+static int iOpenEndpoint(const char *pcEndpoint)
+{
+    if (strncmp(pcEndpoint, "udp:", 4) == 0)
+    {
+        struct sockaddr_in6 sAddr;
+        
+        memset(&sAddr, 0, sizeof(sAddr));
+        sAddr.sin6_addr = in6addr_loopback;
+        if (iIPv6ParseSocketAddress(pcEndpoint + 4, &sAddr) < 0)
+        {
+            fprintf(stderr, "Invalid endpoint address \"%s\"\n", pcEndpoint + 4);
+            return -1;
+        }
+        
+        sTraffic.iFd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if ((sTraffic.iFd < 0) || (connect(sTraffic.iFd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0))
+        {
+            perror("connect");
+            return -1;
+        }
+    }
+    else if (strncmp(pcEndpoint, "unix:", 5) == 0)
+    {
+        struct sockaddr_un sAddr;
+        
+        memset(&sAddr, 0, sizeof(sAddr));
+        sAddr.sun_family = AF_UNIX;
+        
+        sTraffic.iFd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (sTraffic.iFd < 0)
+        {
+            perror("socket");
+            return -1;
+        }
+        
+        /* The daemon can only answer a bound socket */
+        snprintf(sTraffic.acLocalPath, sizeof(sTraffic.acLocalPath), "/tmp/TrafficGenerator.%d", (int)getpid());
+        strcpy(sAddr.sun_path, sTraffic.acLocalPath);
+        unlink(sAddr.sun_path);
+        if (bind(sTraffic.iFd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0)
+        {
+            perror("bind");
+            return -1;
+        }
+        
+        if (strlen(pcEndpoint + 5) >= sizeof(sAddr.sun_path))
+        {
+            return -1;
+        }
+        strcpy(sAddr.sun_path, pcEndpoint + 5);
+        if (connect(sTraffic.iFd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0)
+        {
+            perror("connect");
+            return -1;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "Unknown endpoint \"%s\"\n", pcEndpoint);
+        return -1;
+    }
+    return 0;
+}
+
+
+static uint16_t u16PickLength(void)
+{
+    uint32_t u32Pick = u64Random() % sTraffic.u32LengthWeight;
+    const tsTrafficLength *psLength = sTraffic.asLengths;
+    
+    while (u32Pick >= psLength->u32Weight)
+    {
+        u32Pick -= psLength->u32Weight;
+        psLength++;
+    }
+    return psLength->u16Min + u64Random() % (psLength->u16Max - psLength->u16Min + 1);
+}
+
+
+static teTrafficProtocol ePickProtocol(void)
+{
+    uint32_t u32Pick = u64Random() % sTraffic.u32ProtocolWeight;
+    int i;
+    
+    for (i = 0; u32Pick >= sTraffic.au32ProtocolWeight[i]; i++)
+    {
+        u32Pick -= sTraffic.au32ProtocolWeight[i];
+    }
+    return (teTrafficProtocol)i;
+}
+
+
+/** Build and send the next packet */
+static void vSendPacket(uint32_t u32Sequence)
+{
+    uint8_t au8Packet[IPV6_MIN_MTU];
+    struct ip6_hdr *psHeader = (struct ip6_hdr *)au8Packet;
+    teTrafficProtocol eProtocol = ePickProtocol();
+    uint32_t u32Flow = u64Random() % sTraffic.u32Flows;
+    uint16_t u16Length = u16PickLength();
+    uint16_t u16Payload;
+    uint8_t *pu8L4 = &au8Packet[IPV6_HEADER_LENGTH];
+    tsTrafficStamp *psStamp;
+    uint16_t i;
+    
+    if (u16Length < au16HeaderLength[eProtocol] + sizeof(tsTrafficStamp))
+    {
+        u16Length = au16HeaderLength[eProtocol] + sizeof(tsTrafficStamp);
+    }
+    u16Payload = u16Length - IPV6_HEADER_LENGTH;
+    
+    memset(au8Packet, 0, au16HeaderLength[eProtocol]);
+    psHeader->ip6_flow  = htonl(0x60000000);
+    psHeader->ip6_plen  = htons(u16Payload);
+    psHeader->ip6_hlim  = 64;
+    psHeader->ip6_src   = sTraffic.sSource;
+    psHeader->ip6_dst   = sTraffic.asDestinations[u32Flow % sTraffic.u32NumDestinations];
+    
+    psStamp = (tsTrafficStamp *)&au8Packet[au16HeaderLength[eProtocol]];
+    psStamp->u32Magic    = htonl(TRAFFIC_MAGIC);
+    psStamp->u32Sequence = htonl(u32Sequence);
+    psStamp->u64SentUs   = u64ClockNowUs();
+    for (i = au16HeaderLength[eProtocol] + sizeof(tsTrafficStamp); i < u16Length; i++)
+    {
+        au8Packet[i] = i;
+    }
+    
+    switch (eProtocol)
+    {
+        case E_TRAFFIC_UDP:
+        {
+            struct udphdr *psUDP = (struct udphdr *)pu8L4;
+            
+            psHeader->ip6_nxt = IPPROTO_UDP;
+            psUDP->uh_sport = htons(TRAFFIC_BASE_PORT + u32Flow);
+            psUDP->uh_dport = htons(TRAFFIC_DEST_PORT);
+            psUDP->uh_ulen  = htons(u16Payload);
+            psUDP->uh_sum   = htons(u16IPv6Checksum(&psHeader->ip6_src, &psHeader->ip6_dst, IPPROTO_UDP, pu8L4, u16Payload));
+            break;
+        }
+        
+        case E_TRAFFIC_ICMP:
+        {
+            struct icmp6_hdr *psICMP = (struct icmp6_hdr *)pu8L4;
+            
+            psHeader->ip6_nxt = IPPROTO_ICMPV6;
+            psICMP->icmp6_type  = ICMP6_ECHO_REQUEST;
+            psICMP->icmp6_id    = htons(u32Flow);
+            psICMP->icmp6_seq   = htons(u32Sequence & 0xFFFF);
+            psICMP->icmp6_cksum = htons(u16IPv6Checksum(&psHeader->ip6_src, &psHeader->ip6_dst, IPPROTO_ICMPV6, pu8L4, u16Payload));
+            break;
+        }
+        
+        case E_TRAFFIC_TCP:
+        default:
+        {
+            struct tcphdr *psTCP = (struct tcphdr *)pu8L4;
+            
+            psHeader->ip6_nxt = IPPROTO_TCP;
+            psTCP->th_sport = htons(TRAFFIC_BASE_PORT + u32Flow);
+            psTCP->th_dport = htons(TRAFFIC_DEST_PORT);
+            psTCP->th_seq   = htonl(u32Sequence);
+            psTCP->th_off   = sizeof(struct tcphdr) / 4;
+            psTCP->th_flags = TH_ACK | TH_PUSH;
+            psTCP->th_win   = htons(65535);
+            psTCP->th_sum   = htons(u16IPv6Checksum(&psHeader->ip6_src, &psHeader->ip6_dst, IPPROTO_TCP, pu8L4, u16Payload));
+            break;
+        }
+    }
+    
+    if (send(sTraffic.iFd, au8Packet, u16Length, 0) != u16Length)
+    {
+        sResult.u64SendErrors++;
+        return;
+    }
+    sResult.au64Sent[eProtocol]++;
+    sResult.u64SentBytes += u16Length;
+}
+
+
+/** Read and account for everything that has come back */
+static void vReceivePackets(void)
+{
+    uint8_t au8Packet[IPV6_MIN_MTU + 1];
+    ssize_t iLength;
+    
+    while ((iLength = recv(sTraffic.iFd, au8Packet, sizeof(au8Packet), 0)) > 0)
+    {
+        uint64_t u64Now = u64ClockNowUs();
+        const tsTrafficStamp *psStamp;
+        uint32_t u32Offset, u32Sequence;
+        uint8_t u8Protocol;
+        int iProtocol;
+        
+        u8Protocol = u8IPv6UpperLayer(au8Packet, iLength, &u32Offset);
+        switch (u8Protocol)
+        {
+            case IPPROTO_UDP:       iProtocol = E_TRAFFIC_UDP;  u32Offset += sizeof(struct udphdr);     break;
+            case IPPROTO_ICMPV6:    iProtocol = E_TRAFFIC_ICMP; u32Offset += sizeof(struct icmp6_hdr);  break;
+            case IPPROTO_TCP:       iProtocol = E_TRAFFIC_TCP;  u32Offset += sizeof(struct tcphdr);     break;
+            default:                iProtocol = -1;                                                     break;
+        }
+        
+        psStamp = (const tsTrafficStamp *)&au8Packet[u32Offset];
+        if ((iProtocol < 0) || (iLength < u32Offset + sizeof(tsTrafficStamp)) ||
+            (ntohl(psStamp->u32Magic) != TRAFFIC_MAGIC) ||
+            ((iProtocol == E_TRAFFIC_ICMP) && (au8Packet[u32Offset - sizeof(struct icmp6_hdr)] != ICMP6_ECHO_REPLY)))
+        {
+            sResult.u64Other++;
+            continue;
+        }
+        
+        u32Sequence = ntohl(psStamp->u32Sequence);
+        if ((u32Sequence >= u32MaxPackets) || (pu8Answered[u32Sequence / 8] & (1 << (u32Sequence % 8))))
+        {
+            sResult.u64Duplicates++;
+            continue;
+        }
+        pu8Answered[u32Sequence / 8] |= 1 << (u32Sequence % 8);
+        
+        sResult.au64Received[iProtocol]++;
+        sResult.u64ReceivedBytes += iLength;
+        sResult.u64LastReceivedUs = u64Now;
+        vHistogramRecord(&sRTT, u64Now - psStamp->u64SentUs);
+    }
+}
+
+
+static void vQuitSignalHandler(int sig)
+{
+    bRunning = 0;
+}
+
+
+static void print_usage_exit(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "  Options:\n");
+    fprintf(stderr, "    -h --help                  Print this help.\n");
+    fprintf(stderr, "    -e --endpoint <endpoint>   Daemon endpoint, udp:[<address>:]<port> or unix:<path>. Default %s.\n", TRAFFIC_DEFAULT_ENDPOINT);
+    fprintf(stderr, "    -a --source <address>      Source address of the packets. Default %s.\n", TRAFFIC_DEFAULT_SOURCE);
+    fprintf(stderr, "    -d --destination <list>    Comma separated destination addresses. Default %s.\n", TRAFFIC_DEFAULT_DESTINATION);
+    fprintf(stderr, "    -r --rate <packets/s>      Packets sent per second. Default %d.\n", TRAFFIC_DEFAULT_RATE);
+    fprintf(stderr, "    -l --length <list>         Packet lengths, <length>[-<length>][:<weight>],... Default 64.\n");
+    fprintf(stderr, "    -p --protocol <list>       Protocol mix, <udp|icmp|tcp>[:<weight>],... Default udp.\n");
+    fprintf(stderr, "    -f --flows <count>         Number of flows (source ports or echo identifiers). Default 1.\n");
+    fprintf(stderr, "    -t --time <seconds>        Time to send for. Default %d.\n", TRAFFIC_DEFAULT_TIME);
+    fprintf(stderr, "    -w --wait <ms>             Time to wait for answers after sending. Default %d.\n", TRAFFIC_DEFAULT_WAIT_MS);
+    fprintf(stderr, "    -o --histogram <file>      Write the round trip time distribution (milliseconds) in HdrHistogram format.\n");
+    fprintf(stderr, "    -s --seed <seed>           Random seed. Default 1.\n");
+    exit(EXIT_FAILURE);
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+    const char *pcEndpoint = TRAFFIC_DEFAULT_ENDPOINT;
+    const char *pcHistogramFile = NULL;
+    char acDefaultLengths[] = "64";
+    char acDefaultProtocols[] = "udp";
+    char acDefaultDestination[] = TRAFFIC_DEFAULT_DESTINATION;
+    uint32_t u32Time = TRAFFIC_DEFAULT_TIME;
+    uint32_t u32WaitMs = TRAFFIC_DEFAULT_WAIT_MS;
+    uint64_t u64Start, u64Next, u64End, u64Elapsed;
+    uint64_t u64Sent = 0, u64Received = 0;
+    uint32_t u32Sequence = 0;
+    int i;
+    
+    inet_pton(AF_INET6, TRAFFIC_DEFAULT_SOURCE, &sTraffic.sSource);
+    iParseLengths(acDefaultLengths);
+    iParseProtocols(acDefaultProtocols);
+    iParseDestinations(acDefaultDestination);
+    sTraffic.u32Flows = 1;
+    sTraffic.u32Rate  = TRAFFIC_DEFAULT_RATE;
+    
+    {
+        static struct option long_options[] =
+        {
+            /* Program options */
+            {"help",                    no_argument,        NULL, 'h'},
+            {"endpoint",                required_argument,  NULL, 'e'},
+            {"source",                  required_argument,  NULL, 'a'},
+            {"destination",             required_argument,  NULL, 'd'},
+            {"rate",                    required_argument,  NULL, 'r'},
+            {"length",                  required_argument,  NULL, 'l'},
+            {"protocol",                required_argument,  NULL, 'p'},
+            {"flows",                   required_argument,  NULL, 'f'},
+            {"time",                    required_argument,  NULL, 't'},
+            {"wait",                    required_argument,  NULL, 'w'},
+            {"histogram",               required_argument,  NULL, 'o'},
+            {"seed",                    required_argument,  NULL, 's'},
+            { NULL, 0, NULL, 0}
+        };
+        signed char opt;
+        int option_index;
+        
+        while ((opt = getopt_long(argc, argv, "he:a:d:r:l:p:f:t:w:o:s:", long_options, &option_index)) != -1) 
+        {
+            switch (opt) 
+            {
+                case 'e':
+                    pcEndpoint = optarg;
+                    break;
+                case 'a':
+                    if (inet_pton(AF_INET6, optarg, &sTraffic.sSource) != 1)
+                    {
+                        fprintf(stderr, "Invalid source address \"%s\"\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    break;
+                case 'd':
+                    if (iParseDestinations(optarg) < 0)
+                    {
+                        fprintf(stderr, "Invalid destinations \"%s\"\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    break;
+                case 'r':
+                    sTraffic.u32Rate = strtoul(optarg, NULL, 10);
+                    break;
+                case 'l':
+                    if (iParseLengths(optarg) < 0)
+                    {
+                        fprintf(stderr, "Invalid lengths \"%s\"\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    break;
+                case 'p':
+                    if (iParseProtocols(optarg) < 0)
+                    {
+                        fprintf(stderr, "Invalid protocols \"%s\"\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    break;
+                case 'f':
+                    sTraffic.u32Flows = strtoul(optarg, NULL, 10);
+                    break;
+                case 't':
+                    u32Time = strtoul(optarg, NULL, 10);
+                    break;
+                case 'w':
+                    u32WaitMs = strtoul(optarg, NULL, 10);
+                    break;
+                case 'o':
+                    pcHistogramFile = optarg;
+                    break;
+                case 's':
+                    u64RandomState = strtoull(optarg, NULL, 0);
+                    if (u64RandomState == 0)
+                    {
+                        u64RandomState = 1;
+                    }
+                    break;
+                case 'h':
+                default: /* '?' */
+                    print_usage_exit(argv);
+            }
+        }
+    }
+    
+    if ((sTraffic.u32Rate == 0) || (sTraffic.u32Flows == 0) || (sTraffic.u32Flows > TRAFFIC_MAX_FLOWS))
+    {
+        print_usage_exit(argv);
+    }
+    
+    if (iOpenEndpoint(pcEndpoint) < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    
+    u32MaxPackets = (uint64_t)sTraffic.u32Rate * u32Time + 1;
+    pu8Answered = calloc(u32MaxPackets / 8 + 1, 1);
+    if (!pu8Answered)
+    {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    vHistogramReset(&sRTT);
+    
+    signal(SIGINT,  vQuitSignalHandler);
+    signal(SIGTERM, vQuitSignalHandler);
+    
+    u64Start = u64Next = sResult.u64FirstSentUs = u64ClockNowUs();
+    u64End = u64Start + (uint64_t)u32Time * 1000000ULL;
+    
+    while (bRunning)
+    {
+        uint64_t u64Now = u64ClockNowUs();
+        struct pollfd sPoll = { sTraffic.iFd, POLLIN, 0 };
+        uint64_t u64Wake;
+        
+        /* Catch up if the clock has run on, sending on the schedule rather than late */
+        while ((u64Now >= u64Next) && (u64Next < u64End) && (u32Sequence < u32MaxPackets))
+        {
+            vSendPacket(u32Sequence++);
+            u64Next = u64Start + (u32Sequence * 1000000ULL) / sTraffic.u32Rate;
+        }
+        
+        if ((u64Next >= u64End) || (u32Sequence >= u32MaxPackets))
+        {
+            u64Wake = u64End + u32WaitMs * 1000ULL;
+            if (u64Now >= u64Wake)
+            {
+                break;
+            }
+        }
+        else
+        {
+            u64Wake = u64Next;
+        }
+        
+        if (poll(&sPoll, 1, u64Wake > u64Now ? (int)((u64Wake - u64Now + 999) / 1000) : 0) > 0)
+        {
+            vReceivePackets();
+        }
+    }
+    vReceivePackets();
+    
+    close(sTraffic.iFd);
+    if (sTraffic.acLocalPath[0])
+    {
+        unlink(sTraffic.acLocalPath);
+    }
+    
+    for (i = 0; i < E_TRAFFIC_PROTOCOLS; i++)
+    {
+        u64Sent     += sResult.au64Sent[i];
+        u64Received += sResult.au64Received[i];
+    }
+    u64Elapsed = (sResult.u64LastReceivedUs > u64Start) ? sResult.u64LastReceivedUs - u64Start : 1;
+    
+    printf("endpoint=%s rate=%u flows=%u sent=%llu received=%llu lost=%llu loss=%.4f send_errors=%llu duplicates=%llu other=%llu "
+           "sent_udp=%llu sent_icmp=%llu sent_tcp=%llu received_udp=%llu received_icmp=%llu received_tcp=%llu "
+           "throughput_pps=%.1f throughput_kbps=%.1f "
+           "rtt_min_ms=%.3f rtt_mean_ms=%.3f rtt_p50_ms=%.3f rtt_p90_ms=%.3f rtt_p99_ms=%.3f rtt_p999_ms=%.3f rtt_max_ms=%.3f\n",
+           pcEndpoint, sTraffic.u32Rate, sTraffic.u32Flows,
+           (unsigned long long)u64Sent, (unsigned long long)u64Received,
+           (unsigned long long)(u64Sent - u64Received),
+           u64Sent ? (double)(u64Sent - u64Received) / u64Sent : 0.0,
+           (unsigned long long)sResult.u64SendErrors,
+           (unsigned long long)sResult.u64Duplicates,
+           (unsigned long long)sResult.u64Other,
+           (unsigned long long)sResult.au64Sent[E_TRAFFIC_UDP],
+           (unsigned long long)sResult.au64Sent[E_TRAFFIC_ICMP],
+           (unsigned long long)sResult.au64Sent[E_TRAFFIC_TCP],
+           (unsigned long long)sResult.au64Received[E_TRAFFIC_UDP],
+           (unsigned long long)sResult.au64Received[E_TRAFFIC_ICMP],
+           (unsigned long long)sResult.au64Received[E_TRAFFIC_TCP],
+           (double)u64Received * 1e6 / u64Elapsed,
+           (double)sResult.u64ReceivedBytes * 8e3 / u64Elapsed,
+           sRTT.u64Count ? sRTT.u64Min / 1000.0 : 0.0,
+           sRTT.u64Count ? (double)sRTT.u64Sum / sRTT.u64Count / 1000.0 : 0.0,
+           u64HistogramPercentile(&sRTT, 50.0) / 1000.0,
+           u64HistogramPercentile(&sRTT, 90.0) / 1000.0,
+           u64HistogramPercentile(&sRTT, 99.0) / 1000.0,
+           u64HistogramPercentile(&sRTT, 99.9) / 1000.0,
+           sRTT.u64Max / 1000.0);
+    
+    if (pcHistogramFile)
+    {
+        FILE *psFile = fopen(pcHistogramFile, "w");
+        
+        if (!psFile || (iHistogramWrite(&sRTT, psFile, 1000.0) < 0) || (fclose(psFile) != 0))
+        {
+            perror(pcHistogramFile);
+            return EXIT_FAILURE;
+        }
+    }
+    
+    free(pu8Answered);
+    return EXIT_SUCCESS;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
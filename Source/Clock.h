@@ -0,0 +1,87 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Monotonic clock
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+#ifndef  CLOCK_H_INCLUDED
+#define  CLOCK_H_INCLUDED
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Read the monotonic clock.
+ *  Used for all packet path timing, so that wall clock changes
+ *  do not disturb rate limiting or timeouts.
+ *  \return Microseconds since an arbitrary fixed point
+ */
+static inline uint64_t u64ClockNowUs(void)
+{
+    struct timespec sTime;
+    
+    clock_gettime(CLOCK_MONOTONIC, &sTime);
+    return ((uint64_t)sTime.tv_sec * 1000000ULL) + ((uint64_t)sTime.tv_nsec / 1000);
+}
+
+
+/** Read the monotonic clock with full resolution, for timing short
+ *  stages of the packet path.
+ *  \return Nanoseconds since the same fixed point as u64ClockNowUs
+ */
+static inline uint64_t u64ClockNowNs(void)
+{
+    struct timespec sTime;
+    
+    clock_gettime(CLOCK_MONOTONIC, &sTime);
+    return ((uint64_t)sTime.tv_sec * 1000000000ULL) + (uint64_t)sTime.tv_nsec;
+}
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* CLOCK_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
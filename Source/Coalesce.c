@@ -0,0 +1,560 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Request coalescing
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+/* When several dashboards refresh at once, the same query reaches the same
+ * node from several clients within a few milliseconds. Only the first of a
+ * set of identical JIP or CoAP GET requests is sent into the mesh. Later
+ * ones are held back, and each client is sent a copy of the response with
+ * its own address, port and request identifier.
+ *
+ * Requests are identical if they go to the same node and port and carry the
+ * same message apart from the identifier a client uses to match responses:
+ * the JIP handle, or the CoAP message ID and token. CoAP requests only match
+ * if their tokens are the same length, so responses can be rewritten in
+ * place. Observe requests are never coalesced. Separate CoAP responses are
+ * passed on to waiting clients as non-confirmable, since only the first
+ * client's acknowledgement can reach the node.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+
+#include <libdaemon/daemon.h>
+
+#include "Coalesce.h"
+#include "IPv6.h"
+#include "JIPCache.h"
+#include "TunDevice.h"
+#include "NodeTable.h"
+#include "Shaper.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/* JIP commands */
+#define JIP_COMMAND_GET_REQUEST     0x10
+#define JIP_COMMAND_GET_RESPONSE    0x11
+
+/* CoAP header fields */
+#define COAP_VERSION                1
+#define COAP_TYPE_CON               0
+#define COAP_TYPE_NON               1
+#define COAP_TYPE_ACK               2
+#define COAP_CODE_EMPTY             0x00
+#define COAP_CODE_GET               0x01
+#define COAP_OPTION_OBSERVE         6
+#define COAP_PAYLOAD_MARKER         0xFF
+#define COAP_MAX_TOKEN              8
+
+/* Number of requests tracked (must be a power of 2) */
+#define COALESCE_SLOTS              64
+
+/* Longest request message, less the identifier, that is coalesced */
+#define COALESCE_MAX_KEY            128
+
+/* Longest identifier: CoAP message ID and token */
+#define COALESCE_MAX_ID             (2 + COAP_MAX_TOKEN)
+
+/* Largest response that is copied to waiting clients */
+#define COALESCE_MAX_RESPONSE       2048
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** A client and the identifier of its request */
+typedef struct
+{
+    struct in6_addr sAddress;
+    uint16_t        u16Port;
+    uint8_t         au8Id[COALESCE_MAX_ID];
+} tsCoalesceClient;
+
+
+/** A request in flight */
+typedef struct
+{
+    uint64_t        u64Sent;            /**< 0 if the slot is unused */
+    int             iAnswered;          /**< A response has been seen */
+    struct in6_addr sNode;
+    uint16_t        u16Port;            /**< JIP_PORT or COAP_PORT */
+    uint8_t         u8IdLength;
+    uint16_t        u16KeyLength;
+    uint8_t         au8Key[COALESCE_MAX_KEY];
+    tsCoalesceClient sOrigin;           /**< Client whose request was forwarded */
+    uint32_t        u32NumWaiters;
+    tsCoalesceClient asWaiters[COALESCE_MAX_WAITERS];
+} tsCoalesceRequest;
+
+
+/** Location of a UDP message within an IPv6 packet */
+typedef struct
+{
+    const struct ip6_hdr   *psHeader;
+    uint32_t                u32UDPOffset;
+    uint16_t                u16SourcePort;
+    uint16_t                u16DestPort;
+    const uint8_t          *pu8Message;
+    uint32_t                u32Length;
+} tsCoalesceMessage;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+int                 iCoalesceEnabled = 1;
+
+tsCoalesceStats     sCoalesceStats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static tsCoalesceRequest asRequests[COALESCE_SLOTS];
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/** FNV-1a hash */
+static uint32_t u32CoalesceHash(uint32_t u32Hash, const uint8_t *pu8Data, uint32_t u32Length)
+{
+    uint32_t i;
+    
+    for (i = 0; i < u32Length; i++)
+    {
+        u32Hash = (u32Hash ^ pu8Data[i]) * 16777619;
+    }
+    return u32Hash;
+}
+
+
+/** Find the JIP or CoAP message in a packet.
+ *  \return 0 if the packet is a UDP packet to or from one of the ports
+ */
+static int iCoalesceParse(const uint8_t *pu8Packet, uint32_t u32Length, tsCoalesceMessage *psMessage)
+{
+    const struct udphdr *psUDP;
+    uint32_t u32Offset;
+    uint32_t u32UDPLength;
+    
+    if ((u32Length < IPV6_HEADER_LENGTH) ||
+        (u8IPv6UpperLayer(pu8Packet, u32Length, &u32Offset) != IPPROTO_UDP) ||
+        (u32Offset + sizeof(struct udphdr) > u32Length))
+    {
+        return -1;
+    }
+    
+    psUDP = (const struct udphdr *)&pu8Packet[u32Offset];
+    u32UDPLength = ntohs(psUDP->uh_ulen);
+    if ((u32UDPLength < sizeof(struct udphdr)) || (u32Offset + u32UDPLength > u32Length))
+    {
+        return -1;
+    }
+    
+    psMessage->psHeader         = (const struct ip6_hdr *)pu8Packet;
+    psMessage->u32UDPOffset     = u32Offset;
+    psMessage->u16SourcePort    = ntohs(psUDP->uh_sport);
+    psMessage->u16DestPort      = ntohs(psUDP->uh_dport);
+    psMessage->pu8Message       = &pu8Packet[u32Offset + sizeof(struct udphdr)];
+    psMessage->u32Length        = u32UDPLength - sizeof(struct udphdr);
+    return 0;
+}
+
+
+/** Read the extended form of a CoAP option delta or length.
+ *  \return 0 if the value was complete
+ */
+static int iCoalesceCoAPExtended(const uint8_t *pu8Options, uint32_t u32Length, uint32_t *pu32Offset, uint32_t *pu32Value)
+{
+    if (*pu32Value == 13)
+    {
+        if (*pu32Offset + 1 > u32Length)
+        {
+            return -1;
+        }
+        *pu32Value = 13 + pu8Options[*pu32Offset];
+        *pu32Offset += 1;
+    }
+    else if (*pu32Value == 14)
+    {
+        if (*pu32Offset + 2 > u32Length)
+        {
+            return -1;
+        }
+        *pu32Value = 269 + ((pu8Options[*pu32Offset] << 8) | pu8Options[*pu32Offset + 1]);
+        *pu32Offset += 2;
+    }
+    else if (*pu32Value == 15)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+
+/** Check that CoAP options are well formed and do not include Observe.
+ *  \return 0 if the request may be coalesced
+ */
+static int iCoalesceCoAPOptions(const uint8_t *pu8Options, uint32_t u32Length)
+{
+    uint32_t u32Offset = 0;
+    uint32_t u32Option = 0;
+    
+    while ((u32Offset < u32Length) && (pu8Options[u32Offset] != COAP_PAYLOAD_MARKER))
+    {
+        uint32_t u32Delta  = pu8Options[u32Offset] >> 4;
+        uint32_t u32OptLen = pu8Options[u32Offset] & 0x0F;
+        
+        u32Offset++;
+        if ((iCoalesceCoAPExtended(pu8Options, u32Length, &u32Offset, &u32Delta) < 0) ||
+            (iCoalesceCoAPExtended(pu8Options, u32Length, &u32Offset, &u32OptLen) < 0))
+        {
+            return -1;
+        }
+        
+        u32Option += u32Delta;
+        if (u32Option == COAP_OPTION_OBSERVE)
+        {
+            return -1;
+        }
+        u32Offset += u32OptLen;
+    }
+    return (u32Offset <= u32Length) ? 0 : -1;
+}
+
+
+/** Split a request into the part identifying the client's request and the
+ *  part that must match other requests.
+ *  \return 0 if the request may be coalesced
+ */
+static int iCoalesceSplitRequest(const tsCoalesceMessage *psMessage, tsCoalesceRequest *psRequest, tsCoalesceClient *psClient)
+{
+    const uint8_t *pu8Message = psMessage->pu8Message;
+    uint32_t u32Length = psMessage->u32Length;
+    uint32_t u32Body;
+    
+    memset(psClient, 0, sizeof(tsCoalesceClient));
+    
+    if (psMessage->u16DestPort == JIP_PORT)
+    {
+        /* Version, command, handle */
+        if ((u32Length < 3) || (pu8Message[1] != JIP_COMMAND_GET_REQUEST))
+        {
+            return -1;
+        }
+        psRequest->u8IdLength = 1;
+        psClient->au8Id[0] = pu8Message[2];
+        psRequest->au8Key[0] = pu8Message[0];
+        psRequest->au8Key[1] = pu8Message[1];
+        u32Body = 3;
+    }
+    else if (psMessage->u16DestPort == COAP_PORT)
+    {
+        /* Version, type and token length, code, message ID, token */
+        uint32_t u32TokenLength;
+        uint32_t u32Type;
+        
+        if (u32Length < 4)
+        {
+            return -1;
+        }
+        u32TokenLength = pu8Message[0] & 0x0F;
+        u32Type        = (pu8Message[0] >> 4) & 0x03;
+        if (((pu8Message[0] >> 6) != COAP_VERSION) || (u32TokenLength > COAP_MAX_TOKEN) ||
+            ((u32Type != COAP_TYPE_CON) && (u32Type != COAP_TYPE_NON)) ||
+            (pu8Message[1] != COAP_CODE_GET) || (u32Length < 4 + u32TokenLength) ||
+            (iCoalesceCoAPOptions(&pu8Message[4 + u32TokenLength], u32Length - 4 - u32TokenLength) < 0))
+        {
+            return -1;
+        }
+        psRequest->u8IdLength = 2 + u32TokenLength;
+        memcpy(psClient->au8Id, &pu8Message[2], psRequest->u8IdLength);
+        psRequest->au8Key[0] = pu8Message[0];
+        psRequest->au8Key[1] = pu8Message[1];
+        u32Body = 4 + u32TokenLength;
+    }
+    else
+    {
+        return -1;
+    }
+    
+    if (u32Length - u32Body > COALESCE_MAX_KEY - 2)
+    {
+        return -1;
+    }
+    memcpy(&psRequest->au8Key[2], &pu8Message[u32Body], u32Length - u32Body);
+    psRequest->u16KeyLength = 2 + u32Length - u32Body;
+    
+    memcpy(&psRequest->sNode, &psMessage->psHeader->ip6_dst, sizeof(struct in6_addr));
+    psRequest->u16Port = psMessage->u16DestPort;
+    
+    memcpy(&psClient->sAddress, &psMessage->psHeader->ip6_src, sizeof(struct in6_addr));
+    psClient->u16Port = psMessage->u16SourcePort;
+    return 0;
+}
+
+
+static int iCoalesceClientMatch(const tsCoalesceClient *psClient1, const tsCoalesceClient *psClient2, uint8_t u8IdLength)
+{
+    return ((psClient1->u16Port == psClient2->u16Port) &&
+            (memcmp(&psClient1->sAddress, &psClient2->sAddress, sizeof(struct in6_addr)) == 0) &&
+            (memcmp(psClient1->au8Id, psClient2->au8Id, u8IdLength) == 0));
+}
+
+
+/** Check whether a response answers the forwarded request */
+static int iCoalesceResponseMatch(const tsCoalesceRequest *psRequest, const tsCoalesceMessage *psMessage)
+{
+    const uint8_t *pu8Message = psMessage->pu8Message;
+    
+    if ((psRequest->u16Port != psMessage->u16SourcePort) ||
+        (psRequest->sOrigin.u16Port != psMessage->u16DestPort) ||
+        (memcmp(&psRequest->sNode, &psMessage->psHeader->ip6_src, sizeof(struct in6_addr)) != 0) ||
+        (memcmp(&psRequest->sOrigin.sAddress, &psMessage->psHeader->ip6_dst, sizeof(struct in6_addr)) != 0))
+    {
+        return 0;
+    }
+    
+    if (psRequest->u16Port == JIP_PORT)
+    {
+        return ((psMessage->u32Length >= 3) &&
+                (pu8Message[1] == JIP_COMMAND_GET_RESPONSE) &&
+                (pu8Message[2] == psRequest->sOrigin.au8Id[0]));
+    }
+    
+    if ((psMessage->u32Length < 4) || ((pu8Message[0] >> 6) != COAP_VERSION))
+    {
+        return 0;
+    }
+    if ((((pu8Message[0] >> 4) & 0x03) == COAP_TYPE_ACK) &&
+        (memcmp(&pu8Message[2], psRequest->sOrigin.au8Id, 2) != 0))
+    {
+        /* Acknowledgement of some other message */
+        return 0;
+    }
+    if (pu8Message[1] == COAP_CODE_EMPTY)
+    {
+        /* Empty acknowledgement, the response will follow separately */
+        return ((pu8Message[0] >> 4) & 0x03) == COAP_TYPE_ACK;
+    }
+    return (((pu8Message[0] & 0x0F) == psRequest->u8IdLength - 2) &&
+            (psMessage->u32Length >= psRequest->u8IdLength + 2) &&
+            (memcmp(&pu8Message[4], &psRequest->sOrigin.au8Id[2], psRequest->u8IdLength - 2) == 0));
+}
+
+
+/** Write a copy of a response to a waiting client */
+static void vCoalesceSend(const tsCoalesceRequest *psRequest, const tsCoalesceMessage *psMessage,
+                          const tsCoalesceClient *psClient, const uint8_t *pu8Packet, uint32_t u32Length)
+{
+    uint8_t au8Buffer[COALESCE_MAX_RESPONSE];
+    struct ip6_hdr *psHeader = (struct ip6_hdr *)au8Buffer;
+    struct udphdr *psUDP = (struct udphdr *)&au8Buffer[psMessage->u32UDPOffset];
+    uint8_t *pu8Message = &au8Buffer[psMessage->u32UDPOffset + sizeof(struct udphdr)];
+    uint16_t u16UDPLength = sizeof(struct udphdr) + psMessage->u32Length;
+    
+    memcpy(au8Buffer, pu8Packet, u32Length);
+    memcpy(&psHeader->ip6_dst, &psClient->sAddress, sizeof(struct in6_addr));
+    psUDP->uh_dport = htons(psClient->u16Port);
+    
+    if (psRequest->u16Port == JIP_PORT)
+    {
+        pu8Message[2] = psClient->au8Id[0];
+    }
+    else if (((pu8Message[0] >> 4) & 0x03) == COAP_TYPE_ACK)
+    {
+        memcpy(&pu8Message[2], psClient->au8Id, 2);
+        if (pu8Message[1] != COAP_CODE_EMPTY)
+        {
+            memcpy(&pu8Message[4], &psClient->au8Id[2], psRequest->u8IdLength - 2);
+        }
+    }
+    else
+    {
+        /* Separate response, the client cannot acknowledge it to the node */
+        pu8Message[0] = (pu8Message[0] & ~0x30) | (COAP_TYPE_NON << 4);
+        memcpy(&pu8Message[4], &psClient->au8Id[2], psRequest->u8IdLength - 2);
+    }
+    
+    psUDP->uh_sum = 0;
+    psUDP->uh_sum = htons(u16IPv6Checksum(&psHeader->ip6_src, &psHeader->ip6_dst, IPPROTO_UDP,
+                                          (uint8_t *)psUDP, u16UDPLength));
+    if (psUDP->uh_sum == 0)
+    {
+        psUDP->uh_sum = 0xFFFF;
+    }
+    
+    if (eTunDeviceWritePacket(u32Length, au8Buffer) != E_TUN_OK)
+    {
+        daemon_log(LOG_ERR, "Error writing coalesced response to tun device");
+        return;
+    }
+    sCoalesceStats.u64FannedOut++;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+bool bCoalesceRequest(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length)
+{
+    tsCoalesceRequest sRequest;
+    tsCoalesceMessage sMessage;
+    tsCoalesceClient sClient;
+    tsCoalesceRequest *psRequest;
+    uint32_t u32Hash;
+    uint32_t i;
+    
+    if (!iCoalesceEnabled ||
+        (iCoalesceParse(pu8Packet, u32Length, &sMessage) < 0) ||
+        IN6_IS_ADDR_MULTICAST(&sMessage.psHeader->ip6_dst) ||
+        (iCoalesceSplitRequest(&sMessage, &sRequest, &sClient) < 0))
+    {
+        return FALSE;
+    }
+    
+    u32Hash = u32CoalesceHash(2166136261u, sRequest.sNode.s6_addr, sizeof(struct in6_addr));
+    u32Hash = u32CoalesceHash(u32Hash, (const uint8_t *)&sRequest.u16Port, sizeof(uint16_t));
+    u32Hash = u32CoalesceHash(u32Hash, sRequest.au8Key, sRequest.u16KeyLength);
+    psRequest = &asRequests[u32Hash & (COALESCE_SLOTS - 1)];
+    
+    if (psRequest->u64Sent && !psRequest->iAnswered &&
+        ((u64Now - psRequest->u64Sent) < COALESCE_WINDOW_US) &&
+        (psRequest->u16Port == sRequest.u16Port) &&
+        (psRequest->u8IdLength == sRequest.u8IdLength) &&
+        (psRequest->u16KeyLength == sRequest.u16KeyLength) &&
+        (memcmp(&psRequest->sNode, &sRequest.sNode, sizeof(struct in6_addr)) == 0) &&
+        (memcmp(psRequest->au8Key, sRequest.au8Key, sRequest.u16KeyLength) == 0))
+    {
+        if (iCoalesceClientMatch(&psRequest->sOrigin, &sClient, psRequest->u8IdLength))
+        {
+            /* The client that was forwarded is retrying, pass it on in case the request was lost */
+            return FALSE;
+        }
+        for (i = 0; i < psRequest->u32NumWaiters; i++)
+        {
+            if (iCoalesceClientMatch(&psRequest->asWaiters[i], &sClient, psRequest->u8IdLength))
+            {
+                sCoalesceStats.u64Retransmissions++;
+                return TRUE;
+            }
+        }
+        if (psRequest->u32NumWaiters == COALESCE_MAX_WAITERS)
+        {
+            sCoalesceStats.u64WaitersFull++;
+            return FALSE;
+        }
+        memcpy(&psRequest->asWaiters[psRequest->u32NumWaiters++], &sClient, sizeof(tsCoalesceClient));
+        sCoalesceStats.u64Coalesced++;
+        sCoalesceStats.u64AirtimeSavedUs += u32ShaperAirtime(u32Length, u8NodeTableHops(&sRequest.sNode));
+        return TRUE;
+    }
+    
+    if (psRequest->u64Sent && !psRequest->iAnswered && psRequest->u32NumWaiters &&
+        ((u64Now - psRequest->u64Sent) < COALESCE_WINDOW_US))
+    {
+        /* Slot taken by a different request with clients waiting on it */
+        return FALSE;
+    }
+    
+    /* First of its kind, or the previous one has been answered. Forward and remember it */
+    memcpy(psRequest, &sRequest, sizeof(tsCoalesceRequest));
+    memcpy(&psRequest->sOrigin, &sClient, sizeof(tsCoalesceClient));
+    psRequest->u64Sent          = u64Now;
+    psRequest->iAnswered        = 0;
+    psRequest->u32NumWaiters    = 0;
+    sCoalesceStats.u64Tracked++;
+    return FALSE;
+}
+
+
+void vCoalesceResponse(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length)
+{
+    tsCoalesceMessage sMessage;
+    uint32_t i, j;
+    
+    if (!iCoalesceEnabled || (u32Length > COALESCE_MAX_RESPONSE) ||
+        (iCoalesceParse(pu8Packet, u32Length, &sMessage) < 0) ||
+        ((sMessage.u16SourcePort != JIP_PORT) && (sMessage.u16SourcePort != COAP_PORT)))
+    {
+        return;
+    }
+    
+    for (i = 0; i < COALESCE_SLOTS; i++)
+    {
+        tsCoalesceRequest *psRequest = &asRequests[i];
+        
+        if (!psRequest->u64Sent || ((u64Now - psRequest->u64Sent) >= COALESCE_WINDOW_US) ||
+            !iCoalesceResponseMatch(psRequest, &sMessage))
+        {
+            continue;
+        }
+        
+        for (j = 0; j < psRequest->u32NumWaiters; j++)
+        {
+            vCoalesceSend(psRequest, &sMessage, &psRequest->asWaiters[j], pu8Packet, u32Length);
+        }
+        if (psRequest->u32NumWaiters)
+        {
+            sCoalesceStats.u64AirtimeSavedUs += psRequest->u32NumWaiters *
+                u32ShaperAirtime(u32Length, u8NodeTableHops(&psRequest->sNode));
+        }
+        
+        if ((psRequest->u16Port != COAP_PORT) || (sMessage.pu8Message[1] != COAP_CODE_EMPTY))
+        {
+            /* Later requests must be sent again. Further JIP response packets are still passed on */
+            psRequest->iAnswered = 1;
+        }
+        return;
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
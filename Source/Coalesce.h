@@ -0,0 +1,133 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Request coalescing
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+#ifndef  COALESCE_H_INCLUDED
+#define  COALESCE_H_INCLUDED
+
+#include <stdint.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** UDP port used by CoAP */
+#define COAP_PORT                           5683
+
+/** Time a request is considered in flight, microseconds */
+#define COALESCE_WINDOW_US                  5000000
+
+/** Maximum number of clients waiting on one request */
+#define COALESCE_MAX_WAITERS                8
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** Request coalescing statistics */
+typedef struct
+{
+    uint64_t    u64Tracked;             /**< Requests forwarded and tracked */
+    uint64_t    u64Coalesced;           /**< Duplicate requests absorbed */
+    uint64_t    u64Retransmissions;     /**< Repeats from a client already waiting */
+    uint64_t    u64WaitersFull;         /**< Duplicates forwarded as there was no room to wait */
+    uint64_t    u64FannedOut;           /**< Copies of responses sent to waiting clients */
+    uint64_t    u64AirtimeSavedUs;      /**< Estimated radio airtime saved */
+} tsCoalesceStats;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Flag that coalescing is enabled */
+extern int              iCoalesceEnabled;
+
+
+/** Request coalescing statistics */
+extern tsCoalesceStats  sCoalesceStats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Examine a packet read from the tun device. A JIP or CoAP GET request
+ *  identical to one already in flight to the same node is held back, and
+ *  the client is sent a copy of the response when it arrives.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    IPv6 packet
+ *  \param u32Length    Length of the packet
+ *  \return TRUE if the request has been absorbed and should not be
+ *          forwarded to the module
+ */
+bool bCoalesceRequest(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length);
+
+
+/** Examine a packet received from the mesh, and if it is the response to
+ *  a coalesced request write a copy to the tun device for each client
+ *  waiting on it.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    IPv6 packet
+ *  \param u32Length    Length of the packet
+ */
+void vCoalesceResponse(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* COALESCE_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
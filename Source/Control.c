@@ -0,0 +1,1076 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Control socket
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+/* Operators and monitoring systems talk to the running daemon through a
+ * UNIX stream socket, one command per line. Each response ends with an
+ * empty line, and starts with "error:" if the command failed. Metrics can
+ * also be served over HTTP in the Prometheus text format, for scrapers
+ * that cannot reach a UNIX socket. HTTP connections have slots of their
+ * own and are closed once idle, so scrapers cannot lock operators out.
+ *
+ * Network settings changed with "set" take effect with "reconfigure",
+ * which writes them to the module through the same states as the start up
+ * handshake, so several can be changed at once without restarting the
+ * daemon or losing the tun device.
+ *
+ * Everything here runs in the main loop, between packets, so commands see
+ * and change the daemon's state without any locking. Connections are non
+ * blocking, and a command is only read once the response to the previous
+ * one has been sent, so a slow client never holds up the packet path.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <libdaemon/daemon.h>
+
+#include "Control.h"
+#include "Metrics.h"
+#include "JennicModule.h"
+#include "NodeTable.h"
+#include "Clock.h"
+#include "IPv6.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define CONTROL_SLOTS               (CONTROL_MAX_CLIENTS + CONTROL_MAX_HTTP_CLIENTS)
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** Protocol spoken on a connection */
+typedef enum
+{
+    E_CONTROL_LINE,                     /**< Control socket, one command per line */
+    E_CONTROL_HTTP,                     /**< HTTP/1.x, one request per connection */
+} teControlProtocol;
+
+
+/** A connected client */
+typedef struct
+{
+    int                 iSocket;        /**< -1 if the slot is unused */
+    teControlProtocol   eProtocol;
+    char                acRequest[CONTROL_MAX_REQUEST];
+    uint32_t            u32RequestLength;
+    char               *pcResponse;     /**< Response being sent, NULL if none */
+    size_t              szResponseLength;
+    size_t              szResponseSent;
+    bool                bClose;         /**< Disconnect once the response is sent */
+    uint64_t            u64LastActivity;/**< When data last moved in either direction */
+} tsControlClient;
+
+
+/** A control socket command */
+typedef struct
+{
+    const char         *pcName;
+    const char         *pcHelp;
+    /** Write the response to a command.
+     *  \param psFile   Where to write it
+     *  \param pcArgs   Rest of the command line, after the name and spaces
+     *  \return 0 on success, -1 if the command failed
+     */
+    int               (*prHandler)(FILE *psFile, char *pcArgs);
+} tsControlCommand;
+
+/** A network setting that can be changed with "set" */
+typedef struct
+{
+    const char         *pcName;
+    const char         *pcValues;       /**< Description of the values accepted */
+    /** Show or change the setting.
+     *  \param psFile   Where to write the value when showing it
+     *  \param pcValue  New value, or NULL to show the current one
+     *  \return 0 on success, -1 if the value is not valid
+     */
+    int               (*prSetting)(FILE *psFile, const char *pcValue);
+} tsControlSetting;
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+
+static int iControlHelp(FILE *psFile, char *pcArgs);
+static int iControlMetrics(FILE *psFile, char *pcArgs);
+static int iControlState(FILE *psFile, char *pcArgs);
+static int iControlNodes(FILE *psFile, char *pcArgs);
+static int iControlLogLevel(FILE *psFile, char *pcArgs);
+static int iControlSet(FILE *psFile, char *pcArgs);
+static int iControlReconfigure(FILE *psFile, char *pcArgs);
+static int iControlReset(FILE *psFile, char *pcArgs);
+
+static int iControlSettingMode(FILE *psFile, const char *pcValue);
+static int iControlSettingRegion(FILE *psFile, const char *pcValue);
+static int iControlSettingChannel(FILE *psFile, const char *pcValue);
+static int iControlSettingPan(FILE *psFile, const char *pcValue);
+static int iControlSettingNetwork(FILE *psFile, const char *pcValue);
+static int iControlSettingProfile(FILE *psFile, const char *pcValue);
+static int iControlSettingPrefix(FILE *psFile, const char *pcValue);
+static int iControlSettingKey(FILE *psFile, const char *pcValue);
+static int iControlSettingFrontend(FILE *psFile, const char *pcValue);
+static int iControlSettingDiversity(FILE *psFile, const char *pcValue);
+static int iControlSettingActivityLED(FILE *psFile, const char *pcValue);
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+extern int verbosity;
+
+const char         *pcControlSocket = NULL;
+
+const char         *pcControlMetricsAddress = NULL;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static int iSocketFd = -1;
+
+static int iHttpFd = -1;
+
+/** Control socket connections, followed by HTTP connections */
+static tsControlClient asClients[CONTROL_SLOTS];
+
+static const tsControlCommand asCommands[] =
+{
+    { "help",           "List commands and settings",                               iControlHelp },
+    { "metrics",        "Counters and gauges, Prometheus text format",              iControlMetrics },
+    { "state",          "Module state and network settings",                        iControlState },
+    { "nodes",          "Node table",                                               iControlNodes },
+    { "loglevel",       "[<level>] Show or change the log level, 0-7 or a name",    iControlLogLevel },
+    { "set",            "<setting> <value> Change a setting, see reconfigure",      iControlSet },
+    { "reconfigure",    "Write the settings to the module and restart its network", iControlReconfigure },
+    { "reset",          "Reset the module and repeat the start up handshake",       iControlReset },
+};
+
+static const tsControlSetting asSettings[] =
+{
+    { "mode",           "coordinator, router or commissioning",     iControlSettingMode },
+    { "region",         "0 Europe, 1 USA, 2 Japan",                 iControlSettingRegion },
+    { "channel",        "11 to 26, 0 to select automatically",      iControlSettingChannel },
+    { "pan",            "0 to 0xFFFF, 0xFFFF to select automatically", iControlSettingPan },
+    { "network",        "JenNet network ID",                        iControlSettingNetwork },
+    { "profile",        "JenNet profile, 0 to 255",                 iControlSettingProfile },
+    { "prefix",         "IPv6 prefix, e.g. fd04:bd3:80e8:2::",      iControlSettingPrefix },
+    { "key",            "Network key written as an IPv6 address, or off", iControlSettingKey },
+    { "frontend",       "SP, HP or ETSI",                           iControlSettingFrontend },
+    { "diversity",      "on or off",                                iControlSettingDiversity },
+    { "activityled",    "DIO number, or none",                      iControlSettingActivityLED },
+};
+
+/** Names of the syslog priorities, which are the log levels */
+static const char *apcLogLevels[] = { "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug" };
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/** Parse an unsigned number in any base strtoul understands.
+ *  \return 0 on success, -1 if it is not a number or greater than u32Max
+ */
+static int iControlNumber(const char *pcValue, uint32_t u32Max, uint32_t *pu32Value)
+{
+    char *pcEnd;
+    unsigned long ulValue;
+    
+    errno = 0;
+    ulValue = strtoul(pcValue, &pcEnd, 0);
+    if (errno || (pcEnd == pcValue) || (*pcEnd != '\0') || (ulValue > u32Max))
+    {
+        return -1;
+    }
+    *pu32Value = ulValue;
+    return 0;
+}
+
+
+static int iControlSettingMode(FILE *psFile, const char *pcValue)
+{
+    static const char *apcModes[] = { "coordinator", "router", "commissioning" };
+    uint32_t i;
+    
+    if (!pcValue)
+    {
+        fprintf(psFile, "%s", (eModuleMode <= E_MODE_COMMISSIONING) ? apcModes[eModuleMode] : "unknown");
+        return 0;
+    }
+    for (i = 0; i < sizeof(apcModes) / sizeof(char *); i++)
+    {
+        if (strcmp(pcValue, apcModes[i]) == 0)
+        {
+            eModuleMode = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+static int iControlSettingRegion(FILE *psFile, const char *pcValue)
+{
+    uint32_t u32Region;
+    
+    if (!pcValue)
+    {
+        fprintf(psFile, "%d", eRegion);
+        return 0;
+    }
+    if (iControlNumber(pcValue, E_REGION_MAX - 1, &u32Region) < 0)
+    {
+        return -1;
+    }
+    eRegion = u32Region;
+    return 0;
+}
+
+
+static int iControlSettingChannel(FILE *psFile, const char *pcValue)
+{
+    uint32_t u32Channel;
+    
+    if (!pcValue)
+    {
+        fprintf(psFile, "%d", eChannel);
+        return 0;
+    }
+    if ((iControlNumber(pcValue, E_CHANNEL_MAXIMUM, &u32Channel) < 0) ||
+        ((u32Channel != E_CHANNEL_AUTOMATIC) && (u32Channel < E_CHANNEL_MINIMUM)))
+    {
+        return -1;
+    }
+    eChannel = u32Channel;
+    return 0;
+}
+
+
+static int iControlSettingPan(FILE *psFile, const char *pcValue)
+{
+    uint32_t u32PanID;
+    
+    if (!pcValue)
+    {
+        fprintf(psFile, "0x%04x", u16PanID);
+        return 0;
+    }
+    if (iControlNumber(pcValue, 0xFFFF, &u32PanID) < 0)
+    {
+        return -1;
+    }
+    u16PanID = u32PanID;
+    return 0;
+}
+
+
+static int iControlSettingNetwork(FILE *psFile, const char *pcValue)
+{
+    if (!pcValue)
+    {
+        fprintf(psFile, "0x%08x", u32UserData);
+        return 0;
+    }
+    return iControlNumber(pcValue, 0xFFFFFFFF, &u32UserData);
+}
+
+
+static int iControlSettingProfile(FILE *psFile, const char *pcValue)
+{
+    uint32_t u32Profile;
+    
+    if (!pcValue)
+    {
+        fprintf(psFile, "%d", u8JenNetProfile);
+        return 0;
+    }
+    if (iControlNumber(pcValue, 0xFF, &u32Profile) < 0)
+    {
+        return -1;
+    }
+    u8JenNetProfile = u32Profile;
+    return 0;
+}
+
+
+static int iControlSettingPrefix(FILE *psFile, const char *pcValue)
+{
+    struct in6_addr sAddress;
+    char acAddress[INET6_ADDRSTRLEN];
+    int i;
+    
+    if (!pcValue)
+    {
+        memset(&sAddress, 0, sizeof(sAddress));
+        for (i = 0; i < 8; i++)
+        {
+            sAddress.s6_addr[i] = (u64NetworkPrefix >> (56 - 8 * i)) & 0xFF;
+        }
+        inet_ntop(AF_INET6, &sAddress, acAddress, sizeof(acAddress));
+        fprintf(psFile, "%s", acAddress);
+        return 0;
+    }
+    if (inet_pton(AF_INET6, pcValue, &sAddress) != 1)
+    {
+        return -1;
+    }
+    u64NetworkPrefix = 0;
+    for (i = 0; i < 8; i++)
+    {
+        u64NetworkPrefix = (u64NetworkPrefix << 8) | sAddress.s6_addr[i];
+    }
+    return 0;
+}
+
+
+static int iControlSettingKey(FILE *psFile, const char *pcValue)
+{
+    if (!pcValue)
+    {
+        /* Never give the key away */
+        fprintf(psFile, "%s", iSecureNetwork ? "on" : "off");
+        return 0;
+    }
+    if (strcmp(pcValue, "off") == 0)
+    {
+        iSecureNetwork = 0;
+        return 0;
+    }
+    if (inet_pton(AF_INET6, pcValue, &sSecurityKey) != 1)
+    {
+        return -1;
+    }
+    iSecureNetwork = 1;
+    return 0;
+}
+
+
+static int iControlSettingFrontend(FILE *psFile, const char *pcValue)
+{
+    static const char *apcFrontends[] = { "SP", "HP", "ETSI" };
+    uint32_t i;
+    
+    if (!pcValue)
+    {
+        fprintf(psFile, "%s", (eRadioFrontEnd <= E_FRONTEND_ETSI) ? apcFrontends[eRadioFrontEnd] : "unknown");
+        return 0;
+    }
+    for (i = 0; i < sizeof(apcFrontends) / sizeof(char *); i++)
+    {
+        if (strcmp(pcValue, apcFrontends[i]) == 0)
+        {
+            eRadioFrontEnd = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+static int iControlSettingDiversity(FILE *psFile, const char *pcValue)
+{
+    if (!pcValue)
+    {
+        fprintf(psFile, "%s", iAntennaDiversity ? "on" : "off");
+        return 0;
+    }
+    if (strcmp(pcValue, "on") == 0)
+    {
+        iAntennaDiversity = 1;
+    }
+    else if (strcmp(pcValue, "off") == 0)
+    {
+        iAntennaDiversity = 0;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+
+static int iControlSettingActivityLED(FILE *psFile, const char *pcValue)
+{
+    uint32_t u32ActivityLED;
+    
+    if (!pcValue)
+    {
+        if (eActivityLED == E_ACTIVITY_LED_NONE)
+        {
+            fprintf(psFile, "none");
+        }
+        else
+        {
+            fprintf(psFile, "%u", (uint32_t)eActivityLED);
+        }
+        return 0;
+    }
+    if (strcmp(pcValue, "none") == 0)
+    {
+        eActivityLED = E_ACTIVITY_LED_NONE;
+        return 0;
+    }
+    if (iControlNumber(pcValue, 0xFF, &u32ActivityLED) < 0)
+    {
+        return -1;
+    }
+    eActivityLED = u32ActivityLED;
+    return 0;
+}
+
+
+static int iControlHelp(FILE *psFile, char *pcArgs)
+{
+    uint32_t i;
+    
+    for (i = 0; i < sizeof(asCommands) / sizeof(tsControlCommand); i++)
+    {
+        fprintf(psFile, "%-12s %s\n", asCommands[i].pcName, asCommands[i].pcHelp);
+    }
+    fprintf(psFile, "Settings:\n");
+    for (i = 0; i < sizeof(asSettings) / sizeof(tsControlSetting); i++)
+    {
+        fprintf(psFile, "  %-12s %s\n", asSettings[i].pcName, asSettings[i].pcValues);
+    }
+    return 0;
+}
+
+
+static int iControlMetrics(FILE *psFile, char *pcArgs)
+{
+    return iMetricsWrite(psFile);
+}
+
+
+static int iControlState(FILE *psFile, char *pcArgs)
+{
+    uint32_t u32Version = u32JennicModuleVersion();
+    char acAddress[INET6_ADDRSTRLEN];
+    uint32_t i;
+    
+    inet_ntop(AF_INET6, &sModuleAddress, acAddress, sizeof(acAddress));
+    fprintf(psFile, "state %s\n", pcJennicModuleState());
+    fprintf(psFile, "version %d.%d.%d\n", (u32Version >> 16) & 0xFF, (u32Version >> 8) & 0xFF, u32Version & 0xFF);
+    fprintf(psFile, "address %s\n", acAddress);
+    fprintf(psFile, "tx_queue %u\n", u32JennicModuleTxQueueDepth());
+    fprintf(psFile, "loglevel %d\n", verbosity);
+    for (i = 0; i < sizeof(asSettings) / sizeof(tsControlSetting); i++)
+    {
+        fprintf(psFile, "%s ", asSettings[i].pcName);
+        asSettings[i].prSetting(psFile, NULL);
+        fprintf(psFile, "\n");
+    }
+    return 0;
+}
+
+
+static int iControlNodes(FILE *psFile, char *pcArgs)
+{
+    return iNodeTableWrite(u64ClockNowUs(), psFile);
+}
+
+
+static int iControlLogLevel(FILE *psFile, char *pcArgs)
+{
+    uint32_t u32Level;
+    
+    if (*pcArgs == '\0')
+    {
+        fprintf(psFile, "%d %s\n", verbosity, ((verbosity >= 0) && (verbosity <= LOG_DEBUG)) ? apcLogLevels[verbosity] : "");
+        return 0;
+    }
+    
+    for (u32Level = 0; u32Level <= LOG_DEBUG; u32Level++)
+    {
+        if (strcmp(pcArgs, apcLogLevels[u32Level]) == 0)
+        {
+            break;
+        }
+    }
+    if ((u32Level > LOG_DEBUG) && (iControlNumber(pcArgs, LOG_DEBUG, &u32Level) < 0))
+    {
+        fprintf(psFile, "error: log level must be 0 to %d or one of emerg, alert, crit, err, warning, notice, info, debug\n", LOG_DEBUG);
+        return -1;
+    }
+    
+    verbosity = u32Level;
+    daemon_set_verbosity(verbosity);
+    daemon_log(LOG_INFO, "Log level set to %s", apcLogLevels[u32Level]);
+    fprintf(psFile, "ok\n");
+    return 0;
+}
+
+
+static int iControlSet(FILE *psFile, char *pcArgs)
+{
+    char *pcValue = pcArgs + strcspn(pcArgs, " ");
+    uint32_t i;
+    
+    if (*pcValue)
+    {
+        *pcValue++ = '\0';
+        while (*pcValue == ' ')
+        {
+            pcValue++;
+        }
+    }
+    
+    for (i = 0; i < sizeof(asSettings) / sizeof(tsControlSetting); i++)
+    {
+        if (strcmp(pcArgs, asSettings[i].pcName) == 0)
+        {
+            if ((*pcValue == '\0') || (asSettings[i].prSetting(psFile, pcValue) < 0))
+            {
+                fprintf(psFile, "error: %s must be %s\n", asSettings[i].pcName, asSettings[i].pcValues);
+                return -1;
+            }
+            daemon_log(LOG_INFO, "Setting %s changed", asSettings[i].pcName);
+            fprintf(psFile, "ok\n");
+            return 0;
+        }
+    }
+    fprintf(psFile, "error: unknown setting \"%s\", try \"help\"\n", pcArgs);
+    return -1;
+}
+
+
+static int iControlReconfigure(FILE *psFile, char *pcArgs)
+{
+    if (eJennicModuleReconfigure() != E_MODULE_OK)
+    {
+        fprintf(psFile, "error: could not reconfigure module\n");
+        return -1;
+    }
+    fprintf(psFile, "ok\n");
+    return 0;
+}
+
+
+static int iControlReset(FILE *psFile, char *pcArgs)
+{
+    if (eJennicModuleRestart() != E_MODULE_OK)
+    {
+        fprintf(psFile, "error: could not restart module\n");
+        return -1;
+    }
+    fprintf(psFile, "ok\n");
+    return 0;
+}
+
+
+static void vControlDisconnect(tsControlClient *psClient)
+{
+    close(psClient->iSocket);
+    free(psClient->pcResponse);
+    memset(psClient, 0, sizeof(tsControlClient));
+    psClient->iSocket = -1;
+}
+
+
+static void vControlAccept(int iListenFd, teControlProtocol eProtocol)
+{
+    int iSocket = accept4(iListenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    int iFirst = (eProtocol == E_CONTROL_HTTP) ? CONTROL_MAX_CLIENTS : 0;
+    int iLast  = (eProtocol == E_CONTROL_HTTP) ? CONTROL_SLOTS : CONTROL_MAX_CLIENTS;
+    int i;
+    
+    if (iSocket < 0)
+    {
+        return;
+    }
+    
+    for (i = iFirst; i < iLast; i++)
+    {
+        if (asClients[i].iSocket < 0)
+        {
+            asClients[i].iSocket            = iSocket;
+            asClients[i].eProtocol          = eProtocol;
+            asClients[i].u64LastActivity    = u64ClockNowUs();
+            return;
+        }
+    }
+    
+    daemon_log(LOG_DEBUG, "Too many control connections");
+    close(iSocket);
+}
+
+
+/** Send as much of the pending response as the socket will take.
+ *  \return FALSE if the client was disconnected
+ */
+static bool bControlFlush(tsControlClient *psClient)
+{
+    while (psClient->szResponseSent < psClient->szResponseLength)
+    {
+        ssize_t iSent = send(psClient->iSocket, &psClient->pcResponse[psClient->szResponseSent],
+                             psClient->szResponseLength - psClient->szResponseSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (iSent < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                return TRUE;
+            }
+            vControlDisconnect(psClient);
+            return FALSE;
+        }
+        psClient->szResponseSent += iSent;
+        psClient->u64LastActivity = u64ClockNowUs();
+    }
+    
+    free(psClient->pcResponse);
+    psClient->pcResponse        = NULL;
+    psClient->szResponseLength  = 0;
+    psClient->szResponseSent    = 0;
+    
+    if (psClient->bClose)
+    {
+        vControlDisconnect(psClient);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+/** Run one control socket command */
+static void vControlCommand(FILE *psFile, char *pcLine)
+{
+    char *pcArgs;
+    uint32_t i;
+    
+    while (*pcLine == ' ')
+    {
+        pcLine++;
+    }
+    pcArgs = pcLine + strcspn(pcLine, " ");
+    if (*pcArgs)
+    {
+        *pcArgs++ = '\0';
+        while (*pcArgs == ' ')
+        {
+            pcArgs++;
+        }
+    }
+    
+    for (i = 0; i < sizeof(asCommands) / sizeof(tsControlCommand); i++)
+    {
+        if (strcmp(pcLine, asCommands[i].pcName) == 0)
+        {
+            if (asCommands[i].prHandler(psFile, pcArgs) < 0)
+            {
+                daemon_log(LOG_DEBUG, "Control command \"%s\" failed", pcLine);
+            }
+            return;
+        }
+    }
+    fprintf(psFile, "error: unknown command \"%s\", try \"help\"\n", pcLine);
+}
+
+
+/** Answer an HTTP request, which is only ever for the metrics */
+static void vControlHttp(FILE *psFile, char *pcRequest)
+{
+    char *pcMethod = strtok(pcRequest, " ");
+    char *pcPath = strtok(NULL, " ?\r\n");
+    const char *pcStatus = "200 OK";
+    char *pcBody = NULL;
+    size_t szBody = 0;
+    FILE *psBody = open_memstream(&pcBody, &szBody);
+    
+    if (!psBody)
+    {
+        return;
+    }
+    
+    if (!pcMethod || !pcPath || (strcmp(pcMethod, "GET") && strcmp(pcMethod, "HEAD")))
+    {
+        pcStatus = "405 Method Not Allowed";
+        fprintf(psBody, "Only GET is supported\n");
+    }
+    else if (strcmp(pcPath, "/metrics"))
+    {
+        pcStatus = "404 Not Found";
+        fprintf(psBody, "Metrics are at /metrics\n");
+    }
+    else if (iMetricsWrite(psBody) < 0)
+    {
+        pcStatus = "500 Internal Server Error";
+    }
+    fclose(psBody);
+    
+    fprintf(psFile, "HTTP/1.0 %s\r\n"
+                    "Content-Type: %s\r\n"
+                    "Content-Length: %zu\r\n"
+                    "Connection: close\r\n"
+                    "\r\n", pcStatus, strcmp(pcStatus, "200 OK") ? "text/plain" : METRICS_CONTENT_TYPE, szBody);
+    if (pcMethod && strcmp(pcMethod, "HEAD"))
+    {
+        fwrite(pcBody, 1, szBody, psFile);
+    }
+    free(pcBody);
+}
+
+
+/** Act on the next complete request received from a client, if there is
+ *  one and the response to the previous one has been sent.
+ *  \return FALSE if the client was disconnected
+ */
+static bool bControlProcess(tsControlClient *psClient)
+{
+    char *pcEnd;
+    FILE *psFile;
+    uint32_t u32Used;
+    
+    while (!psClient->pcResponse && !psClient->bClose)
+    {
+        psClient->acRequest[psClient->u32RequestLength] = '\0';
+        
+        if (psClient->eProtocol == E_CONTROL_HTTP)
+        {
+            /* The request is complete at the end of the header */
+            pcEnd = strstr(psClient->acRequest, "\r\n\r\n");
+            if (!pcEnd)
+            {
+                pcEnd = strstr(psClient->acRequest, "\n\n");
+            }
+        }
+        else
+        {
+            pcEnd = strchr(psClient->acRequest, '\n');
+        }
+        
+        if (!pcEnd)
+        {
+            if (psClient->u32RequestLength < sizeof(psClient->acRequest) - 1)
+            {
+                return TRUE;
+            }
+            /* Too long to ever be complete */
+            vControlDisconnect(psClient);
+            return FALSE;
+        }
+        
+        *pcEnd = '\0';
+        u32Used = pcEnd - psClient->acRequest + ((psClient->eProtocol == E_CONTROL_HTTP) ? 2 : 1);
+        if (u32Used > psClient->u32RequestLength)
+        {
+            u32Used = psClient->u32RequestLength;
+        }
+        if ((pcEnd > psClient->acRequest) && (pcEnd[-1] == '\r'))
+        {
+            pcEnd[-1] = '\0';
+        }
+        
+        psFile = open_memstream(&psClient->pcResponse, &psClient->szResponseLength);
+        if (!psFile)
+        {
+            vControlDisconnect(psClient);
+            return FALSE;
+        }
+        if (psClient->eProtocol == E_CONTROL_HTTP)
+        {
+            vControlHttp(psFile, psClient->acRequest);
+            psClient->bClose = TRUE;
+        }
+        else
+        {
+            vControlCommand(psFile, psClient->acRequest);
+            /* End of the response */
+            fputc('\n', psFile);
+        }
+        fclose(psFile);
+        
+        psClient->u32RequestLength -= u32Used;
+        memmove(psClient->acRequest, &psClient->acRequest[u32Used], psClient->u32RequestLength);
+        
+        if (!bControlFlush(psClient))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+
+/** Listen for HTTP connections on "[<address>:]<port>" */
+static int iControlOpenHttp(const char *pcAddress)
+{
+    struct sockaddr_in6 sAddr;
+    int iZero = 0;
+    int iOne = 1;
+    
+    memset(&sAddr, 0, sizeof(sAddr));
+    sAddr.sin6_addr     = in6addr_loopback;
+    if (iIPv6ParseSocketAddress(pcAddress, &sAddr) < 0)
+    {
+        daemon_log(LOG_ERR, "Invalid metrics address \"%s\"", pcAddress);
+        return -1;
+    }
+    
+    iHttpFd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if ((iHttpFd < 0) ||
+        /* Accept IPv4 clients too, as mapped addresses */
+        (setsockopt(iHttpFd, IPPROTO_IPV6, IPV6_V6ONLY, &iZero, sizeof(iZero)) < 0) ||
+        (setsockopt(iHttpFd, SOL_SOCKET, SO_REUSEADDR, &iOne, sizeof(iOne)) < 0) ||
+        (bind(iHttpFd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0) ||
+        (listen(iHttpFd, CONTROL_MAX_HTTP_CLIENTS) < 0))
+    {
+        daemon_log(LOG_ERR, "Could not serve metrics on \"%s\" (%s)", pcControlMetricsAddress, strerror(errno));
+        if (iHttpFd >= 0)
+        {
+            close(iHttpFd);
+            iHttpFd = -1;
+        }
+        return -1;
+    }
+    daemon_log(LOG_INFO, "Serving metrics over HTTP on port %d", ntohs(sAddr.sin6_port));
+    return 0;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iControlOpen(void)
+{
+    struct sockaddr_un sAddr;
+    int i;
+    
+    for (i = 0; i < CONTROL_SLOTS; i++)
+    {
+        asClients[i].iSocket = -1;
+    }
+    
+    if (pcControlSocket)
+    {
+        if (strlen(pcControlSocket) >= sizeof(sAddr.sun_path))
+        {
+            daemon_log(LOG_ERR, "Control socket path too long");
+            return -1;
+        }
+        memset(&sAddr, 0, sizeof(sAddr));
+        sAddr.sun_family = AF_UNIX;
+        strcpy(sAddr.sun_path, pcControlSocket);
+        
+        /* Remove a socket left by a previous run */
+        unlink(pcControlSocket);
+        
+        iSocketFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if ((iSocketFd < 0) ||
+            (bind(iSocketFd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0) ||
+            (listen(iSocketFd, CONTROL_MAX_CLIENTS) < 0))
+        {
+            daemon_log(LOG_ERR, "Could not create control socket %s (%s)", pcControlSocket, strerror(errno));
+            if (iSocketFd >= 0)
+            {
+                close(iSocketFd);
+                iSocketFd = -1;
+            }
+            return -1;
+        }
+        daemon_log(LOG_INFO, "Control socket on %s", pcControlSocket);
+    }
+    
+    if (pcControlMetricsAddress && (iControlOpenHttp(pcControlMetricsAddress) < 0))
+    {
+        vControlClose();
+        return -1;
+    }
+    return 0;
+}
+
+
+void vControlClose(void)
+{
+    int i;
+    
+    for (i = 0; i < CONTROL_SLOTS; i++)
+    {
+        if (asClients[i].iSocket >= 0)
+        {
+            vControlDisconnect(&asClients[i]);
+        }
+    }
+    if (iHttpFd >= 0)
+    {
+        close(iHttpFd);
+        iHttpFd = -1;
+    }
+    if (iSocketFd >= 0)
+    {
+        close(iSocketFd);
+        iSocketFd = -1;
+        unlink(pcControlSocket);
+    }
+}
+
+
+int iControlSetFds(fd_set *psReadFds, fd_set *psWriteFds, int iMaxFd)
+{
+    int i;
+    
+    if (iSocketFd >= 0)
+    {
+        FD_SET(iSocketFd, psReadFds);
+        if (iSocketFd > iMaxFd)
+        {
+            iMaxFd = iSocketFd;
+        }
+    }
+    if (iHttpFd >= 0)
+    {
+        FD_SET(iHttpFd, psReadFds);
+        if (iHttpFd > iMaxFd)
+        {
+            iMaxFd = iHttpFd;
+        }
+    }
+    
+    for (i = 0; i < CONTROL_SLOTS; i++)
+    {
+        if (asClients[i].iSocket < 0)
+        {
+            continue;
+        }
+        FD_SET(asClients[i].iSocket, asClients[i].pcResponse ? psWriteFds : psReadFds);
+        if (asClients[i].iSocket > iMaxFd)
+        {
+            iMaxFd = asClients[i].iSocket;
+        }
+    }
+    return iMaxFd;
+}
+
+
+bool bControlHandleFd(int iFd, bool bReadable, bool bWritable)
+{
+    int i;
+    
+    if (iFd < 0)
+    {
+        return FALSE;
+    }
+    if (iFd == iSocketFd)
+    {
+        vControlAccept(iSocketFd, E_CONTROL_LINE);
+        return TRUE;
+    }
+    if (iFd == iHttpFd)
+    {
+        vControlAccept(iHttpFd, E_CONTROL_HTTP);
+        return TRUE;
+    }
+    
+    for (i = 0; i < CONTROL_SLOTS; i++)
+    {
+        tsControlClient *psClient = &asClients[i];
+        
+        if ((psClient->iSocket < 0) || (iFd != psClient->iSocket))
+        {
+            continue;
+        }
+        
+        if (bWritable && psClient->pcResponse)
+        {
+            if (bControlFlush(psClient))
+            {
+                /* Commands sent while the response was going out */
+                bControlProcess(psClient);
+            }
+        }
+        else if (bReadable)
+        {
+            ssize_t iReceived = recv(psClient->iSocket, &psClient->acRequest[psClient->u32RequestLength],
+                                     sizeof(psClient->acRequest) - 1 - psClient->u32RequestLength, MSG_DONTWAIT);
+            if (iReceived == 0)
+            {
+                vControlDisconnect(psClient);
+            }
+            else if (iReceived > 0)
+            {
+                psClient->u32RequestLength += iReceived;
+                psClient->u64LastActivity = u64ClockNowUs();
+                bControlProcess(psClient);
+            }
+            else if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+            {
+                vControlDisconnect(psClient);
+            }
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+
+void vControlAge(uint64_t u64Now)
+{
+    int i;
+    
+    for (i = CONTROL_MAX_CLIENTS; i < CONTROL_SLOTS; i++)
+    {
+        if ((asClients[i].iSocket >= 0) &&
+            (u64Now - asClients[i].u64LastActivity >= (uint64_t)CONTROL_HTTP_IDLE_TIMEOUT * 1000000))
+        {
+            daemon_log(LOG_DEBUG, "Closing idle HTTP connection");
+            vControlDisconnect(&asClients[i]);
+        }
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -0,0 +1,136 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Control socket
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+#ifndef  CONTROL_H_INCLUDED
+#define  CONTROL_H_INCLUDED
+
+#include <stdint.h>
+#include <sys/select.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Control socket connections served at once */
+#define CONTROL_MAX_CLIENTS                 8
+
+/** HTTP connections served at once, so scrapers cannot crowd out operators */
+#define CONTROL_MAX_HTTP_CLIENTS            4
+
+/** Seconds an HTTP connection may go without sending or receiving */
+#define CONTROL_HTTP_IDLE_TIMEOUT           10
+
+/** Longest command line or HTTP request header accepted */
+#define CONTROL_MAX_REQUEST                 1024
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Path of the UNIX control socket, NULL to disable */
+extern const char      *pcControlSocket;
+
+
+/** "[<address>:]<port>" to serve metrics over HTTP on, NULL to disable.
+ *  The address defaults to the IPv6 loopback address. */
+extern const char      *pcControlMetricsAddress;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Create the control socket and HTTP listener, if configured.
+ *  \return 0 on success, -1 on error
+ */
+int iControlOpen(void);
+
+
+/** Close all connections and remove the control socket */
+void vControlClose(void);
+
+
+/** Add the descriptors of listeners and connections to select sets.
+ *  Connections with a response to send wait to be writable rather than
+ *  readable.
+ *  \param psReadFds    Set of descriptors to wait to read from
+ *  \param psWriteFds   Set of descriptors to wait to write to
+ *  \param iMaxFd       Highest descriptor in the sets so far
+ *  \return Highest descriptor in the sets
+ */
+int iControlSetFds(fd_set *psReadFds, fd_set *psWriteFds, int iMaxFd);
+
+
+/** Deal with a descriptor select has found ready.
+ *  \param iFd          Descriptor
+ *  \param bReadable    Descriptor was in the read set
+ *  \param bWritable    Descriptor was in the write set
+ *  \return TRUE if the descriptor belongs to the control interface
+ */
+bool bControlHandleFd(int iFd, bool bReadable, bool bWritable);
+
+
+/** Close HTTP connections that have been idle too long. Called periodically.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ */
+void vControlAge(uint64_t u64Now);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* CONTROL_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -0,0 +1,129 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Diagnostic dump files
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+/* Dumps of daemon state requested with SIGUSR1 are written to a temporary
+ * file and renamed into place, so readers never see a partial dump. The
+ * daemon runs as root, so the temporary file is created with O_EXCL and
+ * O_NOFOLLOW: a file or symbolic link planted at that name by another user
+ * cannot redirect the write. A stale temporary file left by a crash is
+ * removed and creation tried once more. The statistics page is built the
+ * same way, with iDumpFileCreate.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <libdaemon/daemon.h>
+
+#include "DumpFile.h"
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+int iDumpFileCreate(const char *pcTempName, int iFlags)
+{
+    int iFd;
+    
+    iFlags |= O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC;
+    
+    iFd = open(pcTempName, iFlags, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if ((iFd < 0) && (errno == EEXIST))
+    {
+        /* Left over from an earlier run. Unlinking removes a symbolic link itself, not its target */
+        unlink(pcTempName);
+        iFd = open(pcTempName, iFlags, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    }
+    return iFd;
+}
+
+
+FILE *psDumpFileOpen(const char *pcFileName, char *pcTempName, size_t u32TempLength)
+{
+    FILE *psFile;
+    int iFd;
+    
+    snprintf(pcTempName, u32TempLength, "%s.tmp", pcFileName);
+    
+    iFd = iDumpFileCreate(pcTempName, O_WRONLY);
+    if (iFd < 0)
+    {
+        daemon_log(LOG_ERR, "Could not create %s (%s)", pcTempName, strerror(errno));
+        return NULL;
+    }
+    
+    psFile = fdopen(iFd, "w");
+    if (!psFile)
+    {
+        daemon_log(LOG_ERR, "Could not create %s (%s)", pcTempName, strerror(errno));
+        close(iFd);
+        unlink(pcTempName);
+    }
+    return psFile;
+}
+
+
+int iDumpFileClose(FILE *psFile, const char *pcTempName, const char *pcFileName)
+{
+    if (fclose(psFile) != 0)
+    {
+        daemon_log(LOG_ERR, "Could not write %s (%s)", pcTempName, strerror(errno));
+        unlink(pcTempName);
+        return -1;
+    }
+    if (rename(pcTempName, pcFileName) != 0)
+    {
+        daemon_log(LOG_ERR, "Could not rename %s (%s)", pcTempName, strerror(errno));
+        unlink(pcTempName);
+        return -1;
+    }
+    return 0;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
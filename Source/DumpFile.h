@@ -0,0 +1,105 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Diagnostic dump files
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+#ifndef  DUMPFILE_H_INCLUDED
+#define  DUMPFILE_H_INCLUDED
+
+#include <stdio.h>
+#include <stddef.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Where diagnostic dumps are written, given the directory, the interface
+ *  name and the kind of dump. */
+#define DUMP_FILE_PATH                      "%s/6LoWPANd.%s.%s"
+
+/** Default directory for diagnostic dumps. Only writable by root, unlike /tmp. */
+#define DUMP_FILE_DEFAULT_DIRECTORY         "/run"
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Create a temporary file exclusively, without following symbolic links.
+ *  A file or link already at that name is removed and creation retried once.
+ *  \param pcTempName   Name of the temporary file
+ *  \param iFlags       Access mode, O_WRONLY or O_RDWR
+ *  \return File descriptor, -1 on error with errno set
+ */
+int iDumpFileCreate(const char *pcTempName, int iFlags);
+
+
+/** Create a new temporary file next to a dump file, to be renamed over
+ *  it by iDumpFileClose. The temporary file is created exclusively and
+ *  symbolic links are not followed, so an existing file or link in its
+ *  place is never written through.
+ *  \param pcFileName   Name of the dump file
+ *  \param pcTempName   Buffer for the name of the temporary file
+ *  \param u32TempLength Size of the buffer
+ *  \return Stream to write to, NULL on error
+ */
+FILE *psDumpFileOpen(const char *pcFileName, char *pcTempName, size_t u32TempLength);
+
+
+/** Finish writing a dump and move it into place.
+ *  \param psFile       Stream from psDumpFileOpen
+ *  \param pcTempName   Name of the temporary file
+ *  \param pcFileName   Name of the dump file
+ *  \return 0 on success, -1 on error
+ */
+int iDumpFileClose(FILE *psFile, const char *pcTempName, const char *pcFileName);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* DUMPFILE_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -0,0 +1,520 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Egress packet filter
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+/* Rules file format, one rule per line, '#' starts a comment:
+ *
+ *   prefix-check on|off               Require destinations in the 6LoWPAN prefix (default on)
+ *   prefix <address>/<length>         Also accept destinations in this prefix
+ *   default allow|deny                Reset all protocols and ports to allowed / denied
+ *   allow|deny protocol <protocol>    Protocol by name or number
+ *   allow|deny udp|tcp <port>[-<port>]
+ *   rate <packets/s> <burst>          Limit on all packets
+ *   rate <protocol> <packets/s> <burst>
+ *   reject on|off                     Answer denied packets with Destination Unreachable (default on)
+ *
+ * Link local and multicast destinations always pass the prefix check.
+ * Packets whose upper layer header cannot be found (non-initial
+ * fragments, malformed extension headers) are classed as protocol 255.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/ip6.h>
+#include <netinet/icmp6.h>
+
+#include <libdaemon/daemon.h>
+
+#include "Filter.h"
+#include "IPv6.h"
+#include "JennicModule.h"
+#include "TokenBucket.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define BITMAP_TEST(a, n)           ((a)[(n) >> 3] &   (1 << ((n) & 7)))
+#define BITMAP_SET(a, n)            ((a)[(n) >> 3] |=  (1 << ((n) & 7)))
+#define BITMAP_CLEAR(a, n)          ((a)[(n) >> 3] &= ~(1 << ((n) & 7)))
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** Token bucket rate limit */
+typedef struct
+{
+    uint32_t    u32Rate;                /**< Packets per second, 0 for no limit */
+    uint32_t    u32Burst;               /**< Bucket depth in packets */
+    tsTokenBucket sBucket;              /**< Packets available */
+} tsFilterBucket;
+
+
+/** Compiled rule set */
+typedef struct
+{
+    int             iPrefixCheck;
+    int             iReject;
+    uint32_t        u32NumPrefixes;
+    struct
+    {
+        struct in6_addr sPrefix;
+        uint8_t         u8Length;
+    } asPrefixes[FILTER_MAX_PREFIXES];
+    uint8_t         au8Protocols[256 / 8];
+    uint8_t         au8UDPPorts[65536 / 8];
+    uint8_t         au8TCPPorts[65536 / 8];
+    tsFilterBucket  sRate;
+    tsFilterBucket  asProtocolRate[256];
+} tsFilterRules;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+const char     *pcFilterRulesFile = NULL;
+
+tsFilterStats   sFilterStats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+/** Two rule sets, so a new one can be compiled while the other is in use */
+static tsFilterRules asRules[2];
+
+/** Rule set in use, NULL until the first load */
+static tsFilterRules *psActiveRules = NULL;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void vFilterDefaults(tsFilterRules *psRules)
+{
+    memset(psRules, 0, sizeof(tsFilterRules));
+    psRules->iPrefixCheck = 1;
+    psRules->iReject      = 1;
+    memset(psRules->au8Protocols, 0xFF, sizeof(psRules->au8Protocols));
+    memset(psRules->au8UDPPorts,  0xFF, sizeof(psRules->au8UDPPorts));
+    memset(psRules->au8TCPPorts,  0xFF, sizeof(psRules->au8TCPPorts));
+}
+
+
+static int iFilterParseProtocol(const char *pcProtocol)
+{
+    struct protoent *psProto;
+    char *pcEnd;
+    long lProtocol;
+    
+    lProtocol = strtol(pcProtocol, &pcEnd, 0);
+    if ((*pcEnd == '\0') && (lProtocol >= 0) && (lProtocol <= 255))
+    {
+        return lProtocol;
+    }
+    if (strcmp(pcProtocol, "icmpv6") == 0)
+    {
+        return IPPROTO_ICMPV6;
+    }
+    psProto = getprotobyname(pcProtocol);
+    if (psProto)
+    {
+        return psProto->p_proto;
+    }
+    return -1;
+}
+
+
+static int iFilterParsePorts(char *pcPorts, uint32_t *pu32First, uint32_t *pu32Last)
+{
+    char *pcEnd;
+    
+    *pu32First = strtoul(pcPorts, &pcEnd, 10);
+    if (*pcEnd == '-')
+    {
+        *pu32Last = strtoul(pcEnd + 1, &pcEnd, 10);
+    }
+    else
+    {
+        *pu32Last = *pu32First;
+    }
+    if ((*pcEnd != '\0') || (*pu32First > *pu32Last) || (*pu32Last > 65535))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+
+static int iFilterParseRate(char *pcRate, char *pcBurst, tsFilterBucket *psBucket)
+{
+    char *pcEnd1, *pcEnd2;
+    
+    if (!pcRate || !pcBurst)
+    {
+        return -1;
+    }
+    psBucket->u32Rate  = strtoul(pcRate,  &pcEnd1, 10);
+    psBucket->u32Burst = strtoul(pcBurst, &pcEnd2, 10);
+    if ((*pcEnd1 != '\0') || (*pcEnd2 != '\0') || (psBucket->u32Rate == 0) || (psBucket->u32Burst == 0))
+    {
+        return -1;
+    }
+    vTokenBucketFill(&psBucket->sBucket, psBucket->u32Burst, 0);
+    return 0;
+}
+
+
+/** Compile one line of the rules file.
+ *  \return 0 if the line was valid
+ */
+static int iFilterParseLine(tsFilterRules *psRules, char *pcLine)
+{
+    char *pcSave = NULL;
+    char *pcKeyword, *pcArg1, *pcArg2, *pcArg3;
+    
+    pcKeyword = strtok_r(pcLine, " \t\r\n", &pcSave);
+    if (!pcKeyword || (pcKeyword[0] == '#'))
+    {
+        return 0;
+    }
+    pcArg1 = strtok_r(NULL, " \t\r\n", &pcSave);
+    pcArg2 = strtok_r(NULL, " \t\r\n", &pcSave);
+    pcArg3 = strtok_r(NULL, " \t\r\n", &pcSave);
+    
+    if ((strcmp(pcKeyword, "prefix-check") == 0) || (strcmp(pcKeyword, "reject") == 0))
+    {
+        int *piFlag = (pcKeyword[0] == 'p') ? &psRules->iPrefixCheck : &psRules->iReject;
+        
+        if (pcArg1 && (strcmp(pcArg1, "on") == 0))
+        {
+            *piFlag = 1;
+        }
+        else if (pcArg1 && (strcmp(pcArg1, "off") == 0))
+        {
+            *piFlag = 0;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(pcKeyword, "prefix") == 0)
+    {
+        char *pcSlash;
+        char *pcEnd;
+        unsigned long ulLength;
+        
+        if (!pcArg1 || !(pcSlash = strchr(pcArg1, '/')) || (psRules->u32NumPrefixes == FILTER_MAX_PREFIXES))
+        {
+            return -1;
+        }
+        *pcSlash = '\0';
+        ulLength = strtoul(pcSlash + 1, &pcEnd, 10);
+        if ((*pcEnd != '\0') || (ulLength > 128) ||
+            (inet_pton(AF_INET6, pcArg1, &psRules->asPrefixes[psRules->u32NumPrefixes].sPrefix) <= 0))
+        {
+            return -1;
+        }
+        psRules->asPrefixes[psRules->u32NumPrefixes].u8Length = ulLength;
+        psRules->u32NumPrefixes++;
+    }
+    else if (strcmp(pcKeyword, "default") == 0)
+    {
+        int iFill;
+        
+        if (pcArg1 && (strcmp(pcArg1, "allow") == 0))
+        {
+            iFill = 0xFF;
+        }
+        else if (pcArg1 && (strcmp(pcArg1, "deny") == 0))
+        {
+            iFill = 0x00;
+        }
+        else
+        {
+            return -1;
+        }
+        memset(psRules->au8Protocols, iFill, sizeof(psRules->au8Protocols));
+        memset(psRules->au8UDPPorts,  iFill, sizeof(psRules->au8UDPPorts));
+        memset(psRules->au8TCPPorts,  iFill, sizeof(psRules->au8TCPPorts));
+    }
+    else if ((strcmp(pcKeyword, "allow") == 0) || (strcmp(pcKeyword, "deny") == 0))
+    {
+        int iAllow = (pcKeyword[0] == 'a');
+        
+        if (!pcArg1 || !pcArg2)
+        {
+            return -1;
+        }
+        
+        if (strcmp(pcArg1, "protocol") == 0)
+        {
+            int iProtocol = iFilterParseProtocol(pcArg2);
+            
+            if (iProtocol < 0)
+            {
+                return -1;
+            }
+            if (iAllow)
+            {
+                BITMAP_SET(psRules->au8Protocols, iProtocol);
+            }
+            else
+            {
+                BITMAP_CLEAR(psRules->au8Protocols, iProtocol);
+            }
+        }
+        else if ((strcmp(pcArg1, "udp") == 0) || (strcmp(pcArg1, "tcp") == 0))
+        {
+            uint8_t *pu8Ports = (pcArg1[0] == 'u') ? psRules->au8UDPPorts : psRules->au8TCPPorts;
+            uint32_t u32First, u32Last, u32Port;
+            
+            if (iFilterParsePorts(pcArg2, &u32First, &u32Last) < 0)
+            {
+                return -1;
+            }
+            for (u32Port = u32First; u32Port <= u32Last; u32Port++)
+            {
+                if (iAllow)
+                {
+                    BITMAP_SET(pu8Ports, u32Port);
+                }
+                else
+                {
+                    BITMAP_CLEAR(pu8Ports, u32Port);
+                }
+            }
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(pcKeyword, "rate") == 0)
+    {
+        if (pcArg3)
+        {
+            int iProtocol = iFilterParseProtocol(pcArg1);
+            
+            if ((iProtocol < 0) || (iFilterParseRate(pcArg2, pcArg3, &psRules->asProtocolRate[iProtocol]) < 0))
+            {
+                return -1;
+            }
+        }
+        else if (iFilterParseRate(pcArg1, pcArg2, &psRules->sRate) < 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+
+/** Take a token from a rate limit bucket.
+ *  \return 0 if the packet is within the limit
+ */
+static int iFilterBucket(tsFilterBucket *psBucket, uint64_t u64Now)
+{
+    if (psBucket->u32Rate == 0)
+    {
+        return 0;
+    }
+    
+    return bTokenBucketTake(&psBucket->sBucket, psBucket->u32Rate, psBucket->u32Burst, u64Now) ? 0 : -1;
+}
+
+
+/** Determine if a destination is one the 6LoWPAN network can reach */
+static int iFilterPrefixMatch(const tsFilterRules *psRules, const struct in6_addr *psDest)
+{
+    uint32_t i;
+    
+    if (IN6_IS_ADDR_MULTICAST(psDest) || IN6_IS_ADDR_LINKLOCAL(psDest))
+    {
+        return 1;
+    }
+    
+    if ((((uint64_t)ntohl(psDest->s6_addr32[0]) << 32) | ntohl(psDest->s6_addr32[1])) == u64NetworkPrefix)
+    {
+        return 1;
+    }
+    
+    for (i = 0; i < psRules->u32NumPrefixes; i++)
+    {
+        uint32_t u32Bytes = psRules->asPrefixes[i].u8Length / 8;
+        uint32_t u32Bits  = psRules->asPrefixes[i].u8Length % 8;
+        
+        if (memcmp(psDest, &psRules->asPrefixes[i].sPrefix, u32Bytes) != 0)
+        {
+            continue;
+        }
+        if (u32Bits && ((psDest->s6_addr[u32Bytes] ^ psRules->asPrefixes[i].sPrefix.s6_addr[u32Bytes]) & (0xFF00 >> u32Bits)))
+        {
+            continue;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iFilterLoad(void)
+{
+    tsFilterRules *psRules = (psActiveRules == &asRules[0]) ? &asRules[1] : &asRules[0];
+    char acLine[256];
+    uint32_t u32LineNumber = 0;
+    FILE *psFile;
+    
+    vFilterDefaults(psRules);
+    
+    if (pcFilterRulesFile)
+    {
+        psFile = fopen(pcFilterRulesFile, "r");
+        if (!psFile)
+        {
+            daemon_log(LOG_ERR, "Could not open filter rules '%s' (%s)", pcFilterRulesFile, strerror(errno));
+            sFilterStats.u64ReloadErrors++;
+            return -1;
+        }
+        
+        while (fgets(acLine, sizeof(acLine), psFile))
+        {
+            u32LineNumber++;
+            if (iFilterParseLine(psRules, acLine) < 0)
+            {
+                daemon_log(LOG_ERR, "Invalid filter rule at %s:%u, keeping previous rules", pcFilterRulesFile, u32LineNumber);
+                fclose(psFile);
+                sFilterStats.u64ReloadErrors++;
+                return -1;
+            }
+        }
+        fclose(psFile);
+        
+        daemon_log(LOG_INFO, "Loaded filter rules from %s", pcFilterRulesFile);
+    }
+    
+    psActiveRules = psRules;
+    sFilterStats.u64Reloads++;
+    return 0;
+}
+
+
+teFilterVerdict eFilterPacket(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length, uint8_t *pu8Code)
+{
+    tsFilterRules *psRules = psActiveRules;
+    const struct ip6_hdr *psHeader = (const struct ip6_hdr *)pu8Packet;
+    uint32_t u32Offset = 0;
+    uint8_t u8Protocol;
+    
+    if (!psRules)
+    {
+        sFilterStats.u64Passed++;
+        return E_FILTER_PASS;
+    }
+    
+    if (u32Length < IPV6_HEADER_LENGTH)
+    {
+        sFilterStats.u64DroppedProtocol++;
+        return E_FILTER_DROP;
+    }
+    
+    if (psRules->iPrefixCheck && !iFilterPrefixMatch(psRules, &psHeader->ip6_dst))
+    {
+        sFilterStats.u64DroppedPrefix++;
+        *pu8Code = ICMP6_DST_UNREACH_NOROUTE;
+        return psRules->iReject ? E_FILTER_REJECT : E_FILTER_DROP;
+    }
+    
+    u8Protocol = u8IPv6UpperLayer(pu8Packet, u32Length, &u32Offset);
+    
+    if (!BITMAP_TEST(psRules->au8Protocols, u8Protocol))
+    {
+        sFilterStats.u64DroppedProtocol++;
+        *pu8Code = ICMP6_DST_UNREACH_ADMIN;
+        return psRules->iReject ? E_FILTER_REJECT : E_FILTER_DROP;
+    }
+    
+    if ((u8Protocol == IPPROTO_UDP) || (u8Protocol == IPPROTO_TCP))
+    {
+        uint16_t u16Port;
+        
+        if (u32Offset + 4 > u32Length)
+        {
+            sFilterStats.u64DroppedPort++;
+            return E_FILTER_DROP;
+        }
+        u16Port = (pu8Packet[u32Offset + 2] << 8) | pu8Packet[u32Offset + 3];
+        
+        if (!BITMAP_TEST((u8Protocol == IPPROTO_UDP) ? psRules->au8UDPPorts : psRules->au8TCPPorts, u16Port))
+        {
+            sFilterStats.u64DroppedPort++;
+            *pu8Code = ICMP6_DST_UNREACH_ADMIN;
+            return psRules->iReject ? E_FILTER_REJECT : E_FILTER_DROP;
+        }
+    }
+    
+    if ((iFilterBucket(&psRules->asProtocolRate[u8Protocol], u64Now) < 0) ||
+        (iFilterBucket(&psRules->sRate, u64Now) < 0))
+    {
+        sFilterStats.u64DroppedRate++;
+        return E_FILTER_DROP;
+    }
+    
+    sFilterStats.u64Passed++;
+    return E_FILTER_PASS;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
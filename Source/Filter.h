@@ -0,0 +1,130 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Egress packet filter
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+#ifndef  FILTER_H_INCLUDED
+#define  FILTER_H_INCLUDED
+
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Maximum number of additional destination prefixes accepted by the filter */
+#define FILTER_MAX_PREFIXES                 8
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** Enumerated type of filter verdicts */
+typedef enum
+{
+    E_FILTER_PASS,                          /**< Forward the packet to the module */
+    E_FILTER_DROP,                          /**< Discard the packet silently */
+    E_FILTER_REJECT,                        /**< Discard the packet and return Destination Unreachable */
+} teFilterVerdict;
+
+
+/** Filter statistics */
+typedef struct
+{
+    uint64_t    u64Passed;              /**< Packets forwarded */
+    uint64_t    u64DroppedPrefix;       /**< Destination outside the 6LoWPAN prefix */
+    uint64_t    u64DroppedProtocol;     /**< Upper layer protocol not allowed */
+    uint64_t    u64DroppedPort;         /**< UDP or TCP destination port not allowed */
+    uint64_t    u64DroppedRate;         /**< Over a rate limit */
+    uint64_t    u64Reloads;             /**< Rules loaded successfully */
+    uint64_t    u64ReloadErrors;        /**< Rules files rejected */
+} tsFilterStats;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Path of the filter rules file, NULL for the built in rules */
+extern const char      *pcFilterRulesFile;
+
+
+/** Filter statistics */
+extern tsFilterStats    sFilterStats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Load the filter rules from pcFilterRulesFile. The rules are compiled to
+ *  lookup tables and replace the active set only if the whole file is valid,
+ *  so this may be called at any time to reload them.
+ *  \return 0 on success, -1 if the rules could not be loaded
+ */
+int iFilterLoad(void);
+
+
+/** Classify a packet read from the tun device.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    IPv6 packet
+ *  \param u32Length    Length of the packet
+ *  \param pu8Code      ICMPv6 Destination Unreachable code when the verdict is E_FILTER_REJECT
+ *  \return Verdict for the packet
+ */
+teFilterVerdict eFilterPacket(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length, uint8_t *pu8Code);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* FILTER_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,275 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Log-linear histogram
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+/* Buckets follow the HdrHistogram layout: values below
+ * 2^HISTOGRAM_SUB_BUCKET_BITS each have a bucket of their own, and every
+ * power of 2 above that is divided into the same number of equal buckets.
+ * Recording is a count leading zeros and a shift, and the memory used is
+ * fixed however many values are recorded.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "Histogram.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define SUB_BUCKETS                 (1 << HISTOGRAM_SUB_BUCKET_BITS)
+
+/* Number of percentile levels written per halving of the distance to 100% */
+#define PERCENTILE_TICKS_PER_HALF   5
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static uint32_t u32HistogramBucket(uint64_t u64Value)
+{
+    int iMsb;
+    
+    if (u64Value < SUB_BUCKETS)
+    {
+        return (uint32_t)u64Value;
+    }
+    if (u64Value >= (1ULL << HISTOGRAM_VALUE_BITS))
+    {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    
+    iMsb = 63 - __builtin_clzll(u64Value);
+    return ((iMsb - HISTOGRAM_SUB_BUCKET_BITS + 1) << HISTOGRAM_SUB_BUCKET_BITS) +
+           (uint32_t)((u64Value >> (iMsb - HISTOGRAM_SUB_BUCKET_BITS)) - SUB_BUCKETS);
+}
+
+
+/** Smallest value counted in a bucket */
+static uint64_t u64HistogramBucketLow(uint32_t u32Bucket)
+{
+    uint32_t u32Exponent = u32Bucket >> HISTOGRAM_SUB_BUCKET_BITS;
+    uint64_t u64Sub = u32Bucket & (SUB_BUCKETS - 1);
+    
+    if (u32Exponent == 0)
+    {
+        return u64Sub;
+    }
+    return (SUB_BUCKETS + u64Sub) << (u32Exponent - 1);
+}
+
+
+/** Largest value counted in a bucket */
+static uint64_t u64HistogramBucketHigh(uint32_t u32Bucket)
+{
+    uint32_t u32Exponent = u32Bucket >> HISTOGRAM_SUB_BUCKET_BITS;
+    
+    if (u32Exponent <= 1)
+    {
+        return u64HistogramBucketLow(u32Bucket);
+    }
+    return u64HistogramBucketLow(u32Bucket) + (1ULL << (u32Exponent - 1)) - 1;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+void vHistogramReset(tsHistogram *psHistogram)
+{
+    memset(psHistogram, 0, sizeof(tsHistogram));
+}
+
+
+void vHistogramRecord(tsHistogram *psHistogram, uint64_t u64Value)
+{
+    if ((psHistogram->u64Count == 0) || (u64Value < psHistogram->u64Min))
+    {
+        psHistogram->u64Min = u64Value;
+    }
+    if (u64Value > psHistogram->u64Max)
+    {
+        psHistogram->u64Max = u64Value;
+    }
+    psHistogram->au64Buckets[u32HistogramBucket(u64Value)]++;
+    psHistogram->u64Count++;
+    psHistogram->u64Sum += u64Value;
+}
+
+
+void vHistogramAdd(tsHistogram *psTo, const tsHistogram *psFrom)
+{
+    uint32_t i;
+    
+    if (psFrom->u64Count == 0)
+    {
+        return;
+    }
+    if ((psTo->u64Count == 0) || (psFrom->u64Min < psTo->u64Min))
+    {
+        psTo->u64Min = psFrom->u64Min;
+    }
+    if (psFrom->u64Max > psTo->u64Max)
+    {
+        psTo->u64Max = psFrom->u64Max;
+    }
+    
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        psTo->au64Buckets[i] += psFrom->au64Buckets[i];
+    }
+    psTo->u64Count += psFrom->u64Count;
+    psTo->u64Sum   += psFrom->u64Sum;
+}
+
+
+uint64_t u64HistogramPercentile(const tsHistogram *psHistogram, double dPercentile)
+{
+    uint64_t u64Target, u64Seen = 0;
+    uint32_t i;
+    
+    if (psHistogram->u64Count == 0)
+    {
+        return 0;
+    }
+    
+    if (dPercentile > 100.0)
+    {
+        dPercentile = 100.0;
+    }
+    u64Target = (uint64_t)ceil(dPercentile / 100.0 * psHistogram->u64Count);
+    if (u64Target == 0)
+    {
+        u64Target = 1;
+    }
+    
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        u64Seen += psHistogram->au64Buckets[i];
+        if (u64Seen >= u64Target)
+        {
+            uint64_t u64High = u64HistogramBucketHigh(i);
+            
+            /* Never report more than was actually recorded */
+            return (u64High < psHistogram->u64Max) ? u64High : psHistogram->u64Max;
+        }
+    }
+    return psHistogram->u64Max;
+}
+
+
+int iHistogramWrite(const tsHistogram *psHistogram, FILE *psFile, double dScale)
+{
+    double dPercentile = 0.0;
+    double dMean = 0.0, dDeviation = 0.0;
+    uint64_t u64Seen = 0;
+    uint32_t i = 0;
+    
+    fprintf(psFile, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    
+    while (psHistogram->u64Count)
+    {
+        uint64_t u64Target = (uint64_t)ceil(dPercentile / 100.0 * psHistogram->u64Count);
+        uint64_t u64Value;
+        
+        if (u64Target == 0)
+        {
+            u64Target = 1;
+        }
+        
+        /* Percentile levels only increase, so carry on from the last bucket */
+        while ((u64Seen + psHistogram->au64Buckets[i]) < u64Target)
+        {
+            u64Seen += psHistogram->au64Buckets[i];
+            i++;
+        }
+        u64Value = u64HistogramBucketHigh(i);
+        if (u64Value > psHistogram->u64Max)
+        {
+            u64Value = psHistogram->u64Max;
+        }
+        
+        if ((u64Seen + psHistogram->au64Buckets[i]) == psHistogram->u64Count)
+        {
+            fprintf(psFile, "%12.3f %14.12f %10llu\n", u64Value / dScale, 1.0, (unsigned long long)psHistogram->u64Count);
+            break;
+        }
+        
+        fprintf(psFile, "%12.3f %14.12f %10llu %14.2f\n", u64Value / dScale, dPercentile / 100.0,
+                (unsigned long long)(u64Seen + psHistogram->au64Buckets[i]), 100.0 / (100.0 - dPercentile));
+        
+        /* Levels get closer together as they approach 100% */
+        dPercentile += 100.0 / (PERCENTILE_TICKS_PER_HALF * 
+                                pow(2.0, floor(log2(100.0 / (100.0 - dPercentile))) + 1.0));
+    }
+    
+    if (psHistogram->u64Count)
+    {
+        dMean = (double)psHistogram->u64Sum / psHistogram->u64Count;
+        for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+        {
+            if (psHistogram->au64Buckets[i])
+            {
+                double dMid = (u64HistogramBucketLow(i) + u64HistogramBucketHigh(i)) / 2.0 - dMean;
+                
+                dDeviation += dMid * dMid * psHistogram->au64Buckets[i];
+            }
+        }
+        dDeviation = sqrt(dDeviation / psHistogram->u64Count);
+    }
+    
+    fprintf(psFile, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", dMean / dScale, dDeviation / dScale);
+    fprintf(psFile, "#[Max     = %12.3f, Total count    = %12llu]\n",
+            psHistogram->u64Max / dScale, (unsigned long long)psHistogram->u64Count);
+    fprintf(psFile, "#[Buckets = %12d, SubBuckets     = %12d]\n",
+            HISTOGRAM_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1, SUB_BUCKETS);
+    
+    return ferror(psFile) ? -1 : 0;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -0,0 +1,132 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Log-linear histogram
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+#ifndef  HISTOGRAM_H_INCLUDED
+#define  HISTOGRAM_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Each power of 2 is split into 2^HISTOGRAM_SUB_BUCKET_BITS buckets,
+ *  so a recorded value is within 1 part in 64 of the value reported */
+#define HISTOGRAM_SUB_BUCKET_BITS           6
+
+/** Values of 2^HISTOGRAM_VALUE_BITS and over are recorded as the largest bucket */
+#define HISTOGRAM_VALUE_BITS                40
+
+/** Number of buckets */
+#define HISTOGRAM_BUCKETS                   ((HISTOGRAM_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) << HISTOGRAM_SUB_BUCKET_BITS)
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** Distribution of a set of values, such as latencies, with a fixed
+ *  relative precision over the whole range */
+typedef struct
+{
+    uint64_t    u64Count;                       /**< Values recorded */
+    uint64_t    u64Sum;                         /**< Sum of the values recorded */
+    uint64_t    u64Min;                         /**< Smallest value recorded */
+    uint64_t    u64Max;                         /**< Largest value recorded */
+    uint64_t    au64Buckets[HISTOGRAM_BUCKETS]; /**< Number of values in each bucket */
+} tsHistogram;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Clear a histogram. A histogram that is all zero is empty. */
+void vHistogramReset(tsHistogram *psHistogram);
+
+
+/** Record a value in a histogram */
+void vHistogramRecord(tsHistogram *psHistogram, uint64_t u64Value);
+
+
+/** Add the values recorded in one histogram to another */
+void vHistogramAdd(tsHistogram *psTo, const tsHistogram *psFrom);
+
+
+/** Value below which a given percentage of the recorded values lie
+ *  \param psHistogram  Histogram
+ *  \param dPercentile  Percentage, 0 to 100
+ *  \return Largest value equivalent to the bucket the percentile falls in,
+ *          0 if nothing has been recorded
+ */
+uint64_t u64HistogramPercentile(const tsHistogram *psHistogram, double dPercentile);
+
+
+/** Write the percentile distribution in the text format produced by
+ *  HdrHistogram's outputPercentileDistribution, so that runs can be
+ *  compared with its plotting tools.
+ *  \param psHistogram  Histogram
+ *  \param psFile       Where to write it
+ *  \param dScale       Recorded values are divided by this for output,
+ *                      e.g. 1000 to write microseconds as milliseconds
+ *  \return 0 on success, -1 if writing failed
+ */
+int iHistogramWrite(const tsHistogram *psHistogram, FILE *psFile, double dScale);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* HISTOGRAM_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -0,0 +1,293 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          IPv6 packet helpers
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/ip6.h>
+#include <netinet/icmp6.h>
+
+#include <libdaemon/daemon.h>
+
+#include "IPv6.h"
+#include "TokenBucket.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/* Length of the ICMPv6 header including the 32 bit parameter */
+#define ICMPV6_ERROR_HEADER_LENGTH  8
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+tsIPv6Stats sIPv6Stats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+/** Token bucket limiting the rate of ICMPv6 errors (RFC 4443 2.4f) */
+static tsTokenBucket sErrorLimit = { (int64_t)IPV6_ICMP_ERROR_BURST * TOKEN_BUCKET_TOKEN, 0 };
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+uint16_t u16IPv6Checksum(const struct in6_addr *psSource, const struct in6_addr *psDest,
+                         uint8_t u8NextHeader, const uint8_t *pu8Data, uint32_t u32Length)
+{
+    uint32_t u32Sum = 0;
+    uint32_t i;
+    
+    for (i = 0; i < sizeof(struct in6_addr); i += 2)
+    {
+        u32Sum += (psSource->s6_addr[i] << 8) | psSource->s6_addr[i + 1];
+        u32Sum += (psDest->s6_addr[i] << 8)   | psDest->s6_addr[i + 1];
+    }
+    u32Sum += u32Length >> 16;
+    u32Sum += u32Length & 0xFFFF;
+    u32Sum += u8NextHeader;
+    
+    for (i = 0; i + 1 < u32Length; i += 2)
+    {
+        u32Sum += (pu8Data[i] << 8) | pu8Data[i + 1];
+    }
+    if (u32Length & 1)
+    {
+        u32Sum += pu8Data[u32Length - 1] << 8;
+    }
+    
+    while (u32Sum >> 16)
+    {
+        u32Sum = (u32Sum & 0xFFFF) + (u32Sum >> 16);
+    }
+    
+    u32Sum = ~u32Sum & 0xFFFF;
+    /* A computed checksum of zero is transmitted as all ones */
+    return u32Sum ? u32Sum : 0xFFFF;
+}
+
+
+uint8_t u8IPv6UpperLayer(const uint8_t *pu8Packet, uint32_t u32Length, uint32_t *pu32Offset)
+{
+    const struct ip6_hdr *psHeader = (const struct ip6_hdr *)pu8Packet;
+    uint32_t u32Offset = IPV6_HEADER_LENGTH;
+    uint8_t u8NextHeader;
+    
+    if ((u32Length < IPV6_HEADER_LENGTH) || ((pu8Packet[0] >> 4) != 6))
+    {
+        return IPV6_NEXT_HEADER_INVALID;
+    }
+    
+    u8NextHeader = psHeader->ip6_nxt;
+    
+    for (;;)
+    {
+        switch (u8NextHeader)
+        {
+            case IPPROTO_HOPOPTS:
+            case IPPROTO_ROUTING:
+            case IPPROTO_DSTOPTS:
+                if (u32Offset + 8 > u32Length)
+                {
+                    return IPV6_NEXT_HEADER_INVALID;
+                }
+                u8NextHeader = pu8Packet[u32Offset];
+                u32Offset += (pu8Packet[u32Offset + 1] + 1) * 8;
+                break;
+                
+            case IPPROTO_AH:
+                if (u32Offset + 8 > u32Length)
+                {
+                    return IPV6_NEXT_HEADER_INVALID;
+                }
+                u8NextHeader = pu8Packet[u32Offset];
+                u32Offset += (pu8Packet[u32Offset + 1] + 2) * 4;
+                break;
+                
+            case IPPROTO_FRAGMENT:
+            {
+                const struct ip6_frag *psFrag = (const struct ip6_frag *)&pu8Packet[u32Offset];
+                
+                if (u32Offset + sizeof(struct ip6_frag) > u32Length)
+                {
+                    return IPV6_NEXT_HEADER_INVALID;
+                }
+                if (psFrag->ip6f_offlg & IP6F_OFF_MASK)
+                {
+                    /* Upper layer header is in the first fragment */
+                    return IPV6_NEXT_HEADER_INVALID;
+                }
+                u8NextHeader = psFrag->ip6f_nxt;
+                u32Offset += sizeof(struct ip6_frag);
+                break;
+            }
+                
+            default:
+                if (u32Offset > u32Length)
+                {
+                    return IPV6_NEXT_HEADER_INVALID;
+                }
+                *pu32Offset = u32Offset;
+                return u8NextHeader;
+        }
+    }
+}
+
+
+bool bIPv6ErrorPermitted(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length, bool bMulticastOk)
+{
+    const struct ip6_hdr *psHeader = (const struct ip6_hdr *)pu8Packet;
+    uint32_t u32Offset;
+    
+    if ((u32Length < IPV6_HEADER_LENGTH) || ((pu8Packet[0] >> 4) != 6) ||
+        IN6_IS_ADDR_UNSPECIFIED(&psHeader->ip6_src) ||
+        IN6_IS_ADDR_MULTICAST(&psHeader->ip6_src) ||
+        (IN6_IS_ADDR_MULTICAST(&psHeader->ip6_dst) && !bMulticastOk))
+    {
+        sIPv6Stats.u64ErrorsSuppressed++;
+        return FALSE;
+    }
+    
+    if ((u8IPv6UpperLayer(pu8Packet, u32Length, &u32Offset) == IPPROTO_ICMPV6) &&
+        (u32Offset < u32Length) && (pu8Packet[u32Offset] < ICMP6_INFOMSG_MASK))
+    {
+        /* Never send an error about an error */
+        sIPv6Stats.u64ErrorsSuppressed++;
+        return FALSE;
+    }
+    
+    if (!bTokenBucketTake(&sErrorLimit, IPV6_ICMP_ERROR_RATE, IPV6_ICMP_ERROR_BURST, u64Now))
+    {
+        sIPv6Stats.u64ErrorsRateLimited++;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+uint32_t u32IPv6BuildError(uint8_t *pu8Buffer, const struct in6_addr *psSource,
+                           uint8_t u8Type, uint8_t u8Code, uint32_t u32Parameter,
+                           const uint8_t *pu8Invoking, uint32_t u32Length)
+{
+    struct ip6_hdr *psHeader = (struct ip6_hdr *)pu8Buffer;
+    struct icmp6_hdr *psICMP = (struct icmp6_hdr *)&pu8Buffer[IPV6_HEADER_LENGTH];
+    const struct ip6_hdr *psInvoking = (const struct ip6_hdr *)pu8Invoking;
+    uint32_t u32PayloadLength;
+    
+    if (u32Length > IPV6_MIN_MTU - IPV6_HEADER_LENGTH - ICMPV6_ERROR_HEADER_LENGTH)
+    {
+        u32Length = IPV6_MIN_MTU - IPV6_HEADER_LENGTH - ICMPV6_ERROR_HEADER_LENGTH;
+    }
+    u32PayloadLength = ICMPV6_ERROR_HEADER_LENGTH + u32Length;
+    
+    memset(psHeader, 0, IPV6_HEADER_LENGTH);
+    psHeader->ip6_vfc   = 6 << 4;
+    psHeader->ip6_plen  = htons(u32PayloadLength);
+    psHeader->ip6_nxt   = IPPROTO_ICMPV6;
+    psHeader->ip6_hlim  = 255;
+    memcpy(&psHeader->ip6_src, psSource, sizeof(struct in6_addr));
+    memcpy(&psHeader->ip6_dst, &psInvoking->ip6_src, sizeof(struct in6_addr));
+    
+    psICMP->icmp6_type      = u8Type;
+    psICMP->icmp6_code      = u8Code;
+    psICMP->icmp6_cksum     = 0;
+    psICMP->icmp6_data32[0] = htonl(u32Parameter);
+    memcpy(&pu8Buffer[IPV6_HEADER_LENGTH + ICMPV6_ERROR_HEADER_LENGTH], pu8Invoking, u32Length);
+    
+    psICMP->icmp6_cksum = htons(u16IPv6Checksum(&psHeader->ip6_src, &psHeader->ip6_dst, IPPROTO_ICMPV6,
+                                                (uint8_t *)psICMP, u32PayloadLength));
+    
+    sIPv6Stats.u64ErrorsSent++;
+    return IPV6_HEADER_LENGTH + u32PayloadLength;
+}
+
+
+int iIPv6ParseSocketAddress(const char *pcText, struct sockaddr_in6 *psAddr)
+{
+    const char *pcPort = strrchr(pcText, ':');
+    char acHost[INET6_ADDRSTRLEN];
+    unsigned long ulPort;
+    char *pcEnd;
+    
+    if (pcPort)
+    {
+        size_t iHostLength = pcPort - pcText;
+        
+        if ((iHostLength >= 2) && (pcText[0] == '[') && (pcText[iHostLength - 1] == ']'))
+        {
+            pcText++;
+            iHostLength -= 2;
+        }
+        if (iHostLength >= sizeof(acHost))
+        {
+            return -1;
+        }
+        memcpy(acHost, pcText, iHostLength);
+        acHost[iHostLength] = '\0';
+        if (inet_pton(AF_INET6, acHost, &psAddr->sin6_addr) != 1)
+        {
+            return -1;
+        }
+        pcPort++;
+    }
+    else
+    {
+        pcPort = pcText;
+    }
+    
+    ulPort = strtoul(pcPort, &pcEnd, 10);
+    if ((pcEnd == pcPort) || (*pcEnd != '\0') || (ulPort == 0) || (ulPort > 65535))
+    {
+        return -1;
+    }
+    psAddr->sin6_family = AF_INET6;
+    psAddr->sin6_port   = htons(ulPort);
+    return 0;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
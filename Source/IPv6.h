@@ -0,0 +1,171 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          IPv6 packet helpers
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+#ifndef  IPV6_H_INCLUDED
+#define  IPV6_H_INCLUDED
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Length of the fixed IPv6 header */
+#define IPV6_HEADER_LENGTH                  40
+
+/** Minimum link MTU every IPv6 link must support (RFC 2460) */
+#define IPV6_MIN_MTU                        1280
+
+/** Value returned by u8IPv6UpperLayer when the header chain cannot be followed */
+#define IPV6_NEXT_HEADER_INVALID            0xFF
+
+/** Number of ICMPv6 error messages that may be sent in a burst */
+#define IPV6_ICMP_ERROR_BURST               10
+
+/** Sustained ICMPv6 error messages per second */
+#define IPV6_ICMP_ERROR_RATE                10
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** Statistics for locally generated ICMPv6 messages */
+typedef struct
+{
+    uint64_t    u64ErrorsSent;          /**< ICMPv6 error messages generated */
+    uint64_t    u64ErrorsRateLimited;   /**< Errors not sent due to the rate limit */
+    uint64_t    u64ErrorsSuppressed;    /**< Errors not permitted in response to the packet (RFC 4443 2.4e) */
+} tsIPv6Stats;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** ICMPv6 statistics */
+extern tsIPv6Stats sIPv6Stats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Compute the checksum of an upper layer protocol carried in IPv6,
+ *  including the pseudo header.
+ *  \param psSource     Source address
+ *  \param psDest       Destination address
+ *  \param u8NextHeader Upper layer protocol number
+ *  \param pu8Data      Upper layer header and payload, with the checksum field zeroed
+ *  \param u32Length    Length of the upper layer data
+ *  \return Checksum in host byte order
+ */
+uint16_t u16IPv6Checksum(const struct in6_addr *psSource, const struct in6_addr *psDest,
+                         uint8_t u8NextHeader, const uint8_t *pu8Data, uint32_t u32Length);
+
+
+/** Follow the extension header chain of a packet to its upper layer header.
+ *  \param pu8Packet    IPv6 packet
+ *  \param u32Length    Length of the packet
+ *  \param pu32Offset   Offset of the upper layer header in the packet
+ *  \return Upper layer protocol number, IPV6_NEXT_HEADER_INVALID if the
+ *          packet is malformed or is a non-initial fragment
+ */
+uint8_t u8IPv6UpperLayer(const uint8_t *pu8Packet, uint32_t u32Length, uint32_t *pu32Offset);
+
+
+/** Determine if an ICMPv6 error may be sent in response to a packet and
+ *  the error rate limit allows it. Takes a token from the limit if so.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    Packet that caused the error
+ *  \param u32Length    Length of the packet
+ *  \param bMulticastOk Error may be sent for multicast destinations (Packet Too Big)
+ *  \return TRUE if the error should be sent
+ */
+bool bIPv6ErrorPermitted(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length, bool bMulticastOk);
+
+
+/** Build an ICMPv6 error message addressed to the source of a packet.
+ *  As much of the invoking packet is included as fits the minimum MTU.
+ *  \param pu8Buffer    Buffer of at least IPV6_MIN_MTU bytes for the message,
+ *                      which must not overlap the invoking packet
+ *  \param psSource     Source address for the error message
+ *  \param u8Type       ICMPv6 type
+ *  \param u8Code       ICMPv6 code
+ *  \param u32Parameter Type specific parameter (MTU, pointer)
+ *  \param pu8Invoking  Packet that caused the error
+ *  \param u32Length    Length of the packet
+ *  \return Length of the message built
+ */
+uint32_t u32IPv6BuildError(uint8_t *pu8Buffer, const struct in6_addr *psSource,
+                           uint8_t u8Type, uint8_t u8Code, uint32_t u32Parameter,
+                           const uint8_t *pu8Invoking, uint32_t u32Length);
+
+
+/** Parse a socket address written "[<address>:]<port>". The address may be
+ *  in brackets, as in "[::1]:8080".
+ *  \param pcText       Text to parse
+ *  \param psAddr       Filled in with the port, and the address if there is
+ *                      one. Its address is left as it was if there is not.
+ *  \return 0 on success, -1 if the address is not valid or the port is not 1 to 65535
+ */
+int iIPv6ParseSocketAddress(const char *pcText, struct sockaddr_in6 *psAddr);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* IPV6_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,630 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          JIP response cache
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+/* JIP clients tend to poll the same read-only variables of the same nodes
+ * over and over, and every request costs a trip across the serial link and
+ * the mesh. GET responses coming back from the mesh are cached here and
+ * repeated requests are answered by the daemon until the entry expires.
+ *
+ * JIP messages start with a version, a command and a handle chosen by the
+ * client to match responses to requests. A GET request then names a MIB
+ * index and a variable index. The cache is keyed on the node address and
+ * everything after the handle, and a cached response is replayed with the
+ * handle of the new request. Any SET sent to a node empties the node's
+ * entries, and a SET sent to a multicast group empties the whole cache.
+ *
+ * The cache is off unless a policy file is given. Policy file format, one
+ * rule per line, '#' starts a comment. Rules are matched in order, the first
+ * match wins, and a TTL of 0 means the variable is never cached:
+ *
+ *   ttl <MIB index>|* <variable index>|* <seconds>
+ *   default <seconds>                 TTL for variables no rule matches (default 0)
+ *
+ * Only cache scalar variables - a table may be returned in several response
+ * packets. Responses seen to span several packets are not cached.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+
+#include <libdaemon/daemon.h>
+
+#include "JIPCache.h"
+#include "IPv6.h"
+#include "TunDevice.h"
+#include "NodeTable.h"
+#include "Shaper.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/* JIP commands */
+#define JIP_COMMAND_GET_REQUEST     0x10
+#define JIP_COMMAND_GET_RESPONSE    0x11
+#define JIP_COMMAND_SET_REQUEST     0x12
+
+/* Length of the JIP header: version, command, handle */
+#define JIP_HEADER_LENGTH           3
+
+/* Number of cache entries (must be a power of 2) */
+#define JIPCACHE_SLOTS              512
+
+/* Number of outstanding requests tracked (must be a power of 2) */
+#define JIPCACHE_PENDING_SLOTS      64
+
+/* Longest request body that is cached */
+#define JIPCACHE_MAX_KEY            16
+
+/* Longest response body that is cached */
+#define JIPCACHE_MAX_RESPONSE       256
+
+/* Time to wait for the response to a request */
+#define JIPCACHE_PENDING_US         10000000
+
+/* Hop limit of responses sent from the cache */
+#define JIPCACHE_HOP_LIMIT          64
+
+/* Matches any MIB or variable index in a rule */
+#define JIPCACHE_ANY                0xFFFF
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** A TTL rule */
+typedef struct
+{
+    uint16_t        u16MibIndex;
+    uint16_t        u16VarIndex;
+    uint32_t        u32TTL;             /**< Seconds */
+} tsJIPCacheRule;
+
+
+/** Compiled policy */
+typedef struct
+{
+    uint32_t        u32NumRules;
+    tsJIPCacheRule  asRules[JIPCACHE_MAX_RULES];
+    uint32_t        u32DefaultTTL;
+} tsJIPCachePolicy;
+
+
+/** A request and the node it was sent to */
+typedef struct
+{
+    struct in6_addr sNode;
+    uint8_t         u8Version;
+    uint8_t         u8KeyLength;
+    uint8_t         au8Key[JIPCACHE_MAX_KEY];
+} tsJIPCacheKey;
+
+
+/** A cached response */
+typedef struct
+{
+    tsJIPCacheKey   sKey;
+    uint64_t        u64Expires;         /**< 0 if the entry is unused */
+    uint16_t        u16Length;
+    uint8_t         au8Response[JIPCACHE_MAX_RESPONSE];
+} tsJIPCacheEntry;
+
+
+/** A request on its way to a node */
+typedef struct
+{
+    tsJIPCacheKey   sKey;
+    struct in6_addr sClient;
+    uint16_t        u16ClientPort;
+    uint8_t         u8Handle;
+    int             iStored;            /**< A response has already been cached */
+    uint32_t        u32TTL;
+    uint64_t        u64Sent;            /**< 0 if the slot is unused */
+} tsJIPCachePending;
+
+
+/** Location of a JIP message within an IPv6 packet */
+typedef struct
+{
+    const struct ip6_hdr   *psHeader;
+    uint16_t                u16SourcePort;
+    uint16_t                u16DestPort;
+    const uint8_t          *pu8Message;
+    uint32_t                u32Length;
+} tsJIPMessage;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+const char         *pcJIPCachePolicyFile = NULL;
+
+tsJIPCacheStats     sJIPCacheStats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+/** Two policies, so a new one can be compiled while the other is in use */
+static tsJIPCachePolicy asPolicy[2];
+
+/** Policy in use, NULL while the cache is disabled */
+static tsJIPCachePolicy *psActivePolicy = NULL;
+
+static tsJIPCacheEntry asEntries[JIPCACHE_SLOTS];
+
+static tsJIPCachePending asPending[JIPCACHE_PENDING_SLOTS];
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/** FNV-1a hash */
+static uint32_t u32JIPCacheHash(uint32_t u32Hash, const uint8_t *pu8Data, uint32_t u32Length)
+{
+    uint32_t i;
+    
+    for (i = 0; i < u32Length; i++)
+    {
+        u32Hash = (u32Hash ^ pu8Data[i]) * 16777619;
+    }
+    return u32Hash;
+}
+
+
+static uint32_t u32JIPCacheKeyHash(const tsJIPCacheKey *psKey)
+{
+    uint32_t u32Hash = u32JIPCacheHash(2166136261u, psKey->sNode.s6_addr, sizeof(struct in6_addr));
+    
+    u32Hash = u32JIPCacheHash(u32Hash, &psKey->u8Version, 1);
+    return u32JIPCacheHash(u32Hash, psKey->au8Key, psKey->u8KeyLength);
+}
+
+
+static int iJIPCacheKeyMatch(const tsJIPCacheKey *psKey1, const tsJIPCacheKey *psKey2)
+{
+    return ((psKey1->u8Version == psKey2->u8Version) &&
+            (psKey1->u8KeyLength == psKey2->u8KeyLength) &&
+            (memcmp(&psKey1->sNode, &psKey2->sNode, sizeof(struct in6_addr)) == 0) &&
+            (memcmp(psKey1->au8Key, psKey2->au8Key, psKey1->u8KeyLength) == 0));
+}
+
+
+/** Slot tracking a request from a client */
+static tsJIPCachePending *psJIPCachePendingSlot(const struct in6_addr *psNode, const struct in6_addr *psClient,
+                                                uint16_t u16ClientPort, uint8_t u8Handle)
+{
+    uint32_t u32Hash = u32JIPCacheHash(2166136261u, psNode->s6_addr, sizeof(struct in6_addr));
+    
+    u32Hash = u32JIPCacheHash(u32Hash, psClient->s6_addr, sizeof(struct in6_addr));
+    u32Hash = u32JIPCacheHash(u32Hash, (const uint8_t *)&u16ClientPort, sizeof(uint16_t));
+    u32Hash = u32JIPCacheHash(u32Hash, &u8Handle, 1);
+    return &asPending[u32Hash & (JIPCACHE_PENDING_SLOTS - 1)];
+}
+
+
+/** Find the JIP message in a packet.
+ *  \return 0 if the packet is a UDP packet to or from the JIP port
+ */
+static int iJIPCacheParse(const uint8_t *pu8Packet, uint32_t u32Length, tsJIPMessage *psMessage)
+{
+    const struct udphdr *psUDP;
+    uint32_t u32Offset;
+    uint32_t u32UDPLength;
+    
+    if ((u32Length < IPV6_HEADER_LENGTH) ||
+        (u8IPv6UpperLayer(pu8Packet, u32Length, &u32Offset) != IPPROTO_UDP) ||
+        (u32Offset + sizeof(struct udphdr) + JIP_HEADER_LENGTH > u32Length))
+    {
+        return -1;
+    }
+    
+    psUDP = (const struct udphdr *)&pu8Packet[u32Offset];
+    psMessage->psHeader         = (const struct ip6_hdr *)pu8Packet;
+    psMessage->u16SourcePort    = ntohs(psUDP->uh_sport);
+    psMessage->u16DestPort      = ntohs(psUDP->uh_dport);
+    
+    if ((psMessage->u16SourcePort != JIP_PORT) && (psMessage->u16DestPort != JIP_PORT))
+    {
+        return -1;
+    }
+    
+    u32UDPLength = ntohs(psUDP->uh_ulen);
+    if ((u32UDPLength < sizeof(struct udphdr) + JIP_HEADER_LENGTH) || (u32Offset + u32UDPLength > u32Length))
+    {
+        return -1;
+    }
+    psMessage->pu8Message   = &pu8Packet[u32Offset + sizeof(struct udphdr)];
+    psMessage->u32Length    = u32UDPLength - sizeof(struct udphdr);
+    return 0;
+}
+
+
+/** Find the TTL of a variable.
+ *  \return TTL in seconds, 0 if it is not cached
+ */
+static uint32_t u32JIPCacheTTL(const tsJIPCachePolicy *psPolicy, uint8_t u8MibIndex, uint8_t u8VarIndex)
+{
+    uint32_t i;
+    
+    for (i = 0; i < psPolicy->u32NumRules; i++)
+    {
+        const tsJIPCacheRule *psRule = &psPolicy->asRules[i];
+        
+        if (((psRule->u16MibIndex == JIPCACHE_ANY) || (psRule->u16MibIndex == u8MibIndex)) &&
+            ((psRule->u16VarIndex == JIPCACHE_ANY) || (psRule->u16VarIndex == u8VarIndex)))
+        {
+            return psRule->u32TTL;
+        }
+    }
+    return psPolicy->u32DefaultTTL;
+}
+
+
+/** Remove every entry for a node, or every entry if psNode is NULL */
+static void vJIPCacheInvalidate(const struct in6_addr *psNode)
+{
+    uint32_t i;
+    
+    for (i = 0; i < JIPCACHE_SLOTS; i++)
+    {
+        if (asEntries[i].u64Expires &&
+            (!psNode || (memcmp(&asEntries[i].sKey.sNode, psNode, sizeof(struct in6_addr)) == 0)))
+        {
+            asEntries[i].u64Expires = 0;
+            sJIPCacheStats.u64Invalidated++;
+        }
+    }
+}
+
+
+static int iJIPCacheParseIndex(const char *pcIndex, uint16_t *pu16Index)
+{
+    char *pcEnd;
+    unsigned long ulIndex;
+    
+    if (strcmp(pcIndex, "*") == 0)
+    {
+        *pu16Index = JIPCACHE_ANY;
+        return 0;
+    }
+    ulIndex = strtoul(pcIndex, &pcEnd, 0);
+    if ((*pcEnd != '\0') || (ulIndex > 0xFF))
+    {
+        return -1;
+    }
+    *pu16Index = ulIndex;
+    return 0;
+}
+
+
+static int iJIPCacheParseTTL(const char *pcTTL, uint32_t *pu32TTL)
+{
+    char *pcEnd;
+    unsigned long ulTTL = strtoul(pcTTL, &pcEnd, 10);
+    
+    if ((*pcEnd != '\0') || (ulTTL > 86400))
+    {
+        return -1;
+    }
+    *pu32TTL = ulTTL;
+    return 0;
+}
+
+
+/** Compile one line of a policy.
+ *  \return 0 if the line was valid
+ */
+static int iJIPCacheParseLine(tsJIPCachePolicy *psPolicy, char *pcLine)
+{
+    char *pcSave = NULL;
+    char *pcKeyword, *pcArg1, *pcArg2, *pcArg3;
+    
+    pcKeyword = strtok_r(pcLine, " \t\r\n", &pcSave);
+    if (!pcKeyword || (pcKeyword[0] == '#'))
+    {
+        return 0;
+    }
+    pcArg1 = strtok_r(NULL, " \t\r\n", &pcSave);
+    pcArg2 = strtok_r(NULL, " \t\r\n", &pcSave);
+    pcArg3 = strtok_r(NULL, " \t\r\n", &pcSave);
+    
+    if (!pcArg1)
+    {
+        return -1;
+    }
+    
+    if (strcmp(pcKeyword, "ttl") == 0)
+    {
+        tsJIPCacheRule *psRule;
+        
+        if (!pcArg3 || (psPolicy->u32NumRules == JIPCACHE_MAX_RULES))
+        {
+            return -1;
+        }
+        psRule = &psPolicy->asRules[psPolicy->u32NumRules];
+        if ((iJIPCacheParseIndex(pcArg1, &psRule->u16MibIndex) < 0) ||
+            (iJIPCacheParseIndex(pcArg2, &psRule->u16VarIndex) < 0) ||
+            (iJIPCacheParseTTL(pcArg3, &psRule->u32TTL) < 0))
+        {
+            return -1;
+        }
+        psPolicy->u32NumRules++;
+    }
+    else if (strcmp(pcKeyword, "default") == 0)
+    {
+        if (iJIPCacheParseTTL(pcArg1, &psPolicy->u32DefaultTTL) < 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iJIPCacheLoad(void)
+{
+    tsJIPCachePolicy *psPolicy = (psActivePolicy == &asPolicy[0]) ? &asPolicy[1] : &asPolicy[0];
+    char acLine[256];
+    uint32_t u32LineNumber = 0;
+    FILE *psFile;
+    
+    if (!pcJIPCachePolicyFile)
+    {
+        return 0;
+    }
+    
+    memset(psPolicy, 0, sizeof(tsJIPCachePolicy));
+    
+    psFile = fopen(pcJIPCachePolicyFile, "r");
+    if (!psFile)
+    {
+        daemon_log(LOG_ERR, "Could not open JIP cache policy '%s' (%s)", pcJIPCachePolicyFile, strerror(errno));
+        sJIPCacheStats.u64ReloadErrors++;
+        return -1;
+    }
+    
+    while (fgets(acLine, sizeof(acLine), psFile))
+    {
+        u32LineNumber++;
+        if (iJIPCacheParseLine(psPolicy, acLine) < 0)
+        {
+            daemon_log(LOG_ERR, "Invalid JIP cache rule at %s:%u, keeping previous policy", pcJIPCachePolicyFile, u32LineNumber);
+            fclose(psFile);
+            sJIPCacheStats.u64ReloadErrors++;
+            return -1;
+        }
+    }
+    fclose(psFile);
+    
+    daemon_log(LOG_INFO, "Loaded JIP cache policy from %s", pcJIPCachePolicyFile);
+    
+    /* Entries were stored under the previous TTLs */
+    memset(asEntries, 0, sizeof(asEntries));
+    memset(asPending, 0, sizeof(asPending));
+    
+    psActivePolicy = psPolicy;
+    sJIPCacheStats.u64Reloads++;
+    return 0;
+}
+
+
+bool bJIPCacheRequest(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length)
+{
+    const tsJIPCachePolicy *psPolicy = psActivePolicy;
+    tsJIPMessage sMessage;
+    tsJIPCacheKey sKey;
+    tsJIPCacheEntry *psEntry;
+    tsJIPCachePending *psPending;
+    uint32_t u32TTL;
+    
+    if (!psPolicy || (iJIPCacheParse(pu8Packet, u32Length, &sMessage) < 0) || (sMessage.u16DestPort != JIP_PORT))
+    {
+        return FALSE;
+    }
+    
+    if (sMessage.pu8Message[1] == JIP_COMMAND_SET_REQUEST)
+    {
+        vJIPCacheInvalidate(IN6_IS_ADDR_MULTICAST(&sMessage.psHeader->ip6_dst) ? NULL : &sMessage.psHeader->ip6_dst);
+        return FALSE;
+    }
+    
+    if ((sMessage.pu8Message[1] != JIP_COMMAND_GET_REQUEST) ||
+        IN6_IS_ADDR_MULTICAST(&sMessage.psHeader->ip6_dst) ||
+        (sMessage.u32Length < JIP_HEADER_LENGTH + 2) ||
+        (sMessage.u32Length > JIP_HEADER_LENGTH + JIPCACHE_MAX_KEY))
+    {
+        return FALSE;
+    }
+    
+    u32TTL = u32JIPCacheTTL(psPolicy, sMessage.pu8Message[JIP_HEADER_LENGTH], sMessage.pu8Message[JIP_HEADER_LENGTH + 1]);
+    if (u32TTL == 0)
+    {
+        return FALSE;
+    }
+    
+    memset(&sKey, 0, sizeof(tsJIPCacheKey));
+    memcpy(&sKey.sNode, &sMessage.psHeader->ip6_dst, sizeof(struct in6_addr));
+    sKey.u8Version      = sMessage.pu8Message[0];
+    sKey.u8KeyLength    = sMessage.u32Length - JIP_HEADER_LENGTH;
+    memcpy(sKey.au8Key, &sMessage.pu8Message[JIP_HEADER_LENGTH], sKey.u8KeyLength);
+    
+    psEntry = &asEntries[u32JIPCacheKeyHash(&sKey) & (JIPCACHE_SLOTS - 1)];
+    if (psEntry->u64Expires && iJIPCacheKeyMatch(&psEntry->sKey, &sKey))
+    {
+        if (u64Now < psEntry->u64Expires)
+        {
+            uint8_t au8Buffer[IPV6_HEADER_LENGTH + sizeof(struct udphdr) + JIP_HEADER_LENGTH + JIPCACHE_MAX_RESPONSE];
+            struct ip6_hdr *psHeader = (struct ip6_hdr *)au8Buffer;
+            struct udphdr *psUDP = (struct udphdr *)&au8Buffer[IPV6_HEADER_LENGTH];
+            uint8_t *pu8Message = &au8Buffer[IPV6_HEADER_LENGTH + sizeof(struct udphdr)];
+            uint16_t u16UDPLength = sizeof(struct udphdr) + JIP_HEADER_LENGTH + psEntry->u16Length;
+            
+            /* Answer as the node would have */
+            memset(psHeader, 0, IPV6_HEADER_LENGTH);
+            psHeader->ip6_vfc   = 0x60;
+            psHeader->ip6_plen  = htons(u16UDPLength);
+            psHeader->ip6_nxt   = IPPROTO_UDP;
+            psHeader->ip6_hlim  = JIPCACHE_HOP_LIMIT;
+            memcpy(&psHeader->ip6_src, &sMessage.psHeader->ip6_dst, sizeof(struct in6_addr));
+            memcpy(&psHeader->ip6_dst, &sMessage.psHeader->ip6_src, sizeof(struct in6_addr));
+            
+            psUDP->uh_sport     = htons(JIP_PORT);
+            psUDP->uh_dport     = htons(sMessage.u16SourcePort);
+            psUDP->uh_ulen      = htons(u16UDPLength);
+            psUDP->uh_sum       = 0;
+            
+            pu8Message[0]       = sMessage.pu8Message[0];
+            pu8Message[1]       = JIP_COMMAND_GET_RESPONSE;
+            pu8Message[2]       = sMessage.pu8Message[2];
+            memcpy(&pu8Message[JIP_HEADER_LENGTH], psEntry->au8Response, psEntry->u16Length);
+            
+            psUDP->uh_sum = htons(u16IPv6Checksum(&psHeader->ip6_src, &psHeader->ip6_dst, IPPROTO_UDP,
+                                                  (uint8_t *)psUDP, u16UDPLength));
+            if (psUDP->uh_sum == 0)
+            {
+                psUDP->uh_sum = 0xFFFF;
+            }
+            
+            if (eTunDeviceWritePacket(IPV6_HEADER_LENGTH + u16UDPLength, au8Buffer) != E_TUN_OK)
+            {
+                /* Let the node answer instead */
+                return FALSE;
+            }
+            
+            sJIPCacheStats.u64Hits++;
+            sJIPCacheStats.u64AirtimeSavedUs += u32ShaperAirtime(u32Length, u8NodeTableHops(&sKey.sNode)) +
+                                                u32ShaperAirtime(IPV6_HEADER_LENGTH + u16UDPLength, u8NodeTableHops(&sKey.sNode));
+            return TRUE;
+        }
+        psEntry->u64Expires = 0;
+        sJIPCacheStats.u64Expired++;
+    }
+    
+    /* Remember the request so the response can be cached */
+    sJIPCacheStats.u64Misses++;
+    psPending = psJIPCachePendingSlot(&sKey.sNode, &sMessage.psHeader->ip6_src, sMessage.u16SourcePort, sMessage.pu8Message[2]);
+    memcpy(&psPending->sKey, &sKey, sizeof(tsJIPCacheKey));
+    memcpy(&psPending->sClient, &sMessage.psHeader->ip6_src, sizeof(struct in6_addr));
+    psPending->u16ClientPort    = sMessage.u16SourcePort;
+    psPending->u8Handle         = sMessage.pu8Message[2];
+    psPending->iStored          = 0;
+    psPending->u32TTL           = u32TTL;
+    psPending->u64Sent          = u64Now;
+    return FALSE;
+}
+
+
+void vJIPCacheResponse(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length)
+{
+    tsJIPMessage sMessage;
+    tsJIPCachePending *psPending;
+    tsJIPCacheEntry *psEntry;
+    uint32_t u32ResponseLength;
+    
+    if (!psActivePolicy || (iJIPCacheParse(pu8Packet, u32Length, &sMessage) < 0) ||
+        (sMessage.u16SourcePort != JIP_PORT) || (sMessage.pu8Message[1] != JIP_COMMAND_GET_RESPONSE))
+    {
+        return;
+    }
+    
+    psPending = psJIPCachePendingSlot(&sMessage.psHeader->ip6_src, &sMessage.psHeader->ip6_dst,
+                                      sMessage.u16DestPort, sMessage.pu8Message[2]);
+    if (!psPending->u64Sent ||
+        ((u64Now - psPending->u64Sent) > JIPCACHE_PENDING_US) ||
+        (psPending->u8Handle != sMessage.pu8Message[2]) ||
+        (psPending->u16ClientPort != sMessage.u16DestPort) ||
+        (memcmp(&psPending->sKey.sNode, &sMessage.psHeader->ip6_src, sizeof(struct in6_addr)) != 0) ||
+        (memcmp(&psPending->sClient, &sMessage.psHeader->ip6_dst, sizeof(struct in6_addr)) != 0))
+    {
+        /* Not a response to a request being cached */
+        return;
+    }
+    
+    psEntry = &asEntries[u32JIPCacheKeyHash(&psPending->sKey) & (JIPCACHE_SLOTS - 1)];
+    
+    if (psPending->iStored)
+    {
+        /* More than one packet in the response, so the first is not the whole answer */
+        if (psEntry->u64Expires && iJIPCacheKeyMatch(&psEntry->sKey, &psPending->sKey))
+        {
+            psEntry->u64Expires = 0;
+        }
+        psPending->u64Sent = 0;
+        sJIPCacheStats.u64Uncacheable++;
+        return;
+    }
+    
+    u32ResponseLength = sMessage.u32Length - JIP_HEADER_LENGTH;
+    if (u32ResponseLength > JIPCACHE_MAX_RESPONSE)
+    {
+        psPending->u64Sent = 0;
+        sJIPCacheStats.u64Uncacheable++;
+        return;
+    }
+    
+    memcpy(&psEntry->sKey, &psPending->sKey, sizeof(tsJIPCacheKey));
+    psEntry->u64Expires = u64Now + (uint64_t)psPending->u32TTL * 1000000;
+    psEntry->u16Length  = u32ResponseLength;
+    memcpy(psEntry->au8Response, &sMessage.pu8Message[JIP_HEADER_LENGTH], u32ResponseLength);
+    
+    /* Keep watching for a second packet until the request times out */
+    psPending->iStored = 1;
+    sJIPCacheStats.u64Stored++;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
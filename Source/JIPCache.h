@@ -0,0 +1,138 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          JIP response cache
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+#ifndef  JIPCACHE_H_INCLUDED
+#define  JIPCACHE_H_INCLUDED
+
+#include <stdint.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** UDP port used by JIP */
+#define JIP_PORT                            1873
+
+/** Maximum number of TTL rules in a cache policy */
+#define JIPCACHE_MAX_RULES                  64
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** JIP cache statistics */
+typedef struct
+{
+    uint64_t    u64Hits;                /**< GET requests answered from the cache */
+    uint64_t    u64Misses;              /**< Cacheable GET requests sent to the node */
+    uint64_t    u64Stored;              /**< Responses added to the cache */
+    uint64_t    u64Expired;             /**< Entries found to be out of date */
+    uint64_t    u64Invalidated;         /**< Entries removed because of a SET */
+    uint64_t    u64Uncacheable;         /**< Responses that spanned more than one packet */
+    uint64_t    u64AirtimeSavedUs;      /**< Estimated radio airtime saved by cache hits */
+    uint64_t    u64Reloads;             /**< Policies loaded successfully */
+    uint64_t    u64ReloadErrors;        /**< Policy files rejected */
+} tsJIPCacheStats;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Path of the cache policy file, NULL to disable the cache */
+extern const char          *pcJIPCachePolicyFile;
+
+
+/** JIP cache statistics */
+extern tsJIPCacheStats      sJIPCacheStats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Load the cache policy from pcJIPCachePolicyFile. The active policy is
+ *  only replaced if the whole file is valid, so this may be called at any
+ *  time to reload it. Loading a policy empties the cache.
+ *  \return 0 on success, -1 if the policy could not be loaded
+ */
+int iJIPCacheLoad(void);
+
+
+/** Examine a packet read from the tun device. A GET request that can be
+ *  answered from the cache is answered by writing the response to the tun
+ *  device. A SET request invalidates everything cached for its destination.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    IPv6 packet
+ *  \param u32Length    Length of the packet
+ *  \return TRUE if the request was answered and should not be sent on
+ */
+bool bJIPCacheRequest(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length);
+
+
+/** Examine a packet received from the mesh, and cache it if it is the
+ *  response to a cacheable GET request.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    IPv6 packet
+ *  \param u32Length    Length of the packet
+ */
+void vJIPCacheResponse(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* JIPCACHE_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -44,7 +44,6 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <time.h>
-#include <pthread.h>
 #include <sys/stat.h>
 
 #include <libdaemon/daemon.h>
@@ -52,6 +51,15 @@
 #include "JennicModule.h"
 #include "TunDevice.h"
 #include "SerialLink.h"
+#include "Shaper.h"
+#include "Clock.h"
+#include "IPv6.h"
+#include "NodeTable.h"
+#include "Mailbox.h"
+#include "JIPCache.h"
+#include "Coalesce.h"
+#include "NAT64.h"
+#include "Latency.h"
 
 #ifdef USE_ZEROCONF
 #include "Zeroconf.h"
@@ -73,6 +81,8 @@ static struct
     unsigned    uAddressKnown           : 1;    /**< IPv6 address information has been received */
     unsigned    uConfigKnown            : 1;    /**< Configuration of node is known */
     unsigned    uSupportsPing           : 1;    /**< Node supports the ping message */
+    unsigned    uCreditFlowControl      : 1;    /**< Node flow controls IPv6 frames with credits */
+    unsigned    uReconfigured           : 1;    /**< Configuration was changed at run time, so notify when it is read back */
 } sFlags;
 
 
@@ -91,6 +101,22 @@ static enum
     E_STATE_RUNNING,
 } eModuleState;
 
+/** Names of the states, for reporting */
+static const char *apcModuleState[] =
+{
+    "idle",
+    "determine_version",
+    "configure_network",
+    "configure_security",
+    "configure_profile",
+    "start_module",
+    "configure_frontend",
+    "determine_configuration",
+    "determine_address",
+    "activity_led",
+    "running",
+};
+
 
 /** Structure definition to configure the operating parameters of the network 
  *  This verison of the structure is used for the 1.0.X series border routers
@@ -120,6 +146,17 @@ typedef struct
 } __attribute__((__packed__)) tsModule_ConfigV11 ;
 
 
+/** Structure definition of a credit update from the border router.
+ *  Sent by border routers that enabled E_SL_CAPABILITY_CREDIT whenever they free
+ *  IPv6 buffers, and in response to an empty E_SL_MSG_CREDIT from the host.
+ */
+typedef struct
+{
+    uint8_t     u8Window;                       /**< Number of IPv6 buffers in the border router */
+    uint16_t    u16Consumed;                    /**< Running count of IPv6 frames taken from the serial link */
+} __attribute__((__packed__)) tsModule_Credit ;
+
+
 /** Structure definition to configure the security parameters of the network */
 typedef struct
 {
@@ -143,7 +180,7 @@ int              iSecureNetwork     = 0;
 struct in6_addr  sSecurityKey;
 teAuthScheme     eAuthScheme        = SECURITY_CONFIG_DEFAULT_AUTH_SCHEME;
 tuAuthSchemeData uAuthSchemeData;
-void *(*vprConfigChanged)(void *arg)= NULL;
+void (*vprConfigChanged)(void)    = NULL;
 
 
 teActivityLED    eActivityLED       = E_ACTIVITY_LED_NONE;
@@ -153,12 +190,58 @@ teRadioFrontEnd  eRadioFrontEnd     = E_FRONTEND_STANDARD_POWER;
 
 int              iAntennaDiversity  = 0;
 
+int              iReliableSerialLink= 1;
+
 /** Firmware version of the connected device */
 static uint32_t u32JennicDeviceVersion = 0;
 
 /** Time of last successful communications */
 time_t  sLastSuccessfulComms = 0;
 
+/** Module link statistics */
+tsModuleStats    sModuleStats;
+
+/** Address of the border router node */
+struct in6_addr  sModuleAddress;
+
+/** Capabilities offered to the module in the version request */
+static uint8_t u8HostCapabilities = E_SL_CAPABILITY_CREDIT;
+
+/** Time to wait for the reliable link window to open before checking again */
+#define RELIABLE_WINDOW_WAIT_US     5000
+
+/** Time to wait for a credit update before asking the module for one */
+#define CREDIT_STALL_TIMEOUT_US     200000
+
+/** Credit based flow control state */
+static struct
+{
+    uint8_t     u8Window;               /**< Number of IPv6 buffers in the module */
+    uint16_t    u16Sent;                /**< IPv6 frames sent since flow control was enabled */
+    uint16_t    u16Consumed;            /**< IPv6 frames the module has taken from its buffers */
+    uint64_t    u64Stalled;             /**< Time the queue stalled waiting for credit, 0 if not stalled */
+    uint64_t    u64LastRequest;         /**< Time a credit update was last requested */
+} sCredit;
+
+/** Entry in the queue of IPv6 packets waiting for the module */
+typedef struct
+{
+    uint16_t    u16Length;
+    uint8_t     u8Hops;
+    uint64_t    u64Queued;                  /**< Time the packet was queued */
+    uint64_t    u64IngressNs;               /**< Time the packet was read from a local host, 0 if it was not */
+    uint64_t    u64QueuedNs;                /**< Time the packet was queued, for latency histograms */
+    uint8_t     au8Data[MODULE_MAX_PACKET_LENGTH];
+} tsTxQueueEntry;
+
+/** Queue of IPv6 packets waiting for the module */
+static struct
+{
+    tsTxQueueEntry  asEntries[MODULE_TX_QUEUE_LENGTH];
+    uint32_t        u32Head;                /**< Index of the oldest packet */
+    uint32_t        u32Count;               /**< Number of packets queued */
+} sTxQueue;
+
 extern int verbosity;
 
 static teModuleStatus eJennicModuleWriteConfig(void)
@@ -389,11 +472,167 @@ teModuleStatus JennicModuleGetIPv6Address(void)
 
 teModuleStatus eJennicModuleWriteIPv6(uint32_t u32Length, uint8_t *pu8Data)
 {
-    vSL_WriteMessage(E_SL_MSG_IPV6, u32Length, pu8Data);
+    tsTxQueueEntry *psEntry;
+    teModuleTxWait eWait;
+    uint64_t u64Now;
+    
+    if (u32Length > MODULE_MAX_PACKET_LENGTH)
+    {
+        daemon_log(LOG_ERR, "IPv6 packet too long for module (%u bytes)", u32Length);
+        return E_MODULE_ERROR;
+    }
+    
+    if (sTxQueue.u32Count == MODULE_TX_QUEUE_LENGTH)
+    {
+        if (verbosity >= LOG_DEBUG)
+        {
+            daemon_log(LOG_DEBUG, "Transmit queue full, dropping packet");
+        }
+        sModuleStats.u64TxQueueDrops++;
+        return E_MODULE_OK;
+    }
+    
+    psEntry = &sTxQueue.asEntries[(sTxQueue.u32Head + sTxQueue.u32Count) % MODULE_TX_QUEUE_LENGTH];
+    u64Now = u64ClockNowUs();
+    psEntry->u16Length  = u32Length;
+    psEntry->u8Hops     = (u32Length >= IPV6_HEADER_LENGTH) ? u8NodeTableHops((const struct in6_addr *)&pu8Data[24]) : 0;
+    psEntry->u64Queued  = u64Now;
+    psEntry->u64IngressNs = u64LatencyIngress;
+    psEntry->u64QueuedNs  = u64ClockNowNs();
+    memcpy(psEntry->au8Data, pu8Data, u32Length);
+    sTxQueue.u32Count++;
+    
+    if (u32JennicModuleServiceTxQueue(u64Now, &eWait) != 0)
+    {
+        switch (eWait)
+        {
+            case E_MODULE_TX_WAIT_SHAPER:
+                sShaperStats.u64PacketsDelayed++;
+                break;
+            case E_MODULE_TX_WAIT_CREDIT:
+                sModuleStats.u64TxDelayedCredit++;
+                break;
+            default:
+                sModuleStats.u64TxDelayedWindow++;
+                break;
+        }
+    }
     return E_MODULE_OK;
 }
 
 
+/** Called when the transmit queue cannot proceed for lack of credit.
+ *  If no update arrives for a while it may have been lost on the serial
+ *  link, so ask the module to send another.
+ *  \param u64Now       Current time
+ *  \return Microseconds until the stall should be checked again
+ */
+static uint32_t u32JennicModuleCreditStall(uint64_t u64Now)
+{
+    if (sCredit.u64Stalled == 0)
+    {
+        sCredit.u64Stalled      = u64Now;
+        sCredit.u64LastRequest  = u64Now;
+        sModuleStats.u64CreditStalls++;
+    }
+    else if ((u64Now - sCredit.u64LastRequest) >= CREDIT_STALL_TIMEOUT_US)
+    {
+        if (verbosity >= LOG_DEBUG)
+        {
+            daemon_log(LOG_DEBUG, "Writing Module: Credit request");
+        }
+        vSL_WriteMessage(E_SL_MSG_CREDIT, 0, NULL);
+        sCredit.u64LastRequest = u64Now;
+        sModuleStats.u64CreditRequests++;
+    }
+    return (uint32_t)(sCredit.u64LastRequest + CREDIT_STALL_TIMEOUT_US - u64Now);
+}
+
+
+uint32_t u32JennicModuleServiceTxQueue(uint64_t u64Now, teModuleTxWait *peWait)
+{
+    teModuleTxWait eWait;
+    
+    if (!peWait)
+    {
+        peWait = &eWait;
+    }
+    *peWait = E_MODULE_TX_READY;
+    
+    while (sTxQueue.u32Count)
+    {
+        tsTxQueueEntry *psEntry = &sTxQueue.asEntries[sTxQueue.u32Head];
+        uint64_t u64EncodeNs, u64WrittenNs;
+        uint32_t u32Wait;
+        
+        if (!bSL_TxWindowOpen())
+        {
+            /* Wait for acknowledgements so the packet is not sent unprotected */
+            *peWait = E_MODULE_TX_WAIT_WINDOW;
+            return RELIABLE_WINDOW_WAIT_US;
+        }
+        
+        if (sFlags.uCreditFlowControl)
+        {
+            /* The module tells us exactly how much buffer space it has */
+            if ((uint16_t)(sCredit.u16Sent - sCredit.u16Consumed) >= sCredit.u8Window)
+            {
+                *peWait = E_MODULE_TX_WAIT_CREDIT;
+                return u32JennicModuleCreditStall(u64Now);
+            }
+            sCredit.u64Stalled = 0;
+            sCredit.u16Sent++;
+        }
+        else
+        {
+            /* Legacy firmware - estimate what the radio can take */
+            u32Wait = u32ShaperWaitTime(u64Now);
+            if (u32Wait)
+            {
+                *peWait = E_MODULE_TX_WAIT_SHAPER;
+                return u32Wait;
+            }
+            vShaperCharge(u64Now, u32ShaperAirtime(psEntry->u16Length, psEntry->u8Hops));
+        }
+        
+        u64EncodeNs = u64ClockNowNs();
+        vSL_WriteMessage(E_SL_MSG_IPV6, psEntry->u16Length, psEntry->au8Data);
+        u64WrittenNs = u64ClockNowNs();
+        
+        vLatencyRecord(E_LATENCY_TX_PROCESS, psEntry->u64IngressNs, psEntry->u64QueuedNs);
+        vLatencyRecord(E_LATENCY_TX_QUEUE, psEntry->u64QueuedNs, u64EncodeNs);
+        vLatencyRecord(E_LATENCY_TX_WRITE, u64EncodeNs, u64WrittenNs);
+        vLatencyRecord(E_LATENCY_TX_TOTAL, psEntry->u64IngressNs, u64WrittenNs);
+        
+        sModuleStats.u64IPv6TxPackets++;
+        sModuleStats.u64IPv6TxBytes += psEntry->u16Length;
+        vNodeTableOutbound(u64Now, psEntry->au8Data, psEntry->u16Length, (uint32_t)(u64Now - psEntry->u64Queued));
+        
+        sTxQueue.u32Head = (sTxQueue.u32Head + 1) % MODULE_TX_QUEUE_LENGTH;
+        sTxQueue.u32Count--;
+    }
+    return 0;
+}
+
+
+uint32_t u32JennicModuleTxQueueDepth(void)
+{
+    return sTxQueue.u32Count;
+}
+
+
+const char *pcJennicModuleState(void)
+{
+    return apcModuleState[eModuleState];
+}
+
+
+uint32_t u32JennicModuleVersion(void)
+{
+    return sFlags.uVersionKnown ? u32JennicDeviceVersion : 0;
+}
+
+
 teModuleStatus eJennicModuleWritePing(void)
 {
     if (verbosity >= LOG_DEBUG)
@@ -411,7 +650,11 @@ teModuleStatus eJennicModuleWriteVersionRequest(void)
     {
         daemon_log(LOG_DEBUG, "Writing Module: Get Version");
     }
-    vSL_WriteMessage(E_SL_MSG_VERSION_REQUEST, 0, NULL);
+    if (iReliableSerialLink)
+    {
+        u8HostCapabilities |= E_SL_CAPABILITY_RELIABLE;
+    }
+    vSL_WriteMessage(E_SL_MSG_VERSION_REQUEST, sizeof(uint8_t), &u8HostCapabilities);
     return E_MODULE_OK;
 }
 
@@ -438,6 +681,7 @@ static teModuleStatus eJennicModulePing(uint32_t u32Length, uint8_t *pu8Data)
 {
 #define PING_INTERVAL   (10) /* Seconds between pings */
     static time_t   sLastPing = 0;              /* Time last ping was sent */
+    static uint64_t u64PingSent = 0;            /* Monotonic time of the outstanding ping, 0 if none */
 
     if (sFlags.uSupportsPing == 1)
     {
@@ -450,6 +694,13 @@ static teModuleStatus eJennicModulePing(uint32_t u32Length, uint8_t *pu8Data)
             {
                 daemon_log(LOG_DEBUG, "Pong");
             }
+            
+            if (u64PingSent)
+            {
+                /* Round trip time to the module tunes the shaper */
+                vShaperRTTSample((uint32_t)(u64ClockNowUs() - u64PingSent));
+                u64PingSent = 0;
+            }
         }
         else
         {
@@ -459,8 +710,16 @@ static teModuleStatus eJennicModulePing(uint32_t u32Length, uint8_t *pu8Data)
                 {
                     daemon_log(LOG_DEBUG, "Ping");
                 }
+                
+                if (u64PingSent)
+                {
+                    /* Previous ping was never answered */
+                    vShaperLoss();
+                }
+                
                 vSL_WriteMessage(E_SL_MSG_PING, 0, NULL);
                 sLastPing = time(NULL);
+                u64PingSent = u64ClockNowUs();
             }
             else
             {
@@ -606,7 +865,9 @@ teModuleStatus eJennicModuleStateMachine(uint8_t bTimeout)
                     {
                         daemon_log(LOG_ERR, "Cannot determine module address");
                         eModuleState    = E_STATE_DETERMINE_VERSION;
+                        sFlags.uCreditFlowControl = 0;
                         eJennicModuleReset();
+                        vSL_SetReliable(FALSE);
                     }
                 }
                 break;
@@ -661,18 +922,71 @@ teModuleStatus eJennicModuleStart(void)
     }
     eModuleState    = E_STATE_DETERMINE_VERSION;
     memset(&sFlags, 0, sizeof(sFlags));
+    vShaperInit(u64ClockNowUs());
     return eJennicModuleStateMachine(0);
 }
 
 
+teModuleStatus eJennicModuleReconfigure(void)
+{
+    if (eModuleState <= E_STATE_CONFIGURE_NETWORK)
+    {
+        /* The handshake has not written the configuration yet */
+        return E_MODULE_OK;
+    }
+    
+    daemon_log(LOG_INFO, "Reconfiguring module");
+    
+    /* Read the configuration back once the module is running again */
+    sFlags.uConfigKnown = 0;
+    sFlags.uReconfigured = 1;
+    eModuleState = E_STATE_CONFIGURE_NETWORK;
+    return eJennicModuleStateMachine(0);
+}
+
+
+teModuleStatus eJennicModuleRestart(void)
+{
+    daemon_log(LOG_INFO, "Restarting module");
+    
+    eJennicModuleReset();
+    /* The module forgets the link sequence numbers when it resets */
+    vSL_SetReliable(FALSE);
+    return eJennicModuleStart();
+}
+
+
 static teModuleStatus eJennicModuleProcessMessageIPv6(uint32_t u32Length, uint8_t *pu8Data)
 {
+    sModuleStats.u64IPv6RxPackets++;
+    sModuleStats.u64IPv6RxBytes += u32Length;
+    
+    /* Learn the source node and account for the packet */
+    vNodeTableInbound(u64ClockNowUs(), pu8Data, u32Length);
+    
+    if (u32Length >= IPV6_HEADER_LENGTH)
+    {
+        /* The sender is awake, pass on anything held for it */
+        vMailboxNodeAwake(u64ClockNowUs(), (const struct in6_addr *)&pu8Data[8]);
+    }
+    
+    if (bNAT64ToIPv4(u64ClockNowUs(), pu8Data, u32Length))
+    {
+        /* For an IPv4 host, translated and written to the tun device */
+        return E_MODULE_OK;
+    }
+    
+    vJIPCacheResponse(u64ClockNowUs(), pu8Data, u32Length);
+    
     // Write the packet into the TUN device and let the kernel do it's stuff
     if (eTunDeviceWritePacket(u32Length, pu8Data) != E_TUN_OK)
     {
         daemon_log(LOG_ERR, "Error writing to tun device");
         return E_MODULE_ERROR;
     }
+    
+    /* Copy the response to any clients that sent the same request */
+    vCoalesceResponse(u64ClockNowUs(), pu8Data, u32Length);
     return E_MODULE_OK;
 }
 
@@ -694,6 +1008,54 @@ static teModuleStatus eJennicModuleProcessMessageVersion(uint32_t u32Length, uin
         sFlags.uSupportsPing = 1;
     }
     
+    sFlags.uCreditFlowControl = 0;
+    if ((u32Length > 3) && (pu8Data[3] & E_SL_CAPABILITY_CREDIT))
+    {
+        /* Border router has enabled credit based flow control. 
+         * Only send a single frame until it tells us how many buffers it has. */
+        daemon_log(LOG_INFO, "Border router supports credit based flow control");
+        memset(&sCredit, 0, sizeof(sCredit));
+        sCredit.u8Window = 1;
+        sFlags.uCreditFlowControl = 1;
+    }
+    
+    if ((u32Length > 3) && (pu8Data[3] & E_SL_CAPABILITY_RELIABLE))
+    {
+        daemon_log(LOG_INFO, "Border router supports reliable serial link");
+        vSL_SetReliable(TRUE);
+    }
+    else
+    {
+        vSL_SetReliable(FALSE);
+    }
+    
+    return E_MODULE_OK;
+}
+
+
+static teModuleStatus eJennicModuleProcessMessageCredit(uint32_t u32Length, uint8_t *pu8Data)
+{
+    tsModule_Credit *psCredit = (tsModule_Credit *)pu8Data;
+    
+    if ((sFlags.uCreditFlowControl == 0) || (u32Length < sizeof(tsModule_Credit)))
+    {
+        return E_MODULE_OK;
+    }
+    
+    sCredit.u8Window    = psCredit->u8Window;
+    sCredit.u16Consumed = ntohs(psCredit->u16Consumed);
+    
+    if ((uint16_t)(sCredit.u16Sent - sCredit.u16Consumed) > sCredit.u8Window)
+    {
+        /* More frames outstanding than the module can hold, or more consumed
+         * than were sent: the module has restarted its count. */
+        if (verbosity >= LOG_DEBUG)
+        {
+            daemon_log(LOG_DEBUG, "Resynchronising credit (sent %d, consumed %d)", sCredit.u16Sent, sCredit.u16Consumed);
+        }
+        sCredit.u16Sent = sCredit.u16Consumed;
+        sModuleStats.u64CreditResyncs++;
+    }
     return E_MODULE_OK;
 }
 
@@ -701,7 +1063,7 @@ static teModuleStatus eJennicModuleProcessMessageVersion(uint32_t u32Length, uin
 static teModuleStatus eJennicModuleProcessMessageConfig(uint32_t u32Length, uint8_t *pu8Data)
 {
     int iConfigChanged = 0;
-    if (u32Length == 3)
+    if ((u32Length == 3) || (u32Length == 4))
     {
         /* This is actually a version packet in response to the config message */
         return eJennicModuleProcessMessageVersion(u32Length, pu8Data);
@@ -725,10 +1087,12 @@ static teModuleStatus eJennicModuleProcessMessageConfig(uint32_t u32Length, uint
             (eChannel       != psConfig->u8Channel) ||
             (u16PanID       != ntohs(psConfig->u16PanID)) ||
             (u32UserData    != ntohl(psConfig->u32NetworkID)) ||
-            (u64NewPrefix   != u64NetworkPrefix))
+            (u64NewPrefix   != u64NetworkPrefix) ||
+            (sFlags.uReconfigured))
         {
             iConfigChanged = 1;
         }
+        sFlags.uReconfigured = 0;
             
         eRegion             = psConfig->u8Region;
         eChannel            = psConfig->u8Channel;
@@ -745,13 +1109,7 @@ static teModuleStatus eJennicModuleProcessMessageConfig(uint32_t u32Length, uint
         
         if ((vprConfigChanged) && iConfigChanged)
         {
-            pthread_t sThread;
-            /* Start the network changed function in a new thread */
-            
-            if (pthread_create(&sThread, NULL, vprConfigChanged, NULL) != 0)
-            {
-                daemon_log(LOG_ERR, "Error starting configuration changed notification thread\n");
-            }
+            vprConfigChanged();
         }
         
         sFlags.uConfigKnown = 1;
@@ -806,6 +1164,11 @@ static teModuleStatus eJennicModuleProcessMessageIPv6Address(uint32_t u32Length,
     char buffer[INET6_ADDRSTRLEN] = "Could not determine address";
     inet_ntop(AF_INET6, pu8Data, buffer, INET6_ADDRSTRLEN);
     
+    if (u32Length >= sizeof(struct in6_addr))
+    {
+        memcpy(&sModuleAddress, pu8Data, sizeof(struct in6_addr));
+    }
+    
     daemon_log(LOG_INFO, "Module address: %s", buffer);
     
 #ifdef USE_ZEROCONF
@@ -886,6 +1249,7 @@ teModuleStatus eJennicModuleProcessMessage(uint8_t u8Message, uint32_t u32Length
         TEST(E_SL_MSG_LOG);                 eStatus = eJennicModuleProcessMessageLog(u32Length, pu8Data);           break;
         TEST(E_SL_MSG_VERSION);             eStatus = eJennicModuleProcessMessageVersion(u32Length, pu8Data);       break;
         TEST(E_SL_MSG_PING);                eStatus = eJennicModulePing(u32Length, pu8Data);                        break;
+        TEST(E_SL_MSG_CREDIT);              eStatus = eJennicModuleProcessMessageCredit(u32Length, pu8Data);        break;
         default:                            break;
 #undef TEST
     }
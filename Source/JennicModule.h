@@ -70,6 +70,12 @@ extern "C" {
 #define SECURITY_CONFIG_DEFAULT_AUTH_SCHEME             E_AUTH_SCHEME_NONE
 #define SECURITY_CONFIG_DEFAULT_SCHEME_RADIUS_PAP_IPV6  "::"
 
+/** Largest IPv6 packet that can be queued for the module */
+#define MODULE_MAX_PACKET_LENGTH                        2048
+
+/** Number of IPv6 packets that can be queued for the module */
+#define MODULE_TX_QUEUE_LENGTH                          32
+
 /****************************************************************************/
 /***        Type Definitions                                              ***/
 /****************************************************************************/
@@ -147,8 +153,35 @@ typedef enum
 } __attribute__((__packed__)) teRadioFrontEnd;
 
 
-/** Function to call when the network configuration changes */
-extern void *(*vprConfigChanged)(void *arg);
+/** Why the transmit queue is waiting */
+typedef enum
+{
+    E_MODULE_TX_READY,                  /**< Not waiting */
+    E_MODULE_TX_WAIT_SHAPER,            /**< Shaper estimates the radio is still busy */
+    E_MODULE_TX_WAIT_CREDIT,            /**< Module has no buffer space */
+    E_MODULE_TX_WAIT_WINDOW,            /**< Reliable serial link window is full */
+} teModuleTxWait;
+
+
+/** Packet statistics for the module link */
+typedef struct
+{
+    uint64_t    u64IPv6TxPackets;       /**< IPv6 packets written to the module */
+    uint64_t    u64IPv6TxBytes;         /**< IPv6 bytes written to the module */
+    uint64_t    u64IPv6RxPackets;       /**< IPv6 packets received from the module */
+    uint64_t    u64IPv6RxBytes;         /**< IPv6 bytes received from the module */
+    uint64_t    u64TxQueueDrops;        /**< IPv6 packets dropped because the transmit queue was full */
+    uint64_t    u64CreditStalls;        /**< Times the transmit queue waited for credit from the module */
+    uint64_t    u64TxDelayedCredit;     /**< Packets queued while the module had no credit */
+    uint64_t    u64TxDelayedWindow;     /**< Packets queued while the reliable link window was full */
+    uint64_t    u64CreditRequests;      /**< Credit updates requested after a stall */
+    uint64_t    u64CreditResyncs;       /**< Credit counters resynchronised after the module lost state */
+} tsModuleStats;
+
+
+/** Function to call when the network configuration changes. It is called
+ *  while handling a message from the module, so must not block. */
+extern void (*vprConfigChanged)(void);
 
 
 /****************************************************************************/
@@ -216,6 +249,18 @@ extern int              iAntennaDiversity;
 extern teActivityLED    eActivityLED;
 
 
+/** Use the reliable serial link if the border router supports it */
+extern int              iReliableSerialLink;
+
+
+/** Module link statistics */
+extern tsModuleStats    sModuleStats;
+
+
+/** IPv6 address of the border router node, unspecified until reported by the module */
+extern struct in6_addr  sModuleAddress;
+
+
 /****************************************************************************/
 /***        Local Variables                                               ***/
 /****************************************************************************/
@@ -249,14 +294,58 @@ teModuleStatus eJennicModuleReset(void);
 teModuleStatus eJennicModuleGetIPv6Address(void);
 
 
-/** Write available IPv6 packet to the module
+/** Queue an IPv6 packet to be written to the module.
+ *  The packet is sent immediately if the shaper allows, otherwise it is
+ *  held until u32JennicModuleServiceTxQueue releases it. If the queue
+ *  is full the packet is dropped and counted.
  *  \param u32Length    Amount of data available
  *  \param pu8Data      Data to write
- *  \return E_MODULE_OK if data written ok
+ *  \return E_MODULE_OK if data queued ok
  */
 teModuleStatus eJennicModuleWriteIPv6(uint32_t u32Length, uint8_t *pu8Data);
 
 
+/** Write queued IPv6 packets to the module as far as the shaper, credit
+ *  and the reliable link window allow
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param peWait       Set to what the queue is waiting for, may be NULL
+ *  \return 0 if the queue is empty, otherwise microseconds until the next packet may be sent
+ */
+uint32_t u32JennicModuleServiceTxQueue(uint64_t u64Now, teModuleTxWait *peWait);
+
+
+/** Get the number of IPv6 packets waiting to be written to the module
+ *  \return Number of queued packets
+ */
+uint32_t u32JennicModuleTxQueueDepth(void);
+
+
+/** Get the stage of the start up handshake the module is in
+ *  \return Name of the state, "running" once the handshake is complete
+ */
+const char *pcJennicModuleState(void);
+
+
+/** Get the firmware version the module reported
+ *  \return (major << 16) | (minor << 8) | revision, 0 if not known yet
+ */
+uint32_t u32JennicModuleVersion(void);
+
+
+/** Write the current network settings to the module and start it again,
+ *  through the same states as the start up handshake. Packets keep
+ *  flowing while this happens, as far as the module allows.
+ *  \return E_MODULE_OK on success
+ */
+teModuleStatus eJennicModuleReconfigure(void);
+
+
+/** Reset the module and repeat the start up handshake
+ *  \return E_MODULE_OK on success
+ */
+teModuleStatus eJennicModuleRestart(void);
+
+
 /** Process an incoming message from the module
  *  \param u8Message    Message number
  *  \param u32Length    Length of message
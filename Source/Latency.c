@@ -0,0 +1,130 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Packet path latency
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+/* Each packet is timestamped as it passes through the daemon:
+ *
+ *   towards the module:  read from the tun device (or other endpoint),
+ *                        queued, encoding started, written to the serial port
+ *   from the module:     frame decoded, written to the tun device
+ *
+ * and the time between the stamps is recorded in a histogram per stage.
+ * The stamps travel with the packet: u64LatencyIngress and
+ * u64LatencyDecoded cover the synchronous part of the path, and the
+ * transmit queue keeps its own copy while a packet waits for the module.
+ *
+ * Serial port writes complete when the frame is in the kernel's output
+ * buffer, not when its last byte has left the UART.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Latency.h"
+#include "DumpFile.h"
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+tsHistogram asLatency[E_LATENCY_STAGES];
+
+const char *apcLatencyStage[E_LATENCY_STAGES] =
+{
+    "tx_process",
+    "tx_queue",
+    "tx_write",
+    "tx_total",
+    "rx_process",
+    "rx_write",
+    "rx_total",
+};
+
+uint64_t u64LatencyIngress = 0;
+
+uint64_t u64LatencyDecoded = 0;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iLatencyDump(const char *pcFileName)
+{
+    char acTempName[256];
+    FILE *psFile;
+    int i;
+    
+    psFile = psDumpFileOpen(pcFileName, acTempName, sizeof(acTempName));
+    if (!psFile)
+    {
+        return -1;
+    }
+    
+    fprintf(psFile, "# stage count min_us mean_us p50_us p90_us p99_us p999_us max_us\n");
+    for (i = 0; i < E_LATENCY_STAGES; i++)
+    {
+        const tsHistogram *psHistogram = &asLatency[i];
+        
+        fprintf(psFile, "# %s %llu %.3f %.3f %.3f %.3f %.3f %.3f %.3f\n", apcLatencyStage[i],
+                (unsigned long long)psHistogram->u64Count,
+                psHistogram->u64Count ? psHistogram->u64Min / 1000.0 : 0.0,
+                psHistogram->u64Count ? (double)psHistogram->u64Sum / psHistogram->u64Count / 1000.0 : 0.0,
+                u64HistogramPercentile(psHistogram, 50.0) / 1000.0,
+                u64HistogramPercentile(psHistogram, 90.0) / 1000.0,
+                u64HistogramPercentile(psHistogram, 99.0) / 1000.0,
+                u64HistogramPercentile(psHistogram, 99.9) / 1000.0,
+                psHistogram->u64Max / 1000.0);
+    }
+    
+    for (i = 0; i < E_LATENCY_STAGES; i++)
+    {
+        fprintf(psFile, "\n# %s\n", apcLatencyStage[i]);
+        iHistogramWrite(&asLatency[i], psFile, 1000.0);
+    }
+    
+    return iDumpFileClose(psFile, acTempName, pcFileName);
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
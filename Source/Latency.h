@@ -0,0 +1,139 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Packet path latency
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+#ifndef  LATENCY_H_INCLUDED
+#define  LATENCY_H_INCLUDED
+
+#include <stdint.h>
+
+#include "Histogram.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** Stages of the packet path that are timed. Tx is towards the module,
+ *  Rx from it. */
+typedef enum
+{
+    E_LATENCY_TX_PROCESS,               /**< Read from a local host to queued for the module */
+    E_LATENCY_TX_QUEUE,                 /**< Queued to encoding started */
+    E_LATENCY_TX_WRITE,                 /**< Encoding started to written to the serial port */
+    E_LATENCY_TX_TOTAL,                 /**< Read from a local host to written to the serial port */
+    E_LATENCY_RX_PROCESS,               /**< Frame decoded to writing to a local host */
+    E_LATENCY_RX_WRITE,                 /**< Writing to a local host */
+    E_LATENCY_RX_TOTAL,                 /**< Frame decoded to written to a local host */
+    E_LATENCY_STAGES,
+} teLatencyStage;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Time of each stage, nanoseconds. Only the main loop uses these; other
+ *  processes read the copy published in the statistics page. */
+extern tsHistogram asLatency[E_LATENCY_STAGES];
+
+
+/** Names of the stages, as written by iLatencyDump */
+extern const char *apcLatencyStage[E_LATENCY_STAGES];
+
+
+/** Time the packet being handled was read from a local host, 0 if the
+ *  packet did not come from one (u64ClockNowNs) */
+extern uint64_t u64LatencyIngress;
+
+
+/** Time the message being handled was decoded from the serial link, 0
+ *  outside of message handling (u64ClockNowNs) */
+extern uint64_t u64LatencyDecoded;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Record the time taken by a stage.
+ *  \param eStage       Stage
+ *  \param u64Start     Time the stage started, nothing is recorded if 0
+ *  \param u64End       Time the stage ended
+ */
+static inline void vLatencyRecord(teLatencyStage eStage, uint64_t u64Start, uint64_t u64End)
+{
+    if (u64Start && (u64End >= u64Start))
+    {
+        vHistogramRecord(&asLatency[eStage], u64End - u64Start);
+    }
+}
+
+
+/** Write a summary and the distribution of each stage, in microseconds,
+ *  to a file. The file is replaced atomically.
+ *  \param pcFileName   File to write
+ *  \return 0 on success, -1 on error
+ */
+int iLatencyDump(const char *pcFileName);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* LATENCY_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -0,0 +1,301 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Sleepy node mailboxes
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+/* Sleeping end devices only poll their parent now and then, and the
+ * module has room for very few packets waiting for them. Packets for
+ * sleepy nodes are therefore held in the daemon, one bounded FIFO per node,
+ * and released together when the node is next heard from. Sleepy nodes
+ * are the ones given with --sleepy, and optionally (--sleepyresponse) ones
+ * that are consistently slow to answer.
+ *
+ * Every held packet is also on a single list in arrival order. With one
+ * TTL for all packets the oldest packet overall is always the oldest of its
+ * own node, so expiry only ever removes from the heads of both lists.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <libdaemon/daemon.h>
+
+#include "Mailbox.h"
+#include "NodeTable.h"
+#include "IPv6.h"
+#include "JennicModule.h"
+#include "Clock.h"
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** A packet held for a sleeping node */
+struct tsMailboxPacket
+{
+    struct tsMailboxPacket *psNextForNode;  /**< Next packet for the same node */
+    struct tsMailboxPacket *psNextAll;      /**< Next packet in arrival order */
+    struct tsMailboxPacket *psPrevAll;
+    uint64_t                u64Held;        /**< Time the packet was held */
+    uint32_t                u32Length;
+    uint8_t                 au8Data[];
+};
+
+typedef struct tsMailboxPacket tsMailboxPacket;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+extern int verbosity;
+
+uint32_t        u32MailboxTTL               = MAILBOX_DEFAULT_TTL;
+uint32_t        u32MailboxSleepyResponse    = MAILBOX_DEFAULT_SLEEPY_RESPONSE;
+
+tsMailboxStats  sMailboxStats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+/** All held packets, oldest first */
+static tsMailboxPacket *psOldest = NULL;
+static tsMailboxPacket *psNewest = NULL;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/** Remove the oldest packet of a node from both lists */
+static tsMailboxPacket *psMailboxTake(tsNode *psNode)
+{
+    tsMailboxPacket *psPacket = psNode->psMailHead;
+    
+    psNode->psMailHead = psPacket->psNextForNode;
+    if (!psNode->psMailHead)
+    {
+        psNode->psMailTail = NULL;
+    }
+    psNode->u16MailCount--;
+    
+    if (psPacket->psPrevAll)
+    {
+        psPacket->psPrevAll->psNextAll = psPacket->psNextAll;
+    }
+    else
+    {
+        psOldest = psPacket->psNextAll;
+    }
+    if (psPacket->psNextAll)
+    {
+        psPacket->psNextAll->psPrevAll = psPacket->psPrevAll;
+    }
+    else
+    {
+        psNewest = psPacket->psPrevAll;
+    }
+    
+    sMailboxStats.u32Packets--;
+    sMailboxStats.u32Bytes -= psPacket->u32Length;
+    return psPacket;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iMailboxAddSleepyNode(const struct in6_addr *psAddress)
+{
+    if (!psNodeTableAdd(u64ClockNowUs(), psAddress, E_NODE_FLAG_STATIC | E_NODE_FLAG_SLEEPY))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+
+bool bMailboxHold(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length)
+{
+    const struct in6_addr *psDest = (const struct in6_addr *)&pu8Packet[24];
+    tsMailboxPacket *psPacket;
+    tsNode *psNode;
+    
+    if ((u32Length < IPV6_HEADER_LENGTH) || IN6_IS_ADDR_MULTICAST(psDest))
+    {
+        return FALSE;
+    }
+    
+    psNode = psNodeTableLookup(psDest);
+    if (!psNode)
+    {
+        return FALSE;
+    }
+    
+    if (((psNode->u8Flags & (E_NODE_FLAG_SLEEPY | E_NODE_FLAG_STATIC)) == E_NODE_FLAG_SLEEPY) &&
+        (psNode->u32ResponseUs < (uint64_t)u32MailboxSleepyResponse * 500000))
+    {
+        /* Learned node now answers promptly - no longer treat it as sleepy */
+        psNode->u8Flags &= ~E_NODE_FLAG_SLEEPY;
+    }
+    
+    if (!(psNode->u8Flags & E_NODE_FLAG_SLEEPY))
+    {
+        if ((u32MailboxSleepyResponse == 0) ||
+            (psNode->u32ResponseUs < (uint64_t)u32MailboxSleepyResponse * 1000000))
+        {
+            return FALSE;
+        }
+        /* Takes a long time to answer - most likely asleep between polls */
+        psNode->u8Flags |= E_NODE_FLAG_SLEEPY;
+        sMailboxStats.u64Learned++;
+        
+        if (verbosity >= LOG_DEBUG)
+        {
+            char acAddress[INET6_ADDRSTRLEN];
+            inet_ntop(AF_INET6, &psNode->sAddress, acAddress, sizeof(acAddress));
+            daemon_log(LOG_DEBUG, "Node %s is sleepy (average response %ums)", acAddress, psNode->u32ResponseUs / 1000);
+        }
+    }
+    
+    if (((u64Now - psNode->u64LastSeen) < MAILBOX_AWAKE_US) && (psNode->u16MailCount == 0))
+    {
+        /* Heard from recently, so probably still awake */
+        return FALSE;
+    }
+    
+    if (psNode->u16MailCount >= MAILBOX_MAX_PER_NODE)
+    {
+        sMailboxStats.u64DroppedNodeFull++;
+        return TRUE;
+    }
+    
+    if ((sMailboxStats.u32Bytes + u32Length > MAILBOX_MAX_BYTES) ||
+        !(psPacket = malloc(sizeof(tsMailboxPacket) + u32Length)))
+    {
+        sMailboxStats.u64DroppedMemory++;
+        return TRUE;
+    }
+    
+    psPacket->psNextForNode = NULL;
+    psPacket->psNextAll     = NULL;
+    psPacket->psPrevAll     = psNewest;
+    psPacket->u64Held       = u64Now;
+    psPacket->u32Length     = u32Length;
+    memcpy(psPacket->au8Data, pu8Packet, u32Length);
+    
+    if (psNode->psMailTail)
+    {
+        psNode->psMailTail->psNextForNode = psPacket;
+    }
+    else
+    {
+        psNode->psMailHead = psPacket;
+    }
+    psNode->psMailTail = psPacket;
+    psNode->u16MailCount++;
+    
+    if (psNewest)
+    {
+        psNewest->psNextAll = psPacket;
+    }
+    else
+    {
+        psOldest = psPacket;
+    }
+    psNewest = psPacket;
+    
+    sMailboxStats.u32Packets++;
+    sMailboxStats.u32Bytes += u32Length;
+    sMailboxStats.u64Held++;
+    return TRUE;
+}
+
+
+void vMailboxNodeAwake(uint64_t u64Now, const struct in6_addr *psSource)
+{
+    tsNode *psNode;
+    
+    if (!psOldest)
+    {
+        return;
+    }
+    
+    psNode = psNodeTableLookup(psSource);
+    if (!psNode)
+    {
+        return;
+    }
+    
+    while (psNode->psMailHead && (u32JennicModuleTxQueueDepth() < MODULE_TX_QUEUE_LENGTH))
+    {
+        tsMailboxPacket *psPacket = psMailboxTake(psNode);
+        
+        eJennicModuleWriteIPv6(psPacket->u32Length, psPacket->au8Data);
+        sMailboxStats.u64Released++;
+        free(psPacket);
+    }
+}
+
+
+void vMailboxExpire(uint64_t u64Now)
+{
+    uint64_t u64TTL = (uint64_t)u32MailboxTTL * 1000000;
+    
+    while (psOldest && ((u64Now - psOldest->u64Held) > u64TTL))
+    {
+        tsNode *psNode = psNodeTableLookup((const struct in6_addr *)&psOldest->au8Data[24]);
+        tsMailboxPacket *psPacket;
+        
+        if (!psNode || (psNode->psMailHead != psOldest))
+        {
+            /* Cannot happen while nodes with mail are kept in the table */
+            daemon_log(LOG_ERR, "Mailbox packet without a node");
+            break;
+        }
+        psPacket = psMailboxTake(psNode);
+        sMailboxStats.u64Expired++;
+        free(psPacket);
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,155 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Sleepy node mailboxes
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+#ifndef  MAILBOX_H_INCLUDED
+#define  MAILBOX_H_INCLUDED
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Default time a packet is held for a sleeping node, seconds */
+#define MAILBOX_DEFAULT_TTL                 60
+
+/** Default average response time above which a node is taken to be sleepy,
+ *  seconds. Off, as a mains powered node that is slow to answer for a while
+ *  would otherwise have its traffic held; sleepy nodes are given with -Z. */
+#define MAILBOX_DEFAULT_SLEEPY_RESPONSE     0
+
+/** Packets held for any one node */
+#define MAILBOX_MAX_PER_NODE                16
+
+/** Total bytes held in all mailboxes */
+#define MAILBOX_MAX_BYTES                   (1024 * 1024)
+
+/** Time after hearing from a sleepy node during which it is assumed awake, microseconds */
+#define MAILBOX_AWAKE_US                    2000000
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** Mailbox statistics */
+typedef struct
+{
+    uint32_t    u32Packets;             /**< Packets currently held */
+    uint32_t    u32Bytes;               /**< Bytes currently held */
+    uint64_t    u64Held;                /**< Packets put in a mailbox */
+    uint64_t    u64Released;            /**< Packets released when their node woke */
+    uint64_t    u64Expired;             /**< Packets discarded after the TTL */
+    uint64_t    u64DroppedNodeFull;     /**< Packets dropped because the node's mailbox was full */
+    uint64_t    u64DroppedMemory;       /**< Packets dropped because the memory cap was reached */
+    uint64_t    u64Learned;             /**< Nodes learned to be sleepy */
+} tsMailboxStats;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Seconds a packet is held for a sleeping node */
+extern uint32_t         u32MailboxTTL;
+
+
+/** Average response time in seconds above which a node is learned to be sleepy, 0 to disable */
+extern uint32_t         u32MailboxSleepyResponse;
+
+
+/** Mailbox statistics */
+extern tsMailboxStats   sMailboxStats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Configure a node as a sleeping end device.
+ *  \param psAddress    Address of the node
+ *  \return 0 on success
+ */
+int iMailboxAddSleepyNode(const struct in6_addr *psAddress);
+
+
+/** Hold a packet read from the tun device if it is for a sleeping node.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    IPv6 packet
+ *  \param u32Length    Length of the packet
+ *  \return TRUE if the packet has been taken (held or dropped)
+ */
+bool bMailboxHold(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length);
+
+
+/** Called when a packet arrives from the mesh. Any packets held for the
+ *  sender are released to the module.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param psSource     Source address of the packet
+ */
+void vMailboxNodeAwake(uint64_t u64Now, const struct in6_addr *psSource);
+
+
+/** Discard packets that have been held longer than the TTL.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ */
+void vMailboxExpire(uint64_t u64Now);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* MAILBOX_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,275 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Runtime metrics
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+/* The counters are the statistics structures each module already keeps.
+ * They are only ever written by the main loop, and metrics are only read
+ * by the main loop (from the control socket and HTTP endpoint, see
+ * Control.c), so the packet path takes no locks and pays nothing until a
+ * client asks. Counters are described by a table; gauges and summaries
+ * that need a little work are written by hand.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Metrics.h"
+#include "SerialLink.h"
+#include "JennicModule.h"
+#include "TunDevice.h"
+#include "IPv6.h"
+#include "Shaper.h"
+#include "Filter.h"
+#include "Multicast.h"
+#include "NodeTable.h"
+#include "NDProxy.h"
+#include "Mailbox.h"
+#include "JIPCache.h"
+#include "Coalesce.h"
+#include "NAT64.h"
+#include "ShmRing.h"
+#include "Latency.h"
+#include "Notify.h"
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** A counter. Consecutive entries with the same name are one family,
+ *  described by the help text of the first. */
+typedef struct
+{
+    const char      *pcName;
+    const char      *pcHelp;
+    const char      *pcLabels;
+    const uint64_t  *pu64Value;
+} tsMetricsCounter;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static const tsMetricsCounter asCounters[] =
+{
+    { "serial_frames_total",            "Serial link frames",                   "direction=\"tx\"",                 &sSL_Stats.u64FramesTx },
+    { "serial_frames_total",            NULL,                                   "direction=\"rx\"",                 &sSL_Stats.u64FramesRx },
+    { "serial_bytes_total",             "Serial link bytes including framing",  "direction=\"tx\"",                 &sSL_Stats.u64BytesTx },
+    { "serial_bytes_total",             NULL,                                   "direction=\"rx\"",                 &sSL_Stats.u64BytesRx },
+    { "serial_escapes_total",           "Escaped bytes on the serial link",     "direction=\"tx\"",                 &sSL_Stats.u64EscapesTx },
+    { "serial_escapes_total",           NULL,                                   "direction=\"rx\"",                 &sSL_Stats.u64EscapesRx },
+    { "serial_errors_total",            "Serial link receive errors",           "type=\"crc\"",                     &sSL_Stats.u64CRCErrors },
+    { "serial_errors_total",            NULL,                                   "type=\"overflow\"",                &sSL_Stats.u64Overflows },
+    { "serial_errors_total",            NULL,                                   "type=\"missing_end\"",             &sSL_Stats.u64MissingEnd },
+    { "serial_errors_total",            NULL,                                   "type=\"truncated\"",               &sSL_Stats.u64Truncated },
+    { "serial_errors_total",            NULL,                                   "type=\"unexpected_start\"",        &sSL_Stats.u64UnexpectedStart },
+    { "serial_errors_total",            NULL,                                   "type=\"escape\"",                  &sSL_Stats.u64EscapeErrors },
+    { "serial_discarded_bytes_total",   "Bytes received outside of any frame",  NULL,                               &sSL_Stats.u64DiscardedBytes },
+    { "serial_retransmissions_total",   "Sequenced frames sent again",          NULL,                               &sSL_Stats.u64Retransmissions },
+    { "serial_fast_retransmissions_total", "Retransmissions triggered by a NAK", NULL,                              &sSL_Stats.u64FastRetransmissions },
+    { "serial_link_frames_total",       "Link control frames sent",             "type=\"ack\"",                     &sSL_Stats.u64AcksTx },
+    { "serial_link_frames_total",       NULL,                                   "type=\"nak\"",                     &sSL_Stats.u64NaksTx },
+    { "serial_out_of_order_total",      "Sequenced frames held for reordering", NULL,                               &sSL_Stats.u64OutOfOrder },
+    { "serial_duplicates_total",        "Sequenced frames received more than once", NULL,                           &sSL_Stats.u64Duplicates },
+    { "serial_resets_total",            "Sequence resets received from the module", NULL,                           &sSL_Stats.u64Resets },
+    
+    { "ipv6_packets_total",             "IPv6 packets exchanged with the module", "direction=\"to_mesh\"",          &sModuleStats.u64IPv6TxPackets },
+    { "ipv6_packets_total",             NULL,                                   "direction=\"from_mesh\"",          &sModuleStats.u64IPv6RxPackets },
+    { "ipv6_bytes_total",               "IPv6 bytes exchanged with the module", "direction=\"to_mesh\"",            &sModuleStats.u64IPv6TxBytes },
+    { "ipv6_bytes_total",               NULL,                                   "direction=\"from_mesh\"",          &sModuleStats.u64IPv6RxBytes },
+    
+    { "drops_total",                    "Packets dropped, by reason",           "reason=\"tx_queue_full\"",         &sModuleStats.u64TxQueueDrops },
+    { "drops_total",                    NULL,                                   "reason=\"serial_abandoned\"",      &sSL_Stats.u64Abandoned },
+    { "drops_total",                    NULL,                                   "reason=\"serial_queue_full\"",     &sSL_Stats.u64QueueDrops },
+    { "drops_total",                    NULL,                                   "reason=\"oversize\"",              &sTunStats.u64OversizeDrops },
+    { "drops_total",                    NULL,                                   "reason=\"endpoint\"",              &sTunStats.u64EndpointDrops },
+    { "drops_total",                    NULL,                                   "reason=\"filter_prefix\"",         &sFilterStats.u64DroppedPrefix },
+    { "drops_total",                    NULL,                                   "reason=\"filter_protocol\"",       &sFilterStats.u64DroppedProtocol },
+    { "drops_total",                    NULL,                                   "reason=\"filter_port\"",           &sFilterStats.u64DroppedPort },
+    { "drops_total",                    NULL,                                   "reason=\"filter_rate\"",           &sFilterStats.u64DroppedRate },
+    { "drops_total",                    NULL,                                   "reason=\"multicast_group\"",       &sMulticastStats.u64DroppedGroup },
+    { "drops_total",                    NULL,                                   "reason=\"multicast_mld\"",         &sMulticastStats.u64DroppedMLD },
+    { "drops_total",                    NULL,                                   "reason=\"multicast_rate\"",        &sMulticastStats.u64DroppedRate },
+    { "drops_total",                    NULL,                                   "reason=\"multicast_duplicate\"",   &sMulticastStats.u64DroppedDuplicate },
+    { "drops_total",                    NULL,                                   "reason=\"mailbox_expired\"",       &sMailboxStats.u64Expired },
+    { "drops_total",                    NULL,                                   "reason=\"mailbox_node_full\"",     &sMailboxStats.u64DroppedNodeFull },
+    { "drops_total",                    NULL,                                   "reason=\"mailbox_memory\"",        &sMailboxStats.u64DroppedMemory },
+    { "drops_total",                    NULL,                                   "reason=\"nat64_no_binding\"",      &sNAT64Stats.u64DroppedNoBinding },
+    { "drops_total",                    NULL,                                   "reason=\"nat64_filtered\"",        &sNAT64Stats.u64DroppedFiltered },
+    { "drops_total",                    NULL,                                   "reason=\"nat64_full\"",            &sNAT64Stats.u64DroppedFull },
+    { "drops_total",                    NULL,                                   "reason=\"nat64_unsupported\"",     &sNAT64Stats.u64DroppedUnsupported },
+    { "drops_total",                    NULL,                                   "reason=\"nat64_invalid\"",         &sNAT64Stats.u64DroppedInvalid },
+    { "drops_total",                    NULL,                                   "reason=\"shm_full\"",              &sShmRingStats.u64DroppedFull },
+    { "drops_total",                    NULL,                                   "reason=\"shm_invalid\"",           &sShmRingStats.u64DroppedInvalid },
+    { "drops_total",                    NULL,                                   "reason=\"nd_invalid\"",            &sNDProxyStats.u64Invalid },
+    
+    { "icmp_errors_total",              "ICMPv6 errors returned to local hosts", "type=\"packet_too_big\"",         &sTunStats.u64PacketTooBigSent },
+    { "icmp_errors_total",              NULL,                                   "type=\"unreachable\"",             &sTunStats.u64UnreachableSent },
+    { "icmp_errors_rate_limited_total", "ICMPv6 errors not sent due to the rate limit", NULL,                       &sIPv6Stats.u64ErrorsRateLimited },
+    
+    { "credit_stalls_total",            "Times the transmit queue waited for credit", NULL,                         &sModuleStats.u64CreditStalls },
+    { "credit_requests_total",          "Credit updates requested after a stall", NULL,                             &sModuleStats.u64CreditRequests },
+    { "credit_resyncs_total",           "Credit counters resynchronised",       NULL,                               &sModuleStats.u64CreditResyncs },
+    { "tx_delayed_total",               "Packets that waited to be written to the module", "reason=\"credit\"",  &sModuleStats.u64TxDelayedCredit },
+    { "tx_delayed_total",               NULL,                                   "reason=\"window\"",              &sModuleStats.u64TxDelayedWindow },
+    { "shaper_delayed_total",           "Packets that waited for the shaper",   NULL,                               &sShaperStats.u64PacketsDelayed },
+    { "shaper_airtime_microseconds_total", "Estimated radio airtime charged",   NULL,                               &sShaperStats.u64AirtimeUs },
+    
+    { "nd_solicitations_total",         "Neighbor solicitations for mesh addresses", "result=\"answered\"",         &sNDProxyStats.u64Answered },
+    { "nd_solicitations_total",         NULL,                                   "result=\"forwarded\"",             &sNDProxyStats.u64Forwarded },
+    { "jip_cache_requests_total",       "Cacheable JIP GET requests",           "result=\"hit\"",                   &sJIPCacheStats.u64Hits },
+    { "jip_cache_requests_total",       NULL,                                   "result=\"miss\"",                  &sJIPCacheStats.u64Misses },
+    { "coalesced_requests_total",       "Duplicate requests absorbed",          NULL,                               &sCoalesceStats.u64Coalesced },
+    { "airtime_saved_microseconds_total", "Estimated radio airtime saved",      "by=\"jip_cache\"",                 &sJIPCacheStats.u64AirtimeSavedUs },
+    { "airtime_saved_microseconds_total", NULL,                                 "by=\"coalesce\"",                  &sCoalesceStats.u64AirtimeSavedUs },
+    { "airtime_saved_microseconds_total", NULL,                                 "by=\"multicast\"",                 &sMulticastStats.u64AirtimeSavedUs },
+    { "mailbox_held_total",             "Packets held for sleeping nodes",      NULL,                               &sMailboxStats.u64Held },
+    { "nat64_packets_total",            "Packets translated by NAT64",          "direction=\"to_ipv6\"",            &sNAT64Stats.u64ToIPv6 },
+    { "nat64_packets_total",            NULL,                                   "direction=\"to_ipv4\"",            &sNAT64Stats.u64ToIPv4 },
+    { "nat64_icmp_errors_total",        "ICMP errors sent to IPv4 hosts for translated packets", NULL,              &sNAT64Stats.u64ErrorsSent },
+    { "nat64_mss_clamped_total",        "TCP SYNs from nodes whose MSS was lowered", NULL,                          &sNAT64Stats.u64MSSClamped },
+    { "shm_packets_total",              "Packets exchanged over shared memory rings", "direction=\"to_mesh\"",      &sShmRingStats.u64ToMeshPackets },
+    { "shm_packets_total",              NULL,                                   "direction=\"from_mesh\"",          &sShmRingStats.u64FromMeshPackets },
+    { "nodes_learned_total",            "Nodes added to the node table",        NULL,                               &sNodeTableStats.u64Learned },
+    { "notify_runs_total",              "Runs of the configuration notification program", NULL,                    &sNotifyStats.u64Runs },
+    { "notify_coalesced_total",         "Configuration changes folded into a waiting notification", NULL,           &sNotifyStats.u64Coalesced },
+    { "notify_failures_total",          "Notification runs that failed or timed out", NULL,                         &sNotifyStats.u64Failures },
+    { "nodes_expired_total",            "Nodes removed from the node table by aging", NULL,                         &sNodeTableStats.u64Expired },
+};
+
+/** Quantiles given for each latency stage */
+static const double adQuantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void vMetricsHeader(FILE *psFile, const char *pcName, const char *pcType, const char *pcHelp)
+{
+    fprintf(psFile, "# HELP " METRICS_PREFIX "%s %s\n", pcName, pcHelp);
+    fprintf(psFile, "# TYPE " METRICS_PREFIX "%s %s\n", pcName, pcType);
+}
+
+
+static void vMetricsGauge(FILE *psFile, const char *pcName, const char *pcHelp, double dValue)
+{
+    vMetricsHeader(psFile, pcName, "gauge", pcHelp);
+    fprintf(psFile, METRICS_PREFIX "%s %.9g\n", pcName, dValue);
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iMetricsWrite(FILE *psFile)
+{
+    const char *pcState = pcJennicModuleState();
+    uint32_t i, j;
+    
+    for (i = 0; i < sizeof(asCounters) / sizeof(tsMetricsCounter); i++)
+    {
+        const tsMetricsCounter *psCounter = &asCounters[i];
+        
+        if (psCounter->pcHelp)
+        {
+            vMetricsHeader(psFile, psCounter->pcName, "counter", psCounter->pcHelp);
+        }
+        fprintf(psFile, METRICS_PREFIX "%s%s%s%s %llu\n", psCounter->pcName,
+                psCounter->pcLabels ? "{" : "", psCounter->pcLabels ? psCounter->pcLabels : "", psCounter->pcLabels ? "}" : "",
+                (unsigned long long)*psCounter->pu64Value);
+    }
+    
+    vMetricsGauge(psFile, "tx_queue_depth", "IPv6 packets waiting to be written to the module", u32JennicModuleTxQueueDepth());
+    vMetricsGauge(psFile, "mailbox_packets", "Packets held for sleeping nodes", sMailboxStats.u32Packets);
+    vMetricsGauge(psFile, "mailbox_bytes", "Bytes held for sleeping nodes", sMailboxStats.u32Bytes);
+    vMetricsGauge(psFile, "nodes", "Nodes in the node table", sNodeTableStats.u32Nodes);
+    vMetricsGauge(psFile, "nat64_sessions", "NAT64 sessions open", sNAT64Stats.u32Sessions);
+    vMetricsGauge(psFile, "shm_clients", "Applications attached to shared memory rings", sShmRingStats.u32Clients);
+    vMetricsGauge(psFile, "ping_rtt_seconds", "Most recent ping round trip time to the module", sShaperStats.u32LastRTTUs / 1e6);
+    vMetricsGauge(psFile, "ping_rtt_min_seconds", "Lowest ping round trip time to the module", sShaperStats.u32MinRTTUs / 1e6);
+    vMetricsGauge(psFile, "shaper_fill_ratio", "Share of real time allowed as radio airtime", sShaperStats.u32FillPermille / 1000.0);
+    vMetricsGauge(psFile, "module_running", "Start up handshake with the module is complete", strcmp(pcState, "running") == 0);
+    
+    vMetricsHeader(psFile, "module_state", "gauge", "Stage of the start up handshake with the module");
+    fprintf(psFile, METRICS_PREFIX "module_state{state=\"%s\"} 1\n", pcState);
+    
+    vMetricsHeader(psFile, "latency_seconds", "summary", "Time spent in each stage of the packet path");
+    for (i = 0; i < E_LATENCY_STAGES; i++)
+    {
+        for (j = 0; j < sizeof(adQuantiles) / sizeof(double); j++)
+        {
+            fprintf(psFile, METRICS_PREFIX "latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n", apcLatencyStage[i],
+                    adQuantiles[j], u64HistogramPercentile(&asLatency[i], adQuantiles[j] * 100.0) / 1e9);
+        }
+        fprintf(psFile, METRICS_PREFIX "latency_seconds_sum{stage=\"%s\"} %.9f\n", apcLatencyStage[i], asLatency[i].u64Sum / 1e9);
+        fprintf(psFile, METRICS_PREFIX "latency_seconds_count{stage=\"%s\"} %llu\n", apcLatencyStage[i], (unsigned long long)asLatency[i].u64Count);
+    }
+    
+    return ferror(psFile) ? -1 : 0;
+}
+
+
+void vMetricsEnumerate(tprMetricsValue prValue, void *pvContext)
+{
+    uint32_t i;
+    
+    for (i = 0; i < sizeof(asCounters) / sizeof(tsMetricsCounter); i++)
+    {
+        prValue(pvContext, asCounters[i].pcName, asCounters[i].pcLabels, *asCounters[i].pu64Value);
+    }
+    
+    prValue(pvContext, "tx_queue_depth",            NULL, u32JennicModuleTxQueueDepth());
+    prValue(pvContext, "mailbox_packets",           NULL, sMailboxStats.u32Packets);
+    prValue(pvContext, "mailbox_bytes",             NULL, sMailboxStats.u32Bytes);
+    prValue(pvContext, "nodes",                     NULL, sNodeTableStats.u32Nodes);
+    prValue(pvContext, "nat64_sessions",            NULL, sNAT64Stats.u32Sessions);
+    prValue(pvContext, "shm_clients",               NULL, sShmRingStats.u32Clients);
+    prValue(pvContext, "ping_rtt_microseconds",     NULL, sShaperStats.u32LastRTTUs);
+    prValue(pvContext, "ping_rtt_min_microseconds", NULL, sShaperStats.u32MinRTTUs);
+    prValue(pvContext, "shaper_fill_permille",      NULL, sShaperStats.u32FillPermille);
+    prValue(pvContext, "module_running",            NULL, strcmp(pcJennicModuleState(), "running") == 0);
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
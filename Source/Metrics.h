@@ -0,0 +1,107 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Runtime metrics
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+#ifndef  METRICS_H_INCLUDED
+#define  METRICS_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Prefix of every metric name */
+#define METRICS_PREFIX                      "sixlowpand_"
+
+/** Content type of the text written by iMetricsWrite */
+#define METRICS_CONTENT_TYPE                "text/plain; version=0.0.4"
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** Called by vMetricsEnumerate with each value.
+ *  \param pvContext    Passed through from vMetricsEnumerate
+ *  \param pcName       Metric name, without the prefix
+ *  \param pcLabels     Prometheus labels, without braces, or NULL
+ *  \param u64Value     Current value
+ */
+typedef void (*tprMetricsValue)(void *pvContext, const char *pcName, const char *pcLabels, uint64_t u64Value);
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Write the current value of every counter and gauge in the Prometheus
+ *  text exposition format. Must be called from the main loop, which owns
+ *  the statistics.
+ *  \param psFile       Where to write them
+ *  \return 0 on success, -1 if writing failed
+ */
+int iMetricsWrite(FILE *psFile);
+
+
+/** Pass every counter, and every gauge in its native integer units, to a
+ *  function. The values always come in the same order.
+ *  \param prValue      Function to call
+ *  \param pvContext    Passed to the function
+ */
+void vMetricsEnumerate(tprMetricsValue prValue, void *pvContext);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* METRICS_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
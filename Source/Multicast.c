@@ -0,0 +1,504 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Multicast policy
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+/* Hosts send a steady trickle of multicast onto the tun interface (MLD
+ * reports, mDNS, SSDP, router solicitations) and every packet that reaches
+ * the module may be flooded across the whole mesh. Multicast packets are
+ * therefore matched against a list of group rules, rate limited per group
+ * and repeats within a short window are dropped.
+ *
+ * Policy file format, one rule per line, '#' starts a comment. Rules are
+ * matched in order, the first match wins:
+ *
+ *   allow <group>[/<length>] [<packets/s> <burst>]
+ *   deny <group>[/<length>]
+ *   default allow|deny [<packets/s> <burst>]
+ *   dedup <milliseconds>              Duplicate suppression window, 0 to disable
+ *   mld allow|deny                    Forward MLD messages (default deny)
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/ip6.h>
+#include <netinet/icmp6.h>
+
+#include <libdaemon/daemon.h>
+
+#include "Multicast.h"
+#include "IPv6.h"
+#include "Shaper.h"
+#include "TokenBucket.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/* Number of groups with rate limit state (must be a power of 2) */
+#define MULTICAST_GROUP_SLOTS       128
+
+/* Number of recent packets remembered for duplicate suppression (must be a power of 2) */
+#define MULTICAST_DEDUP_SLOTS       256
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** A group rule */
+typedef struct
+{
+    struct in6_addr sGroup;
+    uint8_t         u8Length;
+    int             iAllow;
+    uint32_t        u32Rate;            /**< Packets per second for each matching group */
+    uint32_t        u32Burst;
+} tsMulticastRule;
+
+
+/** Compiled policy */
+typedef struct
+{
+    uint32_t        u32NumRules;
+    tsMulticastRule asRules[MULTICAST_MAX_RULES + 1];   /**< Followed by the default rule */
+    uint32_t        u32DedupUs;
+    int             iAllowMLD;
+} tsMulticastPolicy;
+
+
+/** Rate limit state of a group */
+typedef struct
+{
+    struct in6_addr sGroup;
+    int             iValid;
+    tsTokenBucket   sBucket;
+} tsMulticastGroup;
+
+
+/** Recently forwarded packet */
+typedef struct
+{
+    uint32_t        u32Hash;
+    uint64_t        u64Time;
+} tsMulticastRecent;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+const char         *pcMulticastPolicyFile = NULL;
+
+tsMulticastStats    sMulticastStats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+/** Policy used when no file is given */
+static const char *apcDefaultPolicy[] =
+{
+    "allow ff02::1",                    /* All nodes */
+    "allow ff02::1:ff00:0/104",         /* Solicited node, for address resolution */
+    "deny ff02::/16",                   /* Other link scope groups: mDNS, SSDP, LLMNR, DHCP, routers */
+    "deny ff05::c",                     /* Site scope SSDP */
+    "deny ff0e::c",                     /* Global scope SSDP */
+    "default allow",
+};
+
+/** Two policies, so a new one can be compiled while the other is in use */
+static tsMulticastPolicy asPolicy[2];
+
+/** Policy in use, NULL until the first load */
+static tsMulticastPolicy *psActivePolicy = NULL;
+
+static tsMulticastGroup asGroups[MULTICAST_GROUP_SLOTS];
+
+static tsMulticastRecent asRecent[MULTICAST_DEDUP_SLOTS];
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/** FNV-1a hash */
+static uint32_t u32MulticastHash(uint32_t u32Hash, const uint8_t *pu8Data, uint32_t u32Length)
+{
+    uint32_t i;
+    
+    for (i = 0; i < u32Length; i++)
+    {
+        u32Hash = (u32Hash ^ pu8Data[i]) * 16777619;
+    }
+    return u32Hash;
+}
+
+
+static int iMulticastParseRate(char *pcRate, char *pcBurst, tsMulticastRule *psRule)
+{
+    char *pcEnd1, *pcEnd2;
+    
+    psRule->u32Rate  = MULTICAST_DEFAULT_RATE;
+    psRule->u32Burst = MULTICAST_DEFAULT_BURST;
+    
+    if (!pcRate)
+    {
+        return 0;
+    }
+    if (!pcBurst)
+    {
+        return -1;
+    }
+    psRule->u32Rate  = strtoul(pcRate,  &pcEnd1, 10);
+    psRule->u32Burst = strtoul(pcBurst, &pcEnd2, 10);
+    if ((*pcEnd1 != '\0') || (*pcEnd2 != '\0') || (psRule->u32Rate == 0) || (psRule->u32Burst == 0))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+
+/** Compile one line of a policy.
+ *  \return 0 if the line was valid
+ */
+static int iMulticastParseLine(tsMulticastPolicy *psPolicy, char *pcLine)
+{
+    char *pcSave = NULL;
+    char *pcKeyword, *pcArg1, *pcArg2, *pcArg3;
+    tsMulticastRule *psRule;
+    
+    pcKeyword = strtok_r(pcLine, " \t\r\n", &pcSave);
+    if (!pcKeyword || (pcKeyword[0] == '#'))
+    {
+        return 0;
+    }
+    pcArg1 = strtok_r(NULL, " \t\r\n", &pcSave);
+    pcArg2 = strtok_r(NULL, " \t\r\n", &pcSave);
+    pcArg3 = strtok_r(NULL, " \t\r\n", &pcSave);
+    
+    if (!pcArg1)
+    {
+        return -1;
+    }
+    
+    if ((strcmp(pcKeyword, "allow") == 0) || (strcmp(pcKeyword, "deny") == 0))
+    {
+        char *pcSlash;
+        
+        if (psPolicy->u32NumRules == MULTICAST_MAX_RULES)
+        {
+            return -1;
+        }
+        psRule = &psPolicy->asRules[psPolicy->u32NumRules];
+        psRule->iAllow   = (pcKeyword[0] == 'a');
+        psRule->u8Length = 128;
+        
+        pcSlash = strchr(pcArg1, '/');
+        if (pcSlash)
+        {
+            char *pcEnd;
+            unsigned long ulLength;
+            
+            *pcSlash = '\0';
+            ulLength = strtoul(pcSlash + 1, &pcEnd, 10);
+            if ((*pcEnd != '\0') || (ulLength < 8) || (ulLength > 128))
+            {
+                return -1;
+            }
+            psRule->u8Length = ulLength;
+        }
+        if ((inet_pton(AF_INET6, pcArg1, &psRule->sGroup) <= 0) || !IN6_IS_ADDR_MULTICAST(&psRule->sGroup))
+        {
+            return -1;
+        }
+        if (iMulticastParseRate(psRule->iAllow ? pcArg2 : NULL, pcArg3, psRule) < 0)
+        {
+            return -1;
+        }
+        psPolicy->u32NumRules++;
+    }
+    else if (strcmp(pcKeyword, "default") == 0)
+    {
+        psRule = &psPolicy->asRules[MULTICAST_MAX_RULES];
+        if (strcmp(pcArg1, "allow") == 0)
+        {
+            psRule->iAllow = 1;
+        }
+        else if (strcmp(pcArg1, "deny") == 0)
+        {
+            psRule->iAllow = 0;
+        }
+        else
+        {
+            return -1;
+        }
+        if (iMulticastParseRate(pcArg2, pcArg3, psRule) < 0)
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(pcKeyword, "dedup") == 0)
+    {
+        char *pcEnd;
+        unsigned long ulMs = strtoul(pcArg1, &pcEnd, 10);
+        
+        if ((*pcEnd != '\0') || (ulMs > 60000))
+        {
+            return -1;
+        }
+        psPolicy->u32DedupUs = ulMs * 1000;
+    }
+    else if (strcmp(pcKeyword, "mld") == 0)
+    {
+        if (strcmp(pcArg1, "allow") == 0)
+        {
+            psPolicy->iAllowMLD = 1;
+        }
+        else if (strcmp(pcArg1, "deny") == 0)
+        {
+            psPolicy->iAllowMLD = 0;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+
+/** Find the rule applying to a group */
+static const tsMulticastRule *psMulticastMatch(const tsMulticastPolicy *psPolicy, const struct in6_addr *psGroup)
+{
+    uint32_t i;
+    
+    for (i = 0; i < psPolicy->u32NumRules; i++)
+    {
+        const tsMulticastRule *psRule = &psPolicy->asRules[i];
+        uint32_t u32Bytes = psRule->u8Length / 8;
+        uint32_t u32Bits  = psRule->u8Length % 8;
+        
+        if (memcmp(psGroup, &psRule->sGroup, u32Bytes) != 0)
+        {
+            continue;
+        }
+        if (u32Bits && ((psGroup->s6_addr[u32Bytes] ^ psRule->sGroup.s6_addr[u32Bytes]) & (0xFF00 >> u32Bits)))
+        {
+            continue;
+        }
+        return psRule;
+    }
+    return &psPolicy->asRules[MULTICAST_MAX_RULES];
+}
+
+
+/** Take a token from the bucket of a group.
+ *  \return 0 if the packet is within the group's rate
+ */
+static int iMulticastRateLimit(const tsMulticastRule *psRule, const struct in6_addr *psGroup, uint64_t u64Now)
+{
+    uint32_t u32Slot = u32MulticastHash(2166136261u, psGroup->s6_addr, sizeof(struct in6_addr)) & (MULTICAST_GROUP_SLOTS - 1);
+    tsMulticastGroup *psEntry = &asGroups[u32Slot];
+    
+    if (!psEntry->iValid || memcmp(&psEntry->sGroup, psGroup, sizeof(struct in6_addr)))
+    {
+        /* New group, or it has displaced another one sharing the slot */
+        memcpy(&psEntry->sGroup, psGroup, sizeof(struct in6_addr));
+        psEntry->iValid         = 1;
+        vTokenBucketFill(&psEntry->sBucket, psRule->u32Burst, u64Now);
+    }
+    
+    return bTokenBucketTake(&psEntry->sBucket, psRule->u32Rate, psRule->u32Burst, u64Now) ? 0 : -1;
+}
+
+
+/** Check for a recent identical packet, and remember this one.
+ *  \return 1 if the packet is a duplicate
+ */
+static int iMulticastDuplicate(const tsMulticastPolicy *psPolicy, const uint8_t *pu8Packet, uint32_t u32Length, uint64_t u64Now)
+{
+    tsMulticastRecent *psRecent;
+    uint32_t u32Hash;
+    
+    if (psPolicy->u32DedupUs == 0)
+    {
+        return 0;
+    }
+    
+    /* Hash everything except the hop limit */
+    u32Hash = u32MulticastHash(2166136261u, pu8Packet, 7);
+    u32Hash = u32MulticastHash(u32Hash, &pu8Packet[8], u32Length - 8);
+    
+    psRecent = &asRecent[u32Hash & (MULTICAST_DEDUP_SLOTS - 1)];
+    if ((psRecent->u32Hash == u32Hash) && (psRecent->u64Time != 0) &&
+        ((u64Now - psRecent->u64Time) < psPolicy->u32DedupUs))
+    {
+        return 1;
+    }
+    psRecent->u32Hash = u32Hash;
+    psRecent->u64Time = u64Now;
+    return 0;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iMulticastLoad(void)
+{
+    tsMulticastPolicy *psPolicy = (psActivePolicy == &asPolicy[0]) ? &asPolicy[1] : &asPolicy[0];
+    char acLine[256];
+    uint32_t u32LineNumber = 0;
+    
+    memset(psPolicy, 0, sizeof(tsMulticastPolicy));
+    psPolicy->u32DedupUs = MULTICAST_DEFAULT_DEDUP_MS * 1000;
+    psPolicy->asRules[MULTICAST_MAX_RULES].iAllow   = 1;
+    psPolicy->asRules[MULTICAST_MAX_RULES].u32Rate  = MULTICAST_DEFAULT_RATE;
+    psPolicy->asRules[MULTICAST_MAX_RULES].u32Burst = MULTICAST_DEFAULT_BURST;
+    
+    if (pcMulticastPolicyFile)
+    {
+        FILE *psFile = fopen(pcMulticastPolicyFile, "r");
+        
+        if (!psFile)
+        {
+            daemon_log(LOG_ERR, "Could not open multicast policy '%s' (%s)", pcMulticastPolicyFile, strerror(errno));
+            sMulticastStats.u64ReloadErrors++;
+            return -1;
+        }
+        
+        while (fgets(acLine, sizeof(acLine), psFile))
+        {
+            u32LineNumber++;
+            if (iMulticastParseLine(psPolicy, acLine) < 0)
+            {
+                daemon_log(LOG_ERR, "Invalid multicast rule at %s:%u, keeping previous policy", pcMulticastPolicyFile, u32LineNumber);
+                fclose(psFile);
+                sMulticastStats.u64ReloadErrors++;
+                return -1;
+            }
+        }
+        fclose(psFile);
+        
+        daemon_log(LOG_INFO, "Loaded multicast policy from %s", pcMulticastPolicyFile);
+    }
+    else
+    {
+        for (u32LineNumber = 0; u32LineNumber < sizeof(apcDefaultPolicy) / sizeof(apcDefaultPolicy[0]); u32LineNumber++)
+        {
+            strncpy(acLine, apcDefaultPolicy[u32LineNumber], sizeof(acLine) - 1);
+            acLine[sizeof(acLine) - 1] = '\0';
+            iMulticastParseLine(psPolicy, acLine);
+        }
+    }
+    
+    /* Group state refers to the previous rules */
+    memset(asGroups, 0, sizeof(asGroups));
+    
+    psActivePolicy = psPolicy;
+    sMulticastStats.u64Reloads++;
+    return 0;
+}
+
+
+bool bMulticastForward(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length)
+{
+    const tsMulticastPolicy *psPolicy = psActivePolicy;
+    const struct ip6_hdr *psHeader = (const struct ip6_hdr *)pu8Packet;
+    const tsMulticastRule *psRule;
+    uint32_t u32Offset;
+    
+    if (!psPolicy || (u32Length < IPV6_HEADER_LENGTH))
+    {
+        return TRUE;
+    }
+    
+    if (!psPolicy->iAllowMLD &&
+        (u8IPv6UpperLayer(pu8Packet, u32Length, &u32Offset) == IPPROTO_ICMPV6) && (u32Offset < u32Length))
+    {
+        switch (pu8Packet[u32Offset])
+        {
+            case MLD_LISTENER_QUERY:
+            case MLD_LISTENER_REPORT:
+            case MLD_LISTENER_REDUCTION:
+            case 143:                           /* MLDv2 listener report */
+                sMulticastStats.u64DroppedMLD++;
+                sMulticastStats.u64AirtimeSavedUs += u32ShaperAirtime(u32Length, 0);
+                return FALSE;
+            default:
+                break;
+        }
+    }
+    
+    psRule = psMulticastMatch(psPolicy, &psHeader->ip6_dst);
+    if (!psRule->iAllow)
+    {
+        sMulticastStats.u64DroppedGroup++;
+        sMulticastStats.u64AirtimeSavedUs += u32ShaperAirtime(u32Length, 0);
+        return FALSE;
+    }
+    
+    if (iMulticastDuplicate(psPolicy, pu8Packet, u32Length, u64Now))
+    {
+        sMulticastStats.u64DroppedDuplicate++;
+        sMulticastStats.u64AirtimeSavedUs += u32ShaperAirtime(u32Length, 0);
+        return FALSE;
+    }
+    
+    if (iMulticastRateLimit(psRule, &psHeader->ip6_dst, u64Now) < 0)
+    {
+        sMulticastStats.u64DroppedRate++;
+        sMulticastStats.u64AirtimeSavedUs += u32ShaperAirtime(u32Length, 0);
+        return FALSE;
+    }
+    
+    sMulticastStats.u64Passed++;
+    return TRUE;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
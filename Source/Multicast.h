@@ -0,0 +1,133 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Multicast policy
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+#ifndef  MULTICAST_H_INCLUDED
+#define  MULTICAST_H_INCLUDED
+
+#include <stdint.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Maximum number of group rules in a policy */
+#define MULTICAST_MAX_RULES                 32
+
+/** Default rate limit for each group, packets per second */
+#define MULTICAST_DEFAULT_RATE              10
+
+/** Default burst allowed for each group, packets */
+#define MULTICAST_DEFAULT_BURST             20
+
+/** Default window in which identical packets are suppressed, milliseconds */
+#define MULTICAST_DEFAULT_DEDUP_MS          1000
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** Multicast policy statistics */
+typedef struct
+{
+    uint64_t    u64Passed;              /**< Multicast packets forwarded to the mesh */
+    uint64_t    u64DroppedGroup;        /**< Group not on the whitelist */
+    uint64_t    u64DroppedMLD;          /**< MLD messages, which the mesh does not use */
+    uint64_t    u64DroppedRate;         /**< Over the group's rate limit */
+    uint64_t    u64DroppedDuplicate;    /**< Repeats of a recent packet */
+    uint64_t    u64AirtimeSavedUs;      /**< Estimated radio airtime saved by dropping packets */
+    uint64_t    u64Reloads;             /**< Policies loaded successfully */
+    uint64_t    u64ReloadErrors;        /**< Policy files rejected */
+} tsMulticastStats;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Path of the multicast policy file, NULL for the built in policy */
+extern const char          *pcMulticastPolicyFile;
+
+
+/** Multicast policy statistics */
+extern tsMulticastStats     sMulticastStats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Load the multicast policy from pcMulticastPolicyFile. The active policy
+ *  is only replaced if the whole file is valid, so this may be called at
+ *  any time to reload it.
+ *  \return 0 on success, -1 if the policy could not be loaded
+ */
+int iMulticastLoad(void);
+
+
+/** Decide whether a multicast packet read from the tun device should be
+ *  sent into the mesh.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    IPv6 packet with a multicast destination
+ *  \param u32Length    Length of the packet
+ *  \return TRUE if the packet should be forwarded
+ */
+bool bMulticastForward(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* MULTICAST_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
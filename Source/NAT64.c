@@ -0,0 +1,1042 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          NAT64 translator
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+/* Stateful NAT64 (RFC 6146) between IPv4 hosts on the tun device and the
+ * IPv6 mesh, so IPv4-only clients reach nodes without a separate
+ * translator and another pass through the kernel.
+ *
+ * IPv4 hosts appear in the mesh under a /96 prefix (RFC 6052). Each node
+ * talking to IPv4 hosts is bound to an address of its own from an IPv4
+ * pool, so ports never need translating. Bindings are either configured,
+ * which lets IPv4 hosts open sessions to the node, or made when the node
+ * first sends to an IPv4 host, in which case only hosts the node already
+ * has a session with may reach it. Dynamic bindings last as long as they
+ * have sessions.
+ *
+ * Headers are rewritten in place: the IPv4 header is replaced by an IPv6
+ * header built in the headroom in front of it and vice versa, and transport
+ * checksums are adjusted for the change of pseudo header. UDP, TCP and ICMP
+ * echo are translated; fragments, IPv6 extension headers and ICMP errors
+ * are not. Translated IPv4 packets grow by 20 bytes, so errors the daemon
+ * raises for them (Packet Too Big, filter rejects) go back to the IPv4 host
+ * as ICMPv4 rather than to its synthesized IPv6 address, and the MSS of
+ * TCP SYNs from nodes is clamped so IPv4 hosts never send segments that
+ * could not be forwarded to the mesh.
+ *
+ * The pool must be routed to the tun device. Configuration file format,
+ * one directive per line, '#' starts a comment:
+ *
+ *   prefix <IPv6 prefix>/96               Prefix for IPv4 hosts (default 64:ff9b::/96)
+ *   pool <IPv4 address>/<length>          Addresses for nodes, length 16 to 32
+ *   map <IPv4 address> <IPv6 address>     Configured binding, from the pool
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/icmp6.h>
+
+#include <libdaemon/daemon.h>
+
+#include "NAT64.h"
+#include "IPv6.h"
+#include "TunDevice.h"
+#include "NodeTable.h"
+#include "Clock.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/* Number of session slots (must be a power of 2) */
+#define NAT64_SESSION_SLOTS         8192
+#define NAT64_SESSION_MASK          (NAT64_SESSION_SLOTS - 1)
+
+/* Slots examined by each call to vNAT64Age */
+#define NAT64_AGE_STEP              (NAT64_SESSION_SLOTS / 8)
+
+/* Shortest pool prefix, limiting the size of the binding table */
+#define NAT64_MIN_POOL_LENGTH       16
+
+/* Session state flags */
+#define NAT64_SESSION_FROM_IPV4     0x01    /* Opened by the IPv4 host */
+#define NAT64_SESSION_ESTABLISHED   0x02    /* TCP packets seen in both directions */
+
+/* TCP header */
+#define TCP_HEADER_LENGTH           20
+#define TCP_CHECKSUM_OFFSET         16
+#define TCP_FLAGS_OFFSET            13
+#define TCP_FLAG_FIN                0x01
+#define TCP_FLAG_SYN                0x02
+#define TCP_FLAG_RST                0x04
+
+/* TCP options */
+#define TCP_OPTION_END              0
+#define TCP_OPTION_NOP              1
+#define TCP_OPTION_MSS              2
+#define TCP_OPTION_MSS_LENGTH       4
+
+/* UDP header */
+#define UDP_HEADER_LENGTH           8
+#define UDP_CHECKSUM_OFFSET         6
+
+/* ICMP echo header */
+#define ICMP_ECHO_LENGTH            8
+#define ICMP_CHECKSUM_OFFSET        2
+#define ICMP_ECHO_REPLY             0
+#define ICMP_ECHO_REQUEST           8
+
+/* ICMP errors (RFC 792) */
+#define ICMP_ERROR_HEADER_LENGTH    8
+#define ICMP_UNREACHABLE            3
+#define ICMP_UNREACHABLE_HOST       1
+#define ICMP_UNREACHABLE_PORT       3
+#define ICMP_UNREACHABLE_NEEDFRAG   4
+#define ICMP_UNREACHABLE_ADMIN      10
+
+/* Largest ICMP error, the size every IPv4 host must accept (RFC 1812) */
+#define ICMP_ERROR_MAX_LENGTH       576
+
+/* TTL of ICMP errors sent to IPv4 hosts */
+#define ICMP_ERROR_TTL              64
+
+/* Smallest MTU an IPv4 host must support (RFC 791) */
+#define IPV4_MIN_MTU                68
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** A session, identified by its IPv4 side */
+typedef struct
+{
+    uint32_t        u32Remote;          /**< IPv4 host */
+    uint32_t        u32Local;           /**< Pool address of the node */
+    uint16_t        u16RemotePort;      /**< Port of the IPv4 host, or ICMP echo identifier */
+    uint16_t        u16LocalPort;       /**< Port of the node, or ICMP echo identifier */
+    uint8_t         u8Protocol;         /**< IPv4 protocol, 0 marks an empty slot */
+    uint8_t         u8State;            /**< Combination of session state flags */
+    uint64_t        u64Expires;
+} tsNAT64Session;
+
+
+/** Binding of a pool address to a node */
+typedef struct
+{
+    struct in6_addr sNode;              /**< Unspecified if the address is free */
+    uint32_t        u32Sessions;
+    int             iStatic;
+} tsNAT64Binding;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+const char     *pcNAT64ConfigFile = NULL;
+
+tsNAT64Stats    sNAT64Stats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+/** Prefix for IPv4 hosts, only the first 96 bits are used */
+static struct in6_addr sPrefix = { { { 0x00, 0x64, 0xff, 0x9b } } };
+
+/** IPv4 pool, host byte order */
+static uint32_t u32PoolNetwork;
+static uint32_t u32PoolSize;
+
+/** Usable pool indexes, excluding network and broadcast addresses */
+static uint32_t u32PoolFirst;
+static uint32_t u32PoolLast;
+
+/** Binding of each pool address, NULL while NAT64 is disabled */
+static tsNAT64Binding *pasBindings = NULL;
+
+/** Where to start looking for a free pool address */
+static uint32_t u32BindingCursor;
+
+static tsNAT64Session asSessions[NAT64_SESSION_SLOTS];
+
+/** Next slot to be examined for aging */
+static uint32_t u32AgeCursor;
+
+/** Identification of translated IPv4 packets */
+static uint16_t u16NextIdentification;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/** Add 16 bit words to a one's complement sum */
+static uint32_t u32NAT64Sum(uint32_t u32Sum, const uint8_t *pu8Data, uint32_t u32Length)
+{
+    uint32_t i;
+    
+    for (i = 0; i + 1 < u32Length; i += 2)
+    {
+        u32Sum += (pu8Data[i] << 8) | pu8Data[i + 1];
+    }
+    if (u32Length & 1)
+    {
+        u32Sum += pu8Data[u32Length - 1] << 8;
+    }
+    return u32Sum;
+}
+
+
+static uint16_t u16NAT64Fold(uint32_t u32Sum)
+{
+    while (u32Sum >> 16)
+    {
+        u32Sum = (u32Sum & 0xFFFF) + (u32Sum >> 16);
+    }
+    return u32Sum;
+}
+
+
+/** Update the checksum at pu8Checksum for a pseudo header whose addresses
+ *  summed to u32OldSum and now sum to u32NewSum (RFC 1624)
+ */
+static void vNAT64AdjustChecksum(uint8_t *pu8Checksum, uint32_t u32OldSum, uint32_t u32NewSum)
+{
+    uint32_t u32Sum = (~((pu8Checksum[0] << 8) | pu8Checksum[1]) & 0xFFFF) +
+                      (~u16NAT64Fold(u32OldSum) & 0xFFFF) + u16NAT64Fold(u32NewSum);
+    uint16_t u16Checksum = ~u16NAT64Fold(u32Sum);
+    
+    pu8Checksum[0] = u16Checksum >> 8;
+    pu8Checksum[1] = u16Checksum & 0xFF;
+}
+
+
+static void vNAT64PutChecksum(uint8_t *pu8Checksum, uint16_t u16Checksum)
+{
+    pu8Checksum[0] = u16Checksum >> 8;
+    pu8Checksum[1] = u16Checksum & 0xFF;
+}
+
+
+/** Home slot of a session (Fibonacci hashing) */
+static inline uint32_t u32NAT64Slot(const tsNAT64Session *psKey)
+{
+    uint64_t u64Key = ((uint64_t)psKey->u32Remote << 32) | psKey->u32Local;
+    
+    u64Key ^= ((uint64_t)psKey->u16RemotePort << 40) ^ ((uint64_t)psKey->u16LocalPort << 8) ^ psKey->u8Protocol;
+    return (uint32_t)((u64Key * 0x9E3779B97F4A7C15ULL) >> 40) & NAT64_SESSION_MASK;
+}
+
+
+static inline int iNAT64SessionMatch(const tsNAT64Session *psSession, const tsNAT64Session *psKey)
+{
+    return ((psSession->u32Remote     == psKey->u32Remote) &&
+            (psSession->u32Local      == psKey->u32Local) &&
+            (psSession->u16RemotePort == psKey->u16RemotePort) &&
+            (psSession->u16LocalPort  == psKey->u16LocalPort) &&
+            (psSession->u8Protocol    == psKey->u8Protocol));
+}
+
+
+/** Find the slot holding a session, or the empty slot that ends its probe sequence */
+static uint32_t u32NAT64Find(const tsNAT64Session *psKey)
+{
+    uint32_t u32Slot = u32NAT64Slot(psKey);
+    
+    while (asSessions[u32Slot].u8Protocol && !iNAT64SessionMatch(&asSessions[u32Slot], psKey))
+    {
+        u32Slot = (u32Slot + 1) & NAT64_SESSION_MASK;
+    }
+    return u32Slot;
+}
+
+
+/** Release a dynamic binding */
+static void vNAT64Unbind(uint32_t u32Index)
+{
+    tsNode *psNode = psNodeTableLookup(&pasBindings[u32Index].sNode);
+    
+    if (psNode && (psNode->u32NAT64Binding == u32Index + 1))
+    {
+        psNode->u32NAT64Binding = 0;
+    }
+    memset(&pasBindings[u32Index], 0, sizeof(tsNAT64Binding));
+    sNAT64Stats.u32Bindings--;
+}
+
+
+/** Empty a slot, moving later members of the probe sequence back to fill the gap */
+static void vNAT64Remove(uint32_t u32Slot)
+{
+    uint32_t u32Index = asSessions[u32Slot].u32Local - u32PoolNetwork;
+    uint32_t u32Next = u32Slot;
+    
+    for (;;)
+    {
+        uint32_t u32Home;
+        
+        u32Next = (u32Next + 1) & NAT64_SESSION_MASK;
+        if (asSessions[u32Next].u8Protocol == 0)
+        {
+            break;
+        }
+        
+        u32Home = u32NAT64Slot(&asSessions[u32Next]);
+        
+        /* Entry can stay if its home lies cyclically in (u32Slot, u32Next] */
+        if ((u32Slot <= u32Next) ? ((u32Slot < u32Home) && (u32Home <= u32Next))
+                                 : ((u32Slot < u32Home) || (u32Home <= u32Next)))
+        {
+            continue;
+        }
+        
+        asSessions[u32Slot] = asSessions[u32Next];
+        u32Slot = u32Next;
+    }
+    
+    memset(&asSessions[u32Slot], 0, sizeof(tsNAT64Session));
+    sNAT64Stats.u32Sessions--;
+    
+    if ((--pasBindings[u32Index].u32Sessions == 0) && !pasBindings[u32Index].iStatic)
+    {
+        vNAT64Unbind(u32Index);
+    }
+}
+
+
+/** Find the session a packet belongs to, opening one if allowed, and
+ *  refresh its lifetime.
+ *  \return 0 if the packet may be translated
+ */
+static int iNAT64Session(uint64_t u64Now, const tsNAT64Session *psKey, int iFromIPv4, uint8_t u8TCPFlags)
+{
+    uint32_t u32Index = psKey->u32Local - u32PoolNetwork;
+    tsNAT64Session *psSession = &asSessions[u32NAT64Find(psKey)];
+    uint32_t u32Timeout;
+    
+    if (psSession->u8Protocol == 0)
+    {
+        if (iFromIPv4 && !pasBindings[u32Index].iStatic)
+        {
+            /* Only hosts the node has talked to may reach a dynamic binding */
+            sNAT64Stats.u64DroppedFiltered++;
+            return -1;
+        }
+        if (sNAT64Stats.u32Sessions >= NAT64_MAX_SESSIONS)
+        {
+            sNAT64Stats.u64DroppedFull++;
+            return -1;
+        }
+        *psSession = *psKey;
+        psSession->u8State = iFromIPv4 ? NAT64_SESSION_FROM_IPV4 : 0;
+        pasBindings[u32Index].u32Sessions++;
+        sNAT64Stats.u32Sessions++;
+        sNAT64Stats.u64SessionsCreated++;
+    }
+    
+    switch (psKey->u8Protocol)
+    {
+        case IPPROTO_TCP:
+            if (u8TCPFlags & (TCP_FLAG_FIN | TCP_FLAG_RST))
+            {
+                psSession->u8State &= ~NAT64_SESSION_ESTABLISHED;
+            }
+            else if (!iFromIPv4 != !(psSession->u8State & NAT64_SESSION_FROM_IPV4))
+            {
+                /* Answer from the side that did not open the session */
+                psSession->u8State |= NAT64_SESSION_ESTABLISHED;
+            }
+            u32Timeout = (psSession->u8State & NAT64_SESSION_ESTABLISHED) ? NAT64_TCP_ESTABLISHED_TIMEOUT : NAT64_TCP_TRANSITORY_TIMEOUT;
+            break;
+        case IPPROTO_UDP:
+            u32Timeout = NAT64_UDP_TIMEOUT;
+            break;
+        default:
+            u32Timeout = NAT64_ICMP_TIMEOUT;
+            break;
+    }
+    psSession->u64Expires = u64Now + (uint64_t)u32Timeout * 1000000;
+    return 0;
+}
+
+
+/** Find the pool address bound to a node, binding a free one if necessary.
+ *  \return Index of the pool address plus one, 0 if there is none
+ */
+static uint32_t u32NAT64Bind(uint64_t u64Now, const struct in6_addr *psAddress)
+{
+    tsNode *psNode = psNodeTableLookup(psAddress);
+    uint32_t u32Count;
+    
+    if (!psNode)
+    {
+        return 0;
+    }
+    if (psNode->u32NAT64Binding)
+    {
+        return psNode->u32NAT64Binding;
+    }
+    
+    for (u32Count = u32PoolLast - u32PoolFirst + 1; u32Count; u32Count--)
+    {
+        uint32_t u32Index = u32BindingCursor;
+        
+        u32BindingCursor = (u32BindingCursor == u32PoolLast) ? u32PoolFirst : (u32BindingCursor + 1);
+        if (IN6_IS_ADDR_UNSPECIFIED(&pasBindings[u32Index].sNode))
+        {
+            memcpy(&pasBindings[u32Index].sNode, psAddress, sizeof(struct in6_addr));
+            psNode->u32NAT64Binding = u32Index + 1;
+            sNAT64Stats.u32Bindings++;
+            return u32Index + 1;
+        }
+    }
+    return 0;
+}
+
+
+/** Read the session key and TCP flags of a transport header.
+ *  \return 0 if the protocol is translated
+ */
+static int iNAT64Ports(uint8_t u8Protocol, const uint8_t *pu8Payload, uint32_t u32Length,
+                       uint16_t *pu16Source, uint16_t *pu16Dest, uint8_t *pu8TCPFlags)
+{
+    *pu8TCPFlags = 0;
+    switch (u8Protocol)
+    {
+        case IPPROTO_UDP:
+            if (u32Length < UDP_HEADER_LENGTH)
+            {
+                return -1;
+            }
+            break;
+        case IPPROTO_TCP:
+            if (u32Length < TCP_HEADER_LENGTH)
+            {
+                return -1;
+            }
+            *pu8TCPFlags = pu8Payload[TCP_FLAGS_OFFSET];
+            break;
+        default:
+            /* ICMP echo, both ends are identified by the echo identifier */
+            if (u32Length < ICMP_ECHO_LENGTH)
+            {
+                return -1;
+            }
+            *pu16Source = *pu16Dest = (pu8Payload[4] << 8) | pu8Payload[5];
+            return 0;
+    }
+    *pu16Source = (pu8Payload[0] << 8) | pu8Payload[1];
+    *pu16Dest   = (pu8Payload[2] << 8) | pu8Payload[3];
+    return 0;
+}
+
+
+/** Lower the MSS option of a TCP SYN so that the segments the IPv4 host
+ *  sends back still fit the mesh once translated.
+ */
+static void vNAT64ClampMSS(uint8_t *pu8Payload, uint32_t u32Length)
+{
+    uint32_t u32HeaderLength = (pu8Payload[12] >> 4) * 4;
+    uint32_t u32MaxMSS = u32TunMTU - IPV6_HEADER_LENGTH - TCP_HEADER_LENGTH;
+    uint32_t u32Offset, u32OldSum;
+    
+    if ((u32HeaderLength <= TCP_HEADER_LENGTH) || (u32HeaderLength > u32Length))
+    {
+        return;
+    }
+    
+    for (u32Offset = TCP_HEADER_LENGTH; u32Offset < u32HeaderLength; )
+    {
+        uint8_t *pu8Option = &pu8Payload[u32Offset];
+        uint32_t u32MSS;
+        
+        if (pu8Option[0] == TCP_OPTION_END)
+        {
+            break;
+        }
+        if (pu8Option[0] == TCP_OPTION_NOP)
+        {
+            u32Offset++;
+            continue;
+        }
+        if ((u32Offset + 1 >= u32HeaderLength) || (pu8Option[1] < 2) || (u32Offset + pu8Option[1] > u32HeaderLength))
+        {
+            break;
+        }
+        if ((pu8Option[0] == TCP_OPTION_MSS) && (pu8Option[1] == TCP_OPTION_MSS_LENGTH))
+        {
+            u32MSS = (pu8Option[2] << 8) | pu8Option[3];
+            if (u32MSS > u32MaxMSS)
+            {
+                /* Options start on a 16 bit boundary, so sum them whole */
+                u32OldSum = u32NAT64Sum(0, &pu8Payload[TCP_HEADER_LENGTH], u32HeaderLength - TCP_HEADER_LENGTH);
+                pu8Option[2] = u32MaxMSS >> 8;
+                pu8Option[3] = u32MaxMSS & 0xFF;
+                vNAT64AdjustChecksum(&pu8Payload[TCP_CHECKSUM_OFFSET], u32OldSum,
+                                     u32NAT64Sum(0, &pu8Payload[TCP_HEADER_LENGTH], u32HeaderLength - TCP_HEADER_LENGTH));
+                sNAT64Stats.u64MSSClamped++;
+            }
+            break;
+        }
+        u32Offset += pu8Option[1];
+    }
+}
+
+
+static int iNAT64ParseLine(char *pcLine)
+{
+    char *pcSave = NULL;
+    char *pcKeyword, *pcArg1, *pcArg2;
+    
+    pcKeyword = strtok_r(pcLine, " \t\r\n", &pcSave);
+    if (!pcKeyword || (pcKeyword[0] == '#'))
+    {
+        return 0;
+    }
+    pcArg1 = strtok_r(NULL, " \t\r\n", &pcSave);
+    pcArg2 = strtok_r(NULL, " \t\r\n", &pcSave);
+    
+    if (!pcArg1)
+    {
+        return -1;
+    }
+    
+    if (strcmp(pcKeyword, "prefix") == 0)
+    {
+        char *pcSlash = strchr(pcArg1, '/');
+        
+        if (!pcSlash || (strcmp(pcSlash, "/96") != 0))
+        {
+            return -1;
+        }
+        *pcSlash = '\0';
+        if (inet_pton(AF_INET6, pcArg1, &sPrefix) <= 0)
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(pcKeyword, "pool") == 0)
+    {
+        char *pcSlash = strchr(pcArg1, '/');
+        struct in_addr sPool;
+        unsigned long ulLength;
+        char *pcEnd;
+        
+        if (!pcSlash || pasBindings)
+        {
+            return -1;
+        }
+        *pcSlash = '\0';
+        ulLength = strtoul(pcSlash + 1, &pcEnd, 10);
+        if ((*pcEnd != '\0') || (ulLength < NAT64_MIN_POOL_LENGTH) || (ulLength > 32) ||
+            (inet_pton(AF_INET, pcArg1, &sPool) <= 0))
+        {
+            return -1;
+        }
+        u32PoolSize    = 1 << (32 - ulLength);
+        u32PoolNetwork = ntohl(sPool.s_addr) & ~(u32PoolSize - 1);
+        u32PoolFirst   = (ulLength <= 30) ? 1 : 0;
+        u32PoolLast    = (ulLength <= 30) ? (u32PoolSize - 2) : (u32PoolSize - 1);
+        u32BindingCursor = u32PoolFirst;
+        
+        pasBindings = calloc(u32PoolSize, sizeof(tsNAT64Binding));
+        if (!pasBindings)
+        {
+            daemon_log(LOG_ERR, "Could not allocate NAT64 bindings (%s)", strerror(errno));
+            return -1;
+        }
+    }
+    else if (strcmp(pcKeyword, "map") == 0)
+    {
+        struct in_addr sIPv4;
+        struct in6_addr sIPv6;
+        uint32_t u32Index;
+        tsNode *psNode;
+        
+        if (!pasBindings || !pcArg2 ||
+            (inet_pton(AF_INET, pcArg1, &sIPv4) <= 0) || (inet_pton(AF_INET6, pcArg2, &sIPv6) <= 0))
+        {
+            return -1;
+        }
+        u32Index = ntohl(sIPv4.s_addr) - u32PoolNetwork;
+        if ((u32Index < u32PoolFirst) || (u32Index > u32PoolLast) ||
+            !IN6_IS_ADDR_UNSPECIFIED(&pasBindings[u32Index].sNode))
+        {
+            return -1;
+        }
+        
+        psNode = psNodeTableAdd(u64ClockNowUs(), &sIPv6, E_NODE_FLAG_STATIC);
+        if (!psNode || psNode->u32NAT64Binding)
+        {
+            return -1;
+        }
+        memcpy(&pasBindings[u32Index].sNode, &sIPv6, sizeof(struct in6_addr));
+        pasBindings[u32Index].iStatic = 1;
+        psNode->u32NAT64Binding = u32Index + 1;
+        sNAT64Stats.u32Bindings++;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iNAT64Load(void)
+{
+    char acLine[256];
+    uint32_t u32LineNumber = 0;
+    FILE *psFile;
+    
+    if (!pcNAT64ConfigFile)
+    {
+        return 0;
+    }
+    
+    psFile = fopen(pcNAT64ConfigFile, "r");
+    if (!psFile)
+    {
+        daemon_log(LOG_ERR, "Could not open NAT64 configuration '%s' (%s)", pcNAT64ConfigFile, strerror(errno));
+        return -1;
+    }
+    
+    while (fgets(acLine, sizeof(acLine), psFile))
+    {
+        u32LineNumber++;
+        if (iNAT64ParseLine(acLine) < 0)
+        {
+            daemon_log(LOG_ERR, "Invalid NAT64 configuration at %s:%u", pcNAT64ConfigFile, u32LineNumber);
+            fclose(psFile);
+            return -1;
+        }
+    }
+    fclose(psFile);
+    
+    if (!pasBindings)
+    {
+        daemon_log(LOG_ERR, "No NAT64 pool in %s", pcNAT64ConfigFile);
+        return -1;
+    }
+    
+    daemon_log(LOG_INFO, "Loaded NAT64 configuration from %s", pcNAT64ConfigFile);
+    return 0;
+}
+
+
+uint8_t *pu8NAT64ToIPv6(uint64_t u64Now, uint8_t *pu8Packet, uint32_t *pu32Length)
+{
+    struct ip6_hdr *psHeader;
+    tsNAT64Session sKey;
+    uint8_t *pu8Payload;
+    uint32_t u32HeaderLength, u32TotalLength, u32PayloadLength;
+    uint32_t u32Index, u32OldSum;
+    uint8_t u8TOS, u8TTL, u8Protocol, u8TCPFlags;
+    uint8_t au8Source[4];
+    
+    if (!pasBindings)
+    {
+        sNAT64Stats.u64DroppedUnsupported++;
+        return NULL;
+    }
+    
+    u32HeaderLength = (pu8Packet[0] & 0x0F) * 4;
+    if ((*pu32Length < sizeof(struct ip)) || (u32HeaderLength < sizeof(struct ip)))
+    {
+        sNAT64Stats.u64DroppedInvalid++;
+        return NULL;
+    }
+    u32TotalLength = (pu8Packet[2] << 8) | pu8Packet[3];
+    if ((u32TotalLength < u32HeaderLength) || (u32TotalLength > *pu32Length))
+    {
+        sNAT64Stats.u64DroppedInvalid++;
+        return NULL;
+    }
+    if (((pu8Packet[6] << 8) | pu8Packet[7]) & (IP_MF | IP_OFFMASK))
+    {
+        sNAT64Stats.u64DroppedUnsupported++;
+        return NULL;
+    }
+    
+    u8TOS       = pu8Packet[1];
+    u8TTL       = pu8Packet[8];
+    u8Protocol  = pu8Packet[9];
+    memcpy(au8Source, &pu8Packet[12], sizeof(au8Source));
+    
+    memset(&sKey, 0, sizeof(tsNAT64Session));
+    sKey.u32Remote  = (pu8Packet[12] << 24) | (pu8Packet[13] << 16) | (pu8Packet[14] << 8) | pu8Packet[15];
+    sKey.u32Local   = (pu8Packet[16] << 24) | (pu8Packet[17] << 16) | (pu8Packet[18] << 8) | pu8Packet[19];
+    sKey.u8Protocol = u8Protocol;
+    
+    u32Index = sKey.u32Local - u32PoolNetwork;
+    if ((u32Index >= u32PoolSize) || IN6_IS_ADDR_UNSPECIFIED(&pasBindings[u32Index].sNode))
+    {
+        sNAT64Stats.u64DroppedNoBinding++;
+        return NULL;
+    }
+    
+    pu8Payload       = &pu8Packet[u32HeaderLength];
+    u32PayloadLength = u32TotalLength - u32HeaderLength;
+    
+    if (((u8Protocol != IPPROTO_UDP) && (u8Protocol != IPPROTO_TCP) && (u8Protocol != IPPROTO_ICMP)) ||
+        ((u8Protocol == IPPROTO_ICMP) && (u32PayloadLength >= 1) &&
+         (pu8Payload[0] != ICMP_ECHO_REQUEST) && (pu8Payload[0] != ICMP_ECHO_REPLY)))
+    {
+        sNAT64Stats.u64DroppedUnsupported++;
+        return NULL;
+    }
+    if (iNAT64Ports(u8Protocol, pu8Payload, u32PayloadLength, &sKey.u16RemotePort, &sKey.u16LocalPort, &u8TCPFlags) < 0)
+    {
+        sNAT64Stats.u64DroppedInvalid++;
+        return NULL;
+    }
+    
+    if (iNAT64Session(u64Now, &sKey, 1, u8TCPFlags) < 0)
+    {
+        return NULL;
+    }
+    
+    /* Both addresses, as they appear in the IPv4 pseudo header */
+    u32OldSum = u32NAT64Sum(0, &pu8Packet[12], 8);
+    
+    /* The IPv6 header ends where the IPv4 header did */
+    psHeader = (struct ip6_hdr *)(pu8Payload - IPV6_HEADER_LENGTH);
+    psHeader->ip6_flow = htonl((6 << 28) | (u8TOS << 20));
+    psHeader->ip6_plen = htons(u32PayloadLength);
+    psHeader->ip6_nxt  = (u8Protocol == IPPROTO_ICMP) ? IPPROTO_ICMPV6 : u8Protocol;
+    psHeader->ip6_hlim = u8TTL;
+    memcpy(&psHeader->ip6_src, &sPrefix, 12);
+    memcpy(&psHeader->ip6_src.s6_addr[12], au8Source, sizeof(au8Source));
+    memcpy(&psHeader->ip6_dst, &pasBindings[u32Index].sNode, sizeof(struct in6_addr));
+    
+    switch (u8Protocol)
+    {
+        case IPPROTO_TCP:
+            vNAT64AdjustChecksum(&pu8Payload[TCP_CHECKSUM_OFFSET], u32OldSum, u32NAT64Sum(0, (uint8_t *)&psHeader->ip6_src, 32));
+            break;
+        case IPPROTO_UDP:
+            if ((pu8Payload[UDP_CHECKSUM_OFFSET] == 0) && (pu8Payload[UDP_CHECKSUM_OFFSET + 1] == 0))
+            {
+                /* Optional in IPv4 but not in IPv6 */
+                vNAT64PutChecksum(&pu8Payload[UDP_CHECKSUM_OFFSET],
+                                  u16IPv6Checksum(&psHeader->ip6_src, &psHeader->ip6_dst, IPPROTO_UDP, pu8Payload, u32PayloadLength));
+            }
+            else
+            {
+                vNAT64AdjustChecksum(&pu8Payload[UDP_CHECKSUM_OFFSET], u32OldSum, u32NAT64Sum(0, (uint8_t *)&psHeader->ip6_src, 32));
+            }
+            break;
+        default:
+            /* ICMPv6 covers a pseudo header, ICMP does not */
+            pu8Payload[0] = (pu8Payload[0] == ICMP_ECHO_REQUEST) ? ICMP6_ECHO_REQUEST : ICMP6_ECHO_REPLY;
+            vNAT64PutChecksum(&pu8Payload[ICMP_CHECKSUM_OFFSET], 0);
+            vNAT64PutChecksum(&pu8Payload[ICMP_CHECKSUM_OFFSET],
+                              u16IPv6Checksum(&psHeader->ip6_src, &psHeader->ip6_dst, IPPROTO_ICMPV6, pu8Payload, u32PayloadLength));
+            break;
+    }
+    
+    sNAT64Stats.u64ToIPv6++;
+    *pu32Length = IPV6_HEADER_LENGTH + u32PayloadLength;
+    return (uint8_t *)psHeader;
+}
+
+
+bool bNAT64ToIPv4(uint64_t u64Now, uint8_t *pu8Packet, uint32_t u32Length)
+{
+    const struct ip6_hdr *psHeader = (const struct ip6_hdr *)pu8Packet;
+    tsNAT64Session sKey;
+    uint8_t *pu8IPv4;
+    uint8_t *pu8Payload;
+    uint32_t u32PayloadLength, u32Offset, u32Binding, u32OldSum;
+    uint8_t u8TrafficClass, u8HopLimit, u8Protocol, u8TCPFlags;
+    
+    if (!pasBindings || (u32Length < IPV6_HEADER_LENGTH) || (memcmp(&psHeader->ip6_dst, &sPrefix, 12) != 0))
+    {
+        return FALSE;
+    }
+    
+    u8Protocol = u8IPv6UpperLayer(pu8Packet, u32Length, &u32Offset);
+    if ((u8Protocol == IPV6_NEXT_HEADER_INVALID) || (u32Offset != IPV6_HEADER_LENGTH))
+    {
+        sNAT64Stats.u64DroppedUnsupported++;
+        return TRUE;
+    }
+    
+    u32PayloadLength = ntohs(psHeader->ip6_plen);
+    if (IPV6_HEADER_LENGTH + u32PayloadLength > u32Length)
+    {
+        sNAT64Stats.u64DroppedInvalid++;
+        return TRUE;
+    }
+    pu8Payload = &pu8Packet[IPV6_HEADER_LENGTH];
+    
+    if (((u8Protocol != IPPROTO_UDP) && (u8Protocol != IPPROTO_TCP) && (u8Protocol != IPPROTO_ICMPV6)) ||
+        ((u8Protocol == IPPROTO_ICMPV6) && (u32PayloadLength >= 1) &&
+         (pu8Payload[0] != ICMP6_ECHO_REQUEST) && (pu8Payload[0] != ICMP6_ECHO_REPLY)))
+    {
+        sNAT64Stats.u64DroppedUnsupported++;
+        return TRUE;
+    }
+    
+    u32Binding = u32NAT64Bind(u64Now, &psHeader->ip6_src);
+    if (!u32Binding)
+    {
+        sNAT64Stats.u64DroppedNoBinding++;
+        return TRUE;
+    }
+    
+    memset(&sKey, 0, sizeof(tsNAT64Session));
+    sKey.u32Remote  = (pu8Packet[36] << 24) | (pu8Packet[37] << 16) | (pu8Packet[38] << 8) | pu8Packet[39];
+    sKey.u32Local   = u32PoolNetwork + u32Binding - 1;
+    sKey.u8Protocol = (u8Protocol == IPPROTO_ICMPV6) ? IPPROTO_ICMP : u8Protocol;
+    
+    if (iNAT64Ports(sKey.u8Protocol, pu8Payload, u32PayloadLength, &sKey.u16LocalPort, &sKey.u16RemotePort, &u8TCPFlags) < 0)
+    {
+        sNAT64Stats.u64DroppedInvalid++;
+        return TRUE;
+    }
+    
+    if (iNAT64Session(u64Now, &sKey, 0, u8TCPFlags) < 0)
+    {
+        if ((pasBindings[u32Binding - 1].u32Sessions == 0) && !pasBindings[u32Binding - 1].iStatic)
+        {
+            /* Bound for this packet only */
+            vNAT64Unbind(u32Binding - 1);
+        }
+        return TRUE;
+    }
+    
+    /* Both addresses, as they appear in the IPv6 pseudo header */
+    u32OldSum       = u32NAT64Sum(0, &pu8Packet[8], 32);
+    u8TrafficClass  = (ntohl(psHeader->ip6_flow) >> 20) & 0xFF;
+    u8HopLimit      = psHeader->ip6_hlim;
+    
+    /* The IPv4 header ends where the IPv6 header did */
+    pu8IPv4 = pu8Payload - sizeof(struct ip);
+    pu8IPv4[0]  = 0x45;
+    pu8IPv4[1]  = u8TrafficClass;
+    pu8IPv4[2]  = (sizeof(struct ip) + u32PayloadLength) >> 8;
+    pu8IPv4[3]  = (sizeof(struct ip) + u32PayloadLength) & 0xFF;
+    pu8IPv4[4]  = u16NextIdentification >> 8;
+    pu8IPv4[5]  = u16NextIdentification & 0xFF;
+    pu8IPv4[6]  = 0;
+    pu8IPv4[7]  = 0;
+    pu8IPv4[8]  = u8HopLimit;
+    pu8IPv4[9]  = sKey.u8Protocol;
+    pu8IPv4[10] = 0;
+    pu8IPv4[11] = 0;
+    pu8IPv4[12] = sKey.u32Local >> 24;
+    pu8IPv4[13] = sKey.u32Local >> 16;
+    pu8IPv4[14] = sKey.u32Local >> 8;
+    pu8IPv4[15] = sKey.u32Local;
+    pu8IPv4[16] = sKey.u32Remote >> 24;
+    pu8IPv4[17] = sKey.u32Remote >> 16;
+    pu8IPv4[18] = sKey.u32Remote >> 8;
+    pu8IPv4[19] = sKey.u32Remote;
+    vNAT64PutChecksum(&pu8IPv4[10], ~u16NAT64Fold(u32NAT64Sum(0, pu8IPv4, sizeof(struct ip))));
+    u16NextIdentification++;
+    
+    switch (sKey.u8Protocol)
+    {
+        case IPPROTO_TCP:
+            if (u8TCPFlags & TCP_FLAG_SYN)
+            {
+                vNAT64ClampMSS(pu8Payload, u32PayloadLength);
+            }
+            vNAT64AdjustChecksum(&pu8Payload[TCP_CHECKSUM_OFFSET], u32OldSum, u32NAT64Sum(0, &pu8IPv4[12], 8));
+            break;
+        case IPPROTO_UDP:
+            vNAT64AdjustChecksum(&pu8Payload[UDP_CHECKSUM_OFFSET], u32OldSum, u32NAT64Sum(0, &pu8IPv4[12], 8));
+            if ((pu8Payload[UDP_CHECKSUM_OFFSET] == 0) && (pu8Payload[UDP_CHECKSUM_OFFSET + 1] == 0))
+            {
+                /* Zero means no checksum in IPv4 */
+                vNAT64PutChecksum(&pu8Payload[UDP_CHECKSUM_OFFSET], 0xFFFF);
+            }
+            break;
+        default:
+            pu8Payload[0] = (pu8Payload[0] == ICMP6_ECHO_REQUEST) ? ICMP_ECHO_REQUEST : ICMP_ECHO_REPLY;
+            vNAT64PutChecksum(&pu8Payload[ICMP_CHECKSUM_OFFSET], 0);
+            vNAT64PutChecksum(&pu8Payload[ICMP_CHECKSUM_OFFSET], ~u16NAT64Fold(u32NAT64Sum(0, pu8Payload, u32PayloadLength)));
+            break;
+    }
+    
+    if (eTunDeviceWritePacket(sizeof(struct ip) + u32PayloadLength, pu8IPv4) != E_TUN_OK)
+    {
+        daemon_log(LOG_ERR, "Error writing translated packet to tun device");
+        return TRUE;
+    }
+    sNAT64Stats.u64ToIPv4++;
+    return TRUE;
+}
+
+
+bool bNAT64SendError(uint8_t u8Type, uint8_t u8Code, uint32_t u32Parameter, const uint8_t *pu8Packet, uint32_t u32Length)
+{
+    const struct ip6_hdr *psHeader = (const struct ip6_hdr *)pu8Packet;
+    uint8_t au8Error[ICMP_ERROR_MAX_LENGTH];
+    uint8_t *pu8ICMP = &au8Error[sizeof(struct ip)];
+    uint8_t *pu8Invoking = &pu8ICMP[ICMP_ERROR_HEADER_LENGTH];
+    uint32_t u32Local, u32PayloadLength, u32Copy, u32ErrorLength;
+    tsNode *psNode;
+    
+    if (!pasBindings || (u32Length < IPV6_HEADER_LENGTH) || (memcmp(&psHeader->ip6_src, &sPrefix, 12) != 0))
+    {
+        return FALSE;
+    }
+    
+    psNode = psNodeTableLookup(&psHeader->ip6_dst);
+    if (!psNode || !psNode->u32NAT64Binding)
+    {
+        /* Binding gone since the packet was translated */
+        return TRUE;
+    }
+    u32Local = u32PoolNetwork + psNode->u32NAT64Binding - 1;
+    
+    /* Translate the error as RFC 7915 section 5.2 does */
+    memset(au8Error, 0, sizeof(struct ip) + ICMP_ERROR_HEADER_LENGTH);
+    pu8ICMP[0] = ICMP_UNREACHABLE;
+    switch (u8Type)
+    {
+        case ICMP6_PACKET_TOO_BIG:
+            u32Parameter = (u32Parameter > IPV4_MIN_MTU + NAT64_HEADROOM) ? (u32Parameter - NAT64_HEADROOM) : IPV4_MIN_MTU;
+            pu8ICMP[1] = ICMP_UNREACHABLE_NEEDFRAG;
+            pu8ICMP[6] = u32Parameter >> 8;
+            pu8ICMP[7] = u32Parameter & 0xFF;
+            break;
+        case ICMP6_DST_UNREACH:
+            pu8ICMP[1] = (u8Code == ICMP6_DST_UNREACH_ADMIN)  ? ICMP_UNREACHABLE_ADMIN :
+                         (u8Code == ICMP6_DST_UNREACH_NOPORT) ? ICMP_UNREACHABLE_PORT : ICMP_UNREACHABLE_HOST;
+            break;
+        default:
+            return TRUE;
+    }
+    
+    /* The invoking packet as the IPv4 host sent it, as far as it fits */
+    u32PayloadLength = ntohs(psHeader->ip6_plen);
+    u32Copy = u32Length - IPV6_HEADER_LENGTH;
+    if (u32Copy > u32PayloadLength)
+    {
+        u32Copy = u32PayloadLength;
+    }
+    if (u32Copy > sizeof(au8Error) - (pu8Invoking - au8Error) - sizeof(struct ip))
+    {
+        u32Copy = sizeof(au8Error) - (pu8Invoking - au8Error) - sizeof(struct ip);
+    }
+    memset(pu8Invoking, 0, sizeof(struct ip));
+    pu8Invoking[0]  = 0x45;
+    pu8Invoking[1]  = (ntohl(psHeader->ip6_flow) >> 20) & 0xFF;
+    pu8Invoking[2]  = (sizeof(struct ip) + u32PayloadLength) >> 8;
+    pu8Invoking[3]  = (sizeof(struct ip) + u32PayloadLength) & 0xFF;
+    pu8Invoking[6]  = IP_DF >> 8;
+    pu8Invoking[8]  = psHeader->ip6_hlim;
+    pu8Invoking[9]  = (psHeader->ip6_nxt == IPPROTO_ICMPV6) ? IPPROTO_ICMP : psHeader->ip6_nxt;
+    memcpy(&pu8Invoking[12], &pu8Packet[20], 4);
+    pu8Invoking[16] = u32Local >> 24;
+    pu8Invoking[17] = u32Local >> 16;
+    pu8Invoking[18] = u32Local >> 8;
+    pu8Invoking[19] = u32Local;
+    vNAT64PutChecksum(&pu8Invoking[10], ~u16NAT64Fold(u32NAT64Sum(0, pu8Invoking, sizeof(struct ip))));
+    memcpy(&pu8Invoking[sizeof(struct ip)], &pu8Packet[IPV6_HEADER_LENGTH], u32Copy);
+    if ((psHeader->ip6_nxt == IPPROTO_ICMPV6) && (u32Copy >= 1))
+    {
+        pu8Invoking[sizeof(struct ip)] = (pu8Invoking[sizeof(struct ip)] == ICMP6_ECHO_REQUEST) ? ICMP_ECHO_REQUEST : ICMP_ECHO_REPLY;
+    }
+    
+    u32ErrorLength = (pu8Invoking - au8Error) + sizeof(struct ip) + u32Copy;
+    vNAT64PutChecksum(&pu8ICMP[ICMP_CHECKSUM_OFFSET],
+                      ~u16NAT64Fold(u32NAT64Sum(0, pu8ICMP, u32ErrorLength - sizeof(struct ip))));
+    
+    /* From the pool address the host was sending to */
+    au8Error[0]  = 0x45;
+    au8Error[2]  = u32ErrorLength >> 8;
+    au8Error[3]  = u32ErrorLength & 0xFF;
+    au8Error[4]  = u16NextIdentification >> 8;
+    au8Error[5]  = u16NextIdentification & 0xFF;
+    au8Error[8]  = ICMP_ERROR_TTL;
+    au8Error[9]  = IPPROTO_ICMP;
+    memcpy(&au8Error[12], &pu8Invoking[16], 4);
+    memcpy(&au8Error[16], &pu8Invoking[12], 4);
+    vNAT64PutChecksum(&au8Error[10], ~u16NAT64Fold(u32NAT64Sum(0, au8Error, sizeof(struct ip))));
+    u16NextIdentification++;
+    
+    if (eTunDeviceWritePacket(u32ErrorLength, au8Error) != E_TUN_OK)
+    {
+        daemon_log(LOG_ERR, "Error writing ICMP error to tun device");
+        return TRUE;
+    }
+    sNAT64Stats.u64ErrorsSent++;
+    return TRUE;
+}
+
+
+void vNAT64Age(uint64_t u64Now)
+{
+    uint32_t u32Examined;
+    
+    if (!pasBindings)
+    {
+        return;
+    }
+    
+    for (u32Examined = 0; u32Examined < NAT64_AGE_STEP; u32Examined++)
+    {
+        if (asSessions[u32AgeCursor].u8Protocol && (u64Now > asSessions[u32AgeCursor].u64Expires))
+        {
+            vNAT64Remove(u32AgeCursor);
+            sNAT64Stats.u64SessionsExpired++;
+            /* Another entry may have moved into this slot, look at it again */
+            continue;
+        }
+        u32AgeCursor = (u32AgeCursor + 1) & NAT64_SESSION_MASK;
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,169 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          NAT64 translator
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+#ifndef  NAT64_H_INCLUDED
+#define  NAT64_H_INCLUDED
+
+#include <stdint.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Space needed in front of an IPv4 packet to translate it in place */
+#define NAT64_HEADROOM                      20
+
+/** Maximum number of sessions */
+#define NAT64_MAX_SESSIONS                  7168
+
+/** Session lifetimes, seconds (RFC 6146 section 4) */
+#define NAT64_UDP_TIMEOUT                   300
+#define NAT64_ICMP_TIMEOUT                  60
+#define NAT64_TCP_ESTABLISHED_TIMEOUT       7440
+#define NAT64_TCP_TRANSITORY_TIMEOUT        240
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** NAT64 statistics */
+typedef struct
+{
+    uint32_t    u32Sessions;            /**< Sessions currently open */
+    uint32_t    u32Bindings;            /**< Pool addresses currently bound to nodes */
+    uint64_t    u64ToIPv6;              /**< IPv4 packets translated towards the mesh */
+    uint64_t    u64ToIPv4;              /**< IPv6 packets translated towards IPv4 hosts */
+    uint64_t    u64ErrorsSent;          /**< ICMP errors sent to IPv4 hosts for translated packets */
+    uint64_t    u64MSSClamped;          /**< TCP SYNs from nodes whose MSS was lowered */
+    uint64_t    u64SessionsCreated;
+    uint64_t    u64SessionsExpired;
+    uint64_t    u64DroppedNoBinding;    /**< IPv4 destination not bound to a node, or pool exhausted */
+    uint64_t    u64DroppedFiltered;     /**< Unsolicited IPv4 packet for a dynamic binding */
+    uint64_t    u64DroppedFull;         /**< Session table full */
+    uint64_t    u64DroppedUnsupported;  /**< Fragments, extension headers, other protocols */
+    uint64_t    u64DroppedInvalid;      /**< Malformed packets */
+} tsNAT64Stats;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Path of the NAT64 configuration file, NULL to disable NAT64 */
+extern const char      *pcNAT64ConfigFile;
+
+
+/** NAT64 statistics */
+extern tsNAT64Stats     sNAT64Stats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Load the NAT64 configuration from pcNAT64ConfigFile. Called once at
+ *  startup, as bindings and sessions refer to it.
+ *  \return 0 on success, -1 if the configuration could not be loaded
+ */
+int iNAT64Load(void);
+
+
+/** Translate an IPv4 packet read from the tun device into IPv6, in place.
+ *  There must be NAT64_HEADROOM bytes available in front of the packet.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    IPv4 packet
+ *  \param pu32Length   Length of the packet, updated to the length of the IPv6 packet
+ *  \return Start of the IPv6 packet, NULL if the packet should be dropped
+ */
+uint8_t *pu8NAT64ToIPv6(uint64_t u64Now, uint8_t *pu8Packet, uint32_t *pu32Length);
+
+
+/** Examine an IPv6 packet received from the mesh. If it is addressed to an
+ *  IPv4 host through the NAT64 prefix, translate it in place and write it
+ *  to the tun device.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    IPv6 packet
+ *  \param u32Length    Length of the packet
+ *  \return TRUE if the packet was for the NAT64 prefix and has been dealt with
+ */
+bool bNAT64ToIPv4(uint64_t u64Now, uint8_t *pu8Packet, uint32_t u32Length);
+
+
+/** Examine a packet the daemon is about to send an ICMPv6 error for. If it
+ *  was translated from IPv4, send the equivalent ICMP error to the IPv4
+ *  host instead, since its synthesized IPv6 address leads nowhere.
+ *  \param u8Type       ICMPv6 error type
+ *  \param u8Code       ICMPv6 error code
+ *  \param u32Parameter MTU for Packet Too Big
+ *  \param pu8Packet    IPv6 packet that caused the error
+ *  \param u32Length    Length of the packet
+ *  \return TRUE if the packet came from an IPv4 host and has been dealt with
+ */
+bool bNAT64SendError(uint8_t u8Type, uint8_t u8Code, uint32_t u32Parameter, const uint8_t *pu8Packet, uint32_t u32Length);
+
+
+/** Expire idle sessions, and release dynamic bindings without sessions.
+ *  Called periodically; each call examines a fraction of the session table.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ */
+void vNAT64Age(uint64_t u64Now);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* NAT64_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
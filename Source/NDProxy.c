@@ -0,0 +1,197 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Neighbor Discovery proxy
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/ip6.h>
+#include <netinet/icmp6.h>
+
+#include <libdaemon/daemon.h>
+
+#include "NDProxy.h"
+#include "NodeTable.h"
+#include "IPv6.h"
+#include "TunDevice.h"
+#include "JennicModule.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/* Neighbor Discovery messages must arrive with the maximum hop limit (RFC 4861 7.1.1) */
+#define ND_HOP_LIMIT                255
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+extern int verbosity;
+
+int             iNDProxyEnabled = 1;
+
+tsNDProxyStats  sNDProxyStats;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+/** Determine if an address belongs in the mesh */
+static int iNDProxyMeshAddress(const struct in6_addr *psAddress)
+{
+    if (IN6_IS_ADDR_LINKLOCAL(psAddress))
+    {
+        return 1;
+    }
+    return ((((uint64_t)ntohl(psAddress->s6_addr32[0]) << 32) | ntohl(psAddress->s6_addr32[1])) == u64NetworkPrefix);
+}
+
+
+/** Answer a neighbor solicitation on behalf of a mesh node */
+static void vNDProxyAdvertise(const struct ip6_hdr *psSolicitation, const struct in6_addr *psTarget)
+{
+    uint8_t au8Packet[IPV6_HEADER_LENGTH + sizeof(struct nd_neighbor_advert)];
+    struct ip6_hdr *psHeader = (struct ip6_hdr *)au8Packet;
+    struct nd_neighbor_advert *psAdvert = (struct nd_neighbor_advert *)&au8Packet[IPV6_HEADER_LENGTH];
+    
+    memset(au8Packet, 0, sizeof(au8Packet));
+    psHeader->ip6_vfc   = 6 << 4;
+    psHeader->ip6_plen  = htons(sizeof(struct nd_neighbor_advert));
+    psHeader->ip6_nxt   = IPPROTO_ICMPV6;
+    psHeader->ip6_hlim  = ND_HOP_LIMIT;
+    memcpy(&psHeader->ip6_src, psTarget, sizeof(struct in6_addr));
+    
+    psAdvert->nd_na_type = ND_NEIGHBOR_ADVERT;
+    psAdvert->nd_na_code = 0;
+    memcpy(&psAdvert->nd_na_target, psTarget, sizeof(struct in6_addr));
+    
+    if (IN6_IS_ADDR_UNSPECIFIED(&psSolicitation->ip6_src))
+    {
+        /* Duplicate address detection - defend the node's address to all nodes */
+        psHeader->ip6_dst.s6_addr[0]  = 0xff;
+        psHeader->ip6_dst.s6_addr[1]  = 0x02;
+        psHeader->ip6_dst.s6_addr[15] = 0x01;
+        psAdvert->nd_na_flags_reserved = ND_NA_FLAG_ROUTER;
+    }
+    else
+    {
+        memcpy(&psHeader->ip6_dst, &psSolicitation->ip6_src, sizeof(struct in6_addr));
+        /* A proxy does not set the override flag (RFC 4861 7.2.8) */
+        psAdvert->nd_na_flags_reserved = ND_NA_FLAG_ROUTER | ND_NA_FLAG_SOLICITED;
+    }
+    
+    psAdvert->nd_na_cksum = htons(u16IPv6Checksum(&psHeader->ip6_src, &psHeader->ip6_dst, IPPROTO_ICMPV6,
+                                                  (uint8_t *)psAdvert, sizeof(struct nd_neighbor_advert)));
+    
+    if (eTunDeviceWritePacket(sizeof(au8Packet), au8Packet) == E_TUN_OK)
+    {
+        sNDProxyStats.u64Answered++;
+    }
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+bool bNDProxyHandlePacket(const uint8_t *pu8Packet, uint32_t u32Length)
+{
+    const struct ip6_hdr *psHeader = (const struct ip6_hdr *)pu8Packet;
+    const struct icmp6_hdr *psICMP;
+    uint32_t u32Offset;
+    
+    if (!iNDProxyEnabled ||
+        (u8IPv6UpperLayer(pu8Packet, u32Length, &u32Offset) != IPPROTO_ICMPV6) ||
+        (u32Offset + sizeof(struct icmp6_hdr) > u32Length))
+    {
+        return FALSE;
+    }
+    
+    psICMP = (const struct icmp6_hdr *)&pu8Packet[u32Offset];
+    
+    switch (psICMP->icmp6_type)
+    {
+        case ND_ROUTER_SOLICIT:
+            /* The mesh has no use for the host's router solicitations */
+            sNDProxyStats.u64RouterSolicitations++;
+            return TRUE;
+            
+        case ND_NEIGHBOR_SOLICIT:
+        {
+            const struct nd_neighbor_solicit *psSolicit = (const struct nd_neighbor_solicit *)psICMP;
+            
+            if ((psHeader->ip6_hlim != ND_HOP_LIMIT) || (psICMP->icmp6_code != 0) ||
+                (u32Offset + sizeof(struct nd_neighbor_solicit) > u32Length) ||
+                IN6_IS_ADDR_MULTICAST(&psSolicit->nd_ns_target))
+            {
+                sNDProxyStats.u64Invalid++;
+                return TRUE;
+            }
+            
+            if (!iNDProxyMeshAddress(&psSolicit->nd_ns_target))
+            {
+                return FALSE;
+            }
+            sNDProxyStats.u64Solicitations++;
+            
+            if (!psNodeTableLookup(&psSolicit->nd_ns_target))
+            {
+                sNDProxyStats.u64Forwarded++;
+                return FALSE;
+            }
+            
+            if (verbosity >= LOG_DEBUG)
+            {
+                char acAddress[INET6_ADDRSTRLEN];
+                inet_ntop(AF_INET6, &psSolicit->nd_ns_target, acAddress, sizeof(acAddress));
+                daemon_log(LOG_DEBUG, "Answering neighbor solicitation for %s", acAddress);
+            }
+            vNDProxyAdvertise(psHeader, &psSolicit->nd_ns_target);
+            return TRUE;
+        }
+        
+        default:
+            return FALSE;
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
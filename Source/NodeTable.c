@@ -0,0 +1,399 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Mesh node table
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+/* Open addressing hash table of the nodes seen in inbound traffic, keyed
+ * by interface identifier. Linear probing with backward shift deletion,
+ * so there are no tombstones and lookups stay short as nodes come and go.
+ * Entry pointers are only valid until the next call to vNodeTableAge.
+ *
+ * Hop counts are estimated from the hop limit of inbound packets, assuming
+ * the sender started from the nearest common initial value (64, 128, 255).
+ * This only sees routers that decrement the hop limit, so with mesh-under
+ * forwarding most nodes appear to be a single hop away.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <libdaemon/daemon.h>
+
+#include "NodeTable.h"
+#include "IPv6.h"
+#include "DumpFile.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define NODE_TABLE_MASK             (NODE_TABLE_SIZE - 1)
+
+/* Keep the load factor below 7/8 so that probe sequences stay short */
+#define NODE_TABLE_MAX_NODES        (NODE_TABLE_SIZE - (NODE_TABLE_SIZE / 8))
+
+/* Weight of a new sample in the latency averages, 1/2^n */
+#define NODE_TABLE_EWMA_SHIFT       3
+
+/* Slots examined by each call to vNodeTableAge */
+#define NODE_TABLE_AGE_STEP         (NODE_TABLE_SIZE / 8)
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+uint32_t            u32NodeTableMaxAge = NODE_TABLE_DEFAULT_MAX_AGE;
+
+tsNodeTableStats    sNodeTableStats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static tsNode asNodes[NODE_TABLE_SIZE];
+
+/** Next slot to be examined for aging */
+static uint32_t u32AgeCursor;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static inline uint64_t u64NodeTableIID(const struct in6_addr *psAddress)
+{
+    uint64_t u64IID = 0;
+    int i;
+    
+    for (i = 8; i < 16; i++)
+    {
+        u64IID = (u64IID << 8) | psAddress->s6_addr[i];
+    }
+    return u64IID;
+}
+
+
+/** Home slot of an interface identifier (Fibonacci hashing) */
+static inline uint32_t u32NodeTableSlot(uint64_t u64IID)
+{
+    return (uint32_t)((u64IID * 0x9E3779B97F4A7C15ULL) >> 40) & NODE_TABLE_MASK;
+}
+
+
+/** Find the slot holding an IID, or the empty slot that ends its probe sequence */
+static uint32_t u32NodeTableFind(uint64_t u64IID)
+{
+    uint32_t u32Slot = u32NodeTableSlot(u64IID);
+    
+    while (asNodes[u32Slot].u64IID && (asNodes[u32Slot].u64IID != u64IID))
+    {
+        u32Slot = (u32Slot + 1) & NODE_TABLE_MASK;
+    }
+    return u32Slot;
+}
+
+
+/** Empty a slot, moving later members of the probe sequence back to fill the gap */
+static void vNodeTableRemove(uint32_t u32Slot)
+{
+    uint32_t u32Next = u32Slot;
+    
+    for (;;)
+    {
+        uint32_t u32Home;
+        
+        u32Next = (u32Next + 1) & NODE_TABLE_MASK;
+        if (asNodes[u32Next].u64IID == 0)
+        {
+            break;
+        }
+        
+        u32Home = u32NodeTableSlot(asNodes[u32Next].u64IID);
+        
+        /* Entry can stay if its home lies cyclically in (u32Slot, u32Next] */
+        if ((u32Slot <= u32Next) ? ((u32Slot < u32Home) && (u32Home <= u32Next))
+                                 : ((u32Slot < u32Home) || (u32Home <= u32Next)))
+        {
+            continue;
+        }
+        
+        asNodes[u32Slot] = asNodes[u32Next];
+        u32Slot = u32Next;
+    }
+    
+    memset(&asNodes[u32Slot], 0, sizeof(tsNode));
+    sNodeTableStats.u32Nodes--;
+}
+
+/** Find a node, adding it to the table if it is new */
+static tsNode *psNodeTableLearn(uint64_t u64Now, const struct in6_addr *psAddress)
+{
+    uint64_t u64IID = u64NodeTableIID(psAddress);
+    uint32_t u32Slot;
+    tsNode *psNode;
+    
+    if (u64IID == 0)
+    {
+        return NULL;
+    }
+    
+    u32Slot = u32NodeTableFind(u64IID);
+    psNode = &asNodes[u32Slot];
+    
+    if (psNode->u64IID == 0)
+    {
+        if (sNodeTableStats.u32Nodes >= NODE_TABLE_MAX_NODES)
+        {
+            sNodeTableStats.u64Full++;
+            return NULL;
+        }
+        psNode->u64IID          = u64IID;
+        psNode->u64FirstSeen    = u64Now;
+        psNode->u64LastSeen     = u64Now;
+        sNodeTableStats.u32Nodes++;
+        sNodeTableStats.u64Learned++;
+    }
+    
+    if (!IN6_IS_ADDR_LINKLOCAL(psAddress) || IN6_IS_ADDR_UNSPECIFIED(&psNode->sAddress))
+    {
+        /* Prefer to remember the routable address */
+        memcpy(&psNode->sAddress, psAddress, sizeof(struct in6_addr));
+    }
+    return psNode;
+}
+
+
+/** Fold a sample into a running average */
+static inline void vNodeTableAverage(uint32_t *pu32Average, uint64_t u64Sample)
+{
+    if (u64Sample > UINT32_MAX)
+    {
+        u64Sample = UINT32_MAX;
+    }
+    if (*pu32Average == 0)
+    {
+        *pu32Average = (uint32_t)u64Sample;
+    }
+    else
+    {
+        *pu32Average = (uint32_t)((int64_t)*pu32Average + (((int64_t)u64Sample - (int64_t)*pu32Average) >> NODE_TABLE_EWMA_SHIFT));
+    }
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+tsNode *psNodeTableAdd(uint64_t u64Now, const struct in6_addr *psAddress, uint8_t u8Flags)
+{
+    tsNode *psNode = psNodeTableLearn(u64Now, psAddress);
+    
+    if (psNode)
+    {
+        psNode->u8Flags |= u8Flags;
+    }
+    return psNode;
+}
+
+
+void vNodeTableInbound(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length)
+{
+    const struct in6_addr *psSource = (const struct in6_addr *)&pu8Packet[8];
+    uint8_t u8HopLimit;
+    uint8_t u8Initial;
+    tsNode *psNode;
+    
+    if ((u32Length < IPV6_HEADER_LENGTH) || IN6_IS_ADDR_UNSPECIFIED(psSource) || IN6_IS_ADDR_MULTICAST(psSource))
+    {
+        return;
+    }
+    
+    psNode = psNodeTableLearn(u64Now, psSource);
+    if (!psNode)
+    {
+        return;
+    }
+    psNode->u64RxPackets++;
+    psNode->u64RxBytes += u32Length;
+    
+    u8HopLimit = pu8Packet[7];
+    u8Initial = (u8HopLimit <= 64) ? 64 : (u8HopLimit <= 128) ? 128 : 255;
+    psNode->u8Hops = u8Initial - u8HopLimit;
+    
+    if (psNode->u64LastTx && (psNode->u64LastTx >= psNode->u64LastSeen))
+    {
+        /* First packet heard since we last sent to it */
+        vNodeTableAverage(&psNode->u32ResponseUs, u64Now - psNode->u64LastTx);
+    }
+    psNode->u64LastSeen = u64Now;
+}
+
+
+void vNodeTableOutbound(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length, uint32_t u32QueueUs)
+{
+    tsNode *psNode;
+    
+    if ((u32Length < IPV6_HEADER_LENGTH) || (pu8Packet[24] == 0xFF))
+    {
+        return;
+    }
+    
+    psNode = psNodeTableLookup((const struct in6_addr *)&pu8Packet[24]);
+    if (!psNode)
+    {
+        return;
+    }
+    
+    psNode->u64TxPackets++;
+    psNode->u64TxBytes += u32Length;
+    psNode->u64LastTx = u64Now;
+    vNodeTableAverage(&psNode->u32TxQueueUs, u32QueueUs);
+}
+
+
+uint8_t u8NodeTableHops(const struct in6_addr *psAddress)
+{
+    tsNode *psNode;
+    
+    if (IN6_IS_ADDR_MULTICAST(psAddress))
+    {
+        return 0;
+    }
+    psNode = psNodeTableLookup(psAddress);
+    return psNode ? psNode->u8Hops : 0;
+}
+
+
+tsNode *psNodeTableLookup(const struct in6_addr *psAddress)
+{
+    uint64_t u64IID = u64NodeTableIID(psAddress);
+    uint32_t u32Slot;
+    
+    sNodeTableStats.u64Lookups++;
+    
+    if (u64IID == 0)
+    {
+        return NULL;
+    }
+    
+    u32Slot = u32NodeTableFind(u64IID);
+    if (asNodes[u32Slot].u64IID == 0)
+    {
+        return NULL;
+    }
+    
+    sNodeTableStats.u64Hits++;
+    return &asNodes[u32Slot];
+}
+
+
+void vNodeTableAge(uint64_t u64Now)
+{
+    uint64_t u64MaxAge = (uint64_t)u32NodeTableMaxAge * 1000000;
+    uint32_t u32Examined;
+    
+    for (u32Examined = 0; u32Examined < NODE_TABLE_AGE_STEP; u32Examined++)
+    {
+        tsNode *psNode = &asNodes[u32AgeCursor];
+        
+        if (psNode->u64IID && !(psNode->u8Flags & E_NODE_FLAG_STATIC) && (psNode->u16MailCount == 0) &&
+            (psNode->u32NAT64Binding == 0) &&
+            ((u64Now - psNode->u64LastSeen) > u64MaxAge))
+        {
+            vNodeTableRemove(u32AgeCursor);
+            sNodeTableStats.u64Expired++;
+            /* Another entry may have moved into this slot, look at it again */
+            continue;
+        }
+        u32AgeCursor = (u32AgeCursor + 1) & NODE_TABLE_MASK;
+    }
+}
+
+
+int iNodeTableWrite(uint64_t u64Now, FILE *psFile)
+{
+    char acAddress[INET6_ADDRSTRLEN];
+    uint32_t i;
+    
+    fprintf(psFile, "# address hops first_seen_s last_seen_s rx_packets rx_bytes tx_packets tx_bytes tx_queue_us response_us flags mailbox\n");
+    for (i = 0; i < NODE_TABLE_SIZE; i++)
+    {
+        const tsNode *psNode = &asNodes[i];
+        
+        if (psNode->u64IID == 0)
+        {
+            continue;
+        }
+        inet_ntop(AF_INET6, &psNode->sAddress, acAddress, sizeof(acAddress));
+        fprintf(psFile, "%s %u %llu %llu %llu %llu %llu %llu %u %u %c%c %u\n", acAddress, psNode->u8Hops,
+                (unsigned long long)((u64Now - psNode->u64FirstSeen) / 1000000),
+                (unsigned long long)((u64Now - psNode->u64LastSeen) / 1000000),
+                (unsigned long long)psNode->u64RxPackets, (unsigned long long)psNode->u64RxBytes,
+                (unsigned long long)psNode->u64TxPackets, (unsigned long long)psNode->u64TxBytes,
+                psNode->u32TxQueueUs, psNode->u32ResponseUs,
+                (psNode->u8Flags & E_NODE_FLAG_STATIC) ? 'C' : '-',
+                (psNode->u8Flags & E_NODE_FLAG_SLEEPY) ? 'S' : '-',
+                psNode->u16MailCount);
+    }
+    return ferror(psFile) ? -1 : 0;
+}
+
+
+int iNodeTableDump(uint64_t u64Now, const char *pcFileName)
+{
+    char acTempName[256];
+    FILE *psFile;
+    
+    psFile = psDumpFileOpen(pcFileName, acTempName, sizeof(acTempName));
+    if (!psFile)
+    {
+        return -1;
+    }
+    
+    iNodeTableWrite(u64Now, psFile);
+    
+    return iDumpFileClose(psFile, acTempName, pcFileName);
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,208 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Mesh node table
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+#ifndef  NODETABLE_H_INCLUDED
+#define  NODETABLE_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Number of slots in the node table (must be a power of 2) */
+#define NODE_TABLE_SIZE                     16384
+
+/** Nodes not heard from for this long are removed from the table, seconds */
+#define NODE_TABLE_DEFAULT_MAX_AGE          900
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** Node flags */
+typedef enum
+{
+    E_NODE_FLAG_STATIC          = 0x01,     /**< Configured, never aged out */
+    E_NODE_FLAG_SLEEPY          = 0x02,     /**< Configured or learned to be a sleeping end device */
+} teNodeFlag;
+
+
+struct tsMailboxPacket;
+
+/** A node seen in the mesh */
+typedef struct
+{
+    uint64_t        u64IID;                 /**< Interface identifier, 0 marks an empty slot */
+    struct in6_addr sAddress;               /**< Most recent source address used by the node */
+    uint64_t        u64FirstSeen;           /**< Time the node was learned (u64ClockNowUs) */
+    uint64_t        u64LastSeen;            /**< Time of the last packet from the node */
+    uint64_t        u64LastTx;              /**< Time of the last packet sent to the node */
+    uint64_t        u64RxPackets;           /**< Packets received from the node */
+    uint64_t        u64RxBytes;
+    uint64_t        u64TxPackets;           /**< Packets sent to the node */
+    uint64_t        u64TxBytes;
+    uint32_t        u32TxQueueUs;           /**< Outbound latency: average time packets to the node wait in the transmit queue */
+    uint32_t        u32ResponseUs;          /**< Inbound latency: average time from sending to the node until hearing from it */
+    uint8_t         u8Hops;                 /**< Radio hops estimated from the hop limit of its packets, 0 if unknown */
+    uint8_t         u8Flags;                /**< Combination of teNodeFlag */
+    uint16_t        u16MailCount;           /**< Packets held in the node's mailbox */
+    struct tsMailboxPacket *psMailHead;     /**< Oldest packet held for the node */
+    struct tsMailboxPacket *psMailTail;     /**< Newest packet held for the node */
+    uint32_t        u32NAT64Binding;        /**< Index of the node's NAT64 pool address plus one, 0 if none */
+} tsNode;
+
+
+/** Node table statistics */
+typedef struct
+{
+    uint32_t    u32Nodes;               /**< Nodes currently in the table */
+    uint64_t    u64Lookups;             /**< Lookups by address */
+    uint64_t    u64Hits;                /**< Lookups that found a node */
+    uint64_t    u64Learned;             /**< Nodes added */
+    uint64_t    u64Expired;             /**< Nodes removed by aging */
+    uint64_t    u64Full;                /**< Nodes not added because the table was full */
+} tsNodeTableStats;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Seconds without traffic after which a node is forgotten */
+extern uint32_t             u32NodeTableMaxAge;
+
+
+/** Node table statistics */
+extern tsNodeTableStats     sNodeTableStats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Add a node to the table, for nodes that are configured rather than learned.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param psAddress    Address of the node
+ *  \param u8Flags      Flags to set on the node (teNodeFlag)
+ *  \return The node's entry, NULL if the table is full
+ */
+tsNode *psNodeTableAdd(uint64_t u64Now, const struct in6_addr *psAddress, uint8_t u8Flags);
+
+
+/** Account for an IPv6 packet received from the mesh, learning the
+ *  source node and updating its counters and latency estimates.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    IPv6 packet
+ *  \param u32Length    Length of the packet
+ */
+void vNodeTableInbound(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length);
+
+
+/** Account for an IPv6 packet sent to the mesh.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pu8Packet    IPv6 packet
+ *  \param u32Length    Length of the packet
+ *  \param u32QueueUs   Time the packet waited in the transmit queue
+ */
+void vNodeTableOutbound(uint64_t u64Now, const uint8_t *pu8Packet, uint32_t u32Length, uint32_t u32QueueUs);
+
+
+/** Radio hops to a destination, for the airtime estimate.
+ *  \param psAddress    Destination address
+ *  \return Hops to the node, 0 if not known
+ */
+uint8_t u8NodeTableHops(const struct in6_addr *psAddress);
+
+
+/** Find a node by any of its addresses. Only the interface identifier is
+ *  compared, so the link local and global addresses find the same node.
+ *  \param psAddress    Address of the node
+ *  \return The node's entry, NULL if not known
+ */
+tsNode *psNodeTableLookup(const struct in6_addr *psAddress);
+
+
+/** Remove nodes that have not been heard from for u32NodeTableMaxAge.
+ *  Configured nodes, nodes with packets in their mailbox and nodes with a
+ *  NAT64 binding are kept.
+ *  Called periodically; each call examines a fraction of the table.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ */
+void vNodeTableAge(uint64_t u64Now);
+
+
+/** Write the node table as text, one node per line, with a heading.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param psFile       Where to write it
+ *  \return 0 on success
+ */
+int iNodeTableWrite(uint64_t u64Now, FILE *psFile);
+
+
+/** Write the node table to a file with iNodeTableWrite. The file is written
+ *  under a temporary name and renamed, so readers never see it partly written.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param pcFileName   File to write
+ *  \return 0 on success
+ */
+int iNodeTableDump(uint64_t u64Now, const char *pcFileName);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* NODETABLE_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
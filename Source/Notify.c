@@ -0,0 +1,337 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Configuration change notification
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+/* When the module's network configuration changes, the program given with
+ * --confignotify is run with the new settings as arguments, e.g. to update
+ * radvd or firewall rules. It is started with posix_spawn rather than
+ * through a shell, and at most one copy runs at a time. Changes while it
+ * runs, or within NOTIFY_MIN_INTERVAL of the last run, are coalesced into
+ * one further run with the latest configuration, so a module that keeps
+ * restarting cannot cause a storm of processes.
+ *
+ * SIGCHLD is turned into a readable pipe, so that finished programs are
+ * collected from the main loop rather than in a signal handler.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#include <libdaemon/daemon.h>
+
+#include "Notify.h"
+#include "JennicModule.h"
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+extern char **environ;
+
+const char         *pcNotifyProgram = NULL;
+
+tsNotifyStats       sNotifyStats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+/** SIGCHLD makes the read end readable */
+static int aiSignalPipe[2] = { -1, -1 };
+
+/** Program running, -1 if none */
+static pid_t iChild = -1;
+
+/** When the program was started */
+static uint64_t u64ChildStarted;
+
+/** Program has been sent SIGKILL for taking too long */
+static bool bChildKilled;
+
+/** Configuration has changed since the program was last started */
+static bool bPending = FALSE;
+
+/** Earliest time the program may be started again */
+static uint64_t u64NextRun = 0;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void vNotifySignalHandler(int sig)
+{
+    int iErrno = errno;
+    char cWake = 0;
+    
+    if (write(aiSignalPipe[1], &cWake, sizeof(cWake)) < 0)
+    {
+        /* Pipe full, so the main loop will wake anyway */
+    }
+    errno = iErrno;
+}
+
+
+/** Collect the program if it has finished, or kill it if it has taken too long */
+static void vNotifyReap(uint64_t u64Now)
+{
+    int iStatus;
+    
+    if (iChild < 0)
+    {
+        return;
+    }
+    
+    if (waitpid(iChild, &iStatus, WNOHANG) != iChild)
+    {
+        if (!bChildKilled && (u64Now - u64ChildStarted > (uint64_t)NOTIFY_TIMEOUT * 1000000))
+        {
+            daemon_log(LOG_ERR, "Configuration notification program did not finish in %d seconds", NOTIFY_TIMEOUT);
+            kill(iChild, SIGKILL);
+            bChildKilled = TRUE;
+        }
+        return;
+    }
+    
+    if (WIFEXITED(iStatus) && (WEXITSTATUS(iStatus) == 0))
+    {
+        daemon_log(LOG_INFO, "Configuration notification program run successfully");
+    }
+    else
+    {
+        if (WIFEXITED(iStatus))
+        {
+            daemon_log(LOG_ERR, "Configuration notification program result: %d", WEXITSTATUS(iStatus));
+        }
+        else if (WIFSIGNALED(iStatus))
+        {
+            daemon_log(LOG_ERR, "Configuration notification program killed by signal %d", WTERMSIG(iStatus));
+        }
+        sNotifyStats.u64Failures++;
+    }
+    iChild = -1;
+}
+
+
+/** Start the program with the current configuration */
+static void vNotifySpawn(void)
+{
+    char acChannel[32];
+    char acPan[32];
+    char acNetwork[32];
+    char acPrefix[16 + INET6_ADDRSTRLEN];
+    char acKey[16 + INET6_ADDRSTRLEN];
+    char acAddress[INET6_ADDRSTRLEN];
+    char *apcArgv[7];
+    struct in6_addr sPrefix;
+    posix_spawnattr_t sAttr;
+    sigset_t sDefault;
+    int iArgc = 0;
+    int iResult;
+    int i;
+    
+    memset(&sPrefix, 0, sizeof(struct in6_addr));
+    for (i = 0; i < 8; i++)
+    {
+        sPrefix.s6_addr[i] = (u64NetworkPrefix >> (56 - 8 * i)) & 0xFF;
+    }
+    inet_ntop(AF_INET6, &sPrefix, acAddress, sizeof(acAddress));
+    
+    snprintf(acChannel, sizeof(acChannel), "--channel=%d", eChannel);
+    snprintf(acPan,     sizeof(acPan),     "--pan=0x%04x", u16PanID);
+    snprintf(acNetwork, sizeof(acNetwork), "--network=0x%08x", u32UserData);
+    snprintf(acPrefix,  sizeof(acPrefix),  "--prefix=%s", acAddress);
+    
+    apcArgv[iArgc++] = (char *)pcNotifyProgram;
+    apcArgv[iArgc++] = acChannel;
+    apcArgv[iArgc++] = acPan;
+    apcArgv[iArgc++] = acNetwork;
+    apcArgv[iArgc++] = acPrefix;
+    if (iSecureNetwork)
+    {
+        inet_ntop(AF_INET6, &sSecurityKey, acAddress, sizeof(acAddress));
+        snprintf(acKey, sizeof(acKey), "--key=%s", acAddress);
+        apcArgv[iArgc++] = acKey;
+    }
+    apcArgv[iArgc] = NULL;
+    
+    daemon_log(LOG_DEBUG, "Running configuration notification: %s %s %s %s %s", 
+               pcNotifyProgram, acChannel, acPan, acNetwork, acPrefix);
+    
+    /* The daemon ignores SIGPIPE, which the program should not inherit */
+    sigemptyset(&sDefault);
+    sigaddset(&sDefault, SIGPIPE);
+    posix_spawnattr_init(&sAttr);
+    posix_spawnattr_setsigdefault(&sAttr, &sDefault);
+    posix_spawnattr_setflags(&sAttr, POSIX_SPAWN_SETSIGDEF);
+    
+    iResult = posix_spawn(&iChild, pcNotifyProgram, NULL, &sAttr, apcArgv, environ);
+    posix_spawnattr_destroy(&sAttr);
+    
+    sNotifyStats.u64Runs++;
+    if (iResult != 0)
+    {
+        daemon_log(LOG_ERR, "Could not run configuration notification program %s (%s)", pcNotifyProgram, strerror(iResult));
+        sNotifyStats.u64Failures++;
+        iChild = -1;
+    }
+    bChildKilled = FALSE;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iNotifyOpen(void)
+{
+    int i;
+    
+    if (!pcNotifyProgram)
+    {
+        return 0;
+    }
+    
+    if (pipe(aiSignalPipe) < 0)
+    {
+        daemon_log(LOG_ERR, "Could not create notification pipe (%s)", strerror(errno));
+        return -1;
+    }
+    for (i = 0; i < 2; i++)
+    {
+        fcntl(aiSignalPipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl(aiSignalPipe[i], F_SETFL, O_NONBLOCK);
+    }
+    signal(SIGCHLD, vNotifySignalHandler);
+    return 0;
+}
+
+
+void vNotifyClose(void)
+{
+    int i;
+    
+    if (aiSignalPipe[0] < 0)
+    {
+        return;
+    }
+    signal(SIGCHLD, SIG_DFL);
+    for (i = 0; i < 2; i++)
+    {
+        close(aiSignalPipe[i]);
+        aiSignalPipe[i] = -1;
+    }
+}
+
+
+void vNotifyConfigChanged(void)
+{
+    if (!pcNotifyProgram)
+    {
+        return;
+    }
+    if (bPending)
+    {
+        sNotifyStats.u64Coalesced++;
+    }
+    bPending = TRUE;
+}
+
+
+uint32_t u32NotifyService(uint64_t u64Now)
+{
+    vNotifyReap(u64Now);
+    
+    if (!bPending || (iChild >= 0))
+    {
+        /* Finishing wakes the main loop, and it checks the timeout at least once a second */
+        return 0;
+    }
+    if (u64Now < u64NextRun)
+    {
+        return u64NextRun - u64Now;
+    }
+    
+    bPending    = FALSE;
+    u64NextRun  = u64Now + (uint64_t)NOTIFY_MIN_INTERVAL * 1000000;
+    u64ChildStarted = u64Now;
+    vNotifySpawn();
+    return 0;
+}
+
+
+int iNotifySetFds(fd_set *psReadFds, int iMaxFd)
+{
+    if (aiSignalPipe[0] < 0)
+    {
+        return iMaxFd;
+    }
+    FD_SET(aiSignalPipe[0], psReadFds);
+    return (aiSignalPipe[0] > iMaxFd) ? aiSignalPipe[0] : iMaxFd;
+}
+
+
+bool bNotifyHandleFd(int iFd)
+{
+    char acDiscard[16];
+    
+    if ((aiSignalPipe[0] < 0) || (iFd != aiSignalPipe[0]))
+    {
+        return FALSE;
+    }
+    
+    /* The program is collected by u32NotifyService on the next pass of the loop */
+    while (read(aiSignalPipe[0], acDiscard, sizeof(acDiscard)) > 0);
+    return TRUE;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
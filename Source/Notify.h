@@ -0,0 +1,148 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Configuration change notification
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+#ifndef  NOTIFY_H_INCLUDED
+#define  NOTIFY_H_INCLUDED
+
+#include <stdint.h>
+#include <sys/select.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Least time between runs of the notification program, in seconds */
+#define NOTIFY_MIN_INTERVAL                 5
+
+/** Time the notification program is allowed to run for, in seconds */
+#define NOTIFY_TIMEOUT                      60
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** Notification statistics */
+typedef struct
+{
+    uint64_t    u64Runs;                /**< Times the program was started */
+    uint64_t    u64Coalesced;           /**< Changes folded into a notification already waiting */
+    uint64_t    u64Failures;            /**< Runs that could not start, failed or timed out */
+} tsNotifyStats;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Program to run when the network configuration changes, NULL for none */
+extern const char      *pcNotifyProgram;
+
+
+/** Notification statistics */
+extern tsNotifyStats    sNotifyStats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Prepare to run the notification program, if there is one.
+ *  \return 0 on success, -1 on error
+ */
+int iNotifyOpen(void);
+
+
+/** Stop watching for the program to finish */
+void vNotifyClose(void);
+
+
+/** Note that the network configuration has changed. The program is run
+ *  from the main loop with the configuration as it is then, so several
+ *  changes in quick succession result in a single run.
+ */
+void vNotifyConfigChanged(void);
+
+
+/** Collect a program that has finished, and start it again if the
+ *  configuration has changed and the rate limit allows.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \return Microseconds until this needs to be called again, 0 if it only
+ *          needs to be called when the configuration changes or the
+ *          program finishes
+ */
+uint32_t u32NotifyService(uint64_t u64Now);
+
+
+/** Add the descriptor that becomes readable when the program finishes to
+ *  a select set.
+ *  \param psReadFds    Set to add to
+ *  \param iMaxFd       Highest descriptor in the set so far
+ *  \return Highest descriptor in the set
+ */
+int iNotifySetFds(fd_set *psReadFds, int iMaxFd);
+
+
+/** Deal with a descriptor select has found readable.
+ *  \param iFd          Descriptor
+ *  \return TRUE if the descriptor belongs to the notifier
+ */
+bool bNotifyHandleFd(int iFd);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* NOTIFY_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -0,0 +1,292 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          In-process packet generator and sink
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+/* Stands in for the hosts on the tun device when measuring the daemon.
+ * ICMPv6 echo requests carrying their send time are generated at a fixed
+ * rate towards a node, and the replies are matched to give round trip
+ * times. Packet generation is paced by a timerfd, so it fits into the
+ * main loop's select like any other endpoint, and stops while the
+ * module's transmit queue is busy just as reading the tun device does.
+ * Nothing is generated until the module has told us its address, so that
+ * the start up handshake is not held up.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/ip6.h>
+#include <netinet/icmp6.h>
+#include <sys/timerfd.h>
+
+#include <libdaemon/daemon.h>
+
+#include "PacketGenerator.h"
+#include "IPv6.h"
+#include "JennicModule.h"
+#include "Clock.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Source address of generated packets */
+#define GENERATOR_SOURCE                    "fd00::fffe"
+
+/** ICMPv6 echo identifier of generated packets */
+#define GENERATOR_ECHO_ID                   0x6C77
+
+/** Shortest packet: IPv6 and ICMPv6 headers and the send time */
+#define GENERATOR_MIN_LENGTH                (IPV6_HEADER_LENGTH + sizeof(struct icmp6_hdr) + sizeof(uint64_t))
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+tsPacketGeneratorStats sPacketGeneratorStats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static int iTimerFd = -1;
+
+static struct in6_addr sSource;
+static struct in6_addr sDestination;
+static uint32_t u32Length;
+static uint16_t u16Sequence;
+
+/** Packets due but not yet generated */
+static uint32_t u32Owed;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iPacketGeneratorOpen(const char *pcSpec)
+{
+    char acDestination[INET6_ADDRSTRLEN];
+    unsigned long ulRate = GENERATOR_DEFAULT_RATE;
+    unsigned long ulLength = GENERATOR_DEFAULT_LENGTH;
+    const char *pcComma;
+    struct itimerspec sTimer;
+    
+    memset(&sPacketGeneratorStats, 0, sizeof(sPacketGeneratorStats));
+    inet_pton(AF_INET6, GENERATOR_SOURCE, &sSource);
+    
+    iTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (iTimerFd < 0)
+    {
+        daemon_log(LOG_ERR, "Could not create generator timer (%s)", strerror(errno));
+        return -1;
+    }
+    
+    if (!pcSpec)
+    {
+        /* Sink only - the timer is never armed */
+        daemon_log(LOG_INFO, "Packets for local hosts will be discarded");
+        return iTimerFd;
+    }
+    
+    pcComma = strchr(pcSpec, ',');
+    if (!pcComma)
+    {
+        pcComma = pcSpec + strlen(pcSpec);
+    }
+    if ((pcComma - pcSpec) >= (int)sizeof(acDestination))
+    {
+        goto invalid;
+    }
+    memcpy(acDestination, pcSpec, pcComma - pcSpec);
+    acDestination[pcComma - pcSpec] = '\0';
+    
+    if (inet_pton(AF_INET6, acDestination, &sDestination) != 1)
+    {
+        goto invalid;
+    }
+    if (*pcComma)
+    {
+        char *pcEnd;
+        
+        ulRate = strtoul(pcComma + 1, &pcEnd, 10);
+        if (*pcEnd == ',')
+        {
+            ulLength = strtoul(pcEnd + 1, &pcEnd, 10);
+        }
+        if (*pcEnd != '\0')
+        {
+            goto invalid;
+        }
+    }
+    if ((ulRate < 1) || (ulRate > 1000000) || (ulLength < GENERATOR_MIN_LENGTH) || (ulLength > IPV6_MIN_MTU))
+    {
+        goto invalid;
+    }
+    u32Length = ulLength;
+    
+    sTimer.it_interval.tv_sec  = 0;
+    sTimer.it_interval.tv_nsec = 1000000000UL / ulRate;
+    if (ulRate == 1)
+    {
+        sTimer.it_interval.tv_sec  = 1;
+        sTimer.it_interval.tv_nsec = 0;
+    }
+    sTimer.it_value = sTimer.it_interval;
+    if (timerfd_settime(iTimerFd, 0, &sTimer, NULL) < 0)
+    {
+        daemon_log(LOG_ERR, "Could not start generator timer (%s)", strerror(errno));
+        close(iTimerFd);
+        iTimerFd = -1;
+        return -1;
+    }
+    
+    daemon_log(LOG_INFO, "Generating %lu packets per second of %lu bytes to %s", ulRate, ulLength, acDestination);
+    return iTimerFd;
+    
+invalid:
+    daemon_log(LOG_ERR, "Invalid generator \"%s\", expected <destination>[,<packets per second>[,<length>]]", pcSpec);
+    close(iTimerFd);
+    iTimerFd = -1;
+    return -1;
+}
+
+
+int iPacketGeneratorRead(uint8_t *pu8Buffer, uint32_t u32Size)
+{
+    struct ip6_hdr *psHeader = (struct ip6_hdr *)pu8Buffer;
+    struct icmp6_hdr *psICMP = (struct icmp6_hdr *)&pu8Buffer[IPV6_HEADER_LENGTH];
+    uint64_t u64Expirations;
+    uint64_t u64Now;
+    
+    if ((read(iTimerFd, &u64Expirations, sizeof(u64Expirations)) == sizeof(u64Expirations)) &&
+        !IN6_IS_ADDR_UNSPECIFIED(&sModuleAddress))
+    {
+        u32Owed += (u64Expirations > GENERATOR_MAX_BURST) ? GENERATOR_MAX_BURST : u64Expirations;
+        if (u32Owed > GENERATOR_MAX_BURST)
+        {
+            /* Could not keep up with the rate, forget the excess */
+            sPacketGeneratorStats.u64Deferred += u32Owed - GENERATOR_MAX_BURST;
+            u32Owed = GENERATOR_MAX_BURST;
+        }
+    }
+    
+    if ((u32Owed == 0) || (u32Size < u32Length))
+    {
+        return 0;
+    }
+    u32Owed--;
+    
+    memset(pu8Buffer, 0, u32Length);
+    psHeader->ip6_flow  = htonl(0x60000000);
+    psHeader->ip6_plen  = htons(u32Length - IPV6_HEADER_LENGTH);
+    psHeader->ip6_nxt   = IPPROTO_ICMPV6;
+    psHeader->ip6_hlim  = 64;
+    psHeader->ip6_src   = sSource;
+    psHeader->ip6_dst   = sDestination;
+    
+    psICMP->icmp6_type  = ICMP6_ECHO_REQUEST;
+    psICMP->icmp6_id    = htons(GENERATOR_ECHO_ID);
+    psICMP->icmp6_seq   = htons(u16Sequence++);
+    u64Now = u64ClockNowUs();
+    memcpy(&psICMP[1], &u64Now, sizeof(u64Now));
+    psICMP->icmp6_cksum = htons(u16IPv6Checksum(&sSource, &sDestination, IPPROTO_ICMPV6,
+                                                (uint8_t *)psICMP, u32Length - IPV6_HEADER_LENGTH));
+    
+    sPacketGeneratorStats.u64Sent++;
+    return u32Length;
+}
+
+
+int iPacketGeneratorSink(const uint8_t *pu8Data, uint32_t u32Length)
+{
+    const struct ip6_hdr *psHeader = (const struct ip6_hdr *)pu8Data;
+    const struct icmp6_hdr *psICMP = (const struct icmp6_hdr *)&pu8Data[IPV6_HEADER_LENGTH];
+    
+    sPacketGeneratorStats.u64Received++;
+    sPacketGeneratorStats.u64ReceivedBytes += u32Length;
+    
+    if ((u32Length >= GENERATOR_MIN_LENGTH) && (psHeader->ip6_nxt == IPPROTO_ICMPV6) &&
+        (psICMP->icmp6_type == ICMP6_ECHO_REPLY) && (psICMP->icmp6_id == htons(GENERATOR_ECHO_ID)))
+    {
+        uint64_t u64Sent;
+        uint32_t u32Latency;
+        
+        memcpy(&u64Sent, &psICMP[1], sizeof(u64Sent));
+        u32Latency = (uint32_t)(u64ClockNowUs() - u64Sent);
+        
+        if ((sPacketGeneratorStats.u64Replies == 0) || (u32Latency < sPacketGeneratorStats.u32LatencyMinUs))
+        {
+            sPacketGeneratorStats.u32LatencyMinUs = u32Latency;
+        }
+        if (u32Latency > sPacketGeneratorStats.u32LatencyMaxUs)
+        {
+            sPacketGeneratorStats.u32LatencyMaxUs = u32Latency;
+        }
+        sPacketGeneratorStats.u64LatencyTotalUs += u32Latency;
+        sPacketGeneratorStats.u64Replies++;
+    }
+    return u32Length;
+}
+
+
+void vPacketGeneratorReport(void)
+{
+    tsPacketGeneratorStats *psStats = &sPacketGeneratorStats;
+    
+    daemon_log(LOG_INFO, "Generator: sent %llu, deferred %llu, received %llu (%llu bytes), replies %llu",
+               (unsigned long long)psStats->u64Sent, (unsigned long long)psStats->u64Deferred,
+               (unsigned long long)psStats->u64Received, (unsigned long long)psStats->u64ReceivedBytes,
+               (unsigned long long)psStats->u64Replies);
+    if (psStats->u64Replies)
+    {
+        daemon_log(LOG_INFO, "Generator: round trip min %u us, average %llu us, max %u us",
+                   psStats->u32LatencyMinUs, (unsigned long long)(psStats->u64LatencyTotalUs / psStats->u64Replies),
+                   psStats->u32LatencyMaxUs);
+    }
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -0,0 +1,137 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          In-process packet generator and sink
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+#ifndef  PACKETGENERATOR_H_INCLUDED
+#define  PACKETGENERATOR_H_INCLUDED
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Default packets per second sent by the generator */
+#define GENERATOR_DEFAULT_RATE              100
+
+/** Default length of generated packets, including the IPv6 header */
+#define GENERATOR_DEFAULT_LENGTH            64
+
+/** Most packets generated in one wake up, when catching up */
+#define GENERATOR_MAX_BURST                 32
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** Generator and sink statistics */
+typedef struct
+{
+    uint64_t    u64Sent;                /**< Echo requests generated */
+    uint64_t    u64Deferred;            /**< Packets not generated because the transmit queue was busy for too long */
+    uint64_t    u64Received;            /**< Packets from the mesh */
+    uint64_t    u64ReceivedBytes;
+    uint64_t    u64Replies;             /**< Echo replies to generated requests */
+    uint64_t    u64LatencyTotalUs;      /**< Sum of the round trip times of the replies */
+    uint32_t    u32LatencyMinUs;
+    uint32_t    u32LatencyMaxUs;
+} tsPacketGeneratorStats;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Generator and sink statistics */
+extern tsPacketGeneratorStats sPacketGeneratorStats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Set up the generator.
+ *  \param pcSpec       "<destination>[,<packets per second>[,<length>]]" to
+ *                      send ICMPv6 echo requests, or NULL to only sink packets
+ *  \return File descriptor that is readable when packets are due, -1 on error
+ */
+int iPacketGeneratorOpen(const char *pcSpec);
+
+
+/** Generate the next packet that is due.
+ *  \param pu8Buffer    Buffer for the packet
+ *  \param u32Size      Size of the buffer
+ *  \return Length of the packet, 0 if none is due
+ */
+int iPacketGeneratorRead(uint8_t *pu8Buffer, uint32_t u32Size);
+
+
+/** Take a packet from the mesh, matching echo replies to generated requests.
+ *  \param pu8Data      IPv6 packet
+ *  \param u32Length    Length of the packet
+ *  \return Length taken
+ */
+int iPacketGeneratorSink(const uint8_t *pu8Data, uint32_t u32Length);
+
+
+/** Log the generator and sink statistics */
+void vPacketGeneratorReport(void);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* PACKETGENERATOR_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
@@ -36,6 +36,8 @@
  *
  ***************************************************************************/
 
+#define _GNU_SOURCE
+
 #include "Serial.h"
 
 #include <termios.h>
@@ -48,6 +50,11 @@
 #include <errno.h>
 #include <signal.h>
 #include <string.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include <libdaemon/daemon.h>
 
@@ -58,6 +65,34 @@ extern int verbosity;
 extern volatile sig_atomic_t bRunning;
 
 int serial_fd;
+int serial_loopback_fd = -1;
+
+/** A way of reaching the module */
+typedef struct
+{
+    const char *prefix;                         /**< Device name prefix that selects it */
+    int (*open)(const char *address, uint32_t baud);
+    int stream;                                 /**< End of file means the peer has gone */
+} tsSerialTransport;
+
+static int serial_open_tty(const char *name, uint32_t baud);
+static int serial_open_pty(const char *link, uint32_t baud);
+static int serial_open_tcp(const char *address, uint32_t baud);
+static int serial_open_tcp_listen(const char *address, uint32_t baud);
+static int serial_open_unix(const char *path, uint32_t baud);
+static int serial_open_loopback(const char *unused, uint32_t baud);
+
+static const tsSerialTransport asTransports[] =
+{
+    { "pty",            serial_open_pty,        0 },
+    { "tcp-listen:",    serial_open_tcp_listen, 1 },
+    { "tcp:",           serial_open_tcp,        1 },
+    { "unix:",          serial_open_unix,       1 },
+    { "loopback",       serial_open_loopback,   1 },
+    { "",               serial_open_tty,        0 },    /* Anything else is a tty */
+};
+
+static const tsSerialTransport *psTransport = &asTransports[sizeof(asTransports) / sizeof(tsSerialTransport) - 1];
 
 static struct termios options;       //place for settings for serial port
 char buf[255];                       //buffer for where data is put
@@ -66,6 +101,60 @@ int serial_open(char *name, uint32_t baud)
 {
     int fd;
     
+    for (psTransport = asTransports; ; psTransport++)
+    {
+        if (strncmp(name, psTransport->prefix, strlen(psTransport->prefix)) == 0)
+        {
+            break;
+        }
+    }
+    
+    fd = psTransport->open(name + strlen(psTransport->prefix), baud);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    
+    serial_fd = fd;
+    return fd;
+}
+
+
+/** Put a terminal into raw mode at the given speed */
+static int serial_set_raw(int fd, speed_t baud)
+{
+    if (tcgetattr(fd,&options) == -1)
+    {
+        daemon_log(LOG_ERR, "Error getting port settings (%s)", strerror(errno));
+        return -1;
+    }
+
+    options.c_iflag &= ~(INPCK | ISTRIP | INLCR | IGNCR | ICRNL | IUCLC | IXON | IXANY | IXOFF);
+    options.c_iflag = IGNBRK | IGNPAR;
+    options.c_oflag &= ~(OPOST | OLCUC | ONLCR | OCRNL | ONOCR | ONLRET);
+    options.c_cflag &= ~(CSIZE | CSTOPB | PARENB | CRTSCTS);
+    options.c_cflag |= CS8 | CREAD | HUPCL | CLOCAL;
+    options.c_lflag &= ~(ISIG | ICANON | ECHO | IEXTEN);
+
+    cfsetispeed(&options, baud);
+    cfsetospeed(&options, baud);
+
+    if (tcsetattr(fd,TCSAFLUSH,&options) == -1)
+    {
+        daemon_log(LOG_ERR, "Error setting port settings (%s)", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
+static int serial_open_tty(const char *name, uint32_t baud)
+{
+    int fd;
+    
     daemon_log(LOG_INFO, "Opening serial device '%s' at baud rate %ubps", name, baud);
     
     switch (baud)
@@ -173,35 +262,248 @@ int serial_open(char *name, uint32_t baud)
         return -1;
     }
 
-    if (tcgetattr(fd,&options) == -1)
+    if (serial_set_raw(fd, baud) < 0)
     {
-        daemon_log(LOG_ERR, "Error getting port settings (%s)", strerror(errno));
+        close(fd);
         return -1;
     }
+    return fd;
+}
 
-    options.c_iflag &= ~(INPCK | ISTRIP | INLCR | IGNCR | ICRNL | IUCLC | IXON | IXANY | IXOFF);
-    options.c_iflag = IGNBRK | IGNPAR;
-    options.c_oflag &= ~(OPOST | OLCUC | ONLCR | OCRNL | ONOCR | ONLRET);
-    options.c_cflag &= ~(CSIZE | CSTOPB | PARENB | CRTSCTS);
-    options.c_cflag |= CS8 | CREAD | HUPCL | CLOCAL;
-    options.c_lflag &= ~(ISIG | ICANON | ECHO | IEXTEN);
 
-    cfsetispeed(&options, baud);
-    cfsetospeed(&options, baud);
+/** Create a pseudo terminal for an emulator or a bridge such as socat to open.
+ *  "pty" logs the name of the slave, "pty:<path>" also links <path> to it.
+ */
+static int serial_open_pty(const char *link, uint32_t baud)
+{
+    const char *slave;
+    int fd;
+    
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((fd < 0) || (grantpt(fd) < 0) || (unlockpt(fd) < 0) || ((slave = ptsname(fd)) == NULL))
+    {
+        daemon_log(LOG_ERR, "Couldn't create pseudo terminal (%s)", strerror(errno));
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    
+    /* Keep the slave open so that reads do not fail while nothing else has it open */
+    if ((open(slave, O_RDWR | O_NOCTTY | O_CLOEXEC) < 0) || (serial_set_raw(fd, B38400) < 0))
+    {
+        daemon_log(LOG_ERR, "Couldn't open pseudo terminal \"%s\"(%s)", slave, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    
+    if (*link == ':')
+    {
+        link++;
+        unlink(link);
+        if (symlink(slave, link) < 0)
+        {
+            daemon_log(LOG_ERR, "Couldn't link \"%s\" to \"%s\"(%s)", link, slave, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+    
+    daemon_log(LOG_INFO, "Module pseudo terminal is '%s'", slave);
+    return fd;
+}
 
-    if (tcsetattr(fd,TCSAFLUSH,&options) == -1)
+
+/** Split "host:port", "[v6 address]:port" or "port" into its parts */
+static int serial_resolve(const char *address, int passive, struct addrinfo **ppsResult)
+{
+    char host[256];
+    const char *port = strrchr(address, ':');
+    struct addrinfo sHints;
+    int len, err;
+    
+    if (!port)
     {
-        daemon_log(LOG_ERR, "Error setting port settings (%s)", strerror(errno));
+        /* Port only */
+        port = address - 1;
+    }
+    if ((len = port - address) >= (int)sizeof(host))
+    {
+        daemon_log(LOG_ERR, "Invalid module address \"%s\", expected host:port", address);
         return -1;
     }
+    if (len < 0)
+    {
+        len = 0;
+    }
+    if ((len >= 2) && (address[0] == '[') && (address[len - 1] == ']'))
+    {
+        address++;
+        len -= 2;
+    }
+    memcpy(host, address, len);
+    host[len] = '\0';
     
-    fcntl(fd, F_SETFL, O_NONBLOCK);
+    memset(&sHints, 0, sizeof(sHints));
+    sHints.ai_family   = AF_UNSPEC;
+    sHints.ai_socktype = SOCK_STREAM;
+    sHints.ai_flags    = passive ? AI_PASSIVE : 0;
     
-    serial_fd = fd;
+    err = getaddrinfo(len ? host : NULL, port + 1, &sHints, ppsResult);
+    if (err != 0)
+    {
+        daemon_log(LOG_ERR, "Couldn't resolve module address \"%s\"(%s)", address, gai_strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+
+/** Make a connected stream socket suitable for frames */
+static int serial_socket_ready(int fd)
+{
+    int one = 1;
+    
+    /* Frames are small and latency matters more than packing them */
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    
+    /* A closed connection is reported by write failing, not by a signal */
+    signal(SIGPIPE, SIG_IGN);
     return fd;
 }
 
 
+/** Connect to a module exported over TCP, e.g. by ser2net */
+static int serial_open_tcp(const char *address, uint32_t baud)
+{
+    struct addrinfo *psResult, *psAddr;
+    int fd = -1;
+    
+    daemon_log(LOG_INFO, "Connecting to module at '%s'", address);
+    
+    if (serial_resolve(address, 0, &psResult) < 0)
+    {
+        return -1;
+    }
+    for (psAddr = psResult; psAddr; psAddr = psAddr->ai_next)
+    {
+        fd = socket(psAddr->ai_family, psAddr->ai_socktype, psAddr->ai_protocol);
+        if (fd < 0)
+        {
+            continue;
+        }
+        if (connect(fd, psAddr->ai_addr, psAddr->ai_addrlen) == 0)
+        {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(psResult);
+    
+    if (fd < 0)
+    {
+        daemon_log(LOG_ERR, "Couldn't connect to module at \"%s\"(%s)", address, strerror(errno));
+        return -1;
+    }
+    return serial_socket_ready(fd);
+}
+
+
+/** Wait for a module, or a bridge to one, to connect over TCP */
+static int serial_open_tcp_listen(const char *address, uint32_t baud)
+{
+    struct addrinfo *psResult;
+    int listen_fd, fd, one = 1;
+    
+    if (serial_resolve(address, 1, &psResult) < 0)
+    {
+        return -1;
+    }
+    listen_fd = socket(psResult->ai_family, psResult->ai_socktype, psResult->ai_protocol);
+    if ((listen_fd < 0) ||
+        (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0) ||
+        (bind(listen_fd, psResult->ai_addr, psResult->ai_addrlen) < 0) ||
+        (listen(listen_fd, 1) < 0))
+    {
+        daemon_log(LOG_ERR, "Couldn't listen for module on \"%s\"(%s)", address, strerror(errno));
+        freeaddrinfo(psResult);
+        if (listen_fd >= 0)
+        {
+            close(listen_fd);
+        }
+        return -1;
+    }
+    freeaddrinfo(psResult);
+    
+    daemon_log(LOG_INFO, "Waiting for module connection on '%s'", address);
+    
+    do
+    {
+        fd = accept(listen_fd, NULL, NULL);
+    } while ((fd < 0) && (errno == EINTR) && bRunning);
+    close(listen_fd);
+    
+    if (fd < 0)
+    {
+        daemon_log(LOG_ERR, "Error accepting module connection (%s)", strerror(errno));
+        return -1;
+    }
+    return serial_socket_ready(fd);
+}
+
+
+/** Connect to a module bridged onto a UNIX stream socket */
+static int serial_open_unix(const char *path, uint32_t baud)
+{
+    struct sockaddr_un sAddr;
+    int fd;
+    
+    daemon_log(LOG_INFO, "Connecting to module at '%s'", path);
+    
+    if (strlen(path) >= sizeof(sAddr.sun_path))
+    {
+        daemon_log(LOG_ERR, "Module socket path too long");
+        return -1;
+    }
+    memset(&sAddr, 0, sizeof(sAddr));
+    sAddr.sun_family = AF_UNIX;
+    strcpy(sAddr.sun_path, path);
+    
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((fd < 0) || (connect(fd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0))
+    {
+        daemon_log(LOG_ERR, "Couldn't connect to module at \"%s\"(%s)", path, strerror(errno));
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    return fd;
+}
+
+
+/** Connect to an in-process stand in for the module, which uses serial_loopback_fd */
+static int serial_open_loopback(const char *unused, uint32_t baud)
+{
+    int fds[2];
+    
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+    {
+        daemon_log(LOG_ERR, "Couldn't create loopback connection (%s)", strerror(errno));
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    
+    daemon_log(LOG_INFO, "Using in-process loopback connection to module");
+    serial_loopback_fd = fds[1];
+    return fds[0];
+}
+
+
 int serial_read(const int fd, unsigned char *data)
 {
     signed char res;
@@ -283,7 +585,11 @@ int serial_read_buffer(const int fd, unsigned char *data, uint32_t *count)
         if (res == 0)
         {
             daemon_log(LOG_ERR, "Serial connection to module interrupted");
-            //bRunning = 0;
+            if (psTransport->stream)
+            {
+                /* The connection has closed and will not come back */
+                bRunning = 0;
+            }
         }
         res = *count = 0;
     }
@@ -43,6 +43,18 @@
 
 extern int serial_fd;
 
+/** With the "loopback" transport, the end of the connection that stands in for the module */
+extern int serial_loopback_fd;
+
+/** Open the connection to the module. The name selects the transport:
+ *  - "pty" or "pty:<link>" creates a pseudo terminal for an emulator to open
+ *  - "tcp:<host>:<port>" connects to a module exported over TCP
+ *  - "tcp-listen:[<host>:]<port>" waits for the module to connect
+ *  - "unix:<path>" connects to a UNIX stream socket
+ *  - "loopback" connects to serial_loopback_fd in the same process
+ *  - anything else is a tty device, set up at the given baud rate
+ *  \return file descriptor, or -1 on error
+ */
 int serial_open(char *name, uint32_t baud);
 int serial_read(const int fd, unsigned char *data);
 int serial_write(const int fd, const unsigned char data);
@@ -36,6 +36,7 @@
  *
  ***************************************************************************/
 
+
 #ifdef DEBUG_SERIAL_LINK
 #define DEBUG_ENABLE
 #endif
@@ -52,6 +53,7 @@
 #include <string.h>
 #include <libdaemon/daemon.h>
 #include "SerialLink.h"
+#include "Clock.h"
 
 
 /****************************************************************************/
@@ -62,6 +64,43 @@
 #define SL_ESC_CHAR		0x02
 #define SL_END_CHAR		0x03
 
+/** Start of a sequenced frame. This is never sent unescaped by firmware that
+ *  does not support E_SL_CAPABILITY_RELIABLE, so both framings can share the link */
+#define SL_START_RELIABLE_CHAR  0x04
+
+/** Longest encoded frame: every byte escaped, plus delimiters */
+#define SL_MAX_FRAME_LENGTH     (2 + (2 * (SL_MAX_MESSAGE_LENGTH + 7)))
+
+/** Time to wait for an acknowledgement, after the frame has left the UART,
+ *  before retransmitting. Doubled for each retransmission of a frame, up
+ *  to SL_ARQ_MAX_RTO_US. */
+#define SL_ARQ_RTO_US           30000
+
+/** Longest the retransmission timer may back off to */
+#define SL_ARQ_MAX_RTO_US       250000
+
+/** Baud rate assumed until vSL_SetBaudRate is called */
+#define SL_DEFAULT_BAUD_RATE    1000000
+
+/** Bits on the wire for each byte: start, 8 data and stop */
+#define SL_BITS_PER_BYTE        10
+
+/** Messages held while the transmit window is full */
+#define SL_TX_QUEUE_LENGTH      8
+
+/** Bytes read from the serial port at once */
+#define SL_RX_BUFFER_LENGTH     256
+
+/** Buffers of input processed by one call to bSL_ReadMessage without finding
+ *  a frame, before returning to let the main loop service other work */
+#define SL_RX_BUDGET            16
+
+/** Retransmissions before giving up on a frame */
+#define SL_ARQ_MAX_RETRIES      5
+
+/** Time to wait for outgoing traffic to piggyback an acknowledgement on */
+#define SL_ARQ_ACK_DELAY_US     2000
+
 #if DEBUG_ENABLE
 #define vDebug(...)     daemon_log(LOG_DEBUG, __VA_ARGS__)
 #define vPrintf(...)    daemon_log(LOG_DEBUG, __VA_ARGS__)
@@ -81,18 +120,49 @@ typedef enum
     E_STATE_RX_WAIT_LENMSB,
     E_STATE_RX_WAIT_LENLSB,
     E_STATE_RX_WAIT_CRC,
+    E_STATE_RX_WAIT_CRC_LSB,
+    E_STATE_RX_WAIT_SEQ,
+    E_STATE_RX_WAIT_ACK,
     E_STATE_RX_WAIT_DATA,
 } teSL_RxState;
 
+
+/** Payload codes of E_SL_MSG_LINK frames */
+typedef enum
+{
+    E_SL_LINK_ACK               = 0,    /**< Acknowledge, using the header ack field */
+    E_SL_LINK_NAK               = 1,    /**< Retransmit the sequence number that follows */
+    E_SL_LINK_RESET             = 2,    /**< Sender's next sequence number follows, forget any gap */
+} teSL_LinkCode;
+
+
+/** Stored copy of a sequenced frame */
+typedef struct
+{
+    uint8_t     u8Type;
+    uint8_t     u8Retries;
+    uint16_t    u16Length;
+    uint64_t    u64SentTime;            /**< Time the frame is expected to have left the UART */
+    uint8_t     au8Data[SL_MAX_MESSAGE_LENGTH];
+} tsSL_ArqFrame;
+
 /****************************************************************************/
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
 
-static uint8_t u8SL_CalculateCRC(uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data);
+static uint64_t u64SL_SendFrame(bool bReliable, uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data, uint8_t u8Seq);
+
+static void vSL_SendSequenced(uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data);
+
+static void vSL_SendQueued(void);
+
+static uint32_t u32SL_RetransmitTimeout(uint8_t u8Retries);
 
-static int iSL_TxByte(bool bSpecialCharacter, uint8_t u8Data);
+static void vSL_SendLink(teSL_LinkCode eCode, uint8_t u8Seq);
 
+static bool bSL_ArqReceive(uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data, uint8_t u8Seq, uint8_t u8Ack);
 
+static void vSL_RxError(bool bReliable);
 
 static bool bSL_RxByte(uint8_t *pu8Data);
 
@@ -102,10 +172,89 @@ static bool bSL_RxByte(uint8_t *pu8Data);
 
 extern int serial_fd;
 
+tsSL_Stats sSL_Stats;
+
 /****************************************************************************/
 /***        Local Variables                                               ***/
 /****************************************************************************/
 
+/** CRC-16/CCITT (polynomial 0x1021) lookup table */
+static const uint16_t au16CRC16Table[256] =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
+};
+
+/** Bytes read from the serial port and not yet decoded */
+static uint8_t au8RxBuffer[SL_RX_BUFFER_LENGTH];
+static uint32_t u32RxPosition;
+static uint32_t u32RxAvailable;
+
+/** Buffer refills left before bSL_ReadMessage gives up for now */
+static uint32_t u32RxBudget;
+
+/** Buffer the outgoing frame is encoded into */
+static uint8_t au8TxFrame[SL_MAX_FRAME_LENGTH];
+
+/** Time to send one byte at the link's baud rate, in nanoseconds */
+static uint32_t u32ByteTimeNs = (SL_BITS_PER_BYTE * 1000000000ULL) / SL_DEFAULT_BAUD_RATE;
+
+/** Time the UART is expected to have sent everything written so far.
+ *  Never more than a window of full frames ahead of the current time. */
+static uint64_t u64TxIdle;
+
+/** Selective repeat ARQ state */
+static struct
+{
+    bool            bEnabled;                       /**< Send sequenced frames */
+    
+    /* Transmit side */
+    uint8_t         u8TxBase;                       /**< Oldest unacknowledged sequence number */
+    uint8_t         u8TxNext;                       /**< Sequence number of the next new frame */
+    tsSL_ArqFrame   asTx[SL_ARQ_WINDOW];            /**< Unacknowledged frames */
+    uint8_t         u8QueueHead;                    /**< Oldest message waiting for the window */
+    uint8_t         u8QueueCount;                   /**< Messages waiting for the window */
+    tsSL_ArqFrame   asQueue[SL_TX_QUEUE_LENGTH];    /**< Messages waiting for the window, in order */
+    
+    /* Receive side */
+    uint8_t         u8RxExpected;                   /**< Next in order sequence number from the peer */
+    uint8_t         u8RxUnacked;                    /**< Frames delivered but not yet acknowledged */
+    uint64_t        u64AckDue;                      /**< Time a standalone ACK must be sent, 0 if none */
+    uint64_t        u64LastNak;                     /**< Time the last NAK was sent */
+    bool            abRxValid[SL_ARQ_WINDOW];       /**< Out of order frames held for delivery */
+    tsSL_ArqFrame   asRx[SL_ARQ_WINDOW];
+} sArq;
+
 /****************************************************************************/
 /***        Exported Functions                                            ***/
 /****************************************************************************/
@@ -113,11 +262,36 @@ bool bSL_ReadMessage(uint8_t *pu8Type, uint16_t *pu16Length, uint16_t u16MaxLeng
 {
 
     static teSL_RxState eRxState = E_STATE_RX_WAIT_START;
-    static uint8_t u8CRC;
+    static uint16_t u16CRC;
+    static uint8_t u8Seq;
+    static uint8_t u8Ack;
+    static bool bReliable = FALSE;
     uint8_t u8Data;
     static uint16_t u16Bytes;
     static bool bInEsc = FALSE;
 
+    /* Deliver frames that were held waiting for a retransmission to fill the gap */
+    {
+        uint8_t u8Slot = sArq.u8RxExpected % SL_ARQ_WINDOW;
+        
+        if (sArq.abRxValid[u8Slot] && (sArq.asRx[u8Slot].u16Length <= u16MaxLength))
+        {
+            *pu8Type    = sArq.asRx[u8Slot].u8Type;
+            *pu16Length = sArq.asRx[u8Slot].u16Length;
+            memcpy(pu8Message, sArq.asRx[u8Slot].au8Data, *pu16Length);
+            sArq.abRxValid[u8Slot] = FALSE;
+            sArq.u8RxExpected++;
+            sArq.u8RxUnacked++;
+            if (sArq.u64AckDue == 0)
+            {
+                sArq.u64AckDue = u64ClockNowUs() + SL_ARQ_ACK_DELAY_US;
+            }
+            return(TRUE);
+        }
+    }
+
+    u32RxBudget = SL_RX_BUDGET;
+
     while(bSL_RxByte(&u8Data))
     {
         //vDebug("0x%02x ", u8Data);
@@ -125,40 +299,119 @@ bool bSL_ReadMessage(uint8_t *pu8Type, uint16_t *pu16Length, uint16_t u16MaxLeng
         {
 
         case SL_START_CHAR:
+        case SL_START_RELIABLE_CHAR:
+            if (eRxState != E_STATE_RX_WAIT_START)
+            {
+                /* The end of the previous frame was lost - resynchronise on this one */
+                vDebug("Unexpected START\n");
+                sSL_Stats.u64UnexpectedStart++;
+                vSL_RxError(bReliable);
+            }
             u16Bytes = 0;
             bInEsc = FALSE;
+            bReliable = (u8Data == SL_START_RELIABLE_CHAR);
             vDebug("RX Start\n");
             eRxState = E_STATE_RX_WAIT_TYPE;
             break;
 
         case SL_ESC_CHAR:
             vDebug("Got ESC\n");
-            bInEsc = TRUE;
+            if (eRxState == E_STATE_RX_WAIT_START)
+            {
+                sSL_Stats.u64DiscardedBytes++;
+            }
+            else if (bInEsc)
+            {
+                vDebug("Double ESC\n");
+                sSL_Stats.u64EscapeErrors++;
+                vSL_RxError(bReliable);
+                eRxState = E_STATE_RX_WAIT_START;
+            }
+            else
+            {
+                sSL_Stats.u64EscapesRx++;
+                bInEsc = TRUE;
+            }
             break;
 
         case SL_END_CHAR:
             vDebug("Got END\n");
-            if(u8CRC == u8SL_CalculateCRC(*pu8Type, *pu16Length, pu8Message))
+            if (eRxState == E_STATE_RX_WAIT_START)
+            {
+                sSL_Stats.u64DiscardedBytes++;
+                break;
+            }
+            
+            if (bInEsc)
+            {
+                vDebug("END after ESC\n");
+                sSL_Stats.u64EscapeErrors++;
+                vSL_RxError(bReliable);
+                eRxState = E_STATE_RX_WAIT_START;
+                break;
+            }
+            
+            if ((eRxState != E_STATE_RX_WAIT_DATA) || (u16Bytes != *pu16Length))
             {
+                /* Frame ended before the header or all of its data arrived */
+                vDebug("Truncated frame\n");
+                sSL_Stats.u64Truncated++;
+                vSL_RxError(bReliable);
                 eRxState = E_STATE_RX_WAIT_START;
+                break;
+            }
+            
+            eRxState = E_STATE_RX_WAIT_START;
+            
+            if (bReliable)
+            {
+                if(u16CRC == u16SL_CalculateCRC16(*pu8Type, *pu16Length, u8Seq, u8Ack, pu8Message))
+                {
+                    sSL_Stats.u64FramesRx++;
+                    if (bSL_ArqReceive(*pu8Type, *pu16Length, pu8Message, u8Seq, u8Ack))
+                    {
+                        return(TRUE);
+                    }
+                    break;
+                }
+            }
+            else if(u16CRC == u8SL_CalculateCRC(*pu8Type, *pu16Length, pu8Message))
+            {
+                sSL_Stats.u64FramesRx++;
                 return(TRUE);
             }
             vDebug("CRC BAD\n");
+            sSL_Stats.u64CRCErrors++;
+            vSL_RxError(bReliable);
             break;
 
         default:
+            if (eRxState == E_STATE_RX_WAIT_START)
+            {
+                /* Noise between frames */
+                sSL_Stats.u64DiscardedBytes++;
+                break;
+            }
+            
             if(bInEsc)
             {
                 u8Data ^= 0x10;
                 bInEsc = FALSE;
+                
+                if (u8Data >= 0x10)
+                {
+                    /* Only control characters are ever escaped */
+                    vDebug("Bad escape\n");
+                    sSL_Stats.u64EscapeErrors++;
+                    vSL_RxError(bReliable);
+                    eRxState = E_STATE_RX_WAIT_START;
+                    break;
+                }
             }
 
             switch(eRxState)
             {
 
-                case E_STATE_RX_WAIT_START:
-                    break;
-
                 case E_STATE_RX_WAIT_TYPE:
                     vDebug("Type %d\n", u8Data);
                     *pu8Type = u8Data;
@@ -176,6 +429,8 @@ bool bSL_ReadMessage(uint8_t *pu8Type, uint16_t *pu16Length, uint16_t u16MaxLeng
                     if(*pu16Length > u16MaxLength)
                     {
                         vDebug("Length > MaxLength\n");
+                        sSL_Stats.u64Overflows++;
+                        vSL_RxError(bReliable);
                         eRxState = E_STATE_RX_WAIT_START;
                     }
                     else
@@ -186,16 +441,46 @@ bool bSL_ReadMessage(uint8_t *pu8Type, uint16_t *pu16Length, uint16_t u16MaxLeng
 
                 case E_STATE_RX_WAIT_CRC:
                     vDebug("CRC %02x\n", u8Data);
-                    u8CRC = u8Data;
+                    if (bReliable)
+                    {
+                        u16CRC = (uint16_t)u8Data << 8;
+                        eRxState = E_STATE_RX_WAIT_CRC_LSB;
+                    }
+                    else
+                    {
+                        u16CRC = u8Data;
+                        eRxState = E_STATE_RX_WAIT_DATA;
+                    }
+                    break;
+
+                case E_STATE_RX_WAIT_CRC_LSB:
+                    u16CRC |= u8Data;
+                    eRxState++;
+                    break;
+
+                case E_STATE_RX_WAIT_SEQ:
+                    u8Seq = u8Data;
+                    eRxState++;
+                    break;
+
+                case E_STATE_RX_WAIT_ACK:
+                    u8Ack = u8Data;
                     eRxState++;
                     break;
 
                 case E_STATE_RX_WAIT_DATA:
                     if(u16Bytes < *pu16Length)
                     {
-                        vDebug("Data\n");
                         pu8Message[u16Bytes++] = u8Data;
                     }
+                    else
+                    {
+                        /* More data than the header promised - the end character was lost */
+                        vDebug("Missing END\n");
+                        sSL_Stats.u64MissingEnd++;
+                        vSL_RxError(bReliable);
+                        eRxState = E_STATE_RX_WAIT_START;
+                    }
                     break;
 
                 default:
@@ -214,9 +499,13 @@ bool bSL_ReadMessage(uint8_t *pu8Type, uint16_t *pu16Length, uint16_t u16MaxLeng
 
 /****************************************************************************
  *
- * NAME: vSL_WriteRawMessage
+ * NAME: vSL_WriteMessage
  *
  * DESCRIPTION:
+ * Send a message to the peer. When the reliable link is enabled the
+ * message is sequenced and kept until acknowledged; if the window is full
+ * it waits in a queue behind it, so messages are never reordered. Otherwise
+ * it is sent as a plain frame.
  *
  * PARAMETERS: Name        RW  Usage
  *
@@ -225,39 +514,204 @@ bool bSL_ReadMessage(uint8_t *pu8Type, uint16_t *pu16Length, uint16_t u16MaxLeng
  ****************************************************************************/
 void vSL_WriteMessage(uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data)
 {
-    int n;
-
     vDebug("\nvSL_WriteMessage(%d, %d, %02x)\n", u8Type, u16Length, u8SL_CalculateCRC(u8Type, u16Length, pu8Data));
 
-    /* Send start character */
-    if (iSL_TxByte(TRUE, SL_START_CHAR) < 0) return;
+    if (sArq.bEnabled && (u16Length <= SL_MAX_MESSAGE_LENGTH))
+    {
+        if (bSL_TxWindowOpen())
+        {
+            vSL_SendSequenced(u8Type, u16Length, pu8Data);
+        }
+        else if (sArq.u8QueueCount < SL_TX_QUEUE_LENGTH)
+        {
+            /* Hold it until the window opens, so it cannot overtake frames already in it */
+            tsSL_ArqFrame *psFrame = &sArq.asQueue[(sArq.u8QueueHead + sArq.u8QueueCount) % SL_TX_QUEUE_LENGTH];
+            
+            psFrame->u8Type     = u8Type;
+            psFrame->u16Length  = u16Length;
+            if (u16Length)
+            {
+                memcpy(psFrame->au8Data, pu8Data, u16Length);
+            }
+            sArq.u8QueueCount++;
+        }
+        else
+        {
+            daemon_log(LOG_WARNING, "Serial link: transmit queue full, dropping message type %d", u8Type);
+            sSL_Stats.u64QueueDrops++;
+        }
+    }
+    else
+    {
+        u64SL_SendFrame(FALSE, u8Type, u16Length, pu8Data, 0);
+    }
+}
 
-    /* Send message type */
-    if (iSL_TxByte(FALSE, u8Type) < 0) return;
 
-    /* Send message length */
-    if (iSL_TxByte(FALSE, (u16Length >> 8) & 0xff) < 0) return;
-    if (iSL_TxByte(FALSE, (u16Length >> 0) & 0xff) < 0) return;
+/****************************************************************************
+ *
+ * NAME: vSL_SetBaudRate
+ *
+ * DESCRIPTION:
+ * Set the baud rate used to work out how long frames take to leave the
+ * UART, which the retransmission timer starts from.
+ *
+ * PARAMETERS: Name        RW  Usage
+ *             u32BaudRate R   Baud rate of the serial port
+ *
+ * RETURNS:
+ * void
+ ****************************************************************************/
+void vSL_SetBaudRate(uint32_t u32BaudRate)
+{
+    if (u32BaudRate)
+    {
+        u32ByteTimeNs = (SL_BITS_PER_BYTE * 1000000000ULL) / u32BaudRate;
+    }
+}
 
-    /* Send message checksum */
-    if (iSL_TxByte(FALSE, u8SL_CalculateCRC(u8Type, u16Length, pu8Data)) < 0) return;
 
-    /* Send message payload */
+/****************************************************************************
+ *
+ * NAME: vSL_SetReliable
+ *
+ * DESCRIPTION:
+ * Switch between plain and sequenced frames for outgoing messages.
+ * Enabling starts a new sequence and tells the peer where it begins.
+ *
+ * PARAMETERS: Name        RW  Usage
+ *             bEnable     R   TRUE to send sequenced frames
+ *
+ * RETURNS:
+ * void
+ ****************************************************************************/
+void vSL_SetReliable(bool bEnable)
+{
+    if (bEnable == sArq.bEnabled)
+    {
+        return;
+    }
+    
+    sArq.bEnabled = bEnable;
+    sArq.u8TxBase = sArq.u8TxNext;
+    
+    if (bEnable)
+    {
+        vSL_SendLink(E_SL_LINK_RESET, sArq.u8TxNext);
+    }
+    else
+    {
+        /* The peer no longer takes sequenced frames, send what was waiting as plain ones */
+        while (sArq.u8QueueCount)
+        {
+            tsSL_ArqFrame *psFrame = &sArq.asQueue[sArq.u8QueueHead];
+            
+            u64SL_SendFrame(FALSE, psFrame->u8Type, psFrame->u16Length, psFrame->au8Data, 0);
+            sArq.u8QueueHead = (sArq.u8QueueHead + 1) % SL_TX_QUEUE_LENGTH;
+            sArq.u8QueueCount--;
+        }
+    }
+}
 
-    for(n = 0; n < u16Length; n++)
+
+/****************************************************************************
+ *
+ * NAME: bSL_TxWindowOpen
+ *
+ * DESCRIPTION:
+ * Determine if a sequenced frame can be sent now.
+ *
+ * RETURNS:
+ * TRUE if the reliable link is disabled, or has space in the window and
+ * no messages waiting for it
+ ****************************************************************************/
+bool bSL_TxWindowOpen(void)
+{
+    if (!sArq.bEnabled)
     {
-        if (iSL_TxByte(FALSE, pu8Data[n]) < 0) return;
+        return TRUE;
     }
+    return (((uint8_t)(sArq.u8TxNext - sArq.u8TxBase) < SL_ARQ_WINDOW) && (sArq.u8QueueCount == 0)) ? TRUE : FALSE;
+}
 
-    /* Send end character */
-    if (iSL_TxByte(TRUE, SL_END_CHAR) < 0) return;
+
+/****************************************************************************
+ *
+ * NAME: u32SL_Service
+ *
+ * DESCRIPTION:
+ * Send a delayed acknowledgement if no traffic carried it, and retransmit
+ * frames whose acknowledgement has not arrived in time.
+ *
+ * PARAMETERS: Name        RW  Usage
+ *             u64Now      R   Current time
+ *
+ * RETURNS:
+ * 0 if nothing is outstanding, otherwise microseconds until the next timer
+ ****************************************************************************/
+uint32_t u32SL_Service(uint64_t u64Now)
+{
+    uint64_t u64Next = 0;
+    uint8_t u8Seq;
+    
+    if (sArq.u64AckDue)
+    {
+        if (u64Now >= sArq.u64AckDue)
+        {
+            sSL_Stats.u64AcksTx++;
+            vSL_SendLink(E_SL_LINK_ACK, 0);
+        }
+        else
+        {
+            u64Next = sArq.u64AckDue;
+        }
+    }
+    
+    for (u8Seq = sArq.u8TxBase; u8Seq != sArq.u8TxNext; u8Seq++)
+    {
+        tsSL_ArqFrame *psFrame = &sArq.asTx[u8Seq % SL_ARQ_WINDOW];
+        uint64_t u64Due = psFrame->u64SentTime + u32SL_RetransmitTimeout(psFrame->u8Retries);
+        
+        if (u64Now >= u64Due)
+        {
+            if (psFrame->u8Retries >= SL_ARQ_MAX_RETRIES)
+            {
+                /* Give up on everything outstanding and tell the peer not to wait for it */
+                daemon_log(LOG_WARNING, "Serial link: no acknowledgement for frame %d, abandoning %d frames", 
+                           u8Seq, (uint8_t)(sArq.u8TxNext - sArq.u8TxBase));
+                sSL_Stats.u64Abandoned += (uint8_t)(sArq.u8TxNext - sArq.u8TxBase);
+                sArq.u8TxBase = sArq.u8TxNext;
+                vSL_SendLink(E_SL_LINK_RESET, sArq.u8TxNext);
+                
+                /* Messages that were waiting take the freed window, and need timers of their own */
+                vSL_SendQueued();
+                return u32SL_Service(u64Now);
+            }
+            
+            psFrame->u8Retries++;
+            sSL_Stats.u64Retransmissions++;
+            psFrame->u64SentTime = u64SL_SendFrame(TRUE, psFrame->u8Type, psFrame->u16Length, psFrame->au8Data, u8Seq);
+            u64Due = psFrame->u64SentTime + u32SL_RetransmitTimeout(psFrame->u8Retries);
+        }
+        
+        if ((u64Next == 0) || (u64Due < u64Next))
+        {
+            u64Next = u64Due;
+        }
+    }
+    
+    if (u64Next == 0)
+    {
+        return 0;
+    }
+    return (u64Next > u64Now) ? (uint32_t)(u64Next - u64Now) : 1;
 }
 
 
 /****************************************************************************/
 /***        Local Functions                                               ***/
 /****************************************************************************/
-static uint8_t u8SL_CalculateCRC(uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data)
+uint8_t u8SL_CalculateCRC(uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data)
 {
     int n;
     uint8_t u8CRC = 0;
@@ -280,50 +734,446 @@ static uint8_t u8SL_CalculateCRC(uint8_t u8Type, uint16_t u16Length, uint8_t *pu
     return(u8CRC);
 }
 
+
 /****************************************************************************
  *
- * NAME: vSL_TxByte
+ * NAME: u16SL_CalculateCRC16
  *
  * DESCRIPTION:
+ * CRC-16/CCITT-FALSE over the header and payload of a sequenced frame.
+ *
+ * RETURNS:
+ * CRC value
+ ****************************************************************************/
+uint16_t u16SL_CalculateCRC16(uint8_t u8Type, uint16_t u16Length, uint8_t u8Seq, uint8_t u8Ack, uint8_t *pu8Data)
+{
+#define CRC16_UPDATE(CRC, BYTE) (((CRC) << 8) ^ au16CRC16Table[(((CRC) >> 8) ^ (BYTE)) & 0xff])
+    uint16_t u16CRC = 0xFFFF;
+    int n;
+    
+    u16CRC = CRC16_UPDATE(u16CRC, u8Type);
+    u16CRC = CRC16_UPDATE(u16CRC, (u16Length >> 8) & 0xff);
+    u16CRC = CRC16_UPDATE(u16CRC, (u16Length >> 0) & 0xff);
+    u16CRC = CRC16_UPDATE(u16CRC, u8Seq);
+    u16CRC = CRC16_UPDATE(u16CRC, u8Ack);
+    
+    for(n = 0; n < u16Length; n++)
+    {
+        u16CRC = CRC16_UPDATE(u16CRC, pu8Data[n]);
+    }
+    return(u16CRC);
+#undef CRC16_UPDATE
+}
+
+
+/****************************************************************************
+ *
+ * NAME: u64SL_SendFrame
+ *
+ * DESCRIPTION:
+ * Encode a frame into the transmit buffer and write it in one go.
+ * Sequenced frames carry the latest acknowledgement for the peer.
+ * The write only reaches the kernel's buffer, so the time the frame will
+ * have left the UART is estimated from the baud rate and what is already
+ * waiting to go.
  *
  * PARAMETERS: 	Name        		RW  Usage
+ *              bReliable           R   Send as a sequenced frame
+ *              u8Type              R   Message type
+ *              u16Length           R   Payload length
+ *              pu8Data             R   Payload
+ *              u8Seq               R   Sequence number for sequenced frames
+ *
+ * RETURNS:
+ * Time the frame is expected to have been sent
+ ****************************************************************************/
+static uint64_t u64SL_SendFrame(bool bReliable, uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data, uint8_t u8Seq)
+{
+#define TX_BYTE(BYTE)                                           \
+    do {                                                        \
+        uint8_t u8Byte = (BYTE);                                \
+        if (u8Byte < 0x10)                                      \
+        {                                                       \
+            au8TxFrame[u32Pos++] = SL_ESC_CHAR;                 \
+            u8Byte ^= 0x10;                                     \
+        }                                                       \
+        au8TxFrame[u32Pos++] = u8Byte;                          \
+    } while (0)
+    
+    uint32_t u32Pos = 0;
+    uint64_t u64Now, u64Limit;
+    int iQueued;
+    int n;
+    
+    if (u16Length > SL_MAX_MESSAGE_LENGTH)
+    {
+        daemon_log(LOG_ERR, "Serial link: message too long (%d bytes)", u16Length);
+        return u64ClockNowUs();
+    }
+
+    /* Send start character */
+    au8TxFrame[u32Pos++] = bReliable ? SL_START_RELIABLE_CHAR : SL_START_CHAR;
+
+    /* Send message type */
+    TX_BYTE(u8Type);
+
+    /* Send message length */
+    TX_BYTE((u16Length >> 8) & 0xff);
+    TX_BYTE((u16Length >> 0) & 0xff);
+
+    /* Send message checksum */
+    if (bReliable)
+    {
+        uint8_t u8Ack = sArq.u8RxExpected;
+        uint16_t u16CRC = u16SL_CalculateCRC16(u8Type, u16Length, u8Seq, u8Ack, pu8Data);
+        
+        TX_BYTE((u16CRC >> 8) & 0xff);
+        TX_BYTE((u16CRC >> 0) & 0xff);
+        TX_BYTE(u8Seq);
+        TX_BYTE(u8Ack);
+        
+        /* This frame acknowledges everything delivered so far */
+        sArq.u8RxUnacked = 0;
+        sArq.u64AckDue = 0;
+    }
+    else
+    {
+        TX_BYTE(u8SL_CalculateCRC(u8Type, u16Length, pu8Data));
+    }
+
+    /* Send message payload */
+    for(n = 0; n < u16Length; n++)
+    {
+        TX_BYTE(pu8Data[n]);
+    }
+
+    /* Send end character */
+    au8TxFrame[u32Pos++] = SL_END_CHAR;
+    
+    sSL_Stats.u64FramesTx++;
+    sSL_Stats.u64BytesTx += u32Pos;
+    /* Anything beyond start, type, length, checksum, payload and end was an escape */
+    sSL_Stats.u64EscapesTx += u32Pos - (5 + (bReliable ? 4 : 1) + u16Length);
+    
+    if (serial_write_buffer(serial_fd, au8TxFrame, u32Pos) < 0)
+    {
+        daemon_log(LOG_ERR, "Serial link: error writing frame type %d", u8Type);
+    }
+    
+    u64Now = u64ClockNowUs();
+    if (ioctl(serial_fd, TIOCOUTQ, &iQueued) == 0)
+    {
+        /* Bytes still waiting in the kernel, this frame included. Links that
+         * are faster than the baud rate suggests drain this quickly. */
+        u64TxIdle = u64Now + ((uint64_t)iQueued * u32ByteTimeNs) / 1000;
+    }
+    else
+    {
+        if (u64TxIdle < u64Now)
+        {
+            u64TxIdle = u64Now;
+        }
+        u64TxIdle += ((uint64_t)u32Pos * u32ByteTimeNs) / 1000;
+    }
+    
+    u64Limit = u64Now + ((uint64_t)SL_ARQ_WINDOW * SL_MAX_FRAME_LENGTH * u32ByteTimeNs) / 1000;
+    if (u64TxIdle > u64Limit)
+    {
+        u64TxIdle = u64Limit;
+    }
+    return u64TxIdle;
+#undef TX_BYTE
+}
+
+
+/****************************************************************************
+ *
+ * NAME: vSL_SendSequenced
+ *
+ * DESCRIPTION:
+ * Keep a copy of a message and send it as the next sequenced frame.
+ * The caller must have checked there is room in the window.
+ *
+ * PARAMETERS: 	Name        		RW  Usage
+ *              u8Type              R   Message type
+ *              u16Length           R   Payload length
+ *              pu8Data             R   Payload
  *
  * RETURNS:
  * void
  ****************************************************************************/
-static int iSL_TxByte(bool bSpecialCharacter, uint8_t u8Data)
+static void vSL_SendSequenced(uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data)
 {
-    if(!bSpecialCharacter && (u8Data < 0x10))
+    tsSL_ArqFrame *psFrame = &sArq.asTx[sArq.u8TxNext % SL_ARQ_WINDOW];
+    
+    psFrame->u8Type         = u8Type;
+    psFrame->u16Length      = u16Length;
+    psFrame->u8Retries      = 0;
+    if (u16Length && (psFrame->au8Data != pu8Data))
     {
-        u8Data ^= 0x10;
+        memcpy(psFrame->au8Data, pu8Data, u16Length);
+    }
+    
+    psFrame->u64SentTime = u64SL_SendFrame(TRUE, u8Type, u16Length, psFrame->au8Data, sArq.u8TxNext);
+    sArq.u8TxNext++;
+}
+
 
-        if (serial_write(serial_fd, SL_ESC_CHAR) < 0) return -1;
-        //vDebug(" 0x%02x", SL_ESC_CHAR);
+/****************************************************************************
+ *
+ * NAME: vSL_SendQueued
+ *
+ * DESCRIPTION:
+ * Send messages that were waiting for the window, as far as it allows.
+ *
+ * RETURNS:
+ * void
+ ****************************************************************************/
+static void vSL_SendQueued(void)
+{
+    while (sArq.u8QueueCount && ((uint8_t)(sArq.u8TxNext - sArq.u8TxBase) < SL_ARQ_WINDOW))
+    {
+        tsSL_ArqFrame *psFrame = &sArq.asQueue[sArq.u8QueueHead];
+        
+        vSL_SendSequenced(psFrame->u8Type, psFrame->u16Length, psFrame->au8Data);
+        sArq.u8QueueHead = (sArq.u8QueueHead + 1) % SL_TX_QUEUE_LENGTH;
+        sArq.u8QueueCount--;
     }
-    //vDebug(" 0x%02x", u8Data);
+}
 
-    return serial_write(serial_fd, u8Data);
+
+/****************************************************************************
+ *
+ * NAME: u32SL_RetransmitTimeout
+ *
+ * DESCRIPTION:
+ * Time to wait for an acknowledgement after a frame has left the UART,
+ * doubling with each retransmission up to SL_ARQ_MAX_RTO_US.
+ *
+ * PARAMETERS: 	Name        		RW  Usage
+ *              u8Retries           R   Times the frame has been retransmitted
+ *
+ * RETURNS:
+ * Timeout in microseconds
+ ****************************************************************************/
+static uint32_t u32SL_RetransmitTimeout(uint8_t u8Retries)
+{
+    uint64_t u64Timeout = (uint64_t)SL_ARQ_RTO_US << u8Retries;
+    
+    return (u64Timeout < SL_ARQ_MAX_RTO_US) ? (uint32_t)u64Timeout : SL_ARQ_MAX_RTO_US;
 }
 
 
 /****************************************************************************
  *
- * NAME: bSL_RxByte
+ * NAME: vSL_SendLink
+ *
+ * DESCRIPTION:
+ * Send an unsequenced link control frame.
+ *
+ * PARAMETERS: 	Name        		RW  Usage
+ *              eCode               R   ACK, NAK or RESET
+ *              u8Seq               R   Sequence number the code refers to
+ *
+ * RETURNS:
+ * void
+ ****************************************************************************/
+static void vSL_SendLink(teSL_LinkCode eCode, uint8_t u8Seq)
+{
+    uint8_t au8Payload[2];
+    
+    if (eCode == E_SL_LINK_NAK)
+    {
+        uint64_t u64Now = u64ClockNowUs();
+        
+        /* One NAK is enough to trigger the retransmission, don't flood the link */
+        if ((u64Now - sArq.u64LastNak) < (SL_ARQ_RTO_US / 2))
+        {
+            return;
+        }
+        sArq.u64LastNak = u64Now;
+        sSL_Stats.u64NaksTx++;
+    }
+    
+    au8Payload[0] = eCode;
+    au8Payload[1] = u8Seq;
+    u64SL_SendFrame(TRUE, E_SL_MSG_LINK, sizeof(au8Payload), au8Payload, 0);
+}
+
+
+/****************************************************************************
+ *
+ * NAME: bSL_ArqReceive
+ *
+ * DESCRIPTION:
+ * Process the header of a sequenced frame with a good CRC.
+ * Link control frames are consumed here. In order data frames are passed
+ * up, frames after a gap are held until the gap is filled.
+ *
+ * RETURNS:
+ * TRUE if the frame should be delivered to the caller now
+ ****************************************************************************/
+static bool bSL_ArqReceive(uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data, uint8_t u8Seq, uint8_t u8Ack)
+{
+    uint8_t u8Offset;
+    
+    /* Cumulative acknowledgement of frames we sent */
+    if ((uint8_t)(u8Ack - sArq.u8TxBase) <= (uint8_t)(sArq.u8TxNext - sArq.u8TxBase))
+    {
+        sArq.u8TxBase = u8Ack;
+        vSL_SendQueued();
+    }
+    
+    if (u8Type == E_SL_MSG_LINK)
+    {
+        if (u16Length < 2)
+        {
+            return FALSE;
+        }
+        
+        switch (pu8Data[0])
+        {
+            case (E_SL_LINK_NAK):
+                if ((uint8_t)(pu8Data[1] - sArq.u8TxBase) < (uint8_t)(sArq.u8TxNext - sArq.u8TxBase))
+                {
+                    /* Selectively retransmit the missing frame */
+                    tsSL_ArqFrame *psFrame = &sArq.asTx[pu8Data[1] % SL_ARQ_WINDOW];
+                    
+                    sSL_Stats.u64Retransmissions++;
+                    sSL_Stats.u64FastRetransmissions++;
+                    psFrame->u64SentTime = u64SL_SendFrame(TRUE, psFrame->u8Type, psFrame->u16Length, psFrame->au8Data, pu8Data[1]);
+                }
+                else if (pu8Data[1] != sArq.u8TxNext)
+                {
+                    /* Peer is waiting for a frame we no longer have */
+                    vSL_SendLink(E_SL_LINK_RESET, sArq.u8TxNext);
+                }
+                break;
+                
+            case (E_SL_LINK_RESET):
+                vDebug("Link reset to %d\n", pu8Data[1]);
+                sSL_Stats.u64Resets++;
+                memset(sArq.abRxValid, 0, sizeof(sArq.abRxValid));
+                sArq.u8RxExpected = pu8Data[1];
+                break;
+                
+            default:
+                break;
+        }
+        return FALSE;
+    }
+    
+    u8Offset = u8Seq - sArq.u8RxExpected;
+    
+    if (u8Offset == 0)
+    {
+        sArq.u8RxExpected++;
+        if (++sArq.u8RxUnacked >= (SL_ARQ_WINDOW / 2))
+        {
+            sSL_Stats.u64AcksTx++;
+            vSL_SendLink(E_SL_LINK_ACK, 0);
+        }
+        else if (sArq.u64AckDue == 0)
+        {
+            sArq.u64AckDue = u64ClockNowUs() + SL_ARQ_ACK_DELAY_US;
+        }
+        return TRUE;
+    }
+    
+    if (u8Offset < SL_ARQ_WINDOW)
+    {
+        /* Frame after a gap - hold it and ask for the missing one */
+        uint8_t u8Slot = u8Seq % SL_ARQ_WINDOW;
+        
+        if (!sArq.abRxValid[u8Slot])
+        {
+            sArq.asRx[u8Slot].u8Type    = u8Type;
+            sArq.asRx[u8Slot].u16Length = u16Length;
+            memcpy(sArq.asRx[u8Slot].au8Data, pu8Data, u16Length);
+            sArq.abRxValid[u8Slot] = TRUE;
+            sSL_Stats.u64OutOfOrder++;
+        }
+        vSL_SendLink(E_SL_LINK_NAK, sArq.u8RxExpected);
+    }
+    else if ((uint8_t)(sArq.u8RxExpected - u8Seq) <= SL_ARQ_WINDOW)
+    {
+        /* Already delivered - our acknowledgement must have been lost */
+        sSL_Stats.u64Duplicates++;
+        sSL_Stats.u64AcksTx++;
+        vSL_SendLink(E_SL_LINK_ACK, 0);
+    }
+    else
+    {
+        /* Nowhere near the window; let the peer reset us */
+        vSL_SendLink(E_SL_LINK_NAK, sArq.u8RxExpected);
+    }
+    return FALSE;
+}
+
+
+/****************************************************************************
+ *
+ * NAME: vSL_RxError
  *
  * DESCRIPTION:
+ * Called when a frame is discarded. If it was a sequenced frame, ask for
+ * it again straight away rather than waiting for the sender to time out.
  *
  * PARAMETERS: 	Name        		RW  Usage
+ *              bReliable           R   The discarded frame was sequenced
  *
  * RETURNS:
  * void
  ****************************************************************************/
+static void vSL_RxError(bool bReliable)
+{
+    if (bReliable)
+    {
+        vSL_SendLink(E_SL_LINK_NAK, sArq.u8RxExpected);
+    }
+}
+
+
+/****************************************************************************
+ *
+ * NAME: bSL_RxByte
+ *
+ * DESCRIPTION:
+ * Get the next byte from the serial port, reading a buffer at a time.
+ * Stops once the read budget for this call is used up so that a stream
+ * of noise cannot starve the rest of the daemon; nothing is left in the
+ * buffer at that point, so select() will report any further input.
+ *
+ * PARAMETERS: 	Name        		RW  Usage
+ *              pu8Data             W   Next byte
+ *
+ * RETURNS:
+ * TRUE if a byte was available
+ ****************************************************************************/
 static bool bSL_RxByte(uint8_t *pu8Data)
 {
-    return serial_read(serial_fd, pu8Data);
+    if (u32RxPosition == u32RxAvailable)
+    {
+        if (u32RxBudget == 0)
+        {
+            return FALSE;
+        }
+        u32RxBudget--;
+        
+        u32RxPosition  = 0;
+        u32RxAvailable = sizeof(au8RxBuffer);
+        if (serial_read_buffer(serial_fd, au8RxBuffer, &u32RxAvailable) <= 0)
+        {
+            u32RxAvailable = 0;
+            return FALSE;
+        }
+        sSL_Stats.u64BytesRx += u32RxAvailable;
+    }
+    *pu8Data = au8RxBuffer[u32RxPosition++];
+    return TRUE;
 }
 
 
 /****************************************************************************/
 /***        END OF FILE                                                   ***/
 /****************************************************************************/
-
@@ -49,6 +49,8 @@ extern "C" {
 /***        Include files                                                 ***/
 /****************************************************************************/
 
+#include <stdint.h>
+
 #include "Serial.h"
 
 /****************************************************************************/
@@ -57,6 +59,12 @@ extern "C" {
 
 #define SL_READ(PDATA)		serial_read(serial_fd, PDATA)
 
+/** Largest message payload carried on the serial link */
+#define SL_MAX_MESSAGE_LENGTH   2048
+
+/** Number of sequenced frames that may be unacknowledged in each direction */
+#define SL_ARQ_WINDOW           8
+
 /****************************************************************************/
 /***        Type Definitions                                              ***/
 /****************************************************************************/
@@ -81,9 +89,23 @@ typedef enum
     E_SL_MSG_ACTIVITY_LED       = 113,
     E_SL_MSG_SET_RADIO_FRONTEND = 114,
     E_SL_MSG_ENABLE_DIVERSITY   = 115,
+    E_SL_MSG_CREDIT             = 116,
+    E_SL_MSG_LINK               = 117,
 } teSL_MsgType;
 
 
+/** Capabilities exchanged in the version handshake.
+ *  The host sends its capabilities as the payload of E_SL_MSG_VERSION_REQUEST,
+ *  and firmware that understands them appends the capabilities it has
+ *  enabled to the three version bytes of E_SL_MSG_VERSION.
+ */
+typedef enum
+{
+    E_SL_CAPABILITY_CREDIT      = 0x01,     /**< IPv6 frames are flow controlled by E_SL_MSG_CREDIT */
+    E_SL_CAPABILITY_RELIABLE    = 0x02,     /**< Frames are sequenced, CRC-16 protected and retransmitted */
+} teSL_Capability;
+
+
 /** Typedef bool to builtin integer */
 typedef enum
 {
@@ -97,6 +119,34 @@ typedef enum
     TRUE  = 1,
 } bool;
 
+
+/** Serial link statistics */
+typedef struct
+{
+    uint64_t    u64FramesTx;            /**< Frames written, including retransmissions */
+    uint64_t    u64FramesRx;            /**< Frames received with a good checksum */
+    uint64_t    u64CRCErrors;           /**< Frames received with a bad checksum */
+    uint64_t    u64Overflows;           /**< Frames with a length greater than the receive buffer */
+    uint64_t    u64MissingEnd;          /**< Frames with more data than their length, end character lost */
+    uint64_t    u64Truncated;           /**< Frames ended before their header or data was complete */
+    uint64_t    u64UnexpectedStart;     /**< Start characters received part way through a frame */
+    uint64_t    u64EscapeErrors;        /**< Invalid escape sequences */
+    uint64_t    u64DiscardedBytes;      /**< Bytes received outside of any frame */
+    uint64_t    u64Retransmissions;     /**< Sequenced frames sent again */
+    uint64_t    u64FastRetransmissions; /**< Retransmissions triggered by a NAK rather than a timeout */
+    uint64_t    u64NaksTx;              /**< NAKs sent */
+    uint64_t    u64AcksTx;              /**< Standalone ACKs sent */
+    uint64_t    u64OutOfOrder;          /**< Sequenced frames held for reordering */
+    uint64_t    u64Duplicates;          /**< Sequenced frames received more than once */
+    uint64_t    u64Abandoned;           /**< Sequenced frames given up on after repeated retransmissions */
+    uint64_t    u64QueueDrops;          /**< Messages dropped because the window and the queue behind it were full */
+    uint64_t    u64Resets;              /**< Sequence resets received from the peer */
+    uint64_t    u64BytesTx;             /**< Bytes written, including framing and escapes */
+    uint64_t    u64BytesRx;             /**< Bytes read */
+    uint64_t    u64EscapesTx;           /**< Bytes escaped in frames written */
+    uint64_t    u64EscapesRx;           /**< Escaped bytes received */
+} tsSL_Stats;
+
 /****************************************************************************/
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
@@ -105,6 +155,9 @@ typedef enum
 /***        Exported Variables                                            ***/
 /****************************************************************************/
 
+/** Serial link statistics */
+extern tsSL_Stats sSL_Stats;
+
 /****************************************************************************/
 /***        Local Variables                                               ***/
 /****************************************************************************/
@@ -116,6 +169,39 @@ typedef enum
 bool bSL_ReadMessage(uint8_t *pu8Type, uint16_t *pu16Length, uint16_t u16MaxLength, uint8_t *pu8Message);
 void vSL_WriteMessage(uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data);
 
+/** Enable or disable sequenced, acknowledged frames for messages we send.
+ *  Sequenced frames from the peer are always accepted.
+ *  \param bEnable      TRUE once the peer has enabled E_SL_CAPABILITY_RELIABLE
+ */
+void vSL_SetReliable(bool bEnable);
+
+/** Set the baud rate used to work out when frames have left the UART
+ *  \param u32BaudRate  Baud rate of the serial port
+ */
+void vSL_SetBaudRate(uint32_t u32BaudRate);
+
+/** Determine if another sequenced frame can be sent without exceeding the window.
+ *  Messages written while it is closed are queued behind the window.
+ *  \return TRUE if a message written now will be sent straight away
+ */
+bool bSL_TxWindowOpen(void);
+
+/** Send delayed acknowledgements and retransmit frames that have timed out
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \return 0 if nothing is pending, otherwise microseconds until this should be called again
+ */
+uint32_t u32SL_Service(uint64_t u64Now);
+
+/** Checksum of a plain frame
+ *  \return XOR of the type, length and payload bytes
+ */
+uint8_t u8SL_CalculateCRC(uint8_t u8Type, uint16_t u16Length, uint8_t *pu8Data);
+
+/** Checksum of a sequenced frame
+ *  \return CRC-16/CCITT-FALSE of the header and payload
+ */
+uint16_t u16SL_CalculateCRC16(uint8_t u8Type, uint16_t u16Length, uint8_t u8Seq, uint8_t u8Ack, uint8_t *pu8Data);
+
 /****************************************************************************/
 /***        Local Functions                                               ***/
 /****************************************************************************/
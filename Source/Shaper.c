@@ -0,0 +1,229 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Radio airtime shaper
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include <libdaemon/daemon.h>
+
+#include "Shaper.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/* IEEE 802.15.4 2.4GHz O-QPSK PHY runs at 250kbps, 32us per byte */
+#define RADIO_US_PER_BYTE           32
+
+/* Bytes of each radio frame not available for payload:
+ * PHY header (6), MAC header with long addresses and FCS (21), fragment header (5) */
+#define RADIO_FRAME_OVERHEAD        32
+
+/* Largest payload carried in a single frame (127 byte PSDU less MAC and fragment headers) */
+#define RADIO_FRAME_PAYLOAD         101
+
+/* Fixed time per frame: turnaround, acknowledgement, mean CSMA backoff and LIFS */
+#define RADIO_FRAME_FIXED_US        2300
+
+/* Bytes of IPv6 header typically removed by 6LoWPAN header compression */
+#define SHAPER_IPHC_SAVING          30
+
+/* Limits and step size of the rate adaptation, in permille of real time */
+#define SHAPER_FILL_MAX             1000
+#define SHAPER_FILL_MIN             100
+#define SHAPER_FILL_STEP            25
+
+/* Round trip time allowed above twice the minimum before backing off */
+#define SHAPER_RTT_SLACK_US         20000
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+int             iShaperEnabled          = 1;
+uint8_t         u8ShaperDefaultHops     = SHAPER_DEFAULT_HOPS;
+uint32_t        u32ShaperBurstUs        = SHAPER_DEFAULT_BURST_US;
+tsShaperStats   sShaperStats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+/** Token bucket state */
+static struct
+{
+    int64_t     i64Tokens;              /**< Airtime available, may be negative */
+    uint64_t    u64LastUpdate;          /**< Time the bucket was last filled */
+} sBucket;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void vShaperRefill(uint64_t u64Now)
+{
+    uint64_t u64Elapsed;
+    
+    if (u64Now <= sBucket.u64LastUpdate)
+    {
+        return;
+    }
+    
+    u64Elapsed = u64Now - sBucket.u64LastUpdate;
+    sBucket.u64LastUpdate = u64Now;
+    
+    sBucket.i64Tokens += (int64_t)((u64Elapsed * sShaperStats.u32FillPermille) / 1000);
+    if (sBucket.i64Tokens > (int64_t)u32ShaperBurstUs)
+    {
+        sBucket.i64Tokens = u32ShaperBurstUs;
+    }
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+void vShaperInit(uint64_t u64Now)
+{
+    memset(&sShaperStats, 0, sizeof(sShaperStats));
+    sShaperStats.u32FillPermille = SHAPER_FILL_MAX;
+    
+    sBucket.i64Tokens       = u32ShaperBurstUs;
+    sBucket.u64LastUpdate   = u64Now;
+}
+
+
+uint32_t u32ShaperAirtime(uint32_t u32Length, uint8_t u8Hops)
+{
+    uint32_t u32Frames;
+    uint32_t u32Bytes;
+    
+    /* The node table only sees routers that decrement the hop limit, so its
+     * estimate may be low but is never taken below the configured count */
+    if (u8Hops < u8ShaperDefaultHops)
+    {
+        u8Hops = u8ShaperDefaultHops;
+    }
+    
+    u32Length = (u32Length > SHAPER_IPHC_SAVING) ? (u32Length - SHAPER_IPHC_SAVING) : 1;
+    u32Frames = (u32Length + RADIO_FRAME_PAYLOAD - 1) / RADIO_FRAME_PAYLOAD;
+    u32Bytes  = u32Length + (u32Frames * RADIO_FRAME_OVERHEAD);
+    
+    return ((u32Bytes * RADIO_US_PER_BYTE) + (u32Frames * RADIO_FRAME_FIXED_US)) * u8Hops;
+}
+
+
+uint32_t u32ShaperWaitTime(uint64_t u64Now)
+{
+    if (!iShaperEnabled)
+    {
+        return 0;
+    }
+    
+    vShaperRefill(u64Now);
+    
+    if (sBucket.i64Tokens >= 0)
+    {
+        return 0;
+    }
+    
+    /* Time for the debt to be paid off at the current fill rate */
+    return (uint32_t)(((-sBucket.i64Tokens * 1000) + sShaperStats.u32FillPermille - 1) / sShaperStats.u32FillPermille);
+}
+
+
+void vShaperCharge(uint64_t u64Now, uint32_t u32AirtimeUs)
+{
+    sShaperStats.u64Packets++;
+    sShaperStats.u64AirtimeUs += u32AirtimeUs;
+    
+    if (!iShaperEnabled)
+    {
+        return;
+    }
+    
+    vShaperRefill(u64Now);
+    sBucket.i64Tokens -= u32AirtimeUs;
+}
+
+
+void vShaperRTTSample(uint32_t u32RTTUs)
+{
+    sShaperStats.u32LastRTTUs = u32RTTUs;
+    
+    if ((sShaperStats.u32MinRTTUs == 0) || (u32RTTUs < sShaperStats.u32MinRTTUs))
+    {
+        sShaperStats.u32MinRTTUs = u32RTTUs;
+    }
+    
+    if (u32RTTUs > ((2 * sShaperStats.u32MinRTTUs) + SHAPER_RTT_SLACK_US))
+    {
+        /* Queues are building up in the module - back off */
+        sShaperStats.u32FillPermille = (sShaperStats.u32FillPermille * 3) / 4;
+        if (sShaperStats.u32FillPermille < SHAPER_FILL_MIN)
+        {
+            sShaperStats.u32FillPermille = SHAPER_FILL_MIN;
+        }
+        daemon_log(LOG_DEBUG, "Shaper: RTT %uus, reducing rate to %u permille", 
+                   u32RTTUs, sShaperStats.u32FillPermille);
+    }
+    else
+    {
+        sShaperStats.u32FillPermille += SHAPER_FILL_STEP;
+        if (sShaperStats.u32FillPermille > SHAPER_FILL_MAX)
+        {
+            sShaperStats.u32FillPermille = SHAPER_FILL_MAX;
+        }
+    }
+}
+
+
+void vShaperLoss(void)
+{
+    sShaperStats.u32LossEvents++;
+    sShaperStats.u32FillPermille /= 2;
+    if (sShaperStats.u32FillPermille < SHAPER_FILL_MIN)
+    {
+        sShaperStats.u32FillPermille = SHAPER_FILL_MIN;
+    }
+    daemon_log(LOG_DEBUG, "Shaper: probe lost, reducing rate to %u permille", sShaperStats.u32FillPermille);
+}
+
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
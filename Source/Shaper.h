@@ -0,0 +1,153 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Radio airtime shaper
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+#ifndef  SHAPER_H_INCLUDED
+#define  SHAPER_H_INCLUDED
+
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Default number of radio hops assumed when the route to a node is unknown */
+#define SHAPER_DEFAULT_HOPS                 2
+
+/** Default depth of the token bucket, in microseconds of radio airtime */
+#define SHAPER_DEFAULT_BURST_US             100000
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+
+/** Shaper statistics */
+typedef struct
+{
+    uint64_t    u64Packets;             /**< Packets charged to the shaper */
+    uint64_t    u64PacketsDelayed;      /**< Packets that had to wait for tokens */
+    uint64_t    u64AirtimeUs;           /**< Total estimated airtime charged */
+    uint32_t    u32FillPermille;        /**< Current share of real time allowed as airtime */
+    uint32_t    u32MinRTTUs;            /**< Lowest ping round trip time seen */
+    uint32_t    u32LastRTTUs;           /**< Most recent ping round trip time */
+    uint32_t    u32LossEvents;          /**< Pings that went unanswered */
+} tsShaperStats;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Flag that the shaper is enabled */
+extern int              iShaperEnabled;
+
+
+/** Number of hops to assume when the distance to a node is not known, and the least ever assumed */
+extern uint8_t          u8ShaperDefaultHops;
+
+
+/** Depth of the token bucket in microseconds of airtime */
+extern uint32_t         u32ShaperBurstUs;
+
+
+/** Shaper statistics */
+extern tsShaperStats    sShaperStats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Reset the shaper to its initial state, with a full bucket.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ */
+void vShaperInit(uint64_t u64Now);
+
+
+/** Estimate the radio airtime needed to deliver a packet.
+ *  \param u32Length    Length of the IPv6 packet
+ *  \param u8Hops       Estimated radio hops to the destination, 0 if unknown.
+ *                      Fewer than u8ShaperDefaultHops counts as u8ShaperDefaultHops.
+ *  \return Estimated airtime in microseconds
+ */
+uint32_t u32ShaperAirtime(uint32_t u32Length, uint8_t u8Hops);
+
+
+/** Determine how long to wait before the next packet may be sent
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \return 0 if a packet may be sent now, otherwise microseconds to wait
+ */
+uint32_t u32ShaperWaitTime(uint64_t u64Now);
+
+
+/** Charge a packet that is being sent to the bucket.
+ *  The bucket may go into debt, so that a single large packet is never
+ *  blocked forever by a shallow bucket.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \param u32AirtimeUs Airtime estimate from u32ShaperAirtime
+ */
+void vShaperCharge(uint64_t u64Now, uint32_t u32AirtimeUs);
+
+
+/** Feed a round trip time measurement to the rate adaptation
+ *  \param u32RTTUs     Measured round trip time to the module
+ */
+void vShaperRTTSample(uint32_t u32RTTUs);
+
+
+/** Inform the rate adaptation that a probe was lost */
+void vShaperLoss(void);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* SHAPER_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
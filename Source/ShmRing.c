@@ -0,0 +1,616 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Shared memory packet interface
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+/* Local applications, such as a JIP controller running on the gateway, can
+ * exchange IPv6 packets with the mesh through shared memory rings instead
+ * of sockets and the tun device. Packets from an application go through
+ * the same path as packets read from the tun device, so the filter,
+ * shaper, queues and accounting all apply. Packets from the mesh for the
+ * application's address are put in its ring instead of the tun device.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+
+#include <libdaemon/daemon.h>
+
+#include "ShmRing.h"
+#include "IPv6.h"
+#include "TunDevice.h"
+#include "JennicModule.h"
+#include "Latency.h"
+#include "Clock.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define SHM_RING_MASK               (SHM_RING_SLOTS - 1)
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** An attached application */
+typedef struct
+{
+    int             iSocket;            /**< -1 if the slot is unused */
+    int             iToMeshFd;          /**< Doorbell written by the application */
+    int             iFromMeshFd;        /**< Doorbell written by the daemon */
+    struct in6_addr sAddress;
+    tsShmRingArea  *psArea;             /**< NULL until the handshake is complete */
+    uint64_t        u64Accepted;        /**< When the connection was accepted */
+} tsShmRingClient;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+extern int verbosity;
+
+const char         *pcShmRingSocket = NULL;
+
+tsShmRingStats      sShmRingStats;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static int iListenFd = -1;
+
+static tsShmRingClient asClients[SHM_RING_MAX_CLIENTS];
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void vShmRingDetach(tsShmRingClient *psClient)
+{
+    if (psClient->psArea)
+    {
+        munmap(psClient->psArea, sizeof(tsShmRingArea));
+        close(psClient->iToMeshFd);
+        close(psClient->iFromMeshFd);
+        sShmRingStats.u32Clients--;
+    }
+    close(psClient->iSocket);
+    memset(psClient, 0, sizeof(tsShmRingClient));
+    psClient->iSocket = -1;
+}
+
+
+/** Send the reply to a handshake, with descriptors if there are any */
+static int iShmRingReply(int iSocket, int32_t i32Status, const int *piFds, int iNumFds)
+{
+    tsShmRingReply sReply;
+    struct iovec sIov;
+    struct msghdr sMsg;
+    char acControl[CMSG_SPACE(3 * sizeof(int))];
+    
+    sReply.u32Magic     = SHM_RING_MAGIC;
+    sReply.i32Status    = i32Status;
+    sReply.u32Size      = sizeof(tsShmRingArea);
+    
+    sIov.iov_base = &sReply;
+    sIov.iov_len  = sizeof(sReply);
+    
+    memset(&sMsg, 0, sizeof(sMsg));
+    sMsg.msg_iov    = &sIov;
+    sMsg.msg_iovlen = 1;
+    
+    if (iNumFds)
+    {
+        struct cmsghdr *psCmsg;
+        
+        memset(acControl, 0, sizeof(acControl));
+        sMsg.msg_control    = acControl;
+        sMsg.msg_controllen = CMSG_SPACE(iNumFds * sizeof(int));
+        psCmsg = CMSG_FIRSTHDR(&sMsg);
+        psCmsg->cmsg_level  = SOL_SOCKET;
+        psCmsg->cmsg_type   = SCM_RIGHTS;
+        psCmsg->cmsg_len    = CMSG_LEN(iNumFds * sizeof(int));
+        memcpy(CMSG_DATA(psCmsg), piFds, iNumFds * sizeof(int));
+    }
+    
+    return (sendmsg(iSocket, &sMsg, MSG_NOSIGNAL) == sizeof(sReply)) ? 0 : -1;
+}
+
+
+/** Set up the rings for an application that has sent its request */
+static void vShmRingHandshake(tsShmRingClient *psClient)
+{
+    tsShmRingRequest sRequest;
+    int aiFds[3] = { -1, -1, -1 };
+    ssize_t iLength;
+    int32_t i32Status = 0;
+    int iReply;
+    int i;
+    
+    iLength = recv(psClient->iSocket, &sRequest, sizeof(sRequest), 0);
+    if (iLength <= 0)
+    {
+        vShmRingDetach(psClient);
+        return;
+    }
+    
+    if ((iLength != sizeof(sRequest)) || (sRequest.u32Magic != SHM_RING_MAGIC) || (sRequest.u32Version != SHM_RING_VERSION) ||
+        IN6_IS_ADDR_UNSPECIFIED(&sRequest.sAddress) || IN6_IS_ADDR_MULTICAST(&sRequest.sAddress))
+    {
+        i32Status = EINVAL;
+    }
+    for (i = 0; (i32Status == 0) && (i < SHM_RING_MAX_CLIENTS); i++)
+    {
+        if (asClients[i].psArea && IN6_ARE_ADDR_EQUAL(&asClients[i].sAddress, &sRequest.sAddress))
+        {
+            i32Status = EADDRINUSE;
+        }
+    }
+    
+    if (i32Status == 0)
+    {
+        aiFds[0] = memfd_create("6LoWPANd-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        aiFds[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        aiFds[2] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if ((aiFds[0] < 0) || (aiFds[1] < 0) || (aiFds[2] < 0) ||
+            (ftruncate(aiFds[0], sizeof(tsShmRingArea)) < 0) ||
+            /* The application must not be able to shrink the area under us */
+            (fcntl(aiFds[0], F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) ||
+            ((psClient->psArea = mmap(NULL, sizeof(tsShmRingArea), PROT_READ | PROT_WRITE, MAP_SHARED, aiFds[0], 0)) == MAP_FAILED))
+        {
+            i32Status = errno;
+            daemon_log(LOG_ERR, "Could not set up shared memory ring (%s)", strerror(errno));
+            psClient->psArea = NULL;
+        }
+    }
+    
+    if (i32Status == 0)
+    {
+        psClient->psArea->u32Magic      = SHM_RING_MAGIC;
+        psClient->psArea->u32Version    = SHM_RING_VERSION;
+        psClient->psArea->u32Slots      = SHM_RING_SLOTS;
+        psClient->psArea->u32SlotSize   = SHM_RING_SLOT_SIZE;
+        psClient->iToMeshFd             = aiFds[1];
+        psClient->iFromMeshFd           = aiFds[2];
+        memcpy(&psClient->sAddress, &sRequest.sAddress, sizeof(struct in6_addr));
+        sShmRingStats.u32Clients++;
+    }
+    
+    iReply = iShmRingReply(psClient->iSocket, i32Status, aiFds, (i32Status == 0) ? 3 : 0);
+    
+    /* The mapping keeps the memory, and the application has its own descriptor */
+    if (aiFds[0] >= 0)
+    {
+        close(aiFds[0]);
+    }
+    if (i32Status != 0)
+    {
+        /* The doorbells were not handed to the client, so close them here */
+        sShmRingStats.u64Rejected++;
+        for (i = 1; i < 3; i++)
+        {
+            if (aiFds[i] >= 0)
+            {
+                close(aiFds[i]);
+            }
+        }
+    }
+    if ((iReply < 0) || (i32Status != 0))
+    {
+        vShmRingDetach(psClient);
+        return;
+    }
+    sShmRingStats.u64Attached++;
+    
+    if (verbosity >= LOG_DEBUG)
+    {
+        char acAddress[INET6_ADDRSTRLEN];
+        inet_ntop(AF_INET6, &psClient->sAddress, acAddress, sizeof(acAddress));
+        daemon_log(LOG_DEBUG, "Application attached to shared memory ring as %s", acAddress);
+    }
+}
+
+
+static void vShmRingAccept(void)
+{
+    int iSocket = accept(iListenFd, NULL, NULL);
+    int i;
+    
+    if (iSocket < 0)
+    {
+        return;
+    }
+    fcntl(iSocket, F_SETFD, FD_CLOEXEC);
+    
+    for (i = 0; i < SHM_RING_MAX_CLIENTS; i++)
+    {
+        if (asClients[i].iSocket < 0)
+        {
+            asClients[i].iSocket     = iSocket;
+            asClients[i].u64Accepted = u64ClockNowUs();
+            return;
+        }
+    }
+    
+    iShmRingReply(iSocket, EBUSY, NULL, 0);
+    sShmRingStats.u64Rejected++;
+    close(iSocket);
+}
+
+
+/** Take one packet from an application and send it on.
+ *  \return TRUE if there was a packet
+ */
+static bool bShmRingTake(tsShmRingClient *psClient)
+{
+    tsShmRingIndex *psIndex = &psClient->psArea->sToMesh;
+    uint32_t u32Tail = psIndex->u32Tail;
+    const tsShmRingSlot *psSlot;
+    uint8_t au8Packet[SHM_RING_MAX_PACKET];
+    uint32_t u32Length;
+    
+    if (__atomic_load_n(&psIndex->u32Head, __ATOMIC_SEQ_CST) == u32Tail)
+    {
+        return FALSE;
+    }
+    
+    /* Copy the packet out, so the application cannot change it while it is checked */
+    psSlot = &psClient->psArea->asToMesh[u32Tail & SHM_RING_MASK];
+    u32Length = psSlot->u32Length;
+    if (u32Length <= SHM_RING_MAX_PACKET)
+    {
+        memcpy(au8Packet, psSlot->au8Data, u32Length);
+    }
+    __atomic_store_n(&psIndex->u32Tail, u32Tail + 1, __ATOMIC_SEQ_CST);
+    
+    if ((u32Length < IPV6_HEADER_LENGTH) || (u32Length > SHM_RING_MAX_PACKET) ||
+        ((au8Packet[0] >> 4) != 6) || !IN6_ARE_ADDR_EQUAL((struct in6_addr *)&au8Packet[8], &psClient->sAddress))
+    {
+        sShmRingStats.u64DroppedInvalid++;
+        return TRUE;
+    }
+    
+    sShmRingStats.u64ToMeshPackets++;
+    u64LatencyIngress = u64ClockNowNs();
+    if (eTunDeviceHandlePacket(u32Length, au8Packet) != E_TUN_OK)
+    {
+        daemon_log(LOG_ERR, "Error handling shared memory ring packet");
+    }
+    u64LatencyIngress = 0;
+    return TRUE;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iShmRingOpen(void)
+{
+    struct sockaddr_un sAddr;
+    int i;
+    
+    for (i = 0; i < SHM_RING_MAX_CLIENTS; i++)
+    {
+        asClients[i].iSocket = -1;
+    }
+    
+    if (!pcShmRingSocket)
+    {
+        return 0;
+    }
+    
+    if (strlen(pcShmRingSocket) >= sizeof(sAddr.sun_path))
+    {
+        daemon_log(LOG_ERR, "Shared memory socket path too long");
+        return -1;
+    }
+    memset(&sAddr, 0, sizeof(sAddr));
+    sAddr.sun_family = AF_UNIX;
+    strcpy(sAddr.sun_path, pcShmRingSocket);
+    
+    /* Remove a socket left by a previous run */
+    unlink(pcShmRingSocket);
+    
+    iListenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if ((iListenFd < 0) ||
+        (bind(iListenFd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0) ||
+        (listen(iListenFd, SHM_RING_MAX_CLIENTS) < 0))
+    {
+        daemon_log(LOG_ERR, "Could not create shared memory socket %s (%s)", pcShmRingSocket, strerror(errno));
+        if (iListenFd >= 0)
+        {
+            close(iListenFd);
+            iListenFd = -1;
+        }
+        return -1;
+    }
+    
+    daemon_log(LOG_INFO, "Shared memory packet interface on %s", pcShmRingSocket);
+    return 0;
+}
+
+
+void vShmRingClose(void)
+{
+    int i;
+    
+    if (iListenFd < 0)
+    {
+        return;
+    }
+    for (i = 0; i < SHM_RING_MAX_CLIENTS; i++)
+    {
+        if (asClients[i].iSocket >= 0)
+        {
+            vShmRingDetach(&asClients[i]);
+        }
+    }
+    close(iListenFd);
+    iListenFd = -1;
+    unlink(pcShmRingSocket);
+}
+
+
+int iShmRingSetFds(fd_set *psReadFds, int iMaxFd, bool bAcceptPackets)
+{
+    int i;
+    
+    if (iListenFd < 0)
+    {
+        return iMaxFd;
+    }
+    
+    FD_SET(iListenFd, psReadFds);
+    if (iListenFd > iMaxFd)
+    {
+        iMaxFd = iListenFd;
+    }
+    
+    for (i = 0; i < SHM_RING_MAX_CLIENTS; i++)
+    {
+        if (asClients[i].iSocket < 0)
+        {
+            continue;
+        }
+        FD_SET(asClients[i].iSocket, psReadFds);
+        if (asClients[i].iSocket > iMaxFd)
+        {
+            iMaxFd = asClients[i].iSocket;
+        }
+        if (bAcceptPackets && asClients[i].psArea)
+        {
+            FD_SET(asClients[i].iToMeshFd, psReadFds);
+            if (asClients[i].iToMeshFd > iMaxFd)
+            {
+                iMaxFd = asClients[i].iToMeshFd;
+            }
+        }
+    }
+    return iMaxFd;
+}
+
+
+bool bShmRingHandleFd(int iFd)
+{
+    int i;
+    
+    if (iListenFd < 0)
+    {
+        return FALSE;
+    }
+    
+    if (iFd == iListenFd)
+    {
+        vShmRingAccept();
+        return TRUE;
+    }
+    
+    for (i = 0; i < SHM_RING_MAX_CLIENTS; i++)
+    {
+        tsShmRingClient *psClient = &asClients[i];
+        
+        if (psClient->iSocket < 0)
+        {
+            continue;
+        }
+        
+        if (iFd == psClient->iSocket)
+        {
+            if (!psClient->psArea)
+            {
+                vShmRingHandshake(psClient);
+            }
+            else
+            {
+                char cDiscard;
+                
+                /* Nothing more is expected, so this is the application going away */
+                if (recv(psClient->iSocket, &cDiscard, sizeof(cDiscard), MSG_DONTWAIT) <= 0)
+                {
+                    vShmRingDetach(psClient);
+                }
+            }
+            return TRUE;
+        }
+        
+        if (psClient->psArea && (iFd == psClient->iToMeshFd))
+        {
+            uint64_t u64Count;
+            
+            /* Clear the doorbell, then empty the ring */
+            if (read(psClient->iToMeshFd, &u64Count, sizeof(u64Count)) < 0)
+            {
+                /* Already cleared */
+            }
+            vShmRingService();
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+
+void vShmRingService(void)
+{
+    static uint32_t u32Next = 0;
+    bool bProgress;
+    int i;
+    
+    if (iListenFd < 0)
+    {
+        return;
+    }
+    
+    do
+    {
+        bProgress = FALSE;
+        
+        /* One packet from each application in turn */
+        for (i = 0; i < SHM_RING_MAX_CLIENTS; i++)
+        {
+            tsShmRingClient *psClient = &asClients[(u32Next + i) % SHM_RING_MAX_CLIENTS];
+            
+            if (u32JennicModuleTxQueueDepth() != 0)
+            {
+                /* Leave the rest until the queue drains, as for the tun device */
+                u32Next = (u32Next + i) % SHM_RING_MAX_CLIENTS;
+                return;
+            }
+            if (psClient->psArea && bShmRingTake(psClient))
+            {
+                bProgress = TRUE;
+            }
+        }
+    } while (bProgress);
+}
+
+
+void vShmRingAge(uint64_t u64Now)
+{
+    int i;
+    
+    if (iListenFd < 0)
+    {
+        return;
+    }
+    
+    for (i = 0; i < SHM_RING_MAX_CLIENTS; i++)
+    {
+        tsShmRingClient *psClient = &asClients[i];
+        
+        if ((psClient->iSocket >= 0) && !psClient->psArea &&
+            (u64Now - psClient->u64Accepted >= (uint64_t)SHM_RING_HANDSHAKE_TIMEOUT * 1000000))
+        {
+            /* Connected but never asked for rings, give the slot to someone else */
+            daemon_log(LOG_INFO, "Shared memory handshake timed out");
+            sShmRingStats.u64Rejected++;
+            vShmRingDetach(psClient);
+        }
+    }
+}
+
+
+bool bShmRingDeliver(uint32_t u32Length, const uint8_t *pu8Data)
+{
+    int i;
+    
+    if ((iListenFd < 0) || (sShmRingStats.u32Clients == 0) ||
+        (u32Length < IPV6_HEADER_LENGTH) || ((pu8Data[0] >> 4) != 6))
+    {
+        return FALSE;
+    }
+    
+    for (i = 0; i < SHM_RING_MAX_CLIENTS; i++)
+    {
+        tsShmRingClient *psClient = &asClients[i];
+        tsShmRingIndex *psIndex;
+        tsShmRingSlot *psSlot;
+        uint32_t u32Head;
+        
+        if (!psClient->psArea || !IN6_ARE_ADDR_EQUAL((const struct in6_addr *)&pu8Data[24], &psClient->sAddress))
+        {
+            continue;
+        }
+        
+        psIndex = &psClient->psArea->sFromMesh;
+        u32Head = psIndex->u32Head;
+        if ((u32Length > SHM_RING_MAX_PACKET) ||
+            ((uint32_t)(u32Head - __atomic_load_n(&psIndex->u32Tail, __ATOMIC_SEQ_CST)) >= SHM_RING_SLOTS))
+        {
+            sShmRingStats.u64DroppedFull++;
+            return TRUE;
+        }
+        
+        psSlot = &psClient->psArea->asFromMesh[u32Head & SHM_RING_MASK];
+        psSlot->u32Length = u32Length;
+        memcpy(psSlot->au8Data, pu8Data, u32Length);
+        __atomic_store_n(&psIndex->u32Head, u32Head + 1, __ATOMIC_SEQ_CST);
+        sShmRingStats.u64FromMeshPackets++;
+        
+        if (__atomic_load_n(&psIndex->u32Tail, __ATOMIC_SEQ_CST) == u32Head)
+        {
+            /* The application may be waiting for the ring to fill */
+            uint64_t u64One = 1;
+            if (write(psClient->iFromMeshFd, &u64One, sizeof(u64One)) < 0)
+            {
+                /* Counter already set */
+            }
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
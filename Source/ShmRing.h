@@ -0,0 +1,238 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Shared memory packet interface
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+#ifndef  SHMRING_H_INCLUDED
+#define  SHMRING_H_INCLUDED
+
+#include <stdint.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Identifies the shared memory area and handshake messages */
+#define SHM_RING_MAGIC                      0x364C5752
+
+/** Version of the layout below */
+#define SHM_RING_VERSION                    1
+
+/** Slots in each ring (a power of 2) */
+#define SHM_RING_SLOTS                      256
+
+/** Size of each slot */
+#define SHM_RING_SLOT_SIZE                  2048
+
+/** Largest packet a slot can hold */
+#define SHM_RING_MAX_PACKET                 (SHM_RING_SLOT_SIZE - sizeof(uint32_t))
+
+/** Maximum number of applications attached at once */
+#define SHM_RING_MAX_CLIENTS                4
+
+/** Seconds an application has to send its request after connecting */
+#define SHM_RING_HANDSHAKE_TIMEOUT          5
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/* An application connects to the daemon's UNIX socket (SOCK_SEQPACKET) and
+ * sends a tsShmRingRequest naming the IPv6 address it will use. The reply
+ * carries three descriptors: the shared memory area, the doorbell the
+ * application writes when it adds packets for the mesh, and the doorbell
+ * the daemon writes when it adds packets from the mesh. Both doorbells are
+ * eventfds. Closing the socket detaches the application.
+ *
+ * Each ring has one producer and one consumer. u32Head and u32Tail count
+ * packets from zero and wrap; a packet is in slot (index % SHM_RING_SLOTS).
+ * The producer fills the slot and then advances u32Head, the consumer reads
+ * the slot and then advances u32Tail, each with a sequentially consistent
+ * store. A producer only needs to ring the doorbell when it finds the ring
+ * empty after advancing u32Head (u32Tail == old u32Head).
+ */
+
+/** Indexes of one ring, on separate cache lines */
+typedef struct
+{
+    uint32_t        u32Head;            /**< Packets added by the producer */
+    uint8_t         au8Pad1[60];
+    uint32_t        u32Tail;            /**< Packets removed by the consumer */
+    uint8_t         au8Pad2[60];
+} tsShmRingIndex;
+
+
+/** A packet in a ring */
+typedef struct
+{
+    uint32_t        u32Length;
+    uint8_t         au8Data[SHM_RING_MAX_PACKET];
+} tsShmRingSlot;
+
+
+/** Layout of the shared memory area */
+typedef struct
+{
+    uint32_t        u32Magic;
+    uint32_t        u32Version;
+    uint32_t        u32Slots;
+    uint32_t        u32SlotSize;
+    uint8_t         au8Pad[48];
+    tsShmRingIndex  sToMesh;            /**< Indexes of packets from the application */
+    tsShmRingIndex  sFromMesh;          /**< Indexes of packets for the application */
+    tsShmRingSlot   asToMesh[SHM_RING_SLOTS];
+    tsShmRingSlot   asFromMesh[SHM_RING_SLOTS];
+} tsShmRingArea;
+
+
+/** Sent by the application after connecting */
+typedef struct
+{
+    uint32_t        u32Magic;
+    uint32_t        u32Version;
+    struct in6_addr sAddress;           /**< Source address of its packets, and where packets are delivered */
+} tsShmRingRequest;
+
+
+/** Reply from the daemon. The descriptors are attached when i32Status is 0 */
+typedef struct
+{
+    uint32_t        u32Magic;
+    int32_t         i32Status;          /**< 0, or an errno value */
+    uint32_t        u32Size;            /**< Size of the shared memory area */
+} tsShmRingReply;
+
+
+/** Shared memory interface statistics */
+typedef struct
+{
+    uint32_t    u32Clients;             /**< Applications attached */
+    uint64_t    u64Attached;            /**< Applications that have attached */
+    uint64_t    u64Rejected;            /**< Handshakes refused or timed out */
+    uint64_t    u64ToMeshPackets;       /**< Packets taken from applications */
+    uint64_t    u64FromMeshPackets;     /**< Packets given to applications */
+    uint64_t    u64DroppedFull;         /**< Packets for an application whose ring was full */
+    uint64_t    u64DroppedInvalid;      /**< Packets from an application with a bad length or source */
+} tsShmRingStats;
+
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Path of the UNIX socket applications connect to, NULL to disable */
+extern const char      *pcShmRingSocket;
+
+
+/** Shared memory interface statistics */
+extern tsShmRingStats   sShmRingStats;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Create the UNIX socket applications connect to, if one is configured.
+ *  \return 0 on success, -1 on error
+ */
+int iShmRingOpen(void);
+
+
+/** Remove the UNIX socket */
+void vShmRingClose(void);
+
+
+/** Add the interface's descriptors to a select set.
+ *  \param psReadFds    Set to add to
+ *  \param iMaxFd       Highest descriptor in the set so far
+ *  \param bAcceptPackets   Include the doorbells of packets for the mesh
+ *  \return Highest descriptor in the set
+ */
+int iShmRingSetFds(fd_set *psReadFds, int iMaxFd, bool bAcceptPackets);
+
+
+/** Deal with a descriptor select has found readable.
+ *  \param iFd          Descriptor
+ *  \return TRUE if the descriptor belongs to the interface
+ */
+bool bShmRingHandleFd(int iFd);
+
+
+/** Pass packets from applications towards the mesh, through the same path
+ *  as packets from the tun device, while the module transmit queue is empty.
+ */
+void vShmRingService(void);
+
+
+/** Disconnect applications that have not completed the handshake in
+ *  time, so they do not hold a slot. Called periodically.
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ */
+void vShmRingAge(uint64_t u64Now);
+
+
+/** Deliver a packet to the application that owns its destination address.
+ *  \param u32Length    Length of the packet
+ *  \param pu8Data      IPv6 packet
+ *  \return TRUE if the packet was for an application
+ */
+bool bShmRingDeliver(uint32_t u32Length, const uint8_t *pu8Data);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* SHMRING_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
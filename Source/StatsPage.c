@@ -0,0 +1,274 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Statistics page
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+/* Monitoring agents that poll often can read the daemon's counters and
+ * latency histograms from a memory mapped file, without system calls and
+ * without waking the daemon. The main loop copies the values into the page
+ * once a second, bracketed by a sequence number that readers check to be
+ * sure they did not copy a page that was part way through being updated.
+ * The layout is described in StatsPage.h.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include <libdaemon/daemon.h>
+
+#include "StatsPage.h"
+#include "Metrics.h"
+#include "Latency.h"
+#include "TunDevice.h"
+#include "JennicModule.h"
+#include "Clock.h"
+#include "DumpFile.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+#define STATS_PAGE_HISTOGRAM_SIZE   (sizeof(tsStatsPageHistogram) + HISTOGRAM_BUCKETS * sizeof(uint64_t))
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+const char         *pcStatsPageFile = NULL;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static char acPath[256];
+
+static tsStatsPageHeader *psPage = NULL;
+
+static uint32_t u32Next;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static tsStatsPageCounter *psStatsPageCounter(uint32_t u32Index)
+{
+    return (tsStatsPageCounter *)((uint8_t *)psPage + psPage->u32CounterOffset + u32Index * psPage->u32CounterSize);
+}
+
+
+static tsStatsPageHistogram *psStatsPageHistogram(uint32_t u32Index)
+{
+    return (tsStatsPageHistogram *)((uint8_t *)psPage + psPage->u32HistogramOffset + u32Index * psPage->u32HistogramSize);
+}
+
+
+static void vStatsPageCount(void *pvContext, const char *pcName, const char *pcLabels, uint64_t u64Value)
+{
+    (*(uint32_t *)pvContext)++;
+}
+
+
+static void vStatsPageName(void *pvContext, const char *pcName, const char *pcLabels, uint64_t u64Value)
+{
+    tsStatsPageCounter *psCounter = psStatsPageCounter(u32Next++);
+    
+    if (pcLabels)
+    {
+        snprintf(psCounter->acName, sizeof(psCounter->acName), "%s{%s}", pcName, pcLabels);
+    }
+    else
+    {
+        snprintf(psCounter->acName, sizeof(psCounter->acName), "%s", pcName);
+    }
+}
+
+
+static void vStatsPageValue(void *pvContext, const char *pcName, const char *pcLabels, uint64_t u64Value)
+{
+    psStatsPageCounter(u32Next++)->u64Value = u64Value;
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int iStatsPageOpen(const char *pcVersion)
+{
+    char acTemp[sizeof(acPath) + 4];
+    uint32_t u32Counters = 0;
+    uint32_t u32Size;
+    uint32_t i;
+    void *pvPage;
+    int iFd;
+    
+    if (pcStatsPageFile && (strcmp(pcStatsPageFile, "none") == 0))
+    {
+        return 0;
+    }
+    if (pcStatsPageFile)
+    {
+        snprintf(acPath, sizeof(acPath), "%s", pcStatsPageFile);
+    }
+    else
+    {
+        snprintf(acPath, sizeof(acPath), STATS_PAGE_DEFAULT_PATH, cpTunDevice);
+    }
+    
+    vMetricsEnumerate(vStatsPageCount, &u32Counters);
+    u32Size = sizeof(tsStatsPageHeader) + u32Counters * sizeof(tsStatsPageCounter) + E_LATENCY_STAGES * STATS_PAGE_HISTOGRAM_SIZE;
+    
+    /* Build the page under another name, so readers never see it incomplete */
+    snprintf(acTemp, sizeof(acTemp), "%s.new", acPath);
+    iFd = iDumpFileCreate(acTemp, O_RDWR);
+    if ((iFd < 0) || (ftruncate(iFd, u32Size) < 0) ||
+        ((pvPage = mmap(NULL, u32Size, PROT_READ | PROT_WRITE, MAP_SHARED, iFd, 0)) == MAP_FAILED))
+    {
+        daemon_log(pcStatsPageFile ? LOG_ERR : LOG_WARNING, "Could not create statistics page %s (%s)", acTemp, strerror(errno));
+        if (iFd >= 0)
+        {
+            close(iFd);
+            unlink(acTemp);
+        }
+        return pcStatsPageFile ? -1 : 0;
+    }
+    close(iFd);
+    
+    psPage = pvPage;
+    psPage->u32Magic                    = STATS_PAGE_MAGIC;
+    psPage->u32Version                  = STATS_PAGE_VERSION;
+    psPage->u32HeaderSize               = sizeof(tsStatsPageHeader);
+    psPage->u32PageSize                 = u32Size;
+    psPage->u32Pid                      = getpid();
+    psPage->u32Counters                 = u32Counters;
+    psPage->u32CounterOffset            = sizeof(tsStatsPageHeader);
+    psPage->u32CounterSize              = sizeof(tsStatsPageCounter);
+    psPage->u32Histograms               = E_LATENCY_STAGES;
+    psPage->u32HistogramOffset          = psPage->u32CounterOffset + u32Counters * sizeof(tsStatsPageCounter);
+    psPage->u32HistogramSize            = STATS_PAGE_HISTOGRAM_SIZE;
+    psPage->u32HistogramBuckets         = HISTOGRAM_BUCKETS;
+    psPage->u32HistogramSubBucketBits   = HISTOGRAM_SUB_BUCKET_BITS;
+    psPage->u64StartedUs                = u64ClockNowUs();
+    psPage->u32UpdateInterval           = STATS_PAGE_UPDATE_INTERVAL;
+    snprintf(psPage->acVersion, sizeof(psPage->acVersion), "%s", pcVersion);
+    
+    u32Next = 0;
+    vMetricsEnumerate(vStatsPageName, NULL);
+    for (i = 0; i < E_LATENCY_STAGES; i++)
+    {
+        snprintf(psStatsPageHistogram(i)->acName, STATS_PAGE_HISTOGRAM_NAME, "latency_%s", apcLatencyStage[i]);
+    }
+    vStatsPageUpdate();
+    
+    if (rename(acTemp, acPath) < 0)
+    {
+        daemon_log(LOG_ERR, "Could not create statistics page %s (%s)", acPath, strerror(errno));
+        unlink(acTemp);
+        munmap(psPage, u32Size);
+        psPage = NULL;
+        return pcStatsPageFile ? -1 : 0;
+    }
+    daemon_log(LOG_INFO, "Statistics page at %s", acPath);
+    return 0;
+}
+
+
+void vStatsPageClose(void)
+{
+    if (!psPage)
+    {
+        return;
+    }
+    munmap(psPage, psPage->u32PageSize);
+    psPage = NULL;
+    unlink(acPath);
+}
+
+
+void vStatsPageUpdate(void)
+{
+    uint32_t u32Sequence;
+    struct timeval sNow;
+    uint32_t i;
+    
+    if (!psPage)
+    {
+        return;
+    }
+    
+    /* Odd while updating. The fence keeps the values from being written
+     * before readers can see that. */
+    u32Sequence = psPage->u32Sequence;
+    __atomic_store_n(&psPage->u32Sequence, u32Sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    
+    u32Next = 0;
+    vMetricsEnumerate(vStatsPageValue, NULL);
+    
+    for (i = 0; i < E_LATENCY_STAGES; i++)
+    {
+        tsStatsPageHistogram *psHistogram = psStatsPageHistogram(i);
+        
+        psHistogram->u64Count   = asLatency[i].u64Count;
+        psHistogram->u64Sum     = asLatency[i].u64Sum;
+        psHistogram->u64Min     = asLatency[i].u64Min;
+        psHistogram->u64Max     = asLatency[i].u64Max;
+        memcpy(psHistogram->au64Buckets, asLatency[i].au64Buckets, sizeof(asLatency[i].au64Buckets));
+    }
+    
+    gettimeofday(&sNow, NULL);
+    psPage->u64UpdatedUs    = u64ClockNowUs();
+    psPage->u64UpdatedTime  = (uint64_t)sNow.tv_sec * 1000000 + sNow.tv_usec;
+    strncpy(psPage->acModuleState, pcJennicModuleState(), sizeof(psPage->acModuleState) - 1);
+    
+    __atomic_store_n(&psPage->u32Sequence, u32Sequence + 2, __ATOMIC_RELEASE);
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
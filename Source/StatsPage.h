@@ -0,0 +1,185 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Statistics page
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+#ifndef  STATSPAGE_H_INCLUDED
+#define  STATSPAGE_H_INCLUDED
+
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Where the page is published, given the interface name */
+#define STATS_PAGE_DEFAULT_PATH             "/run/6LoWPANd.%s.stats"
+
+/** Microseconds between updates of the page */
+#define STATS_PAGE_UPDATE_INTERVAL          1000000
+
+/** First word of the page */
+#define STATS_PAGE_MAGIC                    0x5354364C
+
+/** Layout version. Only changes if a field below moves or changes meaning.
+ *  New fields are added to the end of the header, and new counters and
+ *  histograms are added as new named entries, without changing it. */
+#define STATS_PAGE_VERSION                  1
+
+/** Space for a counter name, including the terminating NUL */
+#define STATS_PAGE_COUNTER_NAME             64
+
+/** Space for a histogram name, including the terminating NUL */
+#define STATS_PAGE_HISTOGRAM_NAME           32
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** Start of the page. Readers must find the entries through the offsets
+ *  and sizes given here rather than assuming them, and must check the
+ *  sequence number as follows:
+ *
+ *  -# Read u32Sequence (acquire). If it is odd, the daemon is updating the
+ *     page, so try again.
+ *  -# Copy out the values wanted.
+ *  -# Read u32Sequence again (after an acquire fence). If it has changed,
+ *     the copy may be inconsistent, so start again.
+ *
+ *  All fields are in host byte order.
+ */
+typedef struct
+{
+    uint32_t    u32Magic;               /**< STATS_PAGE_MAGIC */
+    uint32_t    u32Version;             /**< STATS_PAGE_VERSION */
+    uint32_t    u32Sequence;            /**< Incremented before and after each update */
+    uint32_t    u32HeaderSize;          /**< Size of this header */
+    uint32_t    u32PageSize;            /**< Size of the whole page */
+    uint32_t    u32Pid;                 /**< Process ID of the daemon */
+    
+    uint32_t    u32Counters;            /**< Number of counters */
+    uint32_t    u32CounterOffset;       /**< Offset of the first counter from the start of the page */
+    uint32_t    u32CounterSize;         /**< Distance between counters */
+    
+    uint32_t    u32Histograms;          /**< Number of histograms */
+    uint32_t    u32HistogramOffset;     /**< Offset of the first histogram from the start of the page */
+    uint32_t    u32HistogramSize;       /**< Distance between histograms */
+    uint32_t    u32HistogramBuckets;    /**< Buckets in each histogram */
+    uint32_t    u32HistogramSubBucketBits;  /**< Linear sub-buckets per power of two, log 2 */
+    
+    uint64_t    u64StartedUs;           /**< When the daemon started, CLOCK_MONOTONIC */
+    uint64_t    u64UpdatedUs;           /**< When the values were last updated, CLOCK_MONOTONIC */
+    uint64_t    u64UpdatedTime;         /**< When the values were last updated, microseconds since the epoch */
+    uint32_t    u32UpdateInterval;      /**< Microseconds between updates */
+    uint32_t    u32Reserved;
+    
+    char        acVersion[32];          /**< Daemon version */
+    char        acModuleState[16];      /**< Stage of the start up handshake with the module */
+} tsStatsPageHeader;
+
+
+/** A counter or gauge. Names are as given to Prometheus, without the
+ *  prefix, and with the labels if there are any, e.g.
+ *  drops_total{reason="oversize"}. Names do not change while the page
+ *  exists, so readers may look them up once. */
+typedef struct
+{
+    char        acName[STATS_PAGE_COUNTER_NAME];
+    uint64_t    u64Value;
+} tsStatsPageCounter;
+
+
+/** A histogram of durations in nanoseconds, laid out as in Histogram.h */
+typedef struct
+{
+    char        acName[STATS_PAGE_HISTOGRAM_NAME];
+    uint64_t    u64Count;
+    uint64_t    u64Sum;
+    uint64_t    u64Min;
+    uint64_t    u64Max;
+    uint64_t    au64Buckets[];          /**< u32HistogramBuckets of them */
+} tsStatsPageHistogram;
+
+/****************************************************************************/
+/***        Exported Variables                                            ***/
+/****************************************************************************/
+
+
+/** Path of the page, NULL to use STATS_PAGE_DEFAULT_PATH, "none" to disable */
+extern const char      *pcStatsPageFile;
+
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Create the page and fill in the names of its entries. Failing to create
+ *  the default page is not an error, as /run may not be writable.
+ *  \param pcVersion    Daemon version, to put in the page
+ *  \return 0 on success, -1 on error
+ */
+int iStatsPageOpen(const char *pcVersion);
+
+
+/** Remove the page */
+void vStatsPageClose(void);
+
+
+/** Copy the current values into the page. Called from the main loop's
+ *  housekeeping, once each STATS_PAGE_UPDATE_INTERVAL. */
+void vStatsPageUpdate(void);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* STATSPAGE_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -0,0 +1,137 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Token bucket rate limiter
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+
+#ifndef  TOKENBUCKET_H_INCLUDED
+#define  TOKENBUCKET_H_INCLUDED
+
+#include <stdint.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Buckets are kept in millionths of a packet, so that a rate in packets
+ *  per second adds exactly rate tokens for every microsecond */
+#define TOKEN_BUCKET_TOKEN                  1000000
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** Rate limiting token bucket */
+typedef struct
+{
+    int64_t     i64Tokens;              /**< Millionths of a packet available */
+    uint64_t    u64LastUpdate;          /**< Time the bucket was last filled */
+} tsTokenBucket;
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Fill a bucket to its burst size.
+ *  \param psBucket     Bucket
+ *  \param u32Burst     Packets the bucket holds
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ */
+static inline void vTokenBucketFill(tsTokenBucket *psBucket, uint32_t u32Burst, uint64_t u64Now)
+{
+    psBucket->i64Tokens     = (int64_t)u32Burst * TOKEN_BUCKET_TOKEN;
+    psBucket->u64LastUpdate = u64Now;
+}
+
+
+/** Add the tokens earned since the last call and take one for a packet.
+ *  The time since the last call is limited to what it takes to fill the
+ *  bucket, so a bucket that has been idle for a long time, or has never
+ *  been used, cannot overflow the arithmetic.
+ *  \param psBucket     Bucket
+ *  \param u32Rate      Packets per second
+ *  \param u32Burst     Packets the bucket holds
+ *  \param u64Now       Current time (from u64ClockNowUs)
+ *  \return TRUE if the packet is within the limit
+ */
+static inline bool bTokenBucketTake(tsTokenBucket *psBucket, uint32_t u32Rate, uint32_t u32Burst, uint64_t u64Now)
+{
+    int64_t i64Burst = (int64_t)u32Burst * TOKEN_BUCKET_TOKEN;
+    
+    if ((u64Now > psBucket->u64LastUpdate) && u32Rate)
+    {
+        uint64_t u64Elapsed = u64Now - psBucket->u64LastUpdate;
+        
+        if (u64Elapsed >= ((uint64_t)i64Burst / u32Rate) + 1)
+        {
+            psBucket->i64Tokens = i64Burst;
+        }
+        else
+        {
+            psBucket->i64Tokens += (int64_t)(u64Elapsed * u32Rate);
+            if (psBucket->i64Tokens > i64Burst)
+            {
+                psBucket->i64Tokens = i64Burst;
+            }
+        }
+        psBucket->u64LastUpdate = u64Now;
+    }
+    
+    if (psBucket->i64Tokens < TOKEN_BUCKET_TOKEN)
+    {
+        return FALSE;
+    }
+    psBucket->i64Tokens -= TOKEN_BUCKET_TOKEN;
+    return TRUE;
+}
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* TOKENBUCKET_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -0,0 +1,429 @@
+/****************************************************************************
+ *
+ * MODULE:             Linux 6LoWPAN Routing daemon
+ *
+ * COMPONENT:          Statistics page reader
+ *
+ * REVISION:           $Revision$
+ *
+ * DATED:              $Date$
+ *
+ ****************************************************************************
+ *
+ * This software is owned by NXP B.V. and/or its supplier and is protected
+ * under applicable copyright laws. All rights are reserved. We grant You,
+ * and any third parties, a license to use this software solely and
+ * exclusively on NXP products [NXP Microcontrollers such as JN5148, JN5142, JN5139]. 
+ * You, and any third parties must reproduce the copyright and warranty notice
+ * and any other legend of ownership on each copy or partial copy of the 
+ * software.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+ * Copyright NXP B.V. 2012. All rights reserved
+ *
+ ***************************************************************************/
+
+
+
+/* Prints the counters and latency histograms a running 6LoWPANd publishes
+ * in its statistics page (see StatsPage.h). Reading the page takes no
+ * system calls once it is mapped, and never wakes the daemon, so it can be
+ * run as often as a monitoring agent likes. With an interval, the values
+ * are printed repeatedly along with the rate each counter has changed at.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "StatsPage.h"
+#include "Histogram.h"
+#include "Clock.h"
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Copies to attempt while the daemon keeps updating the page */
+#define STATS_READ_ATTEMPTS                 1000
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** A mapped page */
+typedef struct
+{
+    const tsStatsPageHeader *psPage;    /**< NULL if not mapped */
+    size_t              szSize;
+    ino_t               iInode;         /**< To notice the daemon restarting */
+} tsStatsMapping;
+
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
+
+static char **ppcNames;
+
+static int iNumNames;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static void print_usage_exit(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options] [name prefix...]\n", argv[0]);
+    fprintf(stderr, "  Options:\n");
+    fprintf(stderr, "    -h --help                  Print this help.\n");
+    fprintf(stderr, "    -I --interface <name>      Interface the daemon was started with. Default tun0.\n");
+    fprintf(stderr, "    -f --file <file>           Statistics page to read. Default " STATS_PAGE_DEFAULT_PATH ".\n", "<interface>");
+    fprintf(stderr, "    -i --interval <seconds>    Print again each interval, with rates.\n");
+    exit(EXIT_FAILURE);
+}
+
+
+static void vStatsUnmap(tsStatsMapping *psMapping)
+{
+    if (psMapping->psPage)
+    {
+        munmap((void *)psMapping->psPage, psMapping->szSize);
+        psMapping->psPage = NULL;
+    }
+}
+
+
+/** Map the page, checking that its layout is one this reader understands.
+ *  \return 0 on success, -1 on error
+ */
+static int iStatsMap(tsStatsMapping *psMapping, const char *pcPath)
+{
+    const tsStatsPageHeader *psPage;
+    struct stat sStat;
+    int iFd;
+    
+    iFd = open(pcPath, O_RDONLY | O_CLOEXEC);
+    if ((iFd < 0) || (fstat(iFd, &sStat) < 0))
+    {
+        fprintf(stderr, "Could not open %s (%s)\n", pcPath, strerror(errno));
+        if (iFd >= 0)
+        {
+            close(iFd);
+        }
+        return -1;
+    }
+    if (sStat.st_size < (off_t)sizeof(tsStatsPageHeader))
+    {
+        fprintf(stderr, "%s is not a statistics page\n", pcPath);
+        close(iFd);
+        return -1;
+    }
+    psPage = mmap(NULL, sStat.st_size, PROT_READ, MAP_SHARED, iFd, 0);
+    close(iFd);
+    if (psPage == MAP_FAILED)
+    {
+        fprintf(stderr, "Could not map %s (%s)\n", pcPath, strerror(errno));
+        return -1;
+    }
+    
+    psMapping->psPage   = psPage;
+    psMapping->szSize   = sStat.st_size;
+    psMapping->iInode   = sStat.st_ino;
+    
+    if ((psPage->u32Magic != STATS_PAGE_MAGIC) || (psPage->u32PageSize > sStat.st_size))
+    {
+        fprintf(stderr, "%s is not a statistics page\n", pcPath);
+        vStatsUnmap(psMapping);
+        return -1;
+    }
+    if ((psPage->u32Version != STATS_PAGE_VERSION) || (psPage->u32HeaderSize < sizeof(tsStatsPageHeader)) ||
+        (psPage->u32CounterSize < sizeof(tsStatsPageCounter)) || (psPage->u32HistogramSize < sizeof(tsStatsPageHistogram)))
+    {
+        fprintf(stderr, "%s has layout version %u, this reader understands %u\n", pcPath, psPage->u32Version, STATS_PAGE_VERSION);
+        vStatsUnmap(psMapping);
+        return -1;
+    }
+    return 0;
+}
+
+
+/** Take a consistent copy of the page.
+ *  \return 0 on success, -1 if the daemon never stopped updating it
+ */
+static int iStatsCopy(const tsStatsMapping *psMapping, tsStatsPageHeader *psCopy)
+{
+    const tsStatsPageHeader *psPage = psMapping->psPage;
+    uint32_t u32Sequence;
+    int i;
+    
+    for (i = 0; i < STATS_READ_ATTEMPTS; i++)
+    {
+        u32Sequence = __atomic_load_n(&psPage->u32Sequence, __ATOMIC_ACQUIRE);
+        if (u32Sequence & 1)
+        {
+            continue;
+        }
+        memcpy(psCopy, psPage, psPage->u32PageSize);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&psPage->u32Sequence, __ATOMIC_RELAXED) == u32Sequence)
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+static const tsStatsPageCounter *psStatsCounter(const tsStatsPageHeader *psPage, uint32_t u32Index)
+{
+    return (const tsStatsPageCounter *)((const uint8_t *)psPage + psPage->u32CounterOffset + u32Index * psPage->u32CounterSize);
+}
+
+
+static const tsStatsPageHistogram *psStatsHistogram(const tsStatsPageHeader *psPage, uint32_t u32Index)
+{
+    return (const tsStatsPageHistogram *)((const uint8_t *)psPage + psPage->u32HistogramOffset + u32Index * psPage->u32HistogramSize);
+}
+
+
+/** Whether a name was asked for on the command line */
+static int iStatsWanted(const char *pcName)
+{
+    int i;
+    
+    if (iNumNames == 0)
+    {
+        return 1;
+    }
+    for (i = 0; i < iNumNames; i++)
+    {
+        if (strncmp(pcName, ppcNames[i], strlen(ppcNames[i])) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/** Print a copy of the page, and rates since the previous copy if there is one */
+static void vStatsPrint(const tsStatsPageHeader *psPage, const tsStatsPageHeader *psPrevious)
+{
+    uint64_t u64Now = u64ClockNowUs();
+    double dElapsed = 0.0;
+    int bHeading = 0;
+    uint32_t i;
+    
+    printf("# 6LoWPANd %s pid %u up %llus module %s updated %llums ago\n", psPage->acVersion, psPage->u32Pid,
+           (unsigned long long)((psPage->u64UpdatedUs - psPage->u64StartedUs) / 1000000), psPage->acModuleState,
+           (unsigned long long)((u64Now > psPage->u64UpdatedUs) ? (u64Now - psPage->u64UpdatedUs) / 1000 : 0));
+    if (u64Now > psPage->u64UpdatedUs + 3 * (uint64_t)psPage->u32UpdateInterval)
+    {
+        printf("# stale, the daemon may have stopped\n");
+    }
+    
+    if (psPrevious && (psPrevious->u32Counters == psPage->u32Counters) && (psPage->u64UpdatedUs > psPrevious->u64UpdatedUs))
+    {
+        dElapsed = (psPage->u64UpdatedUs - psPrevious->u64UpdatedUs) / 1e6;
+    }
+    
+    for (i = 0; i < psPage->u32Counters; i++)
+    {
+        const tsStatsPageCounter *psCounter = psStatsCounter(psPage, i);
+        
+        if (!iStatsWanted(psCounter->acName))
+        {
+            continue;
+        }
+        /* Rates only mean something for counters, not gauges */
+        if ((dElapsed > 0.0) && strstr(psCounter->acName, "_total"))
+        {
+            const tsStatsPageCounter *psLast = psStatsCounter(psPrevious, i);
+            
+            printf("%-48s %20llu %12.1f/s\n", psCounter->acName, (unsigned long long)psCounter->u64Value,
+                   ((double)psCounter->u64Value - (double)psLast->u64Value) / dElapsed);
+        }
+        else
+        {
+            printf("%-48s %20llu\n", psCounter->acName, (unsigned long long)psCounter->u64Value);
+        }
+    }
+    
+    for (i = 0; i < psPage->u32Histograms; i++)
+    {
+        const tsStatsPageHistogram *psEntry = psStatsHistogram(psPage, i);
+        static tsHistogram sHistogram;
+        double adPercentiles[4] = { 0.0, 0.0, 0.0, 0.0 };
+        
+        if (!iStatsWanted(psEntry->acName))
+        {
+            continue;
+        }
+        if (!bHeading)
+        {
+            printf("# %-30s %10s %10s %10s %10s %10s %10s %10s %10s\n", "histogram", "count",
+                   "min_us", "mean_us", "p50_us", "p90_us", "p99_us", "p999_us", "max_us");
+            bHeading = 1;
+        }
+        
+        /* Percentiles need the bucket layout to match this reader's */
+        if ((psPage->u32HistogramBuckets == HISTOGRAM_BUCKETS) && (psPage->u32HistogramSubBucketBits == HISTOGRAM_SUB_BUCKET_BITS))
+        {
+            sHistogram.u64Count = psEntry->u64Count;
+            sHistogram.u64Sum   = psEntry->u64Sum;
+            sHistogram.u64Min   = psEntry->u64Min;
+            sHistogram.u64Max   = psEntry->u64Max;
+            memcpy(sHistogram.au64Buckets, psEntry->au64Buckets, sizeof(sHistogram.au64Buckets));
+            adPercentiles[0] = u64HistogramPercentile(&sHistogram, 50.0) / 1000.0;
+            adPercentiles[1] = u64HistogramPercentile(&sHistogram, 90.0) / 1000.0;
+            adPercentiles[2] = u64HistogramPercentile(&sHistogram, 99.0) / 1000.0;
+            adPercentiles[3] = u64HistogramPercentile(&sHistogram, 99.9) / 1000.0;
+        }
+        printf("  %-30s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", psEntry->acName,
+               (unsigned long long)psEntry->u64Count,
+               psEntry->u64Count ? psEntry->u64Min / 1000.0 : 0.0,
+               psEntry->u64Count ? (double)psEntry->u64Sum / psEntry->u64Count / 1000.0 : 0.0,
+               adPercentiles[0], adPercentiles[1], adPercentiles[2], adPercentiles[3],
+               psEntry->u64Max / 1000.0);
+    }
+    fflush(stdout);
+}
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+    tsStatsMapping sMapping = { NULL, 0, 0 };
+    tsStatsPageHeader *psCopy = NULL;
+    tsStatsPageHeader *psPrevious = NULL;
+    const char *pcInterface = "tun0";
+    const char *pcFile = NULL;
+    char acPath[256];
+    uint32_t u32Interval = 0;
+    
+    {
+        static struct option long_options[] =
+        {
+            /* Program options */
+            {"help",                    no_argument,        NULL, 'h'},
+            {"interface",               required_argument,  NULL, 'I'},
+            {"file",                    required_argument,  NULL, 'f'},
+            {"interval",                required_argument,  NULL, 'i'},
+            { NULL, 0, NULL, 0}
+        };
+        signed char opt;
+        int option_index;
+        
+        while ((opt = getopt_long(argc, argv, "hI:f:i:", long_options, &option_index)) != -1) 
+        {
+            switch (opt) 
+            {
+                case 'I':
+                    pcInterface = optarg;
+                    break;
+                case 'f':
+                    pcFile = optarg;
+                    break;
+                case 'i':
+                    u32Interval = strtoul(optarg, NULL, 10);
+                    break;
+                case 'h':
+                default: /* '?' */
+                    print_usage_exit(argv);
+            }
+        }
+    }
+    ppcNames    = &argv[optind];
+    iNumNames   = argc - optind;
+    
+    if (pcFile)
+    {
+        snprintf(acPath, sizeof(acPath), "%s", pcFile);
+    }
+    else
+    {
+        snprintf(acPath, sizeof(acPath), STATS_PAGE_DEFAULT_PATH, pcInterface);
+    }
+    
+    while (1)
+    {
+        struct stat sStat;
+        
+        /* A restarted daemon publishes a new page */
+        if (sMapping.psPage && ((stat(acPath, &sStat) < 0) || (sStat.st_ino != sMapping.iInode)))
+        {
+            vStatsUnmap(&sMapping);
+            free(psPrevious);
+            psPrevious = NULL;
+        }
+        if (!sMapping.psPage)
+        {
+            if (iStatsMap(&sMapping, acPath) < 0)
+            {
+                if (u32Interval == 0)
+                {
+                    return EXIT_FAILURE;
+                }
+                sleep(u32Interval);
+                continue;
+            }
+        }
+        
+        psCopy = malloc(sMapping.psPage->u32PageSize);
+        if (!psCopy)
+        {
+            fprintf(stderr, "Out of memory\n");
+            return EXIT_FAILURE;
+        }
+        if (iStatsCopy(&sMapping, psCopy) < 0)
+        {
+            fprintf(stderr, "%s kept changing while being read\n", acPath);
+            free(psCopy);
+            return EXIT_FAILURE;
+        }
+        
+        vStatsPrint(psCopy, psPrevious);
+        free(psPrevious);
+        psPrevious = psCopy;
+        
+        if (u32Interval == 0)
+        {
+            break;
+        }
+        sleep(u32Interval);
+        printf("\n");
+    }
+    
+    free(psPrevious);
+    vStatsUnmap(&sMapping);
+    return EXIT_SUCCESS;
+}
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
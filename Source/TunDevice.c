@@ -45,14 +45,31 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/un.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
 #include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/icmp6.h>
 
 #include <libdaemon/daemon.h>
 
 #include "TunDevice.h"
 #include "JennicModule.h"
+#include "IPv6.h"
+#include "Filter.h"
+#include "Multicast.h"
+#include "NDProxy.h"
+#include "Mailbox.h"
+#include "JIPCache.h"
+#include "Coalesce.h"
+#include "NAT64.h"
+#include "ShmRing.h"
+#include "PacketGenerator.h"
+#include "Latency.h"
+#include "Clock.h"
+
+extern int verbosity;
 
 /** File descriptor for tun device */
 int tun_fd = 0;
@@ -60,8 +77,52 @@ int tun_fd = 0;
 /** Name of the tun device to create **/
 char *cpTunDevice = "tun0";
 
+/** Path MTU towards the 6LoWPAN network */
+uint32_t u32TunMTU = TUN_DEFAULT_MTU;
 
-teTunStatus eTunDeviceOpen(const char *dev)
+/** Where packets for local hosts are exchanged */
+const char *pcTunEndpoint = "tun";
+
+/** Tun device statistics */
+tsTunStats sTunStats;
+
+/** A way of exchanging packets with local hosts */
+typedef struct
+{
+    const char *pcPrefix;                       /**< Endpoint name prefix that selects it */
+    teTunStatus (*prOpen)(const char *pcAddress, const char *dev);
+    int (*prRead)(uint8_t *pu8Buffer, uint32_t u32Size);        /**< Length read, 0 if none, -1 on error */
+    int (*prWrite)(const uint8_t *pu8Data, uint32_t u32Length); /**< Length written, 0 if dropped, -1 on error */
+    uint32_t u32Burst;                          /**< Packets read each time tun_fd is readable */
+} tsTunEndpoint;
+
+static teTunStatus eTunEndpointOpenTun(const char *pcAddress, const char *dev);
+static teTunStatus eTunEndpointOpenUDP(const char *pcAddress, const char *dev);
+static teTunStatus eTunEndpointOpenUnix(const char *pcAddress, const char *dev);
+static teTunStatus eTunEndpointOpenGenerator(const char *pcAddress, const char *dev);
+static teTunStatus eTunEndpointOpenSink(const char *pcAddress, const char *dev);
+static int iTunEndpointRead(uint8_t *pu8Buffer, uint32_t u32Size);
+static int iTunEndpointWrite(const uint8_t *pu8Data, uint32_t u32Length);
+static int iTunEndpointRecv(uint8_t *pu8Buffer, uint32_t u32Size);
+static int iTunEndpointSend(const uint8_t *pu8Data, uint32_t u32Length);
+
+static const tsTunEndpoint asEndpoints[] =
+{
+    { "tun",    eTunEndpointOpenTun,        iTunEndpointRead,       iTunEndpointWrite,      1 },
+    { "udp:",   eTunEndpointOpenUDP,        iTunEndpointRecv,       iTunEndpointSend,       1 },
+    { "unix:",  eTunEndpointOpenUnix,       iTunEndpointRecv,       iTunEndpointSend,       1 },
+    { "gen:",   eTunEndpointOpenGenerator,  iPacketGeneratorRead,   iPacketGeneratorSink,   GENERATOR_MAX_BURST },
+    { "sink",   eTunEndpointOpenSink,       iPacketGeneratorRead,   iPacketGeneratorSink,   1 },
+};
+
+static const tsTunEndpoint *psEndpoint = NULL;
+
+/** Where packets are sent back: the configured or first UDP peer, or the UNIX socket that spoke last */
+static struct sockaddr_storage sTunPeer;
+static socklen_t iTunPeerLength = 0;
+
+
+static teTunStatus eTunEndpointOpenTun(const char *pcAddress, const char *dev)
 {
     struct ifreq ifr;
     int fd, err;
@@ -100,22 +161,345 @@ teTunStatus eTunDeviceOpen(const char *dev)
 }
 
 
-teTunStatus eTunDeviceReadPacket(void)
+/** Exchange packets as UDP datagrams, one packet per datagram.
+ *  "udp:[<address>:]<port>[,<peer address>:<peer port>]"
+ *  The address defaults to the IPv6 loopback address. Only the peer is
+ *  answered, or without one the first host to send a packet.
+ */
+static teTunStatus eTunEndpointOpenUDP(const char *pcAddress, const char *dev)
+{
+    struct sockaddr_in6 sAddr, sPeer;
+    char acAddress[2 * (INET6_ADDRSTRLEN + 8)];
+    char *pcPeer;
+    int iZero = 0;
+    
+    if (strlen(pcAddress) >= sizeof(acAddress))
+    {
+        daemon_log(LOG_ERR, "Invalid endpoint \"%s\"", pcAddress);
+        return E_TUN_ERROR;
+    }
+    strcpy(acAddress, pcAddress);
+    pcPeer = strchr(acAddress, ',');
+    if (pcPeer)
+    {
+        *pcPeer++ = '\0';
+    }
+    
+    memset(&sAddr, 0, sizeof(sAddr));
+    sAddr.sin6_family   = AF_INET6;
+    sAddr.sin6_addr     = in6addr_loopback;
+    if (iIPv6ParseSocketAddress(acAddress, &sAddr) < 0)
+    {
+        daemon_log(LOG_ERR, "Invalid endpoint address \"%s\"", acAddress);
+        return E_TUN_ERROR;
+    }
+    
+    memset(&sPeer, 0, sizeof(sPeer));
+    if (pcPeer && ((strchr(pcPeer, ':') == NULL) || (iIPv6ParseSocketAddress(pcPeer, &sPeer) < 0)))
+    {
+        daemon_log(LOG_ERR, "Invalid endpoint peer \"%s\", an address and port are needed", pcPeer);
+        return E_TUN_ERROR;
+    }
+    
+    tun_fd = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if ((tun_fd < 0) ||
+        /* Given the unspecified or an IPv4 mapped address, accept IPv4 senders too */
+        ((IN6_IS_ADDR_UNSPECIFIED(&sAddr.sin6_addr) || IN6_IS_ADDR_V4MAPPED(&sAddr.sin6_addr)) &&
+         (setsockopt(tun_fd, IPPROTO_IPV6, IPV6_V6ONLY, &iZero, sizeof(iZero)) < 0)) ||
+        (bind(tun_fd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0) ||
+        (pcPeer && (connect(tun_fd, (struct sockaddr *)&sPeer, sizeof(sPeer)) < 0)))
+    {
+        daemon_log(LOG_ERR, "Could not open UDP endpoint \"%s\" (%s)", pcAddress, strerror(errno));
+        return E_TUN_ERROR;
+    }
+    if (pcPeer)
+    {
+        memcpy(&sTunPeer, &sPeer, sizeof(sPeer));
+        iTunPeerLength = sizeof(sPeer);
+    }
+    daemon_log(LOG_INFO, "Exchanging packets for local hosts on UDP port %d", ntohs(sAddr.sin6_port));
+    return E_TUN_OK;
+}
+
+
+/** Exchange packets as datagrams on a UNIX socket. "unix:<path>" */
+static teTunStatus eTunEndpointOpenUnix(const char *pcAddress, const char *dev)
 {
-    unsigned char buf[2048];
+    struct sockaddr_un sAddr;
+    
+    if (strlen(pcAddress) >= sizeof(sAddr.sun_path))
+    {
+        daemon_log(LOG_ERR, "Endpoint socket path too long");
+        return E_TUN_ERROR;
+    }
+    memset(&sAddr, 0, sizeof(sAddr));
+    sAddr.sun_family = AF_UNIX;
+    strcpy(sAddr.sun_path, pcAddress);
+    
+    /* Remove a socket left by a previous run */
+    unlink(pcAddress);
+    
+    tun_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if ((tun_fd < 0) || (bind(tun_fd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0))
+    {
+        daemon_log(LOG_ERR, "Could not open endpoint socket \"%s\" (%s)", pcAddress, strerror(errno));
+        return E_TUN_ERROR;
+    }
+    daemon_log(LOG_INFO, "Exchanging packets for local hosts on %s", pcAddress);
+    return E_TUN_OK;
+}
+
+
+static teTunStatus eTunEndpointOpenGenerator(const char *pcAddress, const char *dev)
+{
+    tun_fd = iPacketGeneratorOpen(pcAddress);
+    return (tun_fd < 0) ? E_TUN_ERROR : E_TUN_OK;
+}
+
+
+static teTunStatus eTunEndpointOpenSink(const char *pcAddress, const char *dev)
+{
+    tun_fd = iPacketGeneratorOpen(NULL);
+    return (tun_fd < 0) ? E_TUN_ERROR : E_TUN_OK;
+}
+
+
+static int iTunEndpointRead(uint8_t *pu8Buffer, uint32_t u32Size)
+{
+    return read(tun_fd, pu8Buffer, u32Size);
+}
+
+
+static int iTunEndpointWrite(const uint8_t *pu8Data, uint32_t u32Length)
+{
+    return write(tun_fd, pu8Data, u32Length);
+}
+
+
+static int iTunEndpointRecv(uint8_t *pu8Buffer, uint32_t u32Size)
+{
+    struct sockaddr_storage sFrom;
+    socklen_t iFromLength = sizeof(sFrom);
     int len;
-    len = read(tun_fd, buf, sizeof(buf));
-    if (len > 0)
+    
+    len = recvfrom(tun_fd, pu8Buffer, u32Size, MSG_DONTWAIT, (struct sockaddr *)&sFrom, &iFromLength);
+    if (len < 0)
     {
+        return ((errno == EAGAIN) || (errno == EINTR)) ? 0 : -1;
+    }
+    if (sFrom.ss_family == AF_UNIX)
+    {
+        if (iFromLength > sizeof(sa_family_t))
+        {
+            /* Answer whoever spoke last. Unbound UNIX sockets cannot be answered. */
+            memcpy(&sTunPeer, &sFrom, iFromLength);
+            iTunPeerLength = iFromLength;
+        }
+    }
+    else if (iTunPeerLength == 0)
+    {
+        /* The first UDP sender becomes the only one, connecting has the kernel drop the rest */
+        char acAddress[INET6_ADDRSTRLEN];
+        
+        memcpy(&sTunPeer, &sFrom, iFromLength);
+        iTunPeerLength = iFromLength;
+        if (connect(tun_fd, (struct sockaddr *)&sTunPeer, iTunPeerLength) < 0)
+        {
+            daemon_log(LOG_ERR, "Could not connect UDP endpoint to its peer (%s)", strerror(errno));
+        }
+        inet_ntop(AF_INET6, &((struct sockaddr_in6 *)&sTunPeer)->sin6_addr, acAddress, sizeof(acAddress));
+        daemon_log(LOG_INFO, "UDP endpoint peer is [%s]:%d", acAddress, ntohs(((struct sockaddr_in6 *)&sTunPeer)->sin6_port));
+    }
+    else if ((iFromLength != iTunPeerLength) || (memcmp(&sFrom, &sTunPeer, iFromLength) != 0))
+    {
+        /* Queued before the socket was connected */
+        return 0;
+    }
+    return len;
+}
+
+
+static int iTunEndpointSend(const uint8_t *pu8Data, uint32_t u32Length)
+{
+    if (iTunPeerLength == 0)
+    {
+        return 0;
+    }
+    if (sendto(tun_fd, pu8Data, u32Length, MSG_DONTWAIT, (struct sockaddr *)&sTunPeer, iTunPeerLength) < 0)
+    {
+        /* Peer gone or not keeping up - like a full tun queue, not an error */
+        return 0;
+    }
+    return u32Length;
+}
+
+
+/** Account for the time taken to pass on a message from the module.
+ *  \param u64Start     Time the write to the local host started, 0 if not timed
+ */
+static void vTunDeviceLatency(uint64_t u64Start)
+{
+    uint64_t u64Now;
+    
+    if (u64Start)
+    {
+        u64Now = u64ClockNowNs();
+        vLatencyRecord(E_LATENCY_RX_PROCESS, u64LatencyDecoded, u64Start);
+        vLatencyRecord(E_LATENCY_RX_WRITE, u64Start, u64Now);
+        vLatencyRecord(E_LATENCY_RX_TOTAL, u64LatencyDecoded, u64Now);
+    }
+}
+
+
+teTunStatus eTunDeviceOpen(const char *dev)
+{
+    uint32_t i;
+    
+    for (i = 0; i < sizeof(asEndpoints) / sizeof(tsTunEndpoint); i++)
+    {
+        if (strncmp(pcTunEndpoint, asEndpoints[i].pcPrefix, strlen(asEndpoints[i].pcPrefix)) == 0)
+        {
+            psEndpoint = &asEndpoints[i];
+            tun_fd = -1;
+            return psEndpoint->prOpen(pcTunEndpoint + strlen(psEndpoint->pcPrefix), dev);
+        }
+    }
+    daemon_log(LOG_ERR, "Unknown endpoint \"%s\"", pcTunEndpoint);
+    return E_TUN_ERROR;
+}
+
+
+void vTunDeviceClose(void)
+{
+    if (!psEndpoint)
+    {
+        return;
+    }
+    if (psEndpoint->prRead == iPacketGeneratorRead)
+    {
+        vPacketGeneratorReport();
+    }
+    if (tun_fd >= 0)
+    {
+        close(tun_fd);
+    }
+    if (psEndpoint->prOpen == eTunEndpointOpenUnix)
+    {
+        unlink(pcTunEndpoint + strlen(psEndpoint->pcPrefix));
+    }
+    psEndpoint = NULL;
+}
+
+
+teTunStatus eTunDeviceReadPacket(void)
+{
+    unsigned char acBuffer[NAT64_HEADROOM + 2048];
+    uint32_t i;
+    
+    for (i = 0; i < psEndpoint->u32Burst; i++)
+    {
+        unsigned char *buf = &acBuffer[NAT64_HEADROOM];
+        int len;
+        
+        if ((i > 0) && (u32JennicModuleTxQueueDepth() != 0))
+        {
+            /* Leave the rest until the queue has drained */
+            break;
+        }
+        
+        len = psEndpoint->prRead(buf, sizeof(acBuffer) - NAT64_HEADROOM);
+        if (len <= 0)
+        {
+            break;
+        }
+        u64LatencyIngress = u64ClockNowNs();
+        if ((buf[0] >> 4) == 4)
+        {
+            /* IPv4 host reaching the mesh through NAT64 */
+            uint32_t u32Length = len;
+            
+            buf = pu8NAT64ToIPv6(u64ClockNowUs(), buf, &u32Length);
+            if (!buf)
+            {
+                u64LatencyIngress = 0;
+                continue;
+            }
+            len = u32Length;
+        }
+        if (eTunDeviceHandlePacket(len, buf) != E_TUN_OK)
+        {
+            u64LatencyIngress = 0;
+            return E_TUN_ERROR;
+        }
+        u64LatencyIngress = 0;
+    }
+    return E_TUN_OK;
+}
+
+
+teTunStatus eTunDeviceHandlePacket(uint32_t u32Length, uint8_t *pu8Data)
+{
+    uint8_t u8Code;
+    
+    if (u32Length > u32TunMTU)
+    {
+        /* Too large for the 6LoWPAN network, let the sender know straight away */
+        sTunStats.u64OversizeDrops++;
+        sTunStats.u64OversizeBytes += u32Length;
+        eTunDeviceSendError(ICMP6_PACKET_TOO_BIG, 0, u32TunMTU, u32Length, pu8Data);
+    }
+    else if (u32Length > 0)
+    {
+        if (bNDProxyHandlePacket(pu8Data, u32Length))
+        {
+            /* Answered locally */
+            return E_TUN_OK;
+        }
+        
+        switch (eFilterPacket(u64ClockNowUs(), pu8Data, u32Length, &u8Code))
+        {
+            case E_FILTER_PASS:
+                break;
+            case E_FILTER_REJECT:
+                eTunDeviceSendError(ICMP6_DST_UNREACH, u8Code, 0, u32Length, pu8Data);
+                return E_TUN_OK;
+            default:
+                return E_TUN_OK;
+        }
+        
+        if (bJIPCacheRequest(u64ClockNowUs(), pu8Data, u32Length))
+        {
+            /* Answered from the JIP cache */
+            return E_TUN_OK;
+        }
+        
+        if ((u32Length >= IPV6_HEADER_LENGTH) && (pu8Data[24] == 0xFF) && !bMulticastForward(u64ClockNowUs(), pu8Data, u32Length))
+        {
+            /* Multicast the mesh does not need, or too much of it */
+            return E_TUN_OK;
+        }
+        
+        if (bCoalesceRequest(u64ClockNowUs(), pu8Data, u32Length))
+        {
+            /* Same request already on its way, the response will be copied */
+            return E_TUN_OK;
+        }
+        
+        if (bMailboxHold(u64ClockNowUs(), pu8Data, u32Length))
+        {
+            /* Destination is asleep, the packet will be sent when it wakes */
+            return E_TUN_OK;
+        }
+        
         // If there's data waiting for us on the TUN device, write it to the Jennic chip.
-        //printf("Data from TUN: %d bytes\n", len);
+        //printf("Data from TUN: %d bytes\n", u32Length);
         
-        //for (i = 0; i < len; i++)
-        //    printf("%x ", buf[i] & 0x000000FF);
+        //for (i = 0; i < u32Length; i++)
+        //    printf("%x ", pu8Data[i] & 0x000000FF);
         //printf("\n");
         
         // Send data to Jennic chip
-        if (eJennicModuleWriteIPv6(len, buf) != E_MODULE_OK)
+        if (eJennicModuleWriteIPv6(u32Length, pu8Data) != E_MODULE_OK)
         {
             daemon_log(LOG_ERR, "Error writing packet to module");
             return E_TUN_ERROR;
@@ -125,16 +509,79 @@ teTunStatus eTunDeviceReadPacket(void)
 }
 
 
+teTunStatus eTunDeviceSendError(uint8_t u8Type, uint8_t u8Code, uint32_t u32Parameter, uint32_t u32Length, uint8_t *pu8Data)
+{
+    uint8_t au8Error[IPV6_MIN_MTU];
+    struct in6_addr sSource = sModuleAddress;
+    uint32_t u32ErrorLength;
+    
+    if (!bIPv6ErrorPermitted(u64ClockNowUs(), pu8Data, u32Length, u8Type == ICMP6_PACKET_TOO_BIG))
+    {
+        return E_TUN_OK;
+    }
+    
+    if (IN6_IS_ADDR_UNSPECIFIED(&sSource))
+    {
+        /* Border router address not known yet - use fe80::1 */
+        sSource.s6_addr[0]  = 0xfe;
+        sSource.s6_addr[1]  = 0x80;
+        sSource.s6_addr[15] = 0x01;
+    }
+    
+    if (bNAT64SendError(u8Type, u8Code, u32Parameter, pu8Data, u32Length))
+    {
+        /* Translated from IPv4, answered with ICMP instead */
+        return E_TUN_OK;
+    }
+    
+    u32ErrorLength = u32IPv6BuildError(au8Error, &sSource, u8Type, u8Code, u32Parameter, pu8Data, u32Length);
+    
+    if (verbosity >= LOG_DEBUG)
+    {
+        daemon_log(LOG_DEBUG, "Sending ICMPv6 error type %d code %d for %u byte packet", u8Type, u8Code, u32Length);
+    }
+    
+    if (eTunDeviceWritePacket(u32ErrorLength, au8Error) != E_TUN_OK)
+    {
+        return E_TUN_ERROR;
+    }
+    
+    if (u8Type == ICMP6_PACKET_TOO_BIG)
+    {
+        sTunStats.u64PacketTooBigSent++;
+    }
+    else
+    {
+        sTunStats.u64UnreachableSent++;
+    }
+    return E_TUN_OK;
+}
+
+
 teTunStatus eTunDeviceWritePacket(uint32_t u32Length, uint8_t *pu8Data)
 {
+    uint64_t u64Start = u64LatencyDecoded ? u64ClockNowNs() : 0;
     int len;
 
-    len = write(tun_fd, pu8Data, u32Length);
+    if (bShmRingDeliver(u32Length, pu8Data))
+    {
+        /* For a local application, bypassing the kernel */
+        vTunDeviceLatency(u64Start);
+        return E_TUN_OK;
+    }
+    
+    len = psEndpoint->prWrite(pu8Data, u32Length);
+    vTunDeviceLatency(u64Start);
     if (len == u32Length)
     {
         //printf("Data to TUN: %d bytes (%d)\n", len, psMsg->u16Length);
         return E_TUN_OK;
     }
+    if (len == 0)
+    {
+        sTunStats.u64EndpointDrops++;
+        return E_TUN_OK;
+    }
     return E_TUN_ERROR;
 }
 
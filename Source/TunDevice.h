@@ -54,6 +54,9 @@ extern "C" {
 /***        Macro Definitions                                             ***/
 /****************************************************************************/
 
+/** Default path MTU towards the 6LoWPAN network */
+#define TUN_DEFAULT_MTU             1280
+
 /****************************************************************************/
 /***        Type Definitions                                              ***/
 /****************************************************************************/
@@ -67,6 +70,17 @@ typedef enum
 } teTunStatus;
 
 
+/** Tun device statistics */
+typedef struct
+{
+    uint64_t    u64OversizeDrops;       /**< Packets dropped for exceeding the path MTU */
+    uint64_t    u64OversizeBytes;       /**< Bytes in packets dropped for exceeding the path MTU */
+    uint64_t    u64PacketTooBigSent;    /**< ICMPv6 Packet Too Big messages returned to the host */
+    uint64_t    u64UnreachableSent;     /**< ICMPv6 Destination Unreachable messages returned to the host */
+    uint64_t    u64EndpointDrops;       /**< Packets for local hosts that a datagram endpoint could not send */
+} tsTunStats;
+
+
 /****************************************************************************/
 /***        Local Function Prototypes                                     ***/
 /****************************************************************************/
@@ -84,6 +98,26 @@ extern int tun_fd;
 extern char *cpTunDevice;
 
 
+/** Where packets for local hosts are exchanged:
+ *  - "tun" creates the tun device cpTunDevice
+ *  - "udp:[<address>:]<port>[,<peer address>:<peer port>]" one packet per UDP
+ *    datagram, on the loopback address unless one is given. Only the peer is
+ *    answered, or without one the first host to send.
+ *  - "unix:<path>" one packet per datagram on a UNIX socket, answering the last sender
+ *  - "gen:<destination>[,<packets per second>[,<length>]]" in-process echo generator
+ *  - "sink" discards packets for local hosts
+ */
+extern const char *pcTunEndpoint;
+
+
+/** Largest IPv6 packet forwarded to the 6LoWPAN network */
+extern uint32_t u32TunMTU;
+
+
+/** Tun device statistics */
+extern tsTunStats sTunStats;
+
+
 /****************************************************************************/
 /***        Local Variables                                               ***/
 /****************************************************************************/
@@ -93,20 +127,55 @@ extern char *cpTunDevice;
 /****************************************************************************/
 
 
-/** Open tun device
- *  \param dev          Name of device to create
+/** Open the endpoint selected by pcTunEndpoint, setting tun_fd
+ *  \param dev          Name of tun device to create
  *  \return E_TUN_OK if opened ok
  */
 teTunStatus eTunDeviceOpen(const char *dev);
 
 
-/** Read available data from the tun device
+/** Close the endpoint, reporting generator results if it was the generator */
+void vTunDeviceClose(void);
+
+
+/** Read available data from the endpoint.
+ *  IPv4 packets are translated to IPv6 by NAT64 first, then the packet is
+ *  passed to eTunDeviceHandlePacket.
  *  \return E_TUN_OK if all ok
  */
 teTunStatus eTunDeviceReadPacket(void);
 
 
-/** Write available data to the tun device
+/** Send an IPv6 packet from a local host towards the mesh.
+ *  Packets larger than u32TunMTU are dropped and answered with an
+ *  ICMPv6 Packet Too Big message written back to the tun device.
+ *  Neighbor Discovery queries about known mesh nodes are answered
+ *  locally. Other packets pass through the egress filter, and multicast through
+ *  the multicast policy, before being queued to the module. JIP requests
+ *  may be answered from the JIP cache, requests identical to one already in
+ *  flight are coalesced, and packets for sleeping nodes are held in the
+ *  node's mailbox.
+ *  \param u32Length    Length of the packet
+ *  \param pu8Data      IPv6 packet
+ *  \return E_TUN_OK if all ok
+ */
+teTunStatus eTunDeviceHandlePacket(uint32_t u32Length, uint8_t *pu8Data);
+
+
+/** Answer a packet read from the tun device with an ICMPv6 error,
+ *  subject to the ICMPv6 error rate limit.
+ *  \param u8Type       ICMPv6 type
+ *  \param u8Code       ICMPv6 code
+ *  \param u32Parameter Type specific parameter (MTU, pointer)
+ *  \param u32Length    Length of the packet
+ *  \param pu8Data      Packet that caused the error
+ *  \return E_TUN_OK unless the error could not be written
+ */
+teTunStatus eTunDeviceSendError(uint8_t u8Type, uint8_t u8Code, uint32_t u32Parameter, uint32_t u32Length, uint8_t *pu8Data);
+
+
+/** Write available data to the tun device, or to the shared memory ring
+ *  of a local application that owns the destination address
  *  \param u32Length    Amount of data available
  *  \param pu8Data      Data to write
  *  \return E_TUN_OK if data written ok
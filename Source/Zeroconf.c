@@ -36,15 +36,32 @@
  *
  ***************************************************************************/
 
-#include <time.h>
+/* The JIP service and the border router's host name are published through
+ * the Avahi daemon. The Avahi client is driven from the daemon's main loop:
+ * the AvahiPoll below keeps Avahi's watches and timeouts in lists that the
+ * main loop adds to its select sets and services each time round, so no
+ * thread is needed and the registration is only ever touched from one
+ * place.
+ *
+ * When the module reports a new address the entry group is reset and
+ * filled again, leaving the client connection alone. If the Avahi daemon
+ * goes away the client waits for it to come back (AVAHI_CLIENT_NO_FAIL);
+ * if the client or the registration fails outright, it is tried again
+ * after ZEROCONF_RETRY_INTERVAL from a timeout on the same loop.
+ */
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
-#include <pthread.h>
 #include <arpa/inet.h>
 #include <string.h>
 #include <errno.h>
-#include <unistd.h>
+#include <sys/time.h>
 
 #include <libdaemon/daemon.h>
 
@@ -52,21 +69,282 @@
 #include <avahi-client/publish.h>
 
 #include <avahi-common/alternative.h>
-#include <avahi-common/simple-watch.h>
+#include <avahi-common/watch.h>
 #include <avahi-common/malloc.h>
 #include <avahi-common/error.h>
 #include <avahi-common/timeval.h>
 
-static AvahiEntryGroup *group = NULL;
-static AvahiSimplePoll *simple_poll = NULL;
+#include "Zeroconf.h"
+
+/****************************************************************************/
+/***        Type Definitions                                              ***/
+/****************************************************************************/
+
+/** Descriptor Avahi is waiting on */
+struct AvahiWatch
+{
+    int                     iFd;
+    AvahiWatchEvent         eEvents;            /**< Events wanted */
+    AvahiWatchEvent         eReturnedEvents;    /**< Events seen by the last select */
+    AvahiWatchCallback      prCallback;
+    void                   *pvUserData;
+    bool                    bDead;              /**< Freed by Avahi, unlinked at the next iZeroconfSetFds */
+    struct AvahiWatch      *psNext;
+};
+
+
+/** Avahi timeout */
+struct AvahiTimeout
+{
+    struct timeval          sExpiry;            /**< Wall clock time, as Avahi uses */
+    bool                    bEnabled;
+    AvahiTimeoutCallback    prCallback;
+    void                   *pvUserData;
+    bool                    bDead;              /**< Freed by Avahi, unlinked at the next iZeroconfSetFds */
+    struct AvahiTimeout    *psNext;
+};
+
+/****************************************************************************/
+/***        Local Function Prototypes                                     ***/
+/****************************************************************************/
+
+static AvahiWatch *psWatchNew(const AvahiPoll *psPoll, int iFd, AvahiWatchEvent eEvents, AvahiWatchCallback prCallback, void *pvUserData);
+static void vWatchUpdate(AvahiWatch *psWatch, AvahiWatchEvent eEvents);
+static AvahiWatchEvent eWatchGetEvents(AvahiWatch *psWatch);
+static void vWatchFree(AvahiWatch *psWatch);
+static AvahiTimeout *psTimeoutNew(const AvahiPoll *psPoll, const struct timeval *psExpiry, AvahiTimeoutCallback prCallback, void *pvUserData);
+static void vTimeoutUpdate(AvahiTimeout *psTimeout, const struct timeval *psExpiry);
+static void vTimeoutFree(AvahiTimeout *psTimeout);
+
+static void create_services(AvahiClient *c);
 
-static int iClientRunning = 0;
+/****************************************************************************/
+/***        Local Variables                                               ***/
+/****************************************************************************/
 
+/** Poll adapter handed to Avahi */
+static const AvahiPoll sPoll =
+{
+    .userdata           = NULL,
+    .watch_new          = psWatchNew,
+    .watch_update       = vWatchUpdate,
+    .watch_get_events   = eWatchGetEvents,
+    .watch_free         = vWatchFree,
+    .timeout_new        = psTimeoutNew,
+    .timeout_update     = vTimeoutUpdate,
+    .timeout_free       = vTimeoutFree,
+};
+
+static AvahiWatch   *psWatches = NULL;
+static AvahiTimeout *psTimeouts = NULL;
+
+static AvahiClient      *client = NULL;
+static AvahiEntryGroup  *group = NULL;
+
+/** Timeout to reconnect or register again after a failure */
+static AvahiTimeout *psRetryTimeout = NULL;
+
+/** Names in use, changed from those requested after a collision */
 static char *name       = NULL;
 static char *hostname   = NULL;
 static char *address    = NULL;
 
-static void create_services(AvahiClient *c);
+/** Names as last requested, to tell whether an update changes anything */
+static char *pcRequestedName        = NULL;
+static char *pcRequestedHostname    = NULL;
+
+/****************************************************************************/
+/***        Local Functions                                               ***/
+/****************************************************************************/
+
+static AvahiWatch *psWatchNew(const AvahiPoll *psPoll, int iFd, AvahiWatchEvent eEvents, AvahiWatchCallback prCallback, void *pvUserData)
+{
+    AvahiWatch *psWatch;
+    
+    psWatch = malloc(sizeof(AvahiWatch));
+    if (!psWatch)
+    {
+        return NULL;
+    }
+    
+    psWatch->iFd                = iFd;
+    psWatch->eEvents            = eEvents;
+    psWatch->eReturnedEvents    = 0;
+    psWatch->prCallback         = prCallback;
+    psWatch->pvUserData         = pvUserData;
+    psWatch->bDead              = FALSE;
+    psWatch->psNext             = psWatches;
+    psWatches = psWatch;
+    return psWatch;
+}
+
+
+static void vWatchUpdate(AvahiWatch *psWatch, AvahiWatchEvent eEvents)
+{
+    psWatch->eEvents = eEvents;
+}
+
+
+static AvahiWatchEvent eWatchGetEvents(AvahiWatch *psWatch)
+{
+    return psWatch->eReturnedEvents;
+}
+
+
+static void vWatchFree(AvahiWatch *psWatch)
+{
+    /* Avahi may free a watch from inside a callback while the list is
+     * being walked, so it is only unlinked later. */
+    psWatch->bDead = TRUE;
+}
+
+
+static AvahiTimeout *psTimeoutNew(const AvahiPoll *psPoll, const struct timeval *psExpiry, AvahiTimeoutCallback prCallback, void *pvUserData)
+{
+    AvahiTimeout *psTimeout;
+    
+    psTimeout = malloc(sizeof(AvahiTimeout));
+    if (!psTimeout)
+    {
+        return NULL;
+    }
+    
+    psTimeout->prCallback   = prCallback;
+    psTimeout->pvUserData   = pvUserData;
+    psTimeout->bDead        = FALSE;
+    vTimeoutUpdate(psTimeout, psExpiry);
+    psTimeout->psNext       = psTimeouts;
+    psTimeouts = psTimeout;
+    return psTimeout;
+}
+
+
+static void vTimeoutUpdate(AvahiTimeout *psTimeout, const struct timeval *psExpiry)
+{
+    if (psExpiry)
+    {
+        psTimeout->sExpiry = *psExpiry;
+        psTimeout->bEnabled = TRUE;
+    }
+    else
+    {
+        psTimeout->bEnabled = FALSE;
+    }
+}
+
+
+static void vTimeoutFree(AvahiTimeout *psTimeout)
+{
+    psTimeout->bDead = TRUE;
+}
+
+
+/** Unlink and free the watches and timeouts Avahi has finished with */
+static void vZeroconfSweep(void)
+{
+    AvahiWatch **ppsWatch = &psWatches;
+    AvahiTimeout **ppsTimeout = &psTimeouts;
+    
+    while (*ppsWatch)
+    {
+        AvahiWatch *psWatch = *ppsWatch;
+        
+        if (psWatch->bDead)
+        {
+            *ppsWatch = psWatch->psNext;
+            free(psWatch);
+        }
+        else
+        {
+            ppsWatch = &psWatch->psNext;
+        }
+    }
+    
+    while (*ppsTimeout)
+    {
+        AvahiTimeout *psTimeout = *ppsTimeout;
+        
+        if (psTimeout->bDead)
+        {
+            *ppsTimeout = psTimeout->psNext;
+            free(psTimeout);
+        }
+        else
+        {
+            ppsTimeout = &psTimeout->psNext;
+        }
+    }
+}
+
+
+static void client_callback(AvahiClient *c, AvahiClientState state, AVAHI_GCC_UNUSED void * userdata);
+
+
+/** Connect to the Avahi daemon */
+static void vZeroconfConnect(void)
+{
+    int error;
+    
+    daemon_log(LOG_DEBUG, "Starting avahi client.");
+    
+    client = avahi_client_new(&sPoll, AVAHI_CLIENT_NO_FAIL, client_callback, NULL, &error);
+    if (!client)
+    {
+        daemon_log(LOG_ERR, "Failed to create Avahi client: %s", avahi_strerror(error));
+    }
+}
+
+
+static void vZeroconfRetry(AvahiTimeout *psTimeout, AVAHI_GCC_UNUSED void *userdata)
+{
+    if (client && (avahi_client_get_state(client) == AVAHI_CLIENT_FAILURE))
+    {
+        /* Start again with a new connection */
+        if (group)
+        {
+            avahi_entry_group_free(group);
+            group = NULL;
+        }
+        avahi_client_free(client);
+        client = NULL;
+    }
+    
+    if (!client)
+    {
+        vZeroconfConnect();
+        if (!client)
+        {
+            vTimeoutUpdate(psTimeout, avahi_elapse_time(&psTimeout->sExpiry, ZEROCONF_RETRY_INTERVAL * 1000, 0));
+        }
+    }
+    else if (avahi_client_get_state(client) == AVAHI_CLIENT_S_RUNNING)
+    {
+        if (group)
+        {
+            avahi_entry_group_reset(group);
+        }
+        create_services(client);
+    }
+}
+
+
+/** Try again after ZEROCONF_RETRY_INTERVAL. This is not done straight away,
+ *  as the client cannot be freed from inside its own callback. */
+static void vZeroconfScheduleRetry(void)
+{
+    struct timeval sExpiry;
+    
+    avahi_elapse_time(&sExpiry, ZEROCONF_RETRY_INTERVAL * 1000, 0);
+    if (psRetryTimeout)
+    {
+        vTimeoutUpdate(psRetryTimeout, &sExpiry);
+    }
+    else
+    {
+        psRetryTimeout = psTimeoutNew(&sPoll, &sExpiry, vZeroconfRetry, NULL);
+    }
+}
+
 
 static void entry_group_callback(AvahiEntryGroup *g, AvahiEntryGroupState state, AVAHI_GCC_UNUSED void *userdata) {
     assert(g == group || group == NULL);
@@ -105,6 +383,7 @@ static void entry_group_callback(AvahiEntryGroup *g, AvahiEntryGroupState state,
             daemon_log(LOG_INFO, "Service name collision, renaming service to '%s' on host '%s'", name, hostname);
 
             /* And recreate the services */
+            avahi_entry_group_reset(g);
             create_services(avahi_entry_group_get_client(g));
             break;
         }
@@ -114,7 +393,7 @@ static void entry_group_callback(AvahiEntryGroup *g, AvahiEntryGroupState state,
             daemon_log(LOG_WARNING, "Entry group failure: %s", avahi_strerror(avahi_client_errno(avahi_entry_group_get_client(g))));
 
             /* Some kind of failure happened while we were registering our services */
-            avahi_simple_poll_quit(simple_poll);
+            vZeroconfScheduleRetry();
             break;
 
         case AVAHI_ENTRY_GROUP_UNCOMMITED:
@@ -124,10 +403,14 @@ static void entry_group_callback(AvahiEntryGroup *g, AvahiEntryGroupState state,
 }
 
 static void create_services(AvahiClient *c) {
-    char *n;
+    char *n = NULL;
     int ret;
     assert(c);
 
+    /* Nothing to register until the module has reported its address */
+    if (!address)
+        return;
+
     /* If this is the first time we're called, let's create a new
      * entry group if necessary */
 
@@ -142,10 +425,11 @@ static void create_services(AvahiClient *c) {
 
     if (avahi_entry_group_is_empty(group))
     {
+        AvahiAddress sAddress;
+        
         n = avahi_strdup_printf("%s.local", hostname);
         daemon_log(LOG_DEBUG, "Adding hostname '%s'", n);
         
-        AvahiAddress sAddress;
         sAddress.proto = AVAHI_PROTO_INET6;
                     
         if (inet_pton(AF_INET6, address, &sAddress.data.ipv6) <= 0)
@@ -156,6 +440,9 @@ static void create_services(AvahiClient *c) {
 
         if ((ret = avahi_entry_group_add_address(group, AVAHI_IF_UNSPEC, AVAHI_PROTO_INET6, 0, n, &sAddress)) < 0)
         {
+            if (ret == AVAHI_ERR_COLLISION)
+                goto collision;
+
             daemon_log(LOG_WARNING, "Failed to add hostname: %s", avahi_strerror(ret));
             goto fail;
         }
@@ -173,6 +460,7 @@ static void create_services(AvahiClient *c) {
         }
 
         avahi_free(n);
+        n = NULL;
 
         /* Tell the server to register the service */
         if ((ret = avahi_entry_group_commit(group)) < 0) {
@@ -187,6 +475,7 @@ collision:
 
     /* A service name collision with a local service happened. Let's
      * pick a new name */
+    avahi_free(n);
     
     /* New hostname */
     n = avahi_alternative_host_name(hostname);
@@ -206,7 +495,8 @@ collision:
     return;
 
 fail:
-    avahi_simple_poll_quit(simple_poll);
+    avahi_free(n);
+    vZeroconfScheduleRetry();
 }
 
 
@@ -224,7 +514,7 @@ static void client_callback(AvahiClient *c, AvahiClientState state, AVAHI_GCC_UN
 
         case AVAHI_CLIENT_FAILURE:
             daemon_log(LOG_WARNING, "Client failure: %s", avahi_strerror(avahi_client_errno(c)));
-            avahi_simple_poll_quit(simple_poll);
+            vZeroconfScheduleRetry();
             break;
 
         case AVAHI_CLIENT_S_COLLISION:
@@ -244,7 +534,16 @@ static void client_callback(AvahiClient *c, AvahiClientState state, AVAHI_GCC_UN
             break;
 
         case AVAHI_CLIENT_CONNECTING:
+            /* The Avahi daemon is not running, or has restarted. The
+             * client goes back to AVAHI_CLIENT_S_RUNNING when it is
+             * back, and the services are registered again then. The
+             * old entry group went with the old daemon. */
             daemon_log(LOG_DEBUG, "Connecting to Avahi daemon");
+            if (group)
+            {
+                avahi_entry_group_free(group);
+                group = NULL;
+            }
             break;
             
         default:
@@ -253,107 +552,203 @@ static void client_callback(AvahiClient *c, AvahiClientState state, AVAHI_GCC_UN
     }
 }
 
-static pthread_t sZC_ThreadInfo;
-static     AvahiClient *client = NULL;
 
+/** Replace a string, returning TRUE if it changed */
+static bool bZeroconfSetString(char **ppcString, const char *pcValue)
+{
+    if (*ppcString && (strcmp(*ppcString, pcValue) == 0))
+    {
+        return FALSE;
+    }
+    avahi_free(*ppcString);
+    *ppcString = avahi_strdup(pcValue);
+    return TRUE;
+}
 
-/** Zeroconf thread. This thread loops forever establishing the service with Avahi. */
-void *pvZC_Thread(void *args)
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+int ZC_RegisterService(const char *pcServiceName, const char *pcHostname, const char *pcNodeAddress)
 {
-    int error;
-    while (iClientRunning)
+    bool bChanged = FALSE;
+    
+    if (bZeroconfSetString(&pcRequestedName, pcServiceName))
     {
-        daemon_log(LOG_DEBUG, "Starting avahi client.");
-        
-        /* Allocate main loop object */
-        if (!(simple_poll = avahi_simple_poll_new()))
+        bZeroconfSetString(&name, pcServiceName);
+        bChanged = TRUE;
+    }
+    if (bZeroconfSetString(&pcRequestedHostname, pcHostname))
+    {
+        bZeroconfSetString(&hostname, pcHostname);
+        bChanged = TRUE;
+    }
+    if (bZeroconfSetString(&address, pcNodeAddress))
+    {
+        bChanged = TRUE;
+    }
+    
+    if (!name || !hostname || !address || !pcRequestedName || !pcRequestedHostname)
+    {
+        daemon_log(LOG_ERR, "Out of memory registering ZeroConf service");
+        return 1;
+    }
+    
+    if (!bChanged)
+    {
+        /* The module reports its address again whenever it restarts */
+        return 0;
+    }
+    
+    if (!client)
+    {
+        vZeroconfConnect();
+        if (!client)
         {
-            daemon_log(LOG_ERR, "Failed to create Avahi simple poll object.");
+            vZeroconfScheduleRetry();
         }
-        else
+    }
+    else if (avahi_client_get_state(client) == AVAHI_CLIENT_S_RUNNING)
+    {
+        /* Replace the records, keeping the connection */
+        if (group)
         {
-            /* Allocate a new client */
-            client = avahi_client_new(avahi_simple_poll_get(simple_poll), AVAHI_CLIENT_NO_FAIL, client_callback, NULL, &error);
+            avahi_entry_group_reset(group);
+        }
+        create_services(client);
+    }
+    /* Otherwise the services are registered when the client is running */
+    
+    return 0;
+}
 
-            /* Check wether creating the client object succeeded */
-            if (!client)
-            {
-                daemon_log(LOG_ERR, "Failed to create Avahi client: %s", avahi_strerror(error));
-            }
-            else
-            {
-                /* Run the main loop */
-                avahi_simple_poll_loop(simple_poll);
-                daemon_log(LOG_INFO, "Avahi client terminated");
-                /* Client terminated - most likely because the daemon exited */
-                
-                /* Cleanup things */
-                if (group)
-                {
-                    avahi_entry_group_free(group);
-                    group = NULL;
-                }
-                if (client)
-                {
-                    avahi_client_free(client);
-                    client = NULL;
-                }
-                if (simple_poll)
-                {
-                    avahi_simple_poll_free(simple_poll);
-                    simple_poll = NULL;
-                }
-            }
 
-            /* Sleep before trying to re-establish the service */
-            sleep(1);
-        }
+void vZeroconfClose(void)
+{
+    if (psRetryTimeout)
+    {
+        vTimeoutFree(psRetryTimeout);
+        psRetryTimeout = NULL;
+    }
+    if (group)
+    {
+        avahi_entry_group_free(group);
+        group = NULL;
     }
-    daemon_log(LOG_INFO, "Zeroconf thread exit");
-    return NULL;
+    if (client)
+    {
+        avahi_client_free(client);
+        client = NULL;
+    }
+    vZeroconfSweep();
+    
+    avahi_free(name);
+    avahi_free(hostname);
+    avahi_free(address);
+    avahi_free(pcRequestedName);
+    avahi_free(pcRequestedHostname);
+    name = hostname = address = pcRequestedName = pcRequestedHostname = NULL;
 }
 
 
-int ZC_RegisterService(const char *pcServiceName, const char *pcHostname, const char *pcNodeAddress)
+uint32_t u32ZeroconfService(void)
 {
-    if (iClientRunning)
+    AvahiTimeout *psTimeout;
+    AvahiUsec iWait = -1;
+    
+    /* Timeouts added or re-armed by a callback wait for the next pass,
+     * so one that is always due cannot hold up the main loop. New ones
+     * go on the front of the list, so are not reached here. */
+    for (psTimeout = psTimeouts; psTimeout; psTimeout = psTimeout->psNext)
     {
-        iClientRunning = 0;
-        
-        /* If we have an existing avahi client, tell it to quit */
-        if (simple_poll)
+        if (!psTimeout->bDead && psTimeout->bEnabled && (avahi_age(&psTimeout->sExpiry) >= 0))
         {
-            avahi_simple_poll_quit(simple_poll);
+            psTimeout->bEnabled = FALSE;
+            psTimeout->prCallback(psTimeout, psTimeout->pvUserData);
         }
-        
-        /* Wait for the avahi thread to exit */
-        pthread_join(sZC_ThreadInfo, NULL);
-        
-        /* Free storage */
-        avahi_free(name);
-        avahi_free(hostname);
-        avahi_free(address); 
     }
     
-    name = avahi_strdup(pcServiceName);
-    hostname = avahi_strdup(pcHostname);
-    address = avahi_strdup(pcNodeAddress);
-
-    /* Create thread to run the main loop */
-    if (pthread_create(&sZC_ThreadInfo, NULL, pvZC_Thread, NULL) != 0)
+    for (psTimeout = psTimeouts; psTimeout; psTimeout = psTimeout->psNext)
     {
-        daemon_log(LOG_ERR, "Error starting ZeroConf thread (%s)", strerror(errno));
-        goto fail;
+        if (!psTimeout->bDead && psTimeout->bEnabled)
+        {
+            AvahiUsec iAge = avahi_age(&psTimeout->sExpiry);
+            AvahiUsec iRemaining = (iAge >= 0) ? 1 : -iAge;
+            
+            if ((iWait < 0) || (iRemaining < iWait))
+            {
+                iWait = iRemaining;
+            }
+        }
     }
+    
+    if (iWait < 0)
+    {
+        return 0;
+    }
+    return (iWait > UINT32_MAX) ? UINT32_MAX : (uint32_t)iWait;
+}
 
-    iClientRunning = 1;
 
-    return 0;
+int iZeroconfSetFds(fd_set *psReadFds, fd_set *psWriteFds, int iMaxFd)
+{
+    AvahiWatch *psWatch;
+    
+    /* Nothing is being walked now, so finished watches can go */
+    vZeroconfSweep();
+    
+    for (psWatch = psWatches; psWatch; psWatch = psWatch->psNext)
+    {
+        psWatch->eReturnedEvents = 0;
+        if (psWatch->eEvents & AVAHI_WATCH_IN)
+        {
+            FD_SET(psWatch->iFd, psReadFds);
+        }
+        if (psWatch->eEvents & AVAHI_WATCH_OUT)
+        {
+            FD_SET(psWatch->iFd, psWriteFds);
+        }
+        if ((psWatch->eEvents & (AVAHI_WATCH_IN | AVAHI_WATCH_OUT)) && (psWatch->iFd > iMaxFd))
+        {
+            iMaxFd = psWatch->iFd;
+        }
+    }
+    return iMaxFd;
+}
 
-fail:
-    avahi_free(name);
-    avahi_free(hostname);
-    avahi_free(address);
 
-    return 1;
+bool bZeroconfHandleFd(int iFd, bool bReadable, bool bWritable)
+{
+    AvahiWatch *psWatch;
+    bool bFound = FALSE;
+    
+    for (psWatch = psWatches; psWatch; psWatch = psWatch->psNext)
+    {
+        if (psWatch->bDead || (psWatch->iFd != iFd))
+        {
+            continue;
+        }
+        bFound = TRUE;
+        
+        psWatch->eReturnedEvents = 0;
+        if (bReadable && (psWatch->eEvents & AVAHI_WATCH_IN))
+        {
+            psWatch->eReturnedEvents |= AVAHI_WATCH_IN;
+        }
+        if (bWritable && (psWatch->eEvents & AVAHI_WATCH_OUT))
+        {
+            psWatch->eReturnedEvents |= AVAHI_WATCH_OUT;
+        }
+        if (psWatch->eReturnedEvents)
+        {
+            psWatch->prCallback(psWatch, psWatch->iFd, psWatch->eReturnedEvents, psWatch->pvUserData);
+        }
+    }
+    return bFound;
 }
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -37,5 +37,83 @@
  ***************************************************************************/
 
 
+
+#ifndef  ZEROCONF_H_INCLUDED
+#define  ZEROCONF_H_INCLUDED
+
+#include <stdint.h>
+#include <sys/select.h>
+
+#include "SerialLink.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************/
+/***        Include files                                                 ***/
+/****************************************************************************/
+
+/****************************************************************************/
+/***        Macro Definitions                                             ***/
+/****************************************************************************/
+
+/** Time to wait before connecting to the Avahi daemon again, or
+ *  registering again after a failure, in seconds */
+#define ZEROCONF_RETRY_INTERVAL             5
+
+/****************************************************************************/
+/***        Exported Functions                                            ***/
+/****************************************************************************/
+
+
+/** Register the border router's JIP service and host name with Avahi, or
+ *  update them if they have changed. Registration carries on from the main
+ *  loop, and is repeated if the Avahi daemon restarts.
+ *  \param pcServiceName    Service name
+ *  \param pcHostname       Host name, without .local
+ *  \param pcNodeAddress    IPv6 address of the border router node
+ *  \return 0 on success
+ */
 int ZC_RegisterService(const char *pcServiceName, const char *pcHostname, const char *pcNodeAddress);
-    
\ No newline at end of file
+
+
+/** Withdraw the service and disconnect from Avahi */
+void vZeroconfClose(void);
+
+
+/** Run Avahi timeouts that have expired.
+ *  \return Microseconds until this needs to be called again, 0 if no
+ *          timeout is pending
+ */
+uint32_t u32ZeroconfService(void);
+
+
+/** Add the descriptors Avahi is waiting on to select sets.
+ *  \param psReadFds    Set of descriptors to wait to read
+ *  \param psWriteFds   Set of descriptors to wait to write
+ *  \param iMaxFd       Highest descriptor in the sets so far
+ *  \return Highest descriptor in the sets
+ */
+int iZeroconfSetFds(fd_set *psReadFds, fd_set *psWriteFds, int iMaxFd);
+
+
+/** Deal with a descriptor select has found ready.
+ *  \param iFd          Descriptor
+ *  \param bReadable    Descriptor is readable
+ *  \param bWritable    Descriptor is writable
+ *  \return TRUE if the descriptor belongs to Avahi
+ */
+bool bZeroconfHandleFd(int iFd, bool bReadable, bool bWritable);
+
+
+#if defined __cplusplus
+}
+#endif
+
+#endif  /* ZEROCONF_H_INCLUDED */
+
+/****************************************************************************/
+/***        END OF FILE                                                   ***/
+/****************************************************************************/
+
@@ -60,6 +60,26 @@
 #include "TunDevice.h"
 #include "Serial.h"
 #include "SerialLink.h"
+#include "Shaper.h"
+#include "IPv6.h"
+#include "Filter.h"
+#include "Multicast.h"
+#include "NodeTable.h"
+#include "NDProxy.h"
+#include "Mailbox.h"
+#include "JIPCache.h"
+#include "Coalesce.h"
+#include "NAT64.h"
+#include "ShmRing.h"
+#include "Control.h"
+#include "StatsPage.h"
+#include "Notify.h"
+#include "DumpFile.h"
+#ifdef USE_ZEROCONF
+#include "Zeroconf.h"
+#endif /* USE_ZEROCONF */
+#include "Latency.h"
+#include "Clock.h"
 
 #define vDelay(a) usleep(a * 1000)
 
@@ -89,12 +109,18 @@ const char *Version = "0.14 (r" VERSION ")";
 /** Baud rate to use for communications */
 static uint32_t u32BaudRate = 1000000;
 
-/** Program to run when network configuration changes */
-static const char *pcConfigProgram = NULL;
-
 /** Main loop running flag */
 volatile sig_atomic_t bRunning = 1;
 
+/** Flag that policy files should be reloaded */
+static volatile sig_atomic_t bReload = 0;
+
+/** Flag that the node table should be written out */
+static volatile sig_atomic_t bDumpNodes = 0;
+
+/** Directory the node table and latency dumps are written to */
+static const char *pcDumpDirectory = DUMP_FILE_DEFAULT_DIRECTORY;
+
 
 /** The signal handler just clears the running flag and re-enables itself. */
 static void vQuitSignalHandler (int sig)
@@ -106,25 +132,76 @@ static void vQuitSignalHandler (int sig)
 }
 
 
+/** SIGHUP handler flags that policy files should be reloaded from the main loop. */
+static void vReloadSignalHandler (int sig)
+{
+    bReload = 1;
+    signal (sig, vReloadSignalHandler);
+    return;
+}
+
+
+/** SIGUSR1 handler flags that the node table and latency histograms should be written to
+ *  <dump directory>/6LoWPANd.<interface>.nodes and <dump directory>/6LoWPANd.<interface>.latency */
+static void vDumpSignalHandler (int sig)
+{
+    bDumpNodes = 1;
+    signal (sig, vDumpSignalHandler);
+    return;
+}
+
+
+/** Reload policy files. The previous policy stays in force if a file is invalid. */
+static void vReloadPolicies(void)
+{
+    daemon_log(LOG_INFO, "Reloading policy files");
+    iFilterLoad();
+    iMulticastLoad();
+    iJIPCacheLoad();
+}
+
+
 static void print_usage_exit(char *argv[])
 {
     fprintf(stderr, "6LoWPANd Version: %s\n", Version);
     fprintf(stderr, "Usage: %s\n", argv[0]);
     fprintf(stderr, "  Arguments:\n");
     fprintf(stderr, "    -s --serial        <serial device>     Serial device for 15.4 module, e.g. /dev/tts/1\n");
+    fprintf(stderr, "                                           or pty[:<link>], tcp:<host>:<port>, tcp-listen:[<host>:]<port>, unix:<path>.\n");
     fprintf(stderr, "  Options:\n");
     fprintf(stderr, "    -h --help                              Print this help.\n");
     fprintf(stderr, "    -f --foreground                        Do not detatch daemon process, run in foreground.\n");
     fprintf(stderr, "    -v --verbosity     <verbosity>         Verbosity level. Increses amount of debug information. Default %d.\n",  LOG_INFO);
     fprintf(stderr, "    -B --baud          <baud rate>         Baud rate to communicate with border router node at. Default %d\n",     u32BaudRate);
     fprintf(stderr, "    -I --interface     <Interface>         Interface name to create. Default %s.\n", cpTunDevice);
+    fprintf(stderr, "    -E --endpoint      <endpoint>          Exchange packets for local hosts through tun, unix:<path>,\n");
+    fprintf(stderr, "                                           udp:[<address>:]<port>[,<peer address>:<peer port>],\n");
+    fprintf(stderr, "                                           gen:<destination>[,<packets per second>[,<length>]] or sink. Default %s.\n", pcTunEndpoint);
     fprintf(stderr, "    -R --reset                             Reset the coordinator node when 6LoWPANd exits. Default %d.\n", iResetCoordinator);
     fprintf(stderr, "    -C --confignotify  <program>           Program to run when the configuration of the 6LoWPAN network is known.\n");
     fprintf(stderr, "    -A --activityled   <DIO For LED>       Specify an DIO to toggle as an activity LED on the border router.\n");
+    fprintf(stderr, "    -M --mtu           <MTU>               Largest IPv6 packet to forward to the 6LoWPAN network. Default %d.\n", TUN_DEFAULT_MTU);
+    fprintf(stderr, "    -X --filter        <rules file>        Egress filter rules for packets to the 6LoWPAN network. Reloaded on SIGHUP.\n");
+    fprintf(stderr, "    -G --multicast     <policy file>       Multicast groups forwarded to the 6LoWPAN network. Reloaded on SIGHUP.\n");
+    fprintf(stderr, "    -L --noproxy                           Do not answer neighbor solicitations for known mesh nodes locally.\n");
+    fprintf(stderr, "    -J --jipcache      <policy file>       Answer repeated JIP GET requests from a cache. Reloaded on SIGHUP.\n");
+    fprintf(stderr, "    -K --nocoalesce                        Forward every JIP and CoAP request, even if an identical one is in flight.\n");
+    fprintf(stderr, "    -4 --nat64         <config file>       Translate between IPv4 hosts on the tun device and the 6LoWPAN network.\n");
+    fprintf(stderr, "    -Y --shmsocket     <socket path>       Let local applications exchange packets with the 6LoWPAN network through shared memory.\n");
+    fprintf(stderr, "    -Z --sleepy        <IPv6 address>      Hold packets for this sleeping node until it is heard from. May be repeated.\n");
+    fprintf(stderr, "    -W --sleepyresponse <seconds>          Treat nodes that take longer than this to respond as sleepy. Default %d (never).\n", MAILBOX_DEFAULT_SLEEPY_RESPONSE);
+    fprintf(stderr, "    -T --mailboxttl    <seconds>           Time to hold packets for sleeping nodes. Default %d.\n", MAILBOX_DEFAULT_TTL);
+    fprintf(stderr, "    -u --control       <socket path>       Accept commands, such as \"metrics\", on this UNIX socket.\n");
+    fprintf(stderr, "    -w --metrics       <[address:]port>    Serve metrics over HTTP for Prometheus. Address defaults to ::1.\n");
+    fprintf(stderr, "    -O --statsfile     <file>              Publish statistics in this memory mapped file, \"none\" to disable. Default " STATS_PAGE_DEFAULT_PATH ".\n", "<interface>");
+    fprintf(stderr, "    -d --dumpdir       <directory>         Write node table and latency dumps here on SIGUSR1. Default " DUMP_FILE_DEFAULT_DIRECTORY ".\n");
     
     fprintf(stderr, "  Module options\n");
     fprintf(stderr, "    -F --frontend      <SP,HP,ETSI>        Specify the frontend fitted to the radio. SP=Standard power,HP=High power, ETSI=ETSI compliant mode.\n");
     fprintf(stderr, "    -D --diversity                         Turn on antenna diversity.\n");
+    fprintf(stderr, "    -H --hops          <hop count>         Least radio hops to assume when pacing packets to the module. Default %d.\n", SHAPER_DEFAULT_HOPS);
+    fprintf(stderr, "    -N --noshaper                          Do not pace packets to the radio airtime available.\n");
+    fprintf(stderr, "    -U --unreliable                        Do not use the reliable serial link, even if the border router supports it.\n");
     
     fprintf(stderr, "  6LoWPAN Network options:\n");
     fprintf(stderr, "    -m --mode          <mode>              802.15.4 stack mode (coordinator, router, commissioning). Default coordinator.\n");
@@ -143,62 +220,14 @@ static void print_usage_exit(char *argv[])
 }
 
 
-/** Function to be called when the network configuration has been changed.
- *  This is actually run in a separate pthread, so that a blocking program 
- *  can't interrupt communications with the module
- */
-void *ConfigChangedCallback(void *arg)
-{
-    char acCommand[1024];
-    char acAddress[INET6_ADDRSTRLEN];
-    struct in6_addr sin6_addr;
-    int result;
-    
-    memset(&sin6_addr, 0, sizeof(struct in6_addr));
-    
-    sin6_addr.s6_addr[0] = (u64NetworkPrefix >> 56) & 0xFF;
-    sin6_addr.s6_addr[1] = (u64NetworkPrefix >> 48) & 0xFF;
-    sin6_addr.s6_addr[2] = (u64NetworkPrefix >> 40) & 0xFF;
-    sin6_addr.s6_addr[3] = (u64NetworkPrefix >> 32) & 0xFF;
-    sin6_addr.s6_addr[4] = (u64NetworkPrefix >> 24) & 0xFF;
-    sin6_addr.s6_addr[5] = (u64NetworkPrefix >> 16) & 0xFF;
-    sin6_addr.s6_addr[6] = (u64NetworkPrefix >>  8) & 0xFF;
-    sin6_addr.s6_addr[7] = (u64NetworkPrefix >>  0) & 0xFF;
-    
-    inet_ntop(AF_INET6, &sin6_addr, acAddress, INET6_ADDRSTRLEN);
-
-    result = sprintf(acCommand, "%s --channel=%d --pan=0x%04x --network=0x%08x --prefix=%s",
-                     pcConfigProgram, eChannel, u16PanID, u32UserData, acAddress);
-    
-    if (iSecureNetwork)
-    {
-        char buffer[INET6_ADDRSTRLEN] = "Could not determine address\n";
-        inet_ntop(AF_INET6, &sSecurityKey, buffer, INET6_ADDRSTRLEN);
-        
-        sprintf(&acCommand[result], " --key=%s", buffer);
-    }    
-    
-    daemon_log(LOG_DEBUG, "Running configuration notification:\n%s", acCommand);
-    
-    result = system(acCommand);
-    
-    if (result == 0)
-    {
-        daemon_log(LOG_INFO, "Configuration notification program run successfully");
-    }
-    else
-    {
-        daemon_log(LOG_ERR, "Configuration notification program result: %d\n", result);
-    }
-    return NULL;
-}
-
-
 int main(int argc, char *argv[])
 {
     fd_set rfds;
+    fd_set wfds;
     struct timeval tv;
     int retval;
+    uint64_t u64NextTick;
+    uint64_t u64NextHousekeeping;
     pid_t pid;
     char *cpSerialDevice = NULL;
 
@@ -214,13 +243,32 @@ int main(int argc, char *argv[])
             {"verbosity",               required_argument,  NULL, 'v'},
             {"baud",                    required_argument,  NULL, 'B'},
             {"interface",               required_argument,  NULL, 'I'},
+            {"endpoint",                required_argument,  NULL, 'E'},
             {"reset",                   no_argument,        NULL, 'R'},
             {"confignotify",            required_argument,  NULL, 'C'},
             {"activityled",             required_argument,  NULL, 'A'},
+            {"mtu",                     required_argument,  NULL, 'M'},
+            {"filter",                  required_argument,  NULL, 'X'},
+            {"multicast",               required_argument,  NULL, 'G'},
+            {"noproxy",                 no_argument,        NULL, 'L'},
+            {"jipcache",                required_argument,  NULL, 'J'},
+            {"nocoalesce",              no_argument,        NULL, 'K'},
+            {"nat64",                   required_argument,  NULL, '4'},
+            {"shmsocket",               required_argument,  NULL, 'Y'},
+            {"sleepy",                  required_argument,  NULL, 'Z'},
+            {"sleepyresponse",          required_argument,  NULL, 'W'},
+            {"mailboxttl",              required_argument,  NULL, 'T'},
+            {"control",                 required_argument,  NULL, 'u'},
+            {"metrics",                 required_argument,  NULL, 'w'},
+            {"statsfile",               required_argument,  NULL, 'O'},
+            {"dumpdir",                 required_argument,  NULL, 'd'},
 
             /* Module options */
             {"frontend",                required_argument,  NULL, 'F'},
             {"diversity",               no_argument,        NULL, 'D'},
+            {"hops",                    required_argument,  NULL, 'H'},
+            {"noshaper",                no_argument,        NULL, 'N'},
+            {"unreliable",              no_argument,        NULL, 'U'},
             
             /* 6LoWPAN network options */
             {"mode",                    required_argument,  NULL, 'm'},
@@ -243,7 +291,7 @@ int main(int argc, char *argv[])
         signed char opt;
         int option_index;
 
-        while ((opt = getopt_long(argc, argv, "s:hfv:B:I:RC:A:F:Dm:r:c:p:j:P:6:k:a:i:", long_options, &option_index)) != -1) 
+        while ((opt = getopt_long(argc, argv, "s:hfv:B:I:E:RC:A:M:X:G:LJ:K4:Y:Z:W:T:u:w:O:d:F:DH:NUm:r:c:p:j:P:6:k:a:i:", long_options, &option_index)) != -1) 
         {
             switch (opt) 
             {
@@ -285,8 +333,8 @@ int main(int argc, char *argv[])
                     if (stat(optarg, &sStat) == 0)
                     {
                         /* File stat'd ok */
-                        pcConfigProgram = optarg;
-                        vprConfigChanged = ConfigChangedCallback;
+                        pcNotifyProgram = optarg;
+                        vprConfigChanged = vNotifyConfigChanged;
                     }
                     else
                     {
@@ -316,6 +364,125 @@ int main(int argc, char *argv[])
                     break;
                 }
                 
+                case 'M':
+                {
+                    char *pcEnd;
+                    uint32_t u32MTU;
+                    errno = 0;
+                    u32MTU = strtoul(optarg, &pcEnd, 0);
+                    if (errno)
+                    {
+                        printf("MTU '%s' cannot be converted to 32 bit integer (%s)\n", optarg, strerror(errno));
+                        print_usage_exit(argv);
+                    }
+                    if (*pcEnd != '\0')
+                    {
+                        printf("MTU '%s' contains invalid characters\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    if ((u32MTU < IPV6_MIN_MTU) || (u32MTU > MODULE_MAX_PACKET_LENGTH))
+                    {
+                        printf("MTU must be between %d and %d\n", IPV6_MIN_MTU, MODULE_MAX_PACKET_LENGTH);
+                        print_usage_exit(argv);
+                    }
+                    u32TunMTU = u32MTU;
+                    break;
+                }
+                
+                case 'X':
+                    pcFilterRulesFile = optarg;
+                    break;
+                
+                case 'G':
+                    pcMulticastPolicyFile = optarg;
+                    break;
+                
+                case 'L':
+                    iNDProxyEnabled = 0;
+                    break;
+                
+                case 'J':
+                    pcJIPCachePolicyFile = optarg;
+                    break;
+                
+                case 'K':
+                    iCoalesceEnabled = 0;
+                    break;
+                
+                case '4':
+                    pcNAT64ConfigFile = optarg;
+                    break;
+                
+                case 'Y':
+                    pcShmRingSocket = optarg;
+                    break;
+                
+                case 'u':
+                    pcControlSocket = optarg;
+                    break;
+                
+                case 'w':
+                    pcControlMetricsAddress = optarg;
+                    break;
+                
+                case 'O':
+                    pcStatsPageFile = optarg;
+                    break;
+                
+                case 'd':
+                    pcDumpDirectory = optarg;
+                    break;
+                
+                case 'Z':
+                {
+                    struct in6_addr sAddress;
+                    
+                    if (inet_pton(AF_INET6, optarg, &sAddress) <= 0)
+                    {
+                        printf("Invalid sleepy node address '%s'\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    if (iMailboxAddSleepyNode(&sAddress) < 0)
+                    {
+                        printf("Could not add sleepy node '%s'\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    break;
+                }
+                
+                case 'W':
+                case 'T':
+                {
+                    char *pcEnd;
+                    uint32_t u32Seconds;
+                    errno = 0;
+                    u32Seconds = strtoul(optarg, &pcEnd, 0);
+                    if (errno)
+                    {
+                        printf("Time '%s' cannot be converted to 32 bit integer (%s)\n", optarg, strerror(errno));
+                        print_usage_exit(argv);
+                    }
+                    if (*pcEnd != '\0')
+                    {
+                        printf("Time '%s' contains invalid characters\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    if (opt == 'W')
+                    {
+                        u32MailboxSleepyResponse = u32Seconds;
+                    }
+                    else if ((u32Seconds == 0) || (u32Seconds > 3600))
+                    {
+                        printf("Mailbox TTL must be between 1 and 3600 seconds\n");
+                        print_usage_exit(argv);
+                    }
+                    else
+                    {
+                        u32MailboxTTL = u32Seconds;
+                    }
+                    break;
+                }
+                
                 case 'F':
                     if (strcmp(optarg, "SP") == 0)
                     {
@@ -340,6 +507,39 @@ int main(int argc, char *argv[])
                     iAntennaDiversity = 1;
                     break;
                     
+                case 'H':
+                {
+                    char *pcEnd;
+                    uint32_t u32Hops;
+                    errno = 0;
+                    u32Hops = strtoul(optarg, &pcEnd, 0);
+                    if (errno)
+                    {
+                        printf("Hop count '%s' cannot be converted to 32 bit integer (%s)\n", optarg, strerror(errno));
+                        print_usage_exit(argv);
+                    }
+                    if (*pcEnd != '\0')
+                    {
+                        printf("Hop count '%s' contains invalid characters\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    if ((u32Hops == 0) || (u32Hops > 0xFF))
+                    {
+                        printf("Invalid hop count '%s' specified\n", optarg);
+                        print_usage_exit(argv);
+                    }
+                    u8ShaperDefaultHops = (uint8_t)u32Hops;
+                    break;
+                }
+                
+                case 'N':
+                    iShaperEnabled = 0;
+                    break;
+                    
+                case 'U':
+                    iReliableSerialLink = 0;
+                    break;
+                    
                 case 'm':
                     if (strcmp(optarg, "coordinator") == 0)
                     {
@@ -511,6 +711,10 @@ int main(int argc, char *argv[])
                 case  'I':
                     cpTunDevice = optarg;
                     break;
+                
+                case 'E':
+                    pcTunEndpoint = optarg;
+                    break;
                     
                 case  'R':
                     iResetCoordinator = 1;
@@ -617,6 +821,11 @@ int main(int argc, char *argv[])
         print_usage_exit(argv);
     }
     
+    if ((iFilterLoad() < 0) || (iMulticastLoad() < 0) || (iJIPCacheLoad() < 0) || (iNAT64Load() < 0))
+    {
+        return 1;
+    }
+    
     if (daemonize)
     {
         /* Prepare for return value passing from the initialization procedure of the daemon process */
@@ -688,59 +897,167 @@ int main(int argc, char *argv[])
     tv.tv_sec = 5;
     tv.tv_usec = 0;
     
-    if ((serial_open(cpSerialDevice, u32BaudRate) < 0) || (eTunDeviceOpen(cpTunDevice) != E_TUN_OK))
+    if ((serial_open(cpSerialDevice, u32BaudRate) < 0) || (eTunDeviceOpen(cpTunDevice) != E_TUN_OK) || (iShmRingOpen() < 0) || (iControlOpen() < 0) || (iStatsPageOpen(Version) < 0) || (iNotifyOpen() < 0))
     {
         goto finish;
     }
+    vSL_SetBaudRate(u32BaudRate);
     
     /* Install signal handlers */
     signal(SIGTERM, vQuitSignalHandler);
     signal(SIGINT, vQuitSignalHandler);
+    signal(SIGHUP, vReloadSignalHandler);
+    signal(SIGUSR1, vDumpSignalHandler);
     
     eJennicModuleStart();
+    u64NextTick = u64ClockNowUs() + 1000000;
+    u64NextHousekeeping = u64NextTick;
     
     while (bRunning)
     {
         int max_fd = 0;
+        uint64_t u64Now = u64ClockNowUs();
+        uint64_t u64Timeout;
+        uint32_t u32TxWait;
+        uint32_t u32LinkWait;
+        uint32_t u32NotifyWait;
+#ifdef USE_ZEROCONF
+        uint32_t u32ZeroconfWait;
+#endif /* USE_ZEROCONF */
+        
+        /* Acknowledge and retransmit on the serial link */
+        u32LinkWait = u32SL_Service(u64Now);
+        
+        /* Send any queued packets that the shaper now allows */
+        u32TxWait = u32JennicModuleServiceTxQueue(u64Now, NULL);
+        
+        /* Collect and run the configuration notification program */
+        u32NotifyWait = u32NotifyService(u64Now);
+        
+#ifdef USE_ZEROCONF
+        /* Run Avahi timeouts */
+        u32ZeroconfWait = u32ZeroconfService();
+#endif /* USE_ZEROCONF */
+        
+        /* Periodic work that must happen however busy the links are */
+        if (u64Now >= u64NextHousekeeping)
+        {
+            u64NextHousekeeping = u64Now + 1000000;
+            vNodeTableAge(u64Now);
+            vMailboxExpire(u64Now);
+            vNAT64Age(u64Now);
+            vShmRingAge(u64Now);
+            vControlAge(u64Now);
+            vStatsPageUpdate();
+        }
+        
+        /* Wait up to one second each loop, less if packets are waiting to be sent. */
+        u64Timeout = (u64NextTick > u64Now) ? (u64NextTick - u64Now) : 0;
+        if (u64NextHousekeeping - u64Now < u64Timeout)
+        {
+            u64Timeout = u64NextHousekeeping - u64Now;
+        }
+        if (u32TxWait && (u32TxWait < u64Timeout))
+        {
+            u64Timeout = u32TxWait;
+        }
+        if (u32LinkWait && (u32LinkWait < u64Timeout))
+        {
+            u64Timeout = u32LinkWait;
+        }
+        if (u32NotifyWait && (u32NotifyWait < u64Timeout))
+        {
+            u64Timeout = u32NotifyWait;
+        }
+#ifdef USE_ZEROCONF
+        if (u32ZeroconfWait && (u32ZeroconfWait < u64Timeout))
+        {
+            u64Timeout = u32ZeroconfWait;
+        }
+#endif /* USE_ZEROCONF */
+        tv.tv_sec = u64Timeout / 1000000;
+        tv.tv_usec = u64Timeout % 1000000;
         
-        /* Wait up to one second each loop. */
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
+        /* Packets left in application rings while the queue was full */
+        if (u32JennicModuleTxQueueDepth() == 0)
+        {
+            vShmRingService();
+        }
         
         FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
         FD_SET(serial_fd, &rfds);
         if (serial_fd > max_fd)
         {
             max_fd = serial_fd;
         }
-        FD_SET(tun_fd, &rfds);
-        if (tun_fd > max_fd)
+        if (u32JennicModuleTxQueueDepth() == 0)
         {
-            max_fd = tun_fd;
+            /* While packets are held back by the shaper, leave further packets 
+             * queued in the kernel where queue management can deal with them. */
+            FD_SET(tun_fd, &rfds);
+            if (tun_fd > max_fd)
+            {
+                max_fd = tun_fd;
+            }
         }
+        max_fd = iShmRingSetFds(&rfds, max_fd, u32JennicModuleTxQueueDepth() == 0);
+        max_fd = iControlSetFds(&rfds, &wfds, max_fd);
+        max_fd = iNotifySetFds(&rfds, max_fd);
+#ifdef USE_ZEROCONF
+        max_fd = iZeroconfSetFds(&rfds, &wfds, max_fd);
+#endif /* USE_ZEROCONF */
 
         /* Wait for data on one either the serial port or the TUN interface. */
-        retval = select(max_fd + 1, &rfds, NULL, NULL, &tv);
+        retval = select(max_fd + 1, &rfds, &wfds, NULL, &tv);
+
+        if (bReload)
+        {
+            bReload = 0;
+            vReloadPolicies();
+        }
+        
+        if (bDumpNodes)
+        {
+            char acFileName[255];
+            
+            bDumpNodes = 0;
+            snprintf(acFileName, sizeof(acFileName), DUMP_FILE_PATH, pcDumpDirectory, cpTunDevice, "nodes");
+            iNodeTableDump(u64ClockNowUs(), acFileName);
+            snprintf(acFileName, sizeof(acFileName), DUMP_FILE_PATH, pcDumpDirectory, cpTunDevice, "latency");
+            iLatencyDump(acFileName);
+        }
 
         if (retval == -1)
         {
-            daemon_log(LOG_ERR, "error in select(): %s", strerror(errno));
+            if (errno != EINTR)
+            {
+                daemon_log(LOG_ERR, "error in select(): %s", strerror(errno));
+            }
         }
         else if (retval)
         {
             int i;
+            
             /* Got data on one of the file descriptors */
             for (i = 0; i < max_fd + 1; i++)
             {
                 if (FD_ISSET(i, &rfds) && (i == serial_fd))
                 {
-                    if(bSL_ReadMessage(&sIncomingMsg.u8Type, &sIncomingMsg.u16Length, sizeof(sIncomingMsg.u8Message), sIncomingMsg.u8Message))
+                    /* Restart the idle timer. Only the module counts, so that busy
+                     * local hosts cannot hold up the start up handshake. */
+                    u64NextTick = u64ClockNowUs() + 1000000;
+                    
+                    /* Process every complete message, including any the link held for reordering */
+                    while(bRunning && bSL_ReadMessage(&sIncomingMsg.u8Type, &sIncomingMsg.u16Length, sizeof(sIncomingMsg.u8Message), sIncomingMsg.u8Message))
                     {
+                        u64LatencyDecoded = u64ClockNowNs();
                         if (eJennicModuleProcessMessage(sIncomingMsg.u8Type, sIncomingMsg.u16Length, sIncomingMsg.u8Message) != E_MODULE_OK)
                         {
                             daemon_log(LOG_ERR, "Error communicating with border router module");
                             bRunning = FALSE;
                         }
+                        u64LatencyDecoded = 0;
                     }
                 }
                 else if (FD_ISSET(i, &rfds) && (i == tun_fd))
@@ -750,6 +1067,24 @@ int main(int argc, char *argv[])
                         daemon_log(LOG_ERR, "Error handling tun packet");
                     }
                 }
+                else if (FD_ISSET(i, &rfds) && bShmRingHandleFd(i))
+                {
+                    /* Shared memory ring socket or doorbell */
+                }
+                else if (FD_ISSET(i, &rfds) && bNotifyHandleFd(i))
+                {
+                    /* Configuration notification program finished */
+                }
+                else if ((FD_ISSET(i, &rfds) || FD_ISSET(i, &wfds)) && bControlHandleFd(i, FD_ISSET(i, &rfds) ? TRUE : FALSE, FD_ISSET(i, &wfds) ? TRUE : FALSE))
+                {
+                    /* Control socket or metrics connection */
+                }
+#ifdef USE_ZEROCONF
+                else if ((FD_ISSET(i, &rfds) || FD_ISSET(i, &wfds)) && bZeroconfHandleFd(i, FD_ISSET(i, &rfds) ? TRUE : FALSE, FD_ISSET(i, &wfds) ? TRUE : FALSE))
+                {
+                    /* Connection to the Avahi daemon */
+                }
+#endif /* USE_ZEROCONF */
                 else if (FD_ISSET(i, &rfds))
                 {
                     daemon_log(LOG_DEBUG, "Data on unknown file desciptor (%d)", i);
@@ -760,9 +1095,11 @@ int main(int argc, char *argv[])
                 }
             }
         }
-        else
+        
+        if (u64ClockNowUs() >= u64NextTick)
         {
-            /* Select timeout */
+            /* Nothing from the module for a second */
+            u64NextTick = u64ClockNowUs() + 1000000;
             if (eJennicModuleStateMachine(1) != E_MODULE_OK)
             {
                 daemon_log(LOG_ERR, "Error communicating with border router module");
@@ -778,6 +1115,14 @@ int main(int argc, char *argv[])
     }
     
 finish:
+#ifdef USE_ZEROCONF
+    vZeroconfClose();
+#endif /* USE_ZEROCONF */
+    vNotifyClose();
+    vStatsPageClose();
+    vControlClose();
+    vShmRingClose();
+    vTunDeviceClose();
     if (daemonize)
     {
         daemon_log(LOG_INFO, "Daemon process exiting");  